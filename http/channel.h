@@ -17,6 +17,7 @@
 #include "absl/strings/str_cat.h"
 #include "common/reffed_ptr.h"
 #include "http/handlers.h"
+#include "http/hpack.h"
 #include "http/http.h"
 #include "http/processor.h"
 #include "net/base_sockets.h"
@@ -44,6 +45,31 @@ class BaseChannel {
   // server-side channels.
   virtual void StartServer() = 0;
 
+  // Starts a client endpoint by sending the HTTP/2 client preface and starting to exchange frames.
+  // Must be called once the connection is established. `callback` is invoked when the server's
+  // initial SETTINGS have been received (and so its limits are known), or with an error if the
+  // connection is closed before that. Requests should be sent only after that.
+  virtual void StartClient(absl::AnyInvocable<void(absl::Status)> callback) = 0;
+
+  // Client-side only. Sends a request on a new stream. See `ChannelProcessor::SendRequest` for
+  // details.
+  virtual absl::Status SendRequest(hpack::HeaderSet const& fields, tsdb2::net::Buffer&& body,
+                                   ResponseCallback&& callback,
+                                   ResponseDataCallback&& data_callback) = 0;
+
+  // Client-side only. Indicates whether the channel can accept new requests, i.e. it's still
+  // connected and not going away.
+  virtual bool is_accepting_requests() const = 0;
+
+  // Client-side only. Returns the number of requests waiting for a response.
+  virtual size_t num_active_requests() const = 0;
+
+  // Client-side only. Returns the maximum number of concurrent requests allowed by the server.
+  virtual size_t max_concurrent_requests() const = 0;
+
+  // Closes the connection, failing all requests still waiting for a response.
+  virtual void Disconnect() = 0;
+
  private:
   BaseChannel(BaseChannel const&) = delete;
   BaseChannel& operator=(BaseChannel const&) = delete;
@@ -78,9 +104,15 @@ class ChannelInterface {
   explicit ChannelInterface() = default;
   virtual ~ChannelInterface() = default;
 
+  // Used by streams to keep the channel alive while a handler is responding asynchronously.
+  virtual void Ref() = 0;
+  virtual bool Unref() = 0;
+
   virtual tsdb2::net::BaseSocket* socket() = 0;
   virtual tsdb2::net::BaseSocket const* socket() const = 0;
 
+  virtual bool is_client() const = 0;
+
   virtual absl::StatusOr<Handler*> GetHandler(std::string_view path) = 0;
 
   // Waits for the next frame, reads it, and passes it on to the processor.
@@ -167,7 +199,7 @@ class Channel final : private Socket, public BaseChannel, private internal::Chan
   bool Unref() override { return Socket::Unref(); }
 
   // Indicates whether this is a client-side channel.
-  bool is_client() const { return manager_ == nullptr; }
+  bool is_client() const override { return manager_ == nullptr; }
 
   // Indicates whether this is a server-side channel.
   bool is_server() const { return manager_ != nullptr; }
@@ -185,6 +217,24 @@ class Channel final : private Socket, public BaseChannel, private internal::Chan
     });
   }
 
+  void StartClient(absl::AnyInvocable<void(absl::Status)> callback) override {
+    processor_.SendClientPreface(std::move(callback));
+    Continue();
+  }
+
+  absl::Status SendRequest(hpack::HeaderSet const& fields, tsdb2::net::Buffer&& body,
+                           ResponseCallback&& callback,
+                           ResponseDataCallback&& data_callback) override {
+    return processor_.SendRequest(fields, std::move(body), std::move(callback),
+                                  std::move(data_callback));
+  }
+
+  bool is_accepting_requests() const override { return processor_.is_accepting_requests(); }
+  size_t num_active_requests() const override { return processor_.num_active_requests(); }
+  size_t max_concurrent_requests() const override { return processor_.max_concurrent_requests(); }
+
+  void Disconnect() override { CloseConnection(); }
+
  private:
   using Buffer = tsdb2::net::Buffer;
   using ReadCallback = absl::AnyInvocable<void(Buffer)>;
@@ -290,11 +340,11 @@ class Channel final : private Socket, public BaseChannel, private internal::Chan
         callback(std::move(status_or_buffer).value());
       } else {
         callback = nullptr;
-        Close();
+        CloseConnection();
       }
     });
     if (!status.ok()) {
-      Close();
+      CloseConnection();
     }
   }
 
@@ -306,12 +356,12 @@ class Channel final : private Socket, public BaseChannel, private internal::Chan
             callback(std::move(status_or_buffer).value());
           } else {
             callback = nullptr;
-            Close();
+            CloseConnection();
           }
         },
         absl::GetFlag(FLAGS_http2_io_timeout));
     if (!status.ok()) {
-      Close();
+      CloseConnection();
     }
   }
 
@@ -323,12 +373,12 @@ class Channel final : private Socket, public BaseChannel, private internal::Chan
             callback();
           } else {
             callback = nullptr;
-            Close();
+            CloseConnection();
           }
         },
         absl::GetFlag(FLAGS_http2_io_timeout));
     if (!status.ok()) {
-      Close();
+      CloseConnection();
     }
   }
 
@@ -384,7 +434,10 @@ class Channel final : private Socket, public BaseChannel, private internal::Chan
     });
   }
 
-  void CloseConnection() override { Close(); }
+  void CloseConnection() override {
+    processor_.Shutdown();
+    Close();
+  }
 
   // Not owned. Points to the parent `Server` for server-side channels, while it's nullptr for
   // client-side ones.
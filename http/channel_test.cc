@@ -1,22 +1,29 @@
 #include "http/channel.h"
 
+#include <unistd.h>
+
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <ostream>
+#include <string>
 #include <string_view>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/log/check.h"
 #include "absl/status/status.h"
 #include "absl/status/status_matchers.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
 #include "common/default_scheduler.h"
+#include "common/flag_override.h"
 #include "common/mock_clock.h"
 #include "common/reffed_ptr.h"
 #include "common/scheduler.h"
@@ -27,11 +34,14 @@
 #include "common/utilities.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "http/executor_handler.h"
 #include "http/handlers.h"
 #include "http/hpack.h"
 #include "http/http.h"
 #include "http/testing.h"
 #include "io/buffer_testing.h"
+#include "io/cord.h"
+#include "io/fd.h"
 #include "net/base_sockets.h"
 #include "net/sockets.h"
 #include "net/ssl_sockets.h"
@@ -41,14 +51,19 @@ namespace {
 
 using ::absl_testing::IsOk;
 using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
 using ::testing::_;
 using ::testing::AllOf;
+using ::testing::ElementsAre;
 using ::testing::Field;
+using ::testing::Matcher;
 using ::testing::NiceMock;
 using ::testing::Not;
+using ::testing::Pair;
 using ::testing::Property;
 using ::testing::Return;
 using ::testing::StrictMock;
+using ::testing::TestTempFile;
 using ::testing::UnorderedElementsAre;
 using ::testing::UnorderedElementsAreArray;
 using ::tsdb2::common::MockClock;
@@ -57,12 +72,15 @@ using ::tsdb2::common::Scheduler;
 using ::tsdb2::common::ScopedOverride;
 using ::tsdb2::common::SimpleCondition;
 using ::tsdb2::common::Singleton;
+using ::tsdb2::common::testing::FlagOverride;
 using ::tsdb2::http::BaseChannel;
 using ::tsdb2::http::Channel;
 using ::tsdb2::http::ChannelManager;
 using ::tsdb2::http::ErrorCode;
+using ::tsdb2::http::ExecutorHandler;
 using ::tsdb2::http::FrameHeader;
 using ::tsdb2::http::FrameType;
+using ::tsdb2::http::HeadersView;
 using ::tsdb2::http::GoAwayFrame;
 using ::tsdb2::http::GoAwayPayload;
 using ::tsdb2::http::Handler;
@@ -80,13 +98,18 @@ using ::tsdb2::http::kPingPayloadSize;
 using ::tsdb2::http::Method;
 using ::tsdb2::http::PriorityPayload;
 using ::tsdb2::http::Request;
+using ::tsdb2::http::ResetStreamFrame;
+using ::tsdb2::http::ResetStreamPayload;
 using ::tsdb2::http::SettingsEntry;
 using ::tsdb2::http::SettingsIdentifier;
 using ::tsdb2::http::StreamInterface;
+using ::tsdb2::http::WindowUpdateFrame;
 using ::tsdb2::http::WindowUpdatePayload;
 using ::tsdb2::http::hpack::Decoder;
 using ::tsdb2::http::hpack::Encoder;
 using ::tsdb2::http::hpack::HeaderSet;
+using ::tsdb2::io::Cord;
+using ::tsdb2::io::FD;
 using ::tsdb2::net::Buffer;
 using ::tsdb2::net::Socket;
 using ::tsdb2::net::SSLSocket;
@@ -94,6 +117,8 @@ using ::tsdb2::testing::http::MockChannelManager;
 using ::tsdb2::testing::http::MockHandler;
 using ::tsdb2::testing::io::BufferAs;
 using ::tsdb2::testing::io::BufferAsArray;
+using ::tsdb2::testing::io::BufferAsBytes;
+using ::tsdb2::testing::io::BufferAsString;
 
 // This GoogleTest matcher checks that the received `absl::StatusOr` is either an error status or
 // the wrapped value matches the inner matcher. We use it to check all connection errors because the
@@ -180,6 +205,16 @@ HeaderSet const kHeaders3{
     {":authority", "www.example.com"},
 };
 
+// Converts a `HeaderSet` to an array of matchers for the fields of a `HeadersView`.
+std::vector<Matcher<HeadersView::Field>> FieldsAre(HeaderSet const& headers) {
+  std::vector<Matcher<HeadersView::Field>> matchers;
+  matchers.reserve(headers.size());
+  for (auto const& [name, value] : headers) {
+    matchers.emplace_back(Pair(name, value));
+  }
+  return matchers;
+}
+
 using SocketTypes = ::testing::Types<tsdb2::net::Socket, tsdb2::net::SSLSocket>;
 
 template <typename Socket>
@@ -326,6 +361,196 @@ TYPED_TEST(ChannelTest, StartServerWithCustomSettings) {
                 Property(&SettingsEntry::value, 2000000)))))));
 }
 
+TYPED_TEST(ChannelTest, BdpProbeGrowsReceiveWindows) {
+  FlagOverride bdp_probe_override{&FLAGS_http2_bdp_probe, true};
+  auto const [channel, peer] = this->MakeConnection();
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/foo")).WillByDefault(Return(&handler));
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/foo")));
+  channel->StartServer();
+  ASSERT_OK(this->PeerWrite(peer, Buffer(kClientPreface.data(), kClientPreface.size())));
+  ASSERT_OK(this->PeerRead(peer, sizeof(FrameHeader) + 5 * sizeof(SettingsEntry)));
+  Buffer encoded_headers = this->field_encoder_.Encode(kHeaders2);
+  ASSERT_OK(this->PeerWrite(peer, Buffer(&FrameHeader()
+                                              .set_length(encoded_headers.size())
+                                              .set_frame_type(FrameType::kHeaders)
+                                              .set_flags(kFlagEndHeaders)
+                                              .set_stream_id(1),
+                                         sizeof(FrameHeader))));
+  ASSERT_OK(this->PeerWrite(peer, std::move(encoded_headers)));
+  std::string const data(16000, 'x');
+  for (int i = 0; i < 3; ++i) {
+    Buffer data_frame{sizeof(FrameHeader) + data.size()};
+    data_frame.MemCpy(&FrameHeader()
+                           .set_length(data.size())
+                           .set_frame_type(FrameType::kData)
+                           .set_flags(0)
+                           .set_stream_id(1),
+                      sizeof(FrameHeader));
+    data_frame.MemCpy(data.data(), data.size());
+    ASSERT_OK(this->PeerWrite(peer, std::move(data_frame)));
+  }
+  EXPECT_THAT(this->PeerRead(peer, sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, kPingPayloadSize),
+                        Property(&FrameHeader::frame_type, FrameType::kPing),
+                        Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 0)))));
+  auto const status_or_payload = this->PeerRead(peer, kPingPayloadSize);
+  ASSERT_OK(status_or_payload);
+  uint64_t const payload = status_or_payload->template as<uint64_t>();
+  EXPECT_THAT(this->PeerRead(peer, sizeof(FrameHeader) + sizeof(WindowUpdatePayload)),
+              IsOkAndHolds(BufferAs<WindowUpdateFrame>(
+                  Field(&WindowUpdateFrame::payload,
+                        Property(&WindowUpdatePayload::window_size_increment, 48000)))));
+  this->clock_.AdvanceTime(absl::Milliseconds(10));
+  Buffer ping_ack{sizeof(FrameHeader) + kPingPayloadSize};
+  ping_ack.MemCpy(&FrameHeader()
+                       .set_length(kPingPayloadSize)
+                       .set_frame_type(FrameType::kPing)
+                       .set_flags(kFlagAck)
+                       .set_stream_id(0),
+                  sizeof(FrameHeader));
+  ping_ack.MemCpy(&payload, kPingPayloadSize);
+  ASSERT_OK(this->PeerWrite(peer, std::move(ping_ack)));
+  EXPECT_THAT(this->PeerRead(peer, sizeof(FrameHeader) + sizeof(WindowUpdatePayload)),
+              IsOkAndHolds(BufferAs<WindowUpdateFrame>(AllOf(
+                  Field(&WindowUpdateFrame::header, Property(&FrameHeader::stream_id, 0)),
+                  Field(&WindowUpdateFrame::payload,
+                        Property(&WindowUpdatePayload::window_size_increment,
+                                 96000 - kDefaultInitialWindowSize))))));
+  EXPECT_THAT(this->PeerRead(peer, sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, sizeof(SettingsEntry)),
+                        Property(&FrameHeader::frame_type, FrameType::kSettings),
+                        Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 0)))));
+  EXPECT_THAT(this->PeerRead(peer, sizeof(SettingsEntry)),
+              IsOkAndHolds(BufferAs<SettingsEntry>(AllOf(
+                  Property(&SettingsEntry::identifier, SettingsIdentifier::kInitialWindowSize),
+                  Property(&SettingsEntry::value, 96000)))));
+  EXPECT_TRUE(channel->is_open());
+}
+
+TYPED_TEST(ChannelTest, NoBdpProbeAtMaxReceiveWindow) {
+  FlagOverride bdp_probe_override{&FLAGS_http2_bdp_probe, true};
+  FlagOverride max_receive_window_override{&FLAGS_http2_max_receive_window_size,
+                                           kDefaultInitialWindowSize};
+  auto const [channel, peer] = this->MakeConnection();
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/foo")).WillByDefault(Return(&handler));
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/foo")));
+  channel->StartServer();
+  ASSERT_OK(this->PeerWrite(peer, Buffer(kClientPreface.data(), kClientPreface.size())));
+  ASSERT_OK(this->PeerRead(peer, sizeof(FrameHeader) + 5 * sizeof(SettingsEntry)));
+  Buffer encoded_headers = this->field_encoder_.Encode(kHeaders2);
+  ASSERT_OK(this->PeerWrite(peer, Buffer(&FrameHeader()
+                                              .set_length(encoded_headers.size())
+                                              .set_frame_type(FrameType::kHeaders)
+                                              .set_flags(kFlagEndHeaders)
+                                              .set_stream_id(1),
+                                         sizeof(FrameHeader))));
+  ASSERT_OK(this->PeerWrite(peer, std::move(encoded_headers)));
+  std::string const data(16000, 'x');
+  for (int i = 0; i < 3; ++i) {
+    Buffer data_frame{sizeof(FrameHeader) + data.size()};
+    data_frame.MemCpy(&FrameHeader()
+                           .set_length(data.size())
+                           .set_frame_type(FrameType::kData)
+                           .set_flags(0)
+                           .set_stream_id(1),
+                      sizeof(FrameHeader));
+    data_frame.MemCpy(data.data(), data.size());
+    ASSERT_OK(this->PeerWrite(peer, std::move(data_frame)));
+  }
+  // The first frame is the connection-level WINDOW_UPDATE, not a PING.
+  EXPECT_THAT(this->PeerRead(peer, sizeof(FrameHeader) + sizeof(WindowUpdatePayload)),
+              IsOkAndHolds(BufferAs<WindowUpdateFrame>(AllOf(
+                  Field(&WindowUpdateFrame::header,
+                        AllOf(Property(&FrameHeader::frame_type, FrameType::kWindowUpdate),
+                              Property(&FrameHeader::stream_id, 0))),
+                  Field(&WindowUpdateFrame::payload,
+                        Property(&WindowUpdatePayload::window_size_increment, 48000))))));
+  EXPECT_TRUE(channel->is_open());
+}
+
+TYPED_TEST(ChannelTest, ReceiveMemoryBudget) {
+  FlagOverride bdp_probe_override{&FLAGS_http2_bdp_probe, true};
+  FlagOverride receive_memory_budget_override{&FLAGS_http2_receive_memory_budget, 80000};
+  auto const [channel, peer] = this->MakeConnection();
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/foo")).WillByDefault(Return(&handler));
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/foo"))).Times(2);
+  channel->StartServer();
+  ASSERT_OK(this->PeerWrite(peer, Buffer(kClientPreface.data(), kClientPreface.size())));
+  ASSERT_OK(this->PeerRead(peer, sizeof(FrameHeader) + 5 * sizeof(SettingsEntry)));
+  Buffer encoded_headers = this->field_encoder_.Encode(kHeaders2);
+  ASSERT_OK(this->PeerWrite(peer, Buffer(&FrameHeader()
+                                              .set_length(encoded_headers.size())
+                                              .set_frame_type(FrameType::kHeaders)
+                                              .set_flags(kFlagEndHeaders)
+                                              .set_stream_id(1),
+                                         sizeof(FrameHeader))));
+  ASSERT_OK(this->PeerWrite(peer, std::move(encoded_headers)));
+  std::string const data(16000, 'x');
+  for (int i = 0; i < 3; ++i) {
+    Buffer data_frame{sizeof(FrameHeader) + data.size()};
+    data_frame.MemCpy(&FrameHeader()
+                           .set_length(data.size())
+                           .set_frame_type(FrameType::kData)
+                           .set_flags(0)
+                           .set_stream_id(1),
+                      sizeof(FrameHeader));
+    data_frame.MemCpy(data.data(), data.size());
+    ASSERT_OK(this->PeerWrite(peer, std::move(data_frame)));
+  }
+  ASSERT_OK(this->PeerRead(peer, sizeof(FrameHeader)));
+  auto const status_or_payload = this->PeerRead(peer, kPingPayloadSize);
+  ASSERT_OK(status_or_payload);
+  uint64_t const payload = status_or_payload->template as<uint64_t>();
+  ASSERT_OK(this->PeerRead(peer, sizeof(FrameHeader) + sizeof(WindowUpdatePayload)));
+  this->clock_.AdvanceTime(absl::Milliseconds(10));
+  Buffer ping_ack{sizeof(FrameHeader) + kPingPayloadSize};
+  ping_ack.MemCpy(&FrameHeader()
+                       .set_length(kPingPayloadSize)
+                       .set_frame_type(FrameType::kPing)
+                       .set_flags(kFlagAck)
+                       .set_stream_id(0),
+                  sizeof(FrameHeader));
+  ping_ack.MemCpy(&payload, kPingPayloadSize);
+  ASSERT_OK(this->PeerWrite(peer, std::move(ping_ack)));
+  // The connection window isn't affected by the budget.
+  EXPECT_THAT(this->PeerRead(peer, sizeof(FrameHeader) + sizeof(WindowUpdatePayload)),
+              IsOkAndHolds(BufferAs<WindowUpdateFrame>(AllOf(
+                  Field(&WindowUpdateFrame::header, Property(&FrameHeader::stream_id, 0)),
+                  Field(&WindowUpdateFrame::payload,
+                        Property(&WindowUpdatePayload::window_size_increment,
+                                 96000 - kDefaultInitialWindowSize))))));
+  // The only open stream gets the whole budget.
+  ASSERT_OK(this->PeerRead(peer, sizeof(FrameHeader)));
+  EXPECT_THAT(this->PeerRead(peer, sizeof(SettingsEntry)),
+              IsOkAndHolds(BufferAs<SettingsEntry>(AllOf(
+                  Property(&SettingsEntry::identifier, SettingsIdentifier::kInitialWindowSize),
+                  Property(&SettingsEntry::value, 80000)))));
+  // Half of the budget would be less than the initial window, so the stream windows go back to it.
+  encoded_headers = this->field_encoder_.Encode(kHeaders2);
+  ASSERT_OK(this->PeerWrite(peer, Buffer(&FrameHeader()
+                                              .set_length(encoded_headers.size())
+                                              .set_frame_type(FrameType::kHeaders)
+                                              .set_flags(kFlagEndHeaders)
+                                              .set_stream_id(3),
+                                         sizeof(FrameHeader))));
+  ASSERT_OK(this->PeerWrite(peer, std::move(encoded_headers)));
+  EXPECT_THAT(this->PeerRead(peer, sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, sizeof(SettingsEntry)),
+                        Property(&FrameHeader::frame_type, FrameType::kSettings),
+                        Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 0)))));
+  EXPECT_THAT(this->PeerRead(peer, sizeof(SettingsEntry)),
+              IsOkAndHolds(BufferAs<SettingsEntry>(AllOf(
+                  Property(&SettingsEntry::identifier, SettingsIdentifier::kInitialWindowSize),
+                  Property(&SettingsEntry::value, kDefaultInitialWindowSize)))));
+  EXPECT_TRUE(channel->is_open());
+}
+
 TYPED_TEST(ChannelTest, FrameTooBig) {
   ASSERT_OK(this->StartServer());
   auto const header = FrameHeader()
@@ -579,7 +804,8 @@ TYPED_TEST(ServerChannelTest, GetRequest) {
   absl::Notification done;
   EXPECT_CALL(handler,
               Run(_, AllOf(Field(&Request::method, Method::kGet), Field(&Request::path, "/bar"),
-                           Field(&Request::headers, UnorderedElementsAreArray(kHeaders3)))))
+                           Field(&Request::headers,
+                                 UnorderedElementsAreArray(FieldsAre(kHeaders3))))))
       .Times(1)
       .WillOnce([&done] { done.Notify(); });
   ASSERT_OK(this->PeerWrite(std::move(frame_header)));
@@ -601,7 +827,8 @@ TYPED_TEST(ServerChannelTest, PostRequest) {
   absl::Notification done;
   EXPECT_CALL(handler,
               Run(_, AllOf(Field(&Request::method, Method::kPost), Field(&Request::path, "/foo"),
-                           Field(&Request::headers, UnorderedElementsAreArray(kHeaders2)))))
+                           Field(&Request::headers,
+                                 UnorderedElementsAreArray(FieldsAre(kHeaders2))))))
       .Times(1)
       .WillOnce([&done] { done.Notify(); });
   ASSERT_OK(this->PeerWrite(std::move(frame_header)));
@@ -620,6 +847,503 @@ TYPED_TEST(ServerChannelTest, PostRequest) {
   EXPECT_TRUE(this->channel_->is_open());
 }
 
+TYPED_TEST(ServerChannelTest, SequentialRequests) {
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/bar")))
+      .Times(2)
+      .WillRepeatedly([](StreamInterface* const stream, Request const& /*request*/) {
+        stream->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/true);
+      });
+  for (uint32_t const stream_id : {41, 43}) {
+    Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+    Buffer frame_header{&FrameHeader()
+                             .set_length(encoded_headers.size())
+                             .set_frame_type(FrameType::kHeaders)
+                             .set_flags(kFlagEndHeaders | kFlagEndStream)
+                             .set_stream_id(stream_id),
+                        sizeof(FrameHeader)};
+    ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+    ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+    EXPECT_THAT(this->PeerRead(sizeof(FrameHeader)),
+                IsOkAndHolds(BufferAs<FrameHeader>(
+                    AllOf(Property(&FrameHeader::length, 1),
+                          Property(&FrameHeader::frame_type, FrameType::kHeaders),
+                          Property(&FrameHeader::flags, kFlagEndHeaders | kFlagEndStream),
+                          Property(&FrameHeader::stream_id, stream_id)))));
+    EXPECT_THAT(this->PeerRead(1), IsOkAndHolds(BufferAsBytes(ElementsAre(0x88))));
+  }
+  EXPECT_TRUE(this->channel_->is_open());
+}
+
+TYPED_TEST(ServerChannelTest, AsyncResponse) {
+  Scheduler handler_scheduler{Scheduler::Options{.num_workers = 1, .start_now = true}};
+  auto mock_handler = std::make_unique<StrictMock<MockHandler>>();
+  EXPECT_CALL(*mock_handler, Run(_, Field(&Request::path, "/bar")))
+      .Times(2)
+      .WillRepeatedly([](StreamInterface* const stream, Request const& /*request*/) {
+        stream->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/false);
+        stream->SendDataOrLog(Buffer("lorem", 5), /*end_stream=*/true);
+      });
+  ExecutorHandler handler{std::move(mock_handler), &handler_scheduler,
+                          /*max_pending_requests=*/10};
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  for (uint32_t const stream_id : {41, 43}) {
+    Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+    Buffer frame_header{&FrameHeader()
+                             .set_length(encoded_headers.size())
+                             .set_frame_type(FrameType::kHeaders)
+                             .set_flags(kFlagEndHeaders | kFlagEndStream)
+                             .set_stream_id(stream_id),
+                        sizeof(FrameHeader)};
+    ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+    ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+    EXPECT_THAT(this->PeerRead(sizeof(FrameHeader)),
+                IsOkAndHolds(BufferAs<FrameHeader>(
+                    AllOf(Property(&FrameHeader::length, 1),
+                          Property(&FrameHeader::frame_type, FrameType::kHeaders),
+                          Property(&FrameHeader::flags, kFlagEndHeaders),
+                          Property(&FrameHeader::stream_id, stream_id)))));
+    EXPECT_THAT(this->PeerRead(1), IsOkAndHolds(BufferAsBytes(ElementsAre(0x88))));
+    EXPECT_THAT(this->PeerRead(sizeof(FrameHeader)),
+                IsOkAndHolds(BufferAs<FrameHeader>(
+                    AllOf(Property(&FrameHeader::length, 5),
+                          Property(&FrameHeader::frame_type, FrameType::kData),
+                          Property(&FrameHeader::flags, kFlagEndStream),
+                          Property(&FrameHeader::stream_id, stream_id)))));
+    EXPECT_THAT(this->PeerRead(5), IsOkAndHolds(BufferAsString("lorem")));
+  }
+  EXPECT_TRUE(this->channel_->is_open());
+}
+
+TYPED_TEST(ServerChannelTest, StreamDataWithFlowControl) {
+  size_t constexpr kDataSize = kDefaultInitialWindowSize + 10;
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  absl::Notification sent;
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/bar")))
+      .WillOnce([&sent](StreamInterface* const stream, Request const& /*request*/) {
+        stream->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/false);
+        std::string const data(kDataSize, 'x');
+        stream->StreamData(Buffer(data.data(), data.size()), /*end_stream=*/true,
+                           [&sent](absl::Status const status) {
+                             EXPECT_OK(status);
+                             sent.Notify();
+                           });
+      });
+  Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+  Buffer frame_header{&FrameHeader()
+                           .set_length(encoded_headers.size())
+                           .set_frame_type(FrameType::kHeaders)
+                           .set_flags(kFlagEndHeaders | kFlagEndStream)
+                           .set_stream_id(41),
+                      sizeof(FrameHeader)};
+  ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+  ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+  ASSERT_OK(this->PeerRead(sizeof(FrameHeader) + 1));
+  size_t received = 0;
+  while (received < kDefaultInitialWindowSize) {
+    auto const status_or_header = this->PeerRead(sizeof(FrameHeader));
+    ASSERT_OK(status_or_header);
+    auto const& header = status_or_header->template as<FrameHeader>();
+    EXPECT_EQ(header.frame_type(), FrameType::kData);
+    EXPECT_EQ(header.flags(), 0);
+    EXPECT_EQ(header.stream_id(), 41);
+    ASSERT_OK(this->PeerRead(header.length()));
+    received += header.length();
+  }
+  EXPECT_EQ(received, kDefaultInitialWindowSize);
+  EXPECT_FALSE(sent.HasBeenNotified());
+  for (uint32_t const stream_id : {0, 41}) {
+    Buffer window_update{sizeof(FrameHeader) + sizeof(WindowUpdatePayload)};
+    window_update.MemCpy(&FrameHeader()
+                              .set_length(sizeof(WindowUpdatePayload))
+                              .set_frame_type(FrameType::kWindowUpdate)
+                              .set_flags(0)
+                              .set_stream_id(stream_id),
+                         sizeof(FrameHeader));
+    window_update.MemCpy(&WindowUpdatePayload().set_window_size_increment(10),
+                         sizeof(WindowUpdatePayload));
+    ASSERT_OK(this->PeerWrite(std::move(window_update)));
+  }
+  EXPECT_THAT(this->PeerRead(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 10),
+                        Property(&FrameHeader::frame_type, FrameType::kData),
+                        Property(&FrameHeader::flags, kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 41)))));
+  EXPECT_THAT(this->PeerRead(10), IsOkAndHolds(BufferAsString("xxxxxxxxxx")));
+  sent.WaitForNotification();
+  EXPECT_TRUE(this->channel_->is_open());
+}
+
+TYPED_TEST(ServerChannelTest, EndStreamSent) {
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  absl::Notification sent;
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/bar")))
+      .WillOnce([&sent](StreamInterface* const stream, Request const& /*request*/) {
+        stream->OnEndStreamSent([&sent](absl::Status const status) {
+          EXPECT_OK(status);
+          sent.Notify();
+        });
+        stream->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/true);
+      });
+  Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+  Buffer frame_header{&FrameHeader()
+                           .set_length(encoded_headers.size())
+                           .set_frame_type(FrameType::kHeaders)
+                           .set_flags(kFlagEndHeaders | kFlagEndStream)
+                           .set_stream_id(41),
+                      sizeof(FrameHeader)};
+  ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+  ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+  EXPECT_THAT(this->PeerRead(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 1),
+                        Property(&FrameHeader::frame_type, FrameType::kHeaders),
+                        Property(&FrameHeader::flags, kFlagEndHeaders | kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 41)))));
+  EXPECT_THAT(this->PeerRead(1), IsOkAndHolds(BufferAsBytes(ElementsAre(0x88))));
+  sent.WaitForNotification();
+  EXPECT_TRUE(this->channel_->is_open());
+}
+
+TYPED_TEST(ServerChannelTest, EndStreamSentAfterFlowControl) {
+  size_t constexpr kDataSize = kDefaultInitialWindowSize + 10;
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  absl::Notification sent;
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/bar")))
+      .WillOnce([&sent](StreamInterface* const stream, Request const& /*request*/) {
+        stream->OnEndStreamSent([&sent](absl::Status const status) {
+          EXPECT_OK(status);
+          sent.Notify();
+        });
+        stream->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/false);
+        std::string const data(kDataSize, 'x');
+        stream->SendDataOrLog(Buffer(data.data(), data.size()), /*end_stream=*/false);
+        // The trailers are queued behind the data that doesn't fit in the window.
+        stream->SendFieldsOrLog({{"lorem", "ipsum"}}, /*end_stream=*/true);
+      });
+  Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+  Buffer frame_header{&FrameHeader()
+                           .set_length(encoded_headers.size())
+                           .set_frame_type(FrameType::kHeaders)
+                           .set_flags(kFlagEndHeaders | kFlagEndStream)
+                           .set_stream_id(41),
+                      sizeof(FrameHeader)};
+  ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+  ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+  ASSERT_OK(this->PeerRead(sizeof(FrameHeader) + 1));
+  size_t received = 0;
+  while (received < kDefaultInitialWindowSize) {
+    auto const status_or_header = this->PeerRead(sizeof(FrameHeader));
+    ASSERT_OK(status_or_header);
+    auto const& header = status_or_header->template as<FrameHeader>();
+    EXPECT_EQ(header.frame_type(), FrameType::kData);
+    ASSERT_OK(this->PeerRead(header.length()));
+    received += header.length();
+  }
+  EXPECT_FALSE(sent.HasBeenNotified());
+  for (uint32_t const stream_id : {0, 41}) {
+    Buffer window_update{sizeof(FrameHeader) + sizeof(WindowUpdatePayload)};
+    window_update.MemCpy(&FrameHeader()
+                              .set_length(sizeof(WindowUpdatePayload))
+                              .set_frame_type(FrameType::kWindowUpdate)
+                              .set_flags(0)
+                              .set_stream_id(stream_id),
+                         sizeof(FrameHeader));
+    window_update.MemCpy(&WindowUpdatePayload().set_window_size_increment(10),
+                         sizeof(WindowUpdatePayload));
+    ASSERT_OK(this->PeerWrite(std::move(window_update)));
+  }
+  ASSERT_OK(this->PeerRead(sizeof(FrameHeader) + 10));
+  auto const status_or_header = this->PeerRead(sizeof(FrameHeader));
+  ASSERT_OK(status_or_header);
+  auto const& header = status_or_header->template as<FrameHeader>();
+  EXPECT_EQ(header.frame_type(), FrameType::kHeaders);
+  EXPECT_EQ(header.flags(), kFlagEndHeaders | kFlagEndStream);
+  ASSERT_OK(this->PeerRead(header.length()));
+  sent.WaitForNotification();
+  EXPECT_TRUE(this->channel_->is_open());
+}
+
+TYPED_TEST(ServerChannelTest, EndStreamNotSent) {
+  size_t constexpr kDataSize = kDefaultInitialWindowSize + 10;
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  absl::Notification cancelled;
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/bar")))
+      .WillOnce([&cancelled](StreamInterface* const stream, Request const& /*request*/) {
+        stream->OnEndStreamSent([&cancelled](absl::Status const status) {
+          EXPECT_THAT(status, StatusIs(absl::StatusCode::kCancelled));
+          cancelled.Notify();
+        });
+        stream->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/false);
+        std::string const data(kDataSize, 'x');
+        stream->SendDataOrLog(Buffer(data.data(), data.size()), /*end_stream=*/true);
+      });
+  Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+  Buffer frame_header{&FrameHeader()
+                           .set_length(encoded_headers.size())
+                           .set_frame_type(FrameType::kHeaders)
+                           .set_flags(kFlagEndHeaders | kFlagEndStream)
+                           .set_stream_id(41),
+                      sizeof(FrameHeader)};
+  ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+  ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+  Buffer reset_frame{sizeof(ResetStreamFrame)};
+  reset_frame.MemCpy(&FrameHeader()
+                          .set_length(sizeof(ResetStreamPayload))
+                          .set_frame_type(FrameType::kResetStream)
+                          .set_flags(0)
+                          .set_stream_id(41),
+                     sizeof(FrameHeader));
+  reset_frame.MemCpy(&ResetStreamPayload().set_error_code(ErrorCode::kCancel),
+                     sizeof(ResetStreamPayload));
+  ASSERT_OK(this->PeerWrite(std::move(reset_frame)));
+  cancelled.WaitForNotification();
+}
+
+TYPED_TEST(ServerChannelTest, StreamFileWithFlowControl) {
+  size_t constexpr kDataSize = kDefaultInitialWindowSize + 10;
+  auto status_or_file = TestTempFile::Create("channel_test");
+  ASSERT_OK(status_or_file);
+  auto const& file = status_or_file.value();
+  std::string const content = absl::StrCat(std::string(kDataSize - 10, 'x'), "0123456789");
+  ASSERT_EQ(::pwrite(*file.fd(), content.data(), content.size(), 0),
+            static_cast<ssize_t>(content.size()));
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  absl::Notification sent;
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/bar")))
+      .WillOnce([&](StreamInterface* const stream, Request const& /*request*/) {
+        stream->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/false);
+        stream->StreamFile(FD(::dup(*file.fd())), /*offset=*/0, kDataSize, /*end_stream=*/true,
+                           [&sent](absl::Status const status) {
+                             EXPECT_OK(status);
+                             sent.Notify();
+                           });
+      });
+  Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+  Buffer frame_header{&FrameHeader()
+                           .set_length(encoded_headers.size())
+                           .set_frame_type(FrameType::kHeaders)
+                           .set_flags(kFlagEndHeaders | kFlagEndStream)
+                           .set_stream_id(41),
+                      sizeof(FrameHeader)};
+  ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+  ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+  ASSERT_OK(this->PeerRead(sizeof(FrameHeader) + 1));
+  size_t received = 0;
+  while (received < kDefaultInitialWindowSize) {
+    auto const status_or_header = this->PeerRead(sizeof(FrameHeader));
+    ASSERT_OK(status_or_header);
+    auto const& header = status_or_header->template as<FrameHeader>();
+    EXPECT_EQ(header.frame_type(), FrameType::kData);
+    EXPECT_EQ(header.flags(), 0);
+    EXPECT_EQ(header.stream_id(), 41);
+    EXPECT_THAT(this->PeerRead(header.length()),
+                IsOkAndHolds(BufferAsString(std::string(header.length(), 'x'))));
+    received += header.length();
+  }
+  EXPECT_EQ(received, kDefaultInitialWindowSize);
+  EXPECT_FALSE(sent.HasBeenNotified());
+  for (uint32_t const stream_id : {0, 41}) {
+    Buffer window_update{sizeof(FrameHeader) + sizeof(WindowUpdatePayload)};
+    window_update.MemCpy(&FrameHeader()
+                              .set_length(sizeof(WindowUpdatePayload))
+                              .set_frame_type(FrameType::kWindowUpdate)
+                              .set_flags(0)
+                              .set_stream_id(stream_id),
+                         sizeof(FrameHeader));
+    window_update.MemCpy(&WindowUpdatePayload().set_window_size_increment(10),
+                         sizeof(WindowUpdatePayload));
+    ASSERT_OK(this->PeerWrite(std::move(window_update)));
+  }
+  EXPECT_THAT(this->PeerRead(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 10),
+                        Property(&FrameHeader::frame_type, FrameType::kData),
+                        Property(&FrameHeader::flags, kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 41)))));
+  EXPECT_THAT(this->PeerRead(10), IsOkAndHolds(BufferAsString("0123456789")));
+  sent.WaitForNotification();
+  EXPECT_TRUE(this->channel_->is_open());
+}
+
+TYPED_TEST(ServerChannelTest, DataOnClosedStream) {
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/bar")))
+      .WillOnce([](StreamInterface* const stream, Request const& /*request*/) {
+        stream->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/true);
+      });
+  Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+  Buffer frame_header{&FrameHeader()
+                           .set_length(encoded_headers.size())
+                           .set_frame_type(FrameType::kHeaders)
+                           .set_flags(kFlagEndHeaders | kFlagEndStream)
+                           .set_stream_id(41),
+                      sizeof(FrameHeader)};
+  ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+  ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+  ASSERT_OK(this->PeerRead(sizeof(FrameHeader) + 1));
+  static std::string_view constexpr kData = "lorem ipsum";
+  auto const make_data_frame = [] {
+    Buffer data_frame{sizeof(FrameHeader) + kData.size()};
+    data_frame.MemCpy(&FrameHeader()
+                           .set_length(kData.size())
+                           .set_frame_type(FrameType::kData)
+                           .set_flags(0)
+                           .set_stream_id(41),
+                      sizeof(FrameHeader));
+    data_frame.MemCpy(kData.data(), kData.size());
+    return data_frame;
+  };
+  ASSERT_OK(this->PeerWrite(make_data_frame()));
+  // The stream has been reclaimed, so the peer gets a stream error rather than a connection error.
+  EXPECT_THAT(this->PeerRead(sizeof(ResetStreamFrame)),
+              IsOkAndHolds(BufferAs<ResetStreamFrame>(AllOf(
+                  Field(&ResetStreamFrame::header,
+                        AllOf(Property(&FrameHeader::frame_type, FrameType::kResetStream),
+                              Property(&FrameHeader::stream_id, 41))),
+                  Field(&ResetStreamFrame::payload,
+                        Property(&ResetStreamPayload::error_code, ErrorCode::kStreamClosed))))));
+  // Any further frames on the same stream are ignored, so the next frame we receive is the PING
+  // ACK rather than another RST_STREAM.
+  ASSERT_OK(this->PeerWrite(make_data_frame()));
+  Buffer ping{sizeof(FrameHeader) + kPingPayloadSize};
+  ping.MemCpy(&FrameHeader()
+                   .set_length(kPingPayloadSize)
+                   .set_frame_type(FrameType::kPing)
+                   .set_flags(0)
+                   .set_stream_id(0),
+              sizeof(FrameHeader));
+  uint64_t const payload = 0x7110400071104000;
+  ping.MemCpy(&payload, kPingPayloadSize);
+  ASSERT_OK(this->PeerWrite(std::move(ping)));
+  EXPECT_THAT(this->PeerRead(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(AllOf(
+                  Property(&FrameHeader::frame_type, FrameType::kPing),
+                  Property(&FrameHeader::flags, kFlagAck), Property(&FrameHeader::stream_id, 0)))));
+  EXPECT_THAT(this->PeerRead(kPingPayloadSize), IsOkAndHolds(BufferAs<uint64_t>(payload)));
+  EXPECT_TRUE(this->channel_->is_open());
+}
+
+TYPED_TEST(ServerChannelTest, ResetStreamWithPendingRead) {
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  absl::Notification cancelled;
+  StreamInterface* reset_stream = nullptr;
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/bar")))
+      .WillOnce([&](StreamInterface* const stream, Request const& /*request*/) {
+        // The handler never closes its end of the stream, it just waits for data.
+        reset_stream = stream;
+        stream->ReadData([&cancelled, stream = reffed_ptr<StreamInterface>(stream)](
+                             absl::StatusOr<Cord> const status_or_data, bool const /*end*/) {
+          EXPECT_THAT(status_or_data, StatusIs(absl::StatusCode::kCancelled));
+          cancelled.Notify();
+        });
+      })
+      .WillOnce([&](StreamInterface* const stream, Request const& /*request*/) {
+        // The reset stream has been reclaimed, so it's recycled for the next one.
+        EXPECT_EQ(stream, reset_stream);
+        stream->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/true);
+      });
+  Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+  Buffer frame_header{&FrameHeader()
+                           .set_length(encoded_headers.size())
+                           .set_frame_type(FrameType::kHeaders)
+                           .set_flags(kFlagEndHeaders)
+                           .set_stream_id(41),
+                      sizeof(FrameHeader)};
+  ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+  ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+  Buffer reset_frame{sizeof(ResetStreamFrame)};
+  reset_frame.MemCpy(&FrameHeader()
+                          .set_length(sizeof(ResetStreamPayload))
+                          .set_frame_type(FrameType::kResetStream)
+                          .set_flags(0)
+                          .set_stream_id(41),
+                     sizeof(FrameHeader));
+  reset_frame.MemCpy(&ResetStreamPayload().set_error_code(ErrorCode::kCancel),
+                     sizeof(ResetStreamPayload));
+  ASSERT_OK(this->PeerWrite(std::move(reset_frame)));
+  cancelled.WaitForNotification();
+  encoded_headers = Buffer(this->field_encoder_.Encode(kHeaders3));
+  frame_header = Buffer(&FrameHeader()
+                             .set_length(encoded_headers.size())
+                             .set_frame_type(FrameType::kHeaders)
+                             .set_flags(kFlagEndHeaders | kFlagEndStream)
+                             .set_stream_id(43),
+                        sizeof(FrameHeader));
+  ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+  ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+  EXPECT_THAT(this->PeerRead(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 1),
+                        Property(&FrameHeader::frame_type, FrameType::kHeaders),
+                        Property(&FrameHeader::flags, kFlagEndHeaders | kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 43)))));
+  EXPECT_THAT(this->PeerRead(1), IsOkAndHolds(BufferAsBytes(ElementsAre(0x88))));
+  EXPECT_TRUE(this->channel_->is_open());
+}
+
+TYPED_TEST(ServerChannelTest, IgnoreFramesOnResetStream) {
+  StrictMock<MockHandler> handler;
+  ON_CALL(this->manager_, GetHandler("/bar")).WillByDefault(Return(&handler));
+  EXPECT_CALL(handler, Run(_, Field(&Request::path, "/bar"))).Times(1);
+  for (int i = 0; i < 2; ++i) {
+    Buffer encoded_headers{this->field_encoder_.Encode(kHeaders3)};
+    Buffer frame_header{&FrameHeader()
+                             .set_length(encoded_headers.size())
+                             .set_frame_type(FrameType::kHeaders)
+                             .set_flags(kFlagEndHeaders | kFlagEndStream)
+                             .set_stream_id(41),
+                        sizeof(FrameHeader)};
+    ASSERT_OK(this->PeerWrite(std::move(frame_header)));
+    ASSERT_OK(this->PeerWrite(std::move(encoded_headers)));
+  }
+  // The second HEADERS frame arrived on a half-closed stream.
+  EXPECT_THAT(this->PeerRead(sizeof(ResetStreamFrame)),
+              IsOkAndHolds(BufferAs<ResetStreamFrame>(AllOf(
+                  Field(&ResetStreamFrame::header,
+                        AllOf(Property(&FrameHeader::frame_type, FrameType::kResetStream),
+                              Property(&FrameHeader::stream_id, 41))),
+                  Field(&ResetStreamFrame::payload,
+                        Property(&ResetStreamPayload::error_code, ErrorCode::kStreamClosed))))));
+  static std::string_view constexpr kData = "lorem ipsum";
+  Buffer data_frame{sizeof(FrameHeader) + kData.size()};
+  data_frame.MemCpy(&FrameHeader()
+                         .set_length(kData.size())
+                         .set_frame_type(FrameType::kData)
+                         .set_flags(kFlagEndStream)
+                         .set_stream_id(41),
+                    sizeof(FrameHeader));
+  data_frame.MemCpy(kData.data(), kData.size());
+  ASSERT_OK(this->PeerWrite(std::move(data_frame)));
+  // The DATA frame must be ignored, so the next frame we receive is the PING ACK rather than a
+  // GOAWAY.
+  Buffer ping{sizeof(FrameHeader) + kPingPayloadSize};
+  ping.MemCpy(&FrameHeader()
+                   .set_length(kPingPayloadSize)
+                   .set_frame_type(FrameType::kPing)
+                   .set_flags(0)
+                   .set_stream_id(0),
+              sizeof(FrameHeader));
+  uint64_t const payload = 0x7110400071104000;
+  ping.MemCpy(&payload, kPingPayloadSize);
+  ASSERT_OK(this->PeerWrite(std::move(ping)));
+  EXPECT_THAT(this->PeerRead(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(AllOf(
+                  Property(&FrameHeader::frame_type, FrameType::kPing),
+                  Property(&FrameHeader::flags, kFlagAck), Property(&FrameHeader::stream_id, 0)))));
+  EXPECT_THAT(this->PeerRead(kPingPayloadSize), IsOkAndHolds(BufferAs<uint64_t>(payload)));
+  EXPECT_TRUE(this->channel_->is_open());
+}
+
 TYPED_TEST(ServerChannelTest, ValidateDataWithoutStreamId) {
   auto const header =
       FrameHeader().set_length(123).set_frame_type(FrameType::kData).set_flags(0).set_stream_id(0);
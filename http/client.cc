@@ -0,0 +1,305 @@
+#include "http/client.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "common/promise.h"
+#include "common/reffed_ptr.h"
+#include "http/channel.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "net/base_sockets.h"
+#include "net/sockets.h"
+#include "net/ssl_sockets.h"
+
+namespace tsdb2 {
+namespace http {
+
+namespace {
+
+using ::tsdb2::common::Promise;
+using ::tsdb2::common::reffed_ptr;
+using ::tsdb2::net::Buffer;
+
+std::string MakeAuthority(std::string_view const host, uint16_t const port) {
+  if (host.find(':') != std::string_view::npos) {
+    // IPv6 addresses must be enclosed in square brackets (see RFC 3986 section 3.2.2).
+    return absl::StrCat("[", host, "]:", port);
+  } else {
+    return absl::StrCat(host, ":", port);
+  }
+}
+
+}  // namespace
+
+Client::~Client() {
+  std::vector<reffed_ptr<BaseChannel>> channels;
+  std::vector<PendingRequest> requests;
+  {
+    absl::MutexLock lock{&mutex_};
+    shutting_down_ = true;
+    for (auto& [target, pool] : pools_) {
+      std::move(pool.channels.begin(), pool.channels.end(), std::back_inserter(channels));
+      pool.channels.clear();
+      std::move(pool.handshaking.begin(), pool.handshaking.end(), std::back_inserter(channels));
+      pool.handshaking.clear();
+      std::move(pool.queue.begin(), pool.queue.end(), std::back_inserter(requests));
+      pool.queue.clear();
+    }
+  }
+  for (auto& request : requests) {
+    request.callback(absl::CancelledError("the HTTP client is shutting down"));
+  }
+  for (auto& channel : channels) {
+    channel->Disconnect();
+  }
+  absl::MutexLock lock{&mutex_, absl::Condition(
+                                    +[](size_t* const num_pending_operations) {
+                                      return *num_pending_operations == 0;
+                                    },
+                                    &num_pending_operations_)};
+}
+
+Promise<Response> Client::Request(std::string_view const host, uint16_t const port,
+                                  Method const method, std::string_view const path,
+                                  hpack::HeaderSet headers, Buffer body) {
+  return StreamingRequest(host, port, method, path, std::move(headers), std::move(body),
+                          /*data_callback=*/nullptr);
+}
+
+Promise<Response> Client::StreamingRequest(std::string_view const host, uint16_t const port,
+                                           Method const method, std::string_view const path,
+                                           hpack::HeaderSet headers, Buffer body,
+                                           ResponseDataCallback data_callback) {
+  hpack::HeaderSet fields;
+  fields.reserve(headers.size() + 4);
+  fields.emplace_back(kMethodHeaderName, kMethodNames.at(method));
+  fields.emplace_back(kSchemeHeaderName, options_.use_ssl ? "https" : "http");
+  fields.emplace_back(kAuthorityHeaderName, MakeAuthority(host, port));
+  fields.emplace_back(kPathHeaderName, path);
+  std::move(headers.begin(), headers.end(), std::back_inserter(fields));
+  Target target{std::string(host), port};
+  return Promise<Response>([&](auto resolve) {
+    {
+      absl::MutexLock lock{&mutex_};
+      if (shutting_down_) {
+        return resolve(absl::CancelledError("the HTTP client is shutting down"));
+      }
+      ++num_pending_operations_;
+      pools_[target].queue.emplace_back(PendingRequest{
+          .fields = std::move(fields),
+          .body = std::move(body),
+          .callback = WrapCallback(target, std::move(resolve)),
+          .data_callback = std::move(data_callback),
+      });
+    }
+    Drain(target);
+  });
+}
+
+size_t Client::num_connections(std::string_view const host, uint16_t const port) const {
+  absl::MutexLock lock{&mutex_};
+  auto const it = pools_.find(Target{std::string(host), port});
+  if (it != pools_.end()) {
+    return it->second.channels.size() + it->second.num_connecting;
+  } else {
+    return 0;
+  }
+}
+
+size_t Client::num_queued_requests(std::string_view const host, uint16_t const port) const {
+  absl::MutexLock lock{&mutex_};
+  auto const it = pools_.find(Target{std::string(host), port});
+  if (it != pools_.end()) {
+    return it->second.queue.size();
+  } else {
+    return 0;
+  }
+}
+
+reffed_ptr<BaseChannel> Client::PickChannelLocked(
+    Pool* const pool, std::vector<reffed_ptr<BaseChannel>>* const dropped) {
+  auto& channels = pool->channels;
+  auto const it = std::partition(channels.begin(), channels.end(), [](auto const& channel) {
+    return channel->is_accepting_requests();
+  });
+  std::move(it, channels.end(), std::back_inserter(*dropped));
+  channels.erase(it, channels.end());
+  reffed_ptr<BaseChannel> const* best = nullptr;
+  size_t best_load = 0;
+  for (auto const& channel : channels) {
+    size_t const load = channel->num_active_requests();
+    if (load < channel->max_concurrent_requests() && (!best || load < best_load)) {
+      best = &channel;
+      best_load = load;
+    }
+  }
+  if (best) {
+    return *best;
+  } else {
+    return nullptr;
+  }
+}
+
+ResponseCallback Client::WrapCallback(Target target, ResponseCallback callback) {
+  return [this, target = std::move(target), callback = std::move(callback)](
+             absl::StatusOr<Response> status_or_response) mutable {
+    callback(std::move(status_or_response));
+    // The completion of this request may have freed up a stream.
+    Drain(target);
+    // NOTE: this must be the very last thing we do because the destructor may proceed as soon as
+    // the counter reaches zero.
+    absl::MutexLock lock{&mutex_};
+    --num_pending_operations_;
+  };
+}
+
+void Client::Drain(Target const& target) {
+  while (true) {
+    std::vector<reffed_ptr<BaseChannel>> dropped;
+    reffed_ptr<BaseChannel> channel;
+    PendingRequest request;
+    {
+      absl::MutexLock lock{&mutex_};
+      auto const it = pools_.find(target);
+      if (it == pools_.end()) {
+        return;
+      }
+      auto& pool = it->second;
+      if (pool.queue.empty()) {
+        return;
+      }
+      channel = PickChannelLocked(&pool, &dropped);
+      if (!channel) {
+        if (shutting_down_ ||
+            pool.channels.size() + pool.num_connecting >= options_.max_connections_per_target) {
+          return;
+        }
+        ++pool.num_connecting;
+        ++num_pending_operations_;
+      } else {
+        request = std::move(pool.queue.front());
+        pool.queue.pop_front();
+      }
+    }
+    if (!channel) {
+      return Connect(target);
+    }
+    auto status = channel->SendRequest(request.fields, std::move(request.body),
+                                       std::move(request.callback),
+                                       std::move(request.data_callback));
+    if (absl::IsResourceExhausted(status) || absl::IsUnavailable(status)) {
+      // The channel filled up or started going away after we picked it. The request wasn't
+      // consumed, so we put it back at the head of the queue and try again.
+      absl::MutexLock lock{&mutex_};
+      pools_[target].queue.emplace_front(std::move(request));
+    } else if (!status.ok()) {
+      request.callback(std::move(status));
+    }
+  }
+}
+
+void Client::Connect(Target const& target) {
+  auto const& [host, port] = target;
+  absl::Status status;
+  if (options_.use_ssl) {
+    using SSLChannel = Channel<tsdb2::net::SSLSocket>;
+    status = SSLChannel::Create(host, port, options_.socket_options,
+                                [this, target](reffed_ptr<SSLChannel> channel,
+                                               absl::Status const status) {
+                                  if (status.ok()) {
+                                    OnTransportConnected(target, std::move(channel));
+                                  } else {
+                                    OnConnect(target, nullptr, status);
+                                  }
+                                })
+                 .status();
+  } else {
+    using RawChannel = Channel<tsdb2::net::Socket>;
+    status = RawChannel::Create(tsdb2::net::kInetSocketTag, host, port, options_.socket_options,
+                                [this, target](reffed_ptr<RawChannel> channel,
+                                               absl::Status const status) {
+                                  if (status.ok()) {
+                                    OnTransportConnected(target, std::move(channel));
+                                  } else {
+                                    OnConnect(target, nullptr, status);
+                                  }
+                                })
+                 .status();
+  }
+  if (!status.ok()) {
+    OnConnect(target, nullptr, std::move(status));
+  }
+}
+
+void Client::OnTransportConnected(Target const& target, reffed_ptr<BaseChannel> channel) {
+  {
+    absl::MutexLock lock{&mutex_};
+    if (!shutting_down_) {
+      pools_[target].handshaking.emplace_back(channel);
+    }
+  }
+  // If we're shutting down the channel is not tracked, so the destructor can't disconnect it.
+  // Nonetheless the handshake completes or fails eventually, and `OnConnect` disconnects it then.
+  //
+  // NOTE: if the destructor disconnects the channel before we start it, `StartClient` fails the
+  // callback right away.
+  BaseChannel* const ptr = channel.get();
+  ptr->StartClient([this, target, channel = std::move(channel)](absl::Status status) mutable {
+    OnConnect(target, std::move(channel), std::move(status));
+  });
+}
+
+void Client::OnConnect(Target const& target, reffed_ptr<BaseChannel> channel,
+                       absl::Status status) {
+  std::deque<PendingRequest> failed;
+  bool disconnect = false;
+  {
+    absl::MutexLock lock{&mutex_};
+    auto& pool = pools_[target];
+    --pool.num_connecting;
+    if (channel) {
+      auto& handshaking = pool.handshaking;
+      handshaking.erase(std::remove(handshaking.begin(), handshaking.end(), channel),
+                        handshaking.end());
+    }
+    if (status.ok()) {
+      if (shutting_down_) {
+        disconnect = true;
+      } else {
+        pool.channels.emplace_back(channel);
+      }
+    } else if (pool.channels.empty() && pool.num_connecting == 0) {
+      // No other connection can serve the queued requests.
+      pool.queue.swap(failed);
+    }
+  }
+  if (disconnect) {
+    channel->Disconnect();
+  }
+  for (auto& request : failed) {
+    request.callback(status);
+  }
+  if (status.ok()) {
+    Drain(target);
+  }
+  channel.reset();
+  // NOTE: this must be the very last thing we do because the destructor may proceed as soon as the
+  // counter reaches zero.
+  absl::MutexLock lock{&mutex_};
+  --num_pending_operations_;
+}
+
+}  // namespace http
+}  // namespace tsdb2
@@ -0,0 +1,176 @@
+#ifndef __TSDB2_HTTP_CLIENT_H__
+#define __TSDB2_HTTP_CLIENT_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "common/promise.h"
+#include "common/reffed_ptr.h"
+#include "http/channel.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "net/base_sockets.h"
+
+namespace tsdb2 {
+namespace http {
+
+// An HTTP/2 client.
+//
+// The client keeps a pool of connections for every target (i.e. host and port) and multiplexes
+// requests over them. Each request goes to the connection with the fewest active requests among
+// those that haven't reached the server's SETTINGS_MAX_CONCURRENT_STREAMS. New connections are only
+// opened when all the existing ones are saturated, up to `Options::max_connections_per_target`.
+// Requests exceeding the capacity of the pool are queued and sent as soon as a stream becomes
+// available.
+//
+// Example:
+//
+//   Promise<void> promise;
+//   Client client{Client::Options()};
+//   promise = client.Request("www.example.com", 443, Method::kGet, "/")
+//       .Then([](absl::StatusOr<Response> status_or_response) {
+//         if (status_or_response.ok()) {
+//           // Use the response.
+//         } else {
+//           // The request failed.
+//         }
+//       });
+//
+// Promises returned by `Request` are resolved in I/O threads, so the `Then` callbacks must not
+// block. They may issue more requests.
+//
+// The returned promise (or the last one in its `Then` chain) must be kept alive until it's
+// resolved, otherwise the I/O thread may resolve a destroyed promise. Since the destructor of
+// `Client` waits for all callbacks to complete, declaring the promise before the client as in the
+// example above is sufficient.
+//
+// This class is thread-safe.
+class Client final {
+ public:
+  struct Options {
+    // Whether to connect over TLS.
+    bool use_ssl = true;
+
+    // Options for the underlying sockets.
+    tsdb2::net::SocketOptions socket_options;
+
+    // Maximum number of connections to each target.
+    size_t max_connections_per_target = 4;
+  };
+
+  explicit Client(Options options) : options_(std::move(options)) {}
+
+  // Closes all connections, failing the pending requests, and waits for all callbacks to complete.
+  ~Client() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Sends a request to the specified host and port. The request pseudo-headers are generated
+  // automatically, so `headers` must contain only regular fields. An empty `body` results in a
+  // request without DATA frames.
+  tsdb2::common::Promise<Response> Request(std::string_view host, uint16_t port, Method method,
+                                           std::string_view path, hpack::HeaderSet headers = {},
+                                           tsdb2::net::Buffer body = tsdb2::net::Buffer())
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Like `Request`, but the DATA of the response is passed to `data_callback` as soon as it's
+  // received, and the `body` of the resolved `Response` is left empty. If the response is received
+  // successfully the promise is resolved after the last call to `data_callback`. Like the promise,
+  // `data_callback` runs in an I/O thread so it must not block.
+  tsdb2::common::Promise<Response> StreamingRequest(std::string_view host, uint16_t port,
+                                                    Method method, std::string_view path,
+                                                    hpack::HeaderSet headers,
+                                                    tsdb2::net::Buffer body,
+                                                    ResponseDataCallback data_callback)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns the number of connections that are open or being opened to the specified target.
+  size_t num_connections(std::string_view host, uint16_t port) const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns the number of requests to the specified target that are waiting for a stream to become
+  // available.
+  size_t num_queued_requests(std::string_view host, uint16_t port) const
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  using Target = std::pair<std::string, uint16_t>;
+
+  struct PendingRequest {
+    hpack::HeaderSet fields;
+    tsdb2::net::Buffer body;
+    ResponseCallback callback;
+    ResponseDataCallback data_callback;
+  };
+
+  struct Pool {
+    // Connected channels.
+    std::vector<tsdb2::common::reffed_ptr<BaseChannel>> channels;
+
+    // Channels that are connected but haven't completed the HTTP/2 handshake yet.
+    std::vector<tsdb2::common::reffed_ptr<BaseChannel>> handshaking;
+
+    // Number of channels being connected, including the handshaking ones.
+    size_t num_connecting = 0;
+
+    // Requests waiting for a stream.
+    std::deque<PendingRequest> queue;
+  };
+
+  Client(Client const&) = delete;
+  Client& operator=(Client const&) = delete;
+  Client(Client&&) = delete;
+  Client& operator=(Client&&) = delete;
+
+  // Returns the least loaded channel of `pool` that can accept one more request, or nullptr if
+  // there's none. Closed channels and channels that are going away are removed from the pool and
+  // moved to `dropped`, which the caller must destroy after releasing `mutex_`.
+  static tsdb2::common::reffed_ptr<BaseChannel> PickChannelLocked(
+      Pool* pool, std::vector<tsdb2::common::reffed_ptr<BaseChannel>>* dropped);
+
+  // Wraps the callback of a request so that the client keeps track of its completion and sends
+  // more queued requests when a stream becomes available.
+  ResponseCallback WrapCallback(Target target, ResponseCallback callback);
+
+  // Sends the queued requests of the specified target as long as there are available streams,
+  // opening a new connection if needed and allowed.
+  void Drain(Target const& target) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Opens a new connection to the specified target. The caller must have already accounted for it
+  // in `Pool::num_connecting`.
+  void Connect(Target const& target) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Invoked when a new connection establishes the transport and is about to start the HTTP/2
+  // handshake.
+  void OnTransportConnected(Target const& target, tsdb2::common::reffed_ptr<BaseChannel> channel)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Invoked when a new connection either completes the HTTP/2 handshake or fails.
+  void OnConnect(Target const& target, tsdb2::common::reffed_ptr<BaseChannel> channel,
+                 absl::Status status) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  Options const options_;
+
+  absl::Mutex mutable mutex_;
+
+  absl::flat_hash_map<Target, Pool> pools_ ABSL_GUARDED_BY(mutex_);
+
+  // Total number of requests whose callback hasn't run yet, plus the connections being opened. The
+  // destructor waits for this to drop to zero.
+  size_t num_pending_operations_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  bool shutting_down_ ABSL_GUARDED_BY(mutex_) = false;
+};
+
+}  // namespace http
+}  // namespace tsdb2
+
+#endif  // __TSDB2_HTTP_CLIENT_H__
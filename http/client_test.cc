@@ -0,0 +1,260 @@
+#include "http/client.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "common/flag_override.h"
+#include "common/no_destructor.h"
+#include "common/promise.h"
+#include "common/reffed_ptr.h"
+#include "common/stats_counter.h"
+#include "common/testing.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "http/server.h"
+#include "http/testing.h"
+#include "io/cord.h"
+#include "net/base_sockets.h"
+#include "server/testing.h"
+
+namespace {
+
+using ::absl_testing::IsOk;
+using ::testing::_;
+using ::testing::Contains;
+using ::testing::ElementsAre;
+using ::testing::Pair;
+using ::tsdb2::common::Promise;
+using ::tsdb2::common::reffed_ptr;
+using ::tsdb2::common::testing::FlagOverride;
+using ::tsdb2::http::Client;
+using ::tsdb2::http::Method;
+using ::tsdb2::http::Request;
+using ::tsdb2::http::Response;
+using ::tsdb2::http::Server;
+using ::tsdb2::http::StreamInterface;
+using ::tsdb2::io::Cord;
+using ::tsdb2::net::Buffer;
+using ::tsdb2::net::kLocalHost;
+using ::tsdb2::net::SocketOptions;
+using ::tsdb2::testing::http::MockHandler;
+
+uint16_t GetNewPort() {
+  static tsdb2::common::NoDestructor<tsdb2::common::StatsCounter> next_port{21024};
+  return next_port->Increment();
+}
+
+std::string ToString(Cord cord) {
+  auto const buffer = std::move(cord).Flatten();
+  return std::string(buffer.as_char_array(), buffer.size());
+}
+
+// Reads the whole request body and sends it back in the response.
+void Echo(reffed_ptr<StreamInterface> stream, Cord body) {
+  auto* const ptr = stream.get();
+  ptr->ReadData([stream = std::move(stream), body = std::move(body)](
+                    absl::StatusOr<Cord> status_or_data, bool const end) mutable {
+    ASSERT_OK(status_or_data);
+    body.Append(std::move(status_or_data).value());
+    if (end) {
+      stream->SendResponseOrLog({{":status", "200"}}, std::move(body).Flatten());
+    } else {
+      Echo(std::move(stream), std::move(body));
+    }
+  });
+}
+
+class ClientTest : public tsdb2::testing::init::Test {
+ protected:
+  void StartServer() {
+    Server::HandlerSet handlers;
+    auto handler = std::make_unique<MockHandler>();
+    handler_ = handler.get();
+    handlers.try_emplace("/foo", std::move(handler));
+    auto status_or_server = Server::Create("", port_, /*use_ssl=*/false, SocketOptions(),
+                                           std::move(handlers));
+    ASSERT_OK(status_or_server);
+    server_ = std::move(status_or_server).value();
+  }
+
+  uint16_t const port_ = GetNewPort();
+  MockHandler* handler_ = nullptr;
+  std::unique_ptr<Server> server_;
+};
+
+TEST_F(ClientTest, Get) {
+  ASSERT_NO_FATAL_FAILURE(StartServer());
+  EXPECT_CALL(*handler_, Run(_, _))
+      .WillOnce([](StreamInterface* const stream, Request const& request) {
+        EXPECT_EQ(request.method, Method::kGet);
+        EXPECT_EQ(request.path, "/foo");
+        stream->SendResponseOrLog({{":status", "200"}, {"lorem", "ipsum"}}, Buffer("dolor", 5));
+      });
+  // NOTE: the promise must outlive the client, whose destructor waits for all callbacks to
+  // complete.
+  Promise<void> promise;
+  Client client{Client::Options{.use_ssl = false}};
+  absl::Notification done;
+  absl::StatusOr<Response> result;
+  promise = client.Request(kLocalHost, port_, Method::kGet, "/foo")
+                .Then([&](absl::StatusOr<Response> status_or_response) {
+                  result = std::move(status_or_response);
+                  done.Notify();
+                });
+  done.WaitForNotification();
+  ASSERT_OK(result);
+  EXPECT_EQ(result->status, 200);
+  EXPECT_THAT(result->headers, Contains(Pair("lorem", "ipsum")));
+  EXPECT_EQ(ToString(std::move(result->body)), "dolor");
+  EXPECT_EQ(client.num_connections(kLocalHost, port_), 1);
+}
+
+TEST_F(ClientTest, PostLargeBody) {
+  ASSERT_NO_FATAL_FAILURE(StartServer());
+  EXPECT_CALL(*handler_, Run(_, _))
+      .WillOnce([](StreamInterface* const stream, Request const& request) {
+        EXPECT_EQ(request.method, Method::kPost);
+        Echo(reffed_ptr<StreamInterface>(stream), Cord());
+      });
+  // Larger than the default flow-control window, so both ends have to send WINDOW_UPDATEs.
+  std::string const body(100 * 1024, 'x');
+  Promise<void> promise;
+  Client client{Client::Options{.use_ssl = false}};
+  absl::Notification done;
+  absl::StatusOr<Response> result;
+  promise =
+      client
+          .Request(kLocalHost, port_, Method::kPost, "/foo", {{"content-type", "text/plain"}},
+                   Buffer(body.data(), body.size()))
+          .Then([&](absl::StatusOr<Response> status_or_response) {
+            result = std::move(status_or_response);
+            done.Notify();
+          });
+  done.WaitForNotification();
+  ASSERT_OK(result);
+  EXPECT_EQ(result->status, 200);
+  EXPECT_EQ(ToString(std::move(result->body)), body);
+}
+
+TEST_F(ClientTest, StreamingRequest) {
+  ASSERT_NO_FATAL_FAILURE(StartServer());
+  absl::Notification handler_started;
+  reffed_ptr<StreamInterface> server_stream;
+  EXPECT_CALL(*handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const stream, Request const& /*request*/) {
+        ASSERT_OK(stream->SendFields({{":status", "200"}}, /*end_stream=*/false));
+        ASSERT_OK(stream->SendData(Buffer("lorem", 5), /*end_stream=*/false));
+        server_stream = reffed_ptr<StreamInterface>(stream);
+        handler_started.Notify();
+      });
+  Promise<void> promise;
+  Client client{Client::Options{.use_ssl = false}};
+  absl::Mutex mutex;
+  std::vector<std::string> chunks;
+  absl::Notification first_chunk;
+  absl::Notification done;
+  absl::StatusOr<Response> result;
+  promise = client
+                .StreamingRequest(kLocalHost, port_, Method::kGet, "/foo", /*headers=*/{},
+                                  /*body=*/Buffer(),
+                                  [&](uint16_t const status, Buffer data) {
+                                    EXPECT_EQ(status, 200);
+                                    absl::MutexLock lock{&mutex};
+                                    chunks.emplace_back(data.as_char_array(), data.size());
+                                    if (!first_chunk.HasBeenNotified()) {
+                                      first_chunk.Notify();
+                                    }
+                                  })
+                .Then([&](absl::StatusOr<Response> status_or_response) {
+                  result = std::move(status_or_response);
+                  done.Notify();
+                });
+  // The first chunk must be delivered while the response is still open.
+  first_chunk.WaitForNotification();
+  EXPECT_FALSE(done.HasBeenNotified());
+  handler_started.WaitForNotification();
+  ASSERT_OK(server_stream->SendData(Buffer("ipsum", 5), /*end_stream=*/true));
+  server_stream.reset();
+  done.WaitForNotification();
+  ASSERT_OK(result);
+  EXPECT_EQ(result->status, 200);
+  EXPECT_EQ(ToString(std::move(result->body)), "");
+  absl::MutexLock lock{&mutex};
+  EXPECT_THAT(chunks, ElementsAre("lorem", "ipsum"));
+}
+
+TEST_F(ClientTest, PoolsConnections) {
+  FlagOverride max_streams_override{&FLAGS_http2_max_concurrent_streams, 1};
+  ASSERT_NO_FATAL_FAILURE(StartServer());
+  absl::Mutex mutex;
+  size_t num_requests = 0;
+  std::vector<reffed_ptr<StreamInterface>> held;
+  EXPECT_CALL(*handler_, Run(_, _))
+      .WillRepeatedly([&](StreamInterface* const stream, Request const& /*request*/) {
+        absl::MutexLock lock{&mutex};
+        // Hold on to the first two requests, respond to the others right away.
+        if (num_requests++ < 2) {
+          held.emplace_back(stream);
+        } else {
+          stream->SendResponseOrLog({{":status", "204"}}, Buffer());
+        }
+      });
+  std::vector<Promise<void>> promises;
+  Client client{Client::Options{.use_ssl = false, .max_connections_per_target = 2}};
+  absl::BlockingCounter counter{4};
+  for (int i = 0; i < 4; ++i) {
+    promises.emplace_back(client.Request(kLocalHost, port_, Method::kGet, "/foo")
+                              .Then([&](absl::StatusOr<Response> status_or_response) {
+                                EXPECT_OK(status_or_response);
+                                counter.DecrementCount();
+                              }));
+  }
+  {
+    absl::MutexLock lock{&mutex, absl::Condition(
+                                     +[](std::vector<reffed_ptr<StreamInterface>>* const held) {
+                                       return held->size() == 2;
+                                     },
+                                     &held)};
+  }
+  EXPECT_EQ(client.num_connections(kLocalHost, port_), 2);
+  EXPECT_EQ(client.num_queued_requests(kLocalHost, port_), 2);
+  std::vector<reffed_ptr<StreamInterface>> streams;
+  {
+    absl::MutexLock lock{&mutex};
+    held.swap(streams);
+  }
+  for (auto& stream : streams) {
+    stream->SendResponseOrLog({{":status", "204"}}, Buffer());
+  }
+  counter.Wait();
+  EXPECT_EQ(client.num_queued_requests(kLocalHost, port_), 0);
+}
+
+TEST_F(ClientTest, ConnectionRefused) {
+  Promise<void> promise;
+  Client client{Client::Options{.use_ssl = false}};
+  absl::Notification done;
+  promise = client.Request(kLocalHost, port_, Method::kGet, "/foo")
+                .Then([&](absl::StatusOr<Response> status_or_response) {
+                  EXPECT_THAT(status_or_response.status(), ::testing::Not(IsOk()));
+                  done.Notify();
+                });
+  done.WaitForNotification();
+  EXPECT_EQ(client.num_connections(kLocalHost, port_), 0);
+}
+
+}  // namespace
@@ -0,0 +1,231 @@
+#include "http/concurrency_limiter.h"
+
+#include <sys/types.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "absl/flags/flag.h"
+#include "absl/status/status.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "common/clock.h"
+#include "common/reffed_ptr.h"
+#include "common/utilities.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "http/stream_proxy.h"
+#include "io/cord.h"
+#include "io/fd.h"
+#include "net/base_sockets.h"
+#include "tsz/base.h"
+#include "tsz/counter.h"
+#include "tsz/metric.h"
+
+ABSL_FLAG(bool, http_adaptive_concurrency_limit, false,
+          "Whether HTTP servers limit the number of requests they process concurrently. The limit "
+          "adapts to the observed request latencies, and requests exceeding it are rejected with "
+          "status 503.");
+
+namespace tsdb2 {
+namespace http {
+
+namespace {
+
+using ::tsdb2::common::reffed_ptr;
+
+char constexpr kPortField[] = "port";
+
+using PortField = tsz::Field<int, kPortField>;
+
+tsz::NoDestructor<tsz::Metric<int64_t, PortField>> concurrency_limit{
+    "/http/server/concurrency_limit",
+    tsz::Options{
+        .description = "Current adaptive limit on the number of concurrent HTTP requests.",
+    }};
+
+tsz::NoDestructor<tsz::Counter<PortField>> rejected_requests{
+    "/http/server/rejected_requests",
+    tsz::Options{
+        .description = "HTTP requests rejected because of the adaptive concurrency limit.",
+    }};
+
+// Returns true iff `fields` contain status 503.
+bool IsServiceUnavailable(hpack::HeaderSet const& fields) {
+  for (auto const& [name, value] : fields) {
+    if (name == kStatusHeaderName) {
+      uint32_t status = 0;
+      return absl::SimpleAtoi(value, &status) &&
+             status == tsdb2::util::to_underlying(Status::k503);
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+ConcurrencyLimiter::ConcurrencyLimiter(Options const& options,
+                                       tsdb2::common::Clock const* const clock)
+    : options_(options),
+      clock_(clock),
+      limit_(std::clamp(options.initial_limit, options.min_limit, options.max_limit)),
+      estimated_limit_(static_cast<double>(limit_.load(std::memory_order_relaxed))) {}
+
+bool ConcurrencyLimiter::TryAcquire() {
+  size_t count = in_flight_.load(std::memory_order_relaxed);
+  do {
+    if (count >= limit_.load(std::memory_order_relaxed)) {
+      return false;
+    }
+  } while (!in_flight_.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+  return true;
+}
+
+void ConcurrencyLimiter::Release(absl::Duration const latency) {
+  size_t const in_flight = in_flight_.fetch_sub(1, std::memory_order_relaxed);
+  double const sample = absl::ToDoubleSeconds(latency);
+  if (sample <= 0) {
+    return;
+  }
+  absl::MutexLock lock{&mutex_};
+  if (long_latency_ > 0) {
+    long_latency_ += (sample - long_latency_) * options_.long_window_weight;
+  } else {
+    long_latency_ = sample;
+  }
+  // If the long-term average is much higher than the current latency the load has dropped
+  // significantly after a period of congestion, so we decay the average faster than usual in order
+  // to let the limit grow back.
+  if (long_latency_ > sample * 2) {
+    long_latency_ *= 0.95;
+  }
+  // Don't grow the limit if less than half of it is in use, otherwise it would grow indefinitely
+  // under light load.
+  if (in_flight < estimated_limit_ / 2) {
+    return;
+  }
+  double const gradient = std::clamp(options_.tolerance * long_latency_ / sample, 0.5, 1.0);
+  double const new_limit = estimated_limit_ * gradient + std::sqrt(estimated_limit_);
+  estimated_limit_ = std::clamp(
+      estimated_limit_ * (1 - options_.smoothing) + new_limit * options_.smoothing,
+      static_cast<double>(options_.min_limit), static_cast<double>(options_.max_limit));
+  limit_.store(static_cast<size_t>(estimated_limit_), std::memory_order_relaxed);
+}
+
+// Proxies a `StreamInterface` to measure the latency of the request and release its slot in the
+// limiter when it completes.
+class ConcurrencyLimitingHandler::LimitedStream final : public StreamProxy {
+ public:
+  explicit LimitedStream(StreamInterface* const stream, reffed_ptr<ConcurrencyLimiter> limiter,
+                         uint16_t const port)
+      : StreamProxy(stream),
+        limiter_(std::move(limiter)),
+        port_(port),
+        start_time_(limiter_->clock()->TimeNow()) {}
+
+  ~LimitedStream() override {
+    if (!closed_.exchange(true, std::memory_order_relaxed)) {
+      limiter_->Abandon();
+    }
+  }
+
+  absl::Status SendFields(hpack::HeaderSet const& fields, bool const end_stream) override {
+    MaybeSetRejected(IsServiceUnavailable(fields));
+    MaybeClose(end_stream);
+    return StreamProxy::SendFields(fields, end_stream);
+  }
+
+  absl::Status SendFields(hpack::PrecompiledHeaders const& precompiled,
+                          hpack::HeaderSet const& fields, bool const end_stream) override {
+    MaybeSetRejected(precompiled.status() == tsdb2::util::to_underlying(Status::k503) ||
+                     IsServiceUnavailable(fields));
+    MaybeClose(end_stream);
+    return StreamProxy::SendFields(precompiled, fields, end_stream);
+  }
+
+  absl::Status SendData(tsdb2::net::Buffer buffer, bool const end_stream) override {
+    MaybeClose(end_stream);
+    return StreamProxy::SendData(std::move(buffer), end_stream);
+  }
+
+  void StreamData(tsdb2::net::Buffer buffer, bool const end_stream,
+                  WriteCallback callback) override {
+    MaybeClose(end_stream);
+    StreamProxy::StreamData(std::move(buffer), end_stream, std::move(callback));
+  }
+
+  void StreamFile(tsdb2::io::FD fd, off_t const offset, size_t const length, bool const end_stream,
+                  WriteCallback callback) override {
+    MaybeClose(end_stream);
+    StreamProxy::StreamFile(std::move(fd), offset, length, end_stream, std::move(callback));
+  }
+
+  void StreamCord(tsdb2::io::Cord cord, bool const end_stream, WriteCallback callback) override {
+    MaybeClose(end_stream);
+    StreamProxy::StreamCord(std::move(cord), end_stream, std::move(callback));
+  }
+
+ private:
+  void MaybeSetRejected(bool const rejected) {
+    if (rejected) {
+      rejected_.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  // When the handler closes the stream the slot is handed over to a callback that releases it once
+  // the end of the stream has been sent. The callback doesn't reference the proxy, which may be
+  // gone by then.
+  void MaybeClose(bool const end_stream) {
+    if (!end_stream || closed_.exchange(true, std::memory_order_relaxed)) {
+      return;
+    }
+    StreamProxy::OnEndStreamSent([limiter = limiter_, port = port_, start_time = start_time_,
+                                  rejected = rejected_.load(std::memory_order_relaxed)](
+                                     absl::Status const status) {
+      if (!status.ok() || rejected) {
+        return limiter->Abandon();
+      }
+      limiter->Release(limiter->clock()->TimeNow() - start_time);
+      concurrency_limit->Set(limiter->limit(), port);
+    });
+  }
+
+  reffed_ptr<ConcurrencyLimiter> const limiter_;
+  uint16_t const port_;
+  absl::Time const start_time_;
+  std::atomic<bool> rejected_{false};
+  std::atomic<bool> closed_{false};
+};
+
+ConcurrencyLimitingHandler::HandlerSet ConcurrencyLimitingHandler::WrapAll(
+    HandlerSet handlers, ConcurrencyLimiter::Options const& options, uint16_t const port) {
+  auto const limiter = tsdb2::common::MakeReffed<ConcurrencyLimiter>(options);
+  concurrency_limit->Set(limiter->limit(), port);
+  for (auto&& [path, handler] : handlers) {
+    handler = std::make_unique<ConcurrencyLimitingHandler>(std::move(handler), limiter, port);
+  }
+  return handlers;
+}
+
+void ConcurrencyLimitingHandler::operator()(StreamInterface* const stream,
+                                            Request const& request) {
+  if (!limiter_->TryAcquire()) {
+    rejected_requests->Increment(port_);
+    return stream->SendFieldsOrLog(
+        {{":status", absl::StrCat(tsdb2::util::to_underlying(Status::k503))}},
+        /*end_stream=*/true);
+  }
+  (*handler_)(reffed_ptr<LimitedStream>(new LimitedStream(stream, limiter_, port_)).get(),
+              request);
+}
+
+}  // namespace http
+}  // namespace tsdb2
@@ -0,0 +1,156 @@
+#ifndef __TSDB2_HTTP_CONCURRENCY_LIMITER_H__
+#define __TSDB2_HTTP_CONCURRENCY_LIMITER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/flags/declare.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "common/clock.h"
+#include "common/ref_count.h"
+#include "common/reffed_ptr.h"
+#include "common/trie_map.h"
+#include "http/handlers.h"
+#include "http/http.h"
+
+ABSL_DECLARE_FLAG(bool, http_adaptive_concurrency_limit);
+
+namespace tsdb2 {
+namespace http {
+
+// Adaptive limit on the number of requests a server processes concurrently.
+//
+// The limit is derived from the observed request latencies using a gradient algorithm: the limiter
+// keeps a long-term exponential moving average of the latency and compares every new sample
+// against it. As long as latencies stay close to the long-term average the limit grows by about
+// the square root of its current value per sample; when latencies increase (meaning that requests
+// are queueing up somewhere) the limit shrinks proportionally to the ratio of the two, down to half
+// of its value per sample.
+//
+// This class is thread-safe. Acquiring a slot is lock-free, while releasing one takes a mutex to
+// update the estimates.
+class ConcurrencyLimiter : public tsdb2::common::SimpleRefCounted {
+ public:
+  struct Options {
+    // The limit used before any latency samples are collected.
+    size_t initial_limit = 100;
+
+    // The limit never goes below `min_limit` and never above `max_limit`.
+    size_t min_limit = 10;
+    size_t max_limit = 1000;
+
+    // How much the latency samples can exceed the long-term average before the limit starts
+    // decreasing. For example, the default of 1.5 tolerates latencies up to 50% higher than usual.
+    double tolerance = 1.5;
+
+    // Weight of each new sample in the long-term latency average.
+    double long_window_weight = 0.01;
+
+    // Weight of each newly computed limit with respect to the previous limit. Lower values make the
+    // limit change more slowly.
+    double smoothing = 0.2;
+  };
+
+  explicit ConcurrencyLimiter(Options const& options,
+                              tsdb2::common::Clock const* const clock =
+                                  tsdb2::common::RealClock::GetInstance());
+
+  ~ConcurrencyLimiter() override = default;
+
+  tsdb2::common::Clock const* clock() const { return clock_; }
+
+  // Returns the current limit.
+  size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+
+  // Returns the number of acquired slots.
+  size_t in_flight() const { return in_flight_.load(std::memory_order_relaxed); }
+
+  // Reserves a slot for a new request. Returns false without reserving anything if the limit has
+  // been reached, in which case the request should be rejected.
+  bool TryAcquire();
+
+  // Releases a slot acquired by a request that completed in `latency`, updating the limit
+  // accordingly.
+  void Release(absl::Duration latency) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Releases a slot without updating the limit. Used for requests whose latency is not
+  // representative, e.g. because they were abandoned.
+  void Abandon() { in_flight_.fetch_sub(1, std::memory_order_relaxed); }
+
+ private:
+  ConcurrencyLimiter(ConcurrencyLimiter const&) = delete;
+  ConcurrencyLimiter& operator=(ConcurrencyLimiter const&) = delete;
+  ConcurrencyLimiter(ConcurrencyLimiter&&) = delete;
+  ConcurrencyLimiter& operator=(ConcurrencyLimiter&&) = delete;
+
+  Options const options_;
+  tsdb2::common::Clock const* const clock_;
+
+  std::atomic<size_t> in_flight_{0};
+  std::atomic<size_t> limit_;
+
+  absl::Mutex mutable mutex_;
+
+  // The unrounded limit, which allows it to change by less than one per sample.
+  double estimated_limit_ ABSL_GUARDED_BY(mutex_);
+
+  // Long-term average latency in seconds. Zero until the first sample is collected.
+  double long_latency_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+// Wraps a `Handler` so that its requests are subject to a `ConcurrencyLimiter`, which is normally
+// shared by all the handlers of a server. Requests exceeding the limit are rejected right away with
+// status 503.
+//
+// The latency of a request is measured from the time the wrapped handler is invoked until the frame
+// closing the local end of the stream has been sent (see `StreamInterface::OnEndStreamSent`). The
+// following requests don't contribute any latency samples:
+//
+//   * requests whose streams are released without being closed, or whose end can't be sent;
+//   * requests rejected with status 503 by the wrapped handler itself, e.g. by an `ExecutorHandler`
+//     whose queue is full, as their latency says nothing about how long it takes to process them.
+//
+// The current limit and the number of rejected requests are exported in the
+// `/http/server/concurrency_limit` and `/http/server/rejected_requests` tsz metrics, with the port
+// of the server in the `port` field.
+class ConcurrencyLimitingHandler final : public Handler {
+ public:
+  using HandlerSet = tsdb2::common::trie_map<std::unique_ptr<Handler>>;
+
+  // Wraps every handler in `handlers` with a `ConcurrencyLimitingHandler` sharing a single
+  // `ConcurrencyLimiter`. `port` is the port of the server, which the metrics are labeled with.
+  static HandlerSet WrapAll(HandlerSet handlers, ConcurrencyLimiter::Options const& options,
+                            uint16_t port);
+
+  explicit ConcurrencyLimitingHandler(std::unique_ptr<Handler> handler,
+                                      tsdb2::common::reffed_ptr<ConcurrencyLimiter> limiter,
+                                      uint16_t const port)
+      : handler_(std::move(handler)), limiter_(std::move(limiter)), port_(port) {}
+
+  ~ConcurrencyLimitingHandler() override = default;
+
+  ConcurrencyLimiter const& limiter() const { return *limiter_; }
+
+  void operator()(StreamInterface* stream, Request const& request) override;
+
+ private:
+  class LimitedStream;
+
+  ConcurrencyLimitingHandler(ConcurrencyLimitingHandler const&) = delete;
+  ConcurrencyLimitingHandler& operator=(ConcurrencyLimitingHandler const&) = delete;
+  ConcurrencyLimitingHandler(ConcurrencyLimitingHandler&&) = delete;
+  ConcurrencyLimitingHandler& operator=(ConcurrencyLimitingHandler&&) = delete;
+
+  std::unique_ptr<Handler> const handler_;
+  tsdb2::common::reffed_ptr<ConcurrencyLimiter> const limiter_;
+  uint16_t const port_;
+};
+
+}  // namespace http
+}  // namespace tsdb2
+
+#endif  // __TSDB2_HTTP_CONCURRENCY_LIMITER_H__
@@ -0,0 +1,268 @@
+#include "http/concurrency_limiter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "common/mock_clock.h"
+#include "common/reffed_ptr.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "http/testing.h"
+#include "server/testing.h"
+
+namespace {
+
+using ::testing::_;
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::Pair;
+using ::testing::Return;
+using ::tsdb2::common::MakeReffed;
+using ::tsdb2::common::MockClock;
+using ::tsdb2::common::reffed_ptr;
+using ::tsdb2::http::ConcurrencyLimiter;
+using ::tsdb2::http::ConcurrencyLimitingHandler;
+using ::tsdb2::http::Method;
+using ::tsdb2::http::Request;
+using ::tsdb2::http::StreamInterface;
+using ::tsdb2::testing::http::MockHandler;
+using ::tsdb2::testing::http::MockStream;
+
+uint16_t constexpr kPort = 8080;
+
+ConcurrencyLimiter::Options const kOptions{
+    .initial_limit = 10,
+    .min_limit = 2,
+    .max_limit = 100,
+};
+
+// Acquires all available slots and releases them with the given latency.
+void RunRound(ConcurrencyLimiter* const limiter, absl::Duration const latency) {
+  size_t count = 0;
+  while (limiter->TryAcquire()) {
+    ++count;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    limiter->Release(latency);
+  }
+}
+
+TEST(ConcurrencyLimiterTest, InitialState) {
+  ConcurrencyLimiter limiter{kOptions};
+  EXPECT_EQ(limiter.limit(), 10);
+  EXPECT_EQ(limiter.in_flight(), 0);
+}
+
+TEST(ConcurrencyLimiterTest, InitialLimitIsClamped) {
+  ConcurrencyLimiter limiter{ConcurrencyLimiter::Options{
+      .initial_limit = 1000,
+      .min_limit = 2,
+      .max_limit = 100,
+  }};
+  EXPECT_EQ(limiter.limit(), 100);
+}
+
+TEST(ConcurrencyLimiterTest, RejectsAtLimit) {
+  ConcurrencyLimiter limiter{kOptions};
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_TRUE(limiter.TryAcquire());
+  }
+  EXPECT_EQ(limiter.in_flight(), 10);
+  EXPECT_FALSE(limiter.TryAcquire());
+  limiter.Abandon();
+  EXPECT_EQ(limiter.in_flight(), 9);
+  EXPECT_TRUE(limiter.TryAcquire());
+}
+
+TEST(ConcurrencyLimiterTest, AbandonDoesNotChangeLimit) {
+  ConcurrencyLimiter limiter{kOptions};
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(limiter.TryAcquire());
+    limiter.Abandon();
+  }
+  EXPECT_EQ(limiter.limit(), 10);
+  EXPECT_EQ(limiter.in_flight(), 0);
+}
+
+TEST(ConcurrencyLimiterTest, GrowsWithSteadyLatency) {
+  ConcurrencyLimiter limiter{kOptions};
+  for (int i = 0; i < 20; ++i) {
+    RunRound(&limiter, absl::Milliseconds(10));
+  }
+  EXPECT_GT(limiter.limit(), 10);
+  EXPECT_EQ(limiter.in_flight(), 0);
+}
+
+TEST(ConcurrencyLimiterTest, DoesNotGrowUnderLightLoad) {
+  ConcurrencyLimiter limiter{kOptions};
+  for (int i = 0; i < 100; ++i) {
+    ASSERT_TRUE(limiter.TryAcquire());
+    limiter.Release(absl::Milliseconds(10));
+  }
+  EXPECT_EQ(limiter.limit(), 10);
+}
+
+TEST(ConcurrencyLimiterTest, ShrinksWhenLatencyIncreases) {
+  ConcurrencyLimiter limiter{kOptions};
+  for (int i = 0; i < 10; ++i) {
+    RunRound(&limiter, absl::Milliseconds(10));
+  }
+  auto const limit = limiter.limit();
+  for (int i = 0; i < 5; ++i) {
+    RunRound(&limiter, absl::Seconds(1));
+  }
+  EXPECT_LT(limiter.limit(), limit);
+}
+
+TEST(ConcurrencyLimiterTest, NeverExceedsMax) {
+  ConcurrencyLimiter limiter{kOptions};
+  for (int i = 0; i < 1000; ++i) {
+    RunRound(&limiter, absl::Milliseconds(10));
+  }
+  EXPECT_EQ(limiter.limit(), 100);
+}
+
+TEST(ConcurrencyLimiterTest, NeverGoesBelowMin) {
+  ConcurrencyLimiter limiter{ConcurrencyLimiter::Options{
+      .initial_limit = 20,
+      .min_limit = 5,
+      .max_limit = 100,
+  }};
+  auto latency = absl::Milliseconds(10);
+  for (int i = 0; i < 30; ++i) {
+    RunRound(&limiter, latency);
+    latency *= 2;
+  }
+  EXPECT_EQ(limiter.limit(), 5);
+}
+
+class ConcurrencyLimitingHandlerTest : public tsdb2::testing::init::Test {
+ protected:
+  explicit ConcurrencyLimitingHandlerTest() {
+    auto handler = std::make_unique<MockHandler>();
+    mock_handler_ = handler.get();
+    handler_.emplace(std::move(handler), limiter_, kPort);
+  }
+
+  MockClock clock_;
+  reffed_ptr<ConcurrencyLimiter> const limiter_ = MakeReffed<ConcurrencyLimiter>(
+      ConcurrencyLimiter::Options{.initial_limit = 2, .min_limit = 2}, &clock_);
+  MockHandler* mock_handler_ = nullptr;
+  std::optional<ConcurrencyLimitingHandler> handler_;
+};
+
+TEST_F(ConcurrencyLimitingHandlerTest, ForwardsRequest) {
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  EXPECT_CALL(*mock_handler_, Run(Ne(&stream), _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& request) {
+        EXPECT_EQ(request.path, "/foo");
+        EXPECT_EQ(limiter_->in_flight(), 1);
+        clock_.AdvanceTime(absl::Milliseconds(10));
+        proxy->SendFieldsOrLog({{":status", "204"}}, /*end_stream=*/true);
+      });
+  StreamInterface::WriteCallback end_stream_sent;
+  EXPECT_CALL(stream, OnEndStreamSent(_)).WillOnce([&](StreamInterface::WriteCallback callback) {
+    end_stream_sent = std::move(callback);
+  });
+  EXPECT_CALL(stream, SendFields(ElementsAre(Pair(":status", "204")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  (*handler_)(&stream, Request{Method::kGet, "/foo"});
+  EXPECT_EQ(limiter_->in_flight(), 1);
+  ASSERT_TRUE(end_stream_sent);
+  end_stream_sent(absl::OkStatus());
+  EXPECT_EQ(limiter_->in_flight(), 0);
+}
+
+TEST_F(ConcurrencyLimitingHandlerTest, EndStreamNotSent) {
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) {
+        proxy->SendFieldsOrLog({{":status", "204"}}, /*end_stream=*/true);
+      });
+  StreamInterface::WriteCallback end_stream_sent;
+  EXPECT_CALL(stream, OnEndStreamSent(_)).WillOnce([&](StreamInterface::WriteCallback callback) {
+    end_stream_sent = std::move(callback);
+  });
+  EXPECT_CALL(stream, SendFields(_, true)).WillOnce(Return(absl::OkStatus()));
+  (*handler_)(&stream, Request{Method::kGet, "/foo"});
+  EXPECT_EQ(limiter_->in_flight(), 1);
+  ASSERT_TRUE(end_stream_sent);
+  end_stream_sent(absl::CancelledError());
+  EXPECT_EQ(limiter_->in_flight(), 0);
+}
+
+TEST_F(ConcurrencyLimitingHandlerTest, HandlerRejection) {
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) {
+        proxy->SendFieldsOrLog({{":status", "503"}}, /*end_stream=*/true);
+      });
+  StreamInterface::WriteCallback end_stream_sent;
+  EXPECT_CALL(stream, OnEndStreamSent(_)).WillOnce([&](StreamInterface::WriteCallback callback) {
+    end_stream_sent = std::move(callback);
+  });
+  EXPECT_CALL(stream, SendFields(ElementsAre(Pair(":status", "503")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  (*handler_)(&stream, Request{Method::kGet, "/foo"});
+  ASSERT_TRUE(end_stream_sent);
+  end_stream_sent(absl::OkStatus());
+  EXPECT_EQ(limiter_->in_flight(), 0);
+}
+
+TEST_F(ConcurrencyLimitingHandlerTest, RejectsOverLimit) {
+  MockStream stream1;
+  MockStream stream2;
+  MockStream stream3;
+  EXPECT_CALL(stream1, Ref());
+  EXPECT_CALL(stream2, Ref());
+  EXPECT_CALL(stream3, Ref()).Times(0);
+  std::vector<reffed_ptr<StreamInterface>> held;
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .Times(2)
+      .WillRepeatedly([&](StreamInterface* const proxy, Request const& /*request*/) {
+        held.emplace_back(proxy);
+      });
+  EXPECT_CALL(stream3, SendFields(ElementsAre(Pair(":status", "503")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  Request const request{Method::kGet, "/foo"};
+  (*handler_)(&stream1, request);
+  (*handler_)(&stream2, request);
+  (*handler_)(&stream3, request);
+  EXPECT_EQ(limiter_->in_flight(), 2);
+  EXPECT_CALL(stream1, Unref()).WillOnce(Return(false));
+  EXPECT_CALL(stream2, Unref()).WillOnce(Return(false));
+  held.clear();
+  EXPECT_EQ(limiter_->in_flight(), 0);
+  EXPECT_EQ(limiter_->limit(), 2);
+}
+
+TEST_F(ConcurrencyLimitingHandlerTest, WrapAll) {
+  ConcurrencyLimitingHandler::HandlerSet handlers;
+  handlers.try_emplace("/foo", std::make_unique<MockHandler>());
+  handlers.try_emplace("/bar", std::make_unique<MockHandler>());
+  handlers = ConcurrencyLimitingHandler::WrapAll(std::move(handlers), kOptions, kPort);
+  auto const* const foo = dynamic_cast<ConcurrencyLimitingHandler*>(handlers["/foo"].get());
+  auto const* const bar = dynamic_cast<ConcurrencyLimitingHandler*>(handlers["/bar"].get());
+  ASSERT_THAT(foo, Ne(nullptr));
+  ASSERT_THAT(bar, Ne(nullptr));
+  EXPECT_THAT(&foo->limiter(), Eq(&bar->limiter()));
+  EXPECT_EQ(foo->limiter().limit(), 10);
+}
+
+}  // namespace
@@ -16,6 +16,7 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "common/utilities.h"
+#include "http/executor_handler.h"
 #include "http/handlers.h"
 #include "http/http.h"
 #include "http/server.h"
@@ -91,6 +92,12 @@ absl::Status DefaultServerBuilder::RegisterHandler(std::string_view const path,
   }
 }
 
+absl::Status DefaultServerBuilder::RegisterHandler(std::string_view const path,
+                                                   std::unique_ptr<Handler> handler,
+                                                   HandlerOptions const &options) {
+  return RegisterHandler(path, ExecutorHandler::Create(std::move(handler), options));
+}
+
 DefaultServerBuilder::HandlerSet DefaultServerBuilder::ExtractHandlerSet() {
   HandlerSet result;
   absl::MutexLock lock{&mutex_};
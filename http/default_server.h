@@ -29,9 +29,16 @@ class DefaultServerBuilder {
   // before other module initializers have a chance to install their handlers!
   std::unique_ptr<Server> Build();
 
+  // Registers a handler running inline in the I/O worker threads. Suitable for handlers that
+  // respond quickly and never block.
   absl::Status RegisterHandler(std::string_view path, std::unique_ptr<Handler> handler)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
+  // Registers a handler running in the executor specified in `options`. See `HandlerOptions` for
+  // the available executors.
+  absl::Status RegisterHandler(std::string_view path, std::unique_ptr<Handler> handler,
+                               HandlerOptions const &options) ABSL_LOCKS_EXCLUDED(mutex_);
+
  private:
   using HandlerSet = tsdb2::common::trie_map<std::unique_ptr<Handler>>;
 
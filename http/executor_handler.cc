@@ -0,0 +1,122 @@
+#include "http/executor_handler.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/strings/str_cat.h"
+#include "common/reffed_ptr.h"
+#include "common/scheduler.h"
+#include "common/singleton.h"
+#include "common/utilities.h"
+#include "http/handlers.h"
+#include "http/http.h"
+
+namespace {
+#ifdef NDEBUG
+uint16_t constexpr kDefaultNumHandlerWorkers = 10;
+#else
+uint16_t constexpr kDefaultNumHandlerWorkers = 1;
+#endif
+}  // namespace
+
+ABSL_FLAG(uint16_t, num_http_handler_workers, kDefaultNumHandlerWorkers,
+          "Number of worker threads in the scheduler shared by the HTTP handlers that don't run "
+          "inline.");
+
+namespace tsdb2 {
+namespace http {
+
+tsdb2::common::Singleton<tsdb2::common::Scheduler> http_handler_scheduler{[] {
+  return new tsdb2::common::Scheduler(tsdb2::common::Scheduler::Options{
+      .num_workers = absl::GetFlag(FLAGS_num_http_handler_workers),
+      .start_now = true,
+  });
+}};
+
+// Owns a copy of a `Request` along with the storage of its header fields, which in the original
+// request are only valid for the duration of the handler call.
+class ExecutorHandler::RequestCopy {
+ public:
+  explicit RequestCopy(Request const& request) : request_(request) {
+    fields_.reserve(request.headers.size());
+    for (auto const& [name, value] : request.headers) {
+      fields_.emplace_back(std::string(name), std::string(value));
+    }
+    views_.reserve(fields_.size());
+    for (auto const& [name, value] : fields_) {
+      views_.emplace_back(name, value);
+    }
+    request_.headers = HeadersView(views_);
+  }
+
+  ~RequestCopy() = default;
+
+  // Moving the vectors doesn't move their elements, so the moved request's headers remain valid.
+  RequestCopy(RequestCopy&&) noexcept = default;
+  RequestCopy& operator=(RequestCopy&&) noexcept = default;
+
+  Request const& request() const { return request_; }
+
+ private:
+  RequestCopy(RequestCopy const&) = delete;
+  RequestCopy& operator=(RequestCopy const&) = delete;
+
+  Request request_;
+  std::vector<std::pair<std::string, std::string>> fields_;
+  std::vector<HeadersView::Field> views_;
+};
+
+std::unique_ptr<Handler> ExecutorHandler::Create(std::unique_ptr<Handler> handler,
+                                                 HandlerOptions const& options) {
+  switch (options.executor) {
+    case HandlerOptions::Executor::kSharedPool:
+      return std::make_unique<ExecutorHandler>(std::move(handler), http_handler_scheduler.Get(),
+                                               options.max_pending_requests);
+    case HandlerOptions::Executor::kDedicatedPool:
+      return std::make_unique<ExecutorHandler>(std::move(handler), options.num_workers,
+                                               options.max_pending_requests);
+    default:
+      return handler;
+  }
+}
+
+ExecutorHandler::ExecutorHandler(std::unique_ptr<Handler> handler, uint16_t const num_workers,
+                                 size_t const max_pending_requests)
+    : state_(std::make_shared<State>(std::move(handler), max_pending_requests)),
+      dedicated_scheduler_(std::make_unique<tsdb2::common::Scheduler>(
+          tsdb2::common::Scheduler::Options{.num_workers = num_workers, .start_now = true})),
+      scheduler_(dedicated_scheduler_.get()) {}
+
+void ExecutorHandler::operator()(StreamInterface* const stream, Request const& request) {
+  if (!state_->TryAcquireSlot()) {
+    return stream->SendFieldsOrLog(
+        {{":status", absl::StrCat(tsdb2::util::to_underlying(Status::k503))}},
+        /*end_stream=*/true);
+  }
+  scheduler_->ScheduleNow([state = state_,
+                           stream = tsdb2::common::reffed_ptr<StreamInterface>(stream),
+                           request = RequestCopy(request)] {
+    (*state->handler)(stream.get(), request.request());
+    state->ReleaseSlot();
+  });
+}
+
+bool ExecutorHandler::State::TryAcquireSlot() {
+  size_t count = num_pending_requests.load(std::memory_order_relaxed);
+  do {
+    if (count >= max_pending_requests) {
+      return false;
+    }
+  } while (
+      !num_pending_requests.compare_exchange_weak(count, count + 1, std::memory_order_relaxed));
+  return true;
+}
+
+}  // namespace http
+}  // namespace tsdb2
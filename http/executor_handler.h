@@ -0,0 +1,101 @@
+#ifndef __TSDB2_HTTP_EXECUTOR_HANDLER_H__
+#define __TSDB2_HTTP_EXECUTOR_HANDLER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "common/scheduler.h"
+#include "common/singleton.h"
+#include "http/handlers.h"
+#include "http/http.h"
+
+namespace tsdb2 {
+namespace http {
+
+// The scheduler shared by all handlers using `HandlerOptions::Executor::kSharedPool`. Its number of
+// worker threads is provided in the `--num_http_handler_workers` command line flag.
+//
+// Handlers don't run in the default scheduler because it's also used for socket timeouts, which
+// must not be delayed by slow handlers.
+extern tsdb2::common::Singleton<tsdb2::common::Scheduler> http_handler_scheduler;
+
+// Wraps a `Handler` so that it runs in a `Scheduler` rather than in the I/O worker thread that
+// decoded the request. That way slow or blocking handlers don't stall the processing of other
+// connections.
+//
+// The wrapped handler receives a copy of the request whose headers remain valid for the whole
+// duration of its `operator()`, and a stream that keeps the connection alive at least until the
+// `operator()` returns. Handlers responding even later must hold their own reference to the stream
+// (see `StreamInterface::Ref`).
+//
+// The number of requests queued or running at any given time is capped. Requests exceeding the cap
+// are rejected right away with status 503.
+//
+// An `ExecutorHandler` may be destroyed while some of its requests are still queued or running in a
+// shared scheduler. The wrapped handler is kept alive until they're done.
+class ExecutorHandler final : public Handler {
+ public:
+  // Wraps `handler` as per `options`. Returns `handler` itself if `options` specify the inline
+  // executor.
+  static std::unique_ptr<Handler> Create(std::unique_ptr<Handler> handler,
+                                         HandlerOptions const& options);
+
+  // Constructs an `ExecutorHandler` running in the provided scheduler.
+  explicit ExecutorHandler(std::unique_ptr<Handler> handler,
+                           tsdb2::common::Scheduler* const scheduler,
+                           size_t const max_pending_requests)
+      : state_(std::make_shared<State>(std::move(handler), max_pending_requests)),
+        scheduler_(scheduler) {}
+
+  // Constructs an `ExecutorHandler` running in its own scheduler with `num_workers` threads.
+  explicit ExecutorHandler(std::unique_ptr<Handler> handler, uint16_t num_workers,
+                           size_t max_pending_requests);
+
+  ~ExecutorHandler() override = default;
+
+  // Returns the number of requests that are queued or running.
+  size_t num_pending_requests() const {
+    return state_->num_pending_requests.load(std::memory_order_relaxed);
+  }
+
+  void operator()(StreamInterface* stream, Request const& request) override;
+
+ private:
+  class RequestCopy;
+
+  // The state shared with the scheduled tasks, which may outlive the `ExecutorHandler` if they run
+  // in a shared scheduler.
+  struct State {
+    explicit State(std::unique_ptr<Handler> handler, size_t const max_pending_requests)
+        : handler(std::move(handler)), max_pending_requests(max_pending_requests) {}
+
+    // Reserves a slot for a new request, returning false if there are already
+    // `max_pending_requests` requests queued or running.
+    bool TryAcquireSlot();
+
+    void ReleaseSlot() { num_pending_requests.fetch_sub(1, std::memory_order_relaxed); }
+
+    std::unique_ptr<Handler> const handler;
+    size_t const max_pending_requests;
+    std::atomic<size_t> num_pending_requests{0};
+  };
+
+  ExecutorHandler(ExecutorHandler const&) = delete;
+  ExecutorHandler& operator=(ExecutorHandler const&) = delete;
+  ExecutorHandler(ExecutorHandler&&) = delete;
+  ExecutorHandler& operator=(ExecutorHandler&&) = delete;
+
+  std::shared_ptr<State> const state_;
+
+  // NOTE: the dedicated scheduler must be declared after the state so that it's destroyed (and its
+  // workers joined) first.
+  std::unique_ptr<tsdb2::common::Scheduler> const dedicated_scheduler_;
+  tsdb2::common::Scheduler* const scheduler_;
+};
+
+}  // namespace http
+}  // namespace tsdb2
+
+#endif  // __TSDB2_HTTP_EXECUTOR_HANDLER_H__
@@ -0,0 +1,160 @@
+#include "http/executor_handler.h"
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/notification.h"
+#include "common/scheduler.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "http/testing.h"
+
+namespace {
+
+using ::testing::_;
+using ::testing::ElementsAre;
+using ::testing::Optional;
+using ::testing::Pair;
+using ::testing::Return;
+using ::tsdb2::common::Scheduler;
+using ::tsdb2::http::ExecutorHandler;
+using ::tsdb2::http::Handler;
+using ::tsdb2::http::HandlerOptions;
+using ::tsdb2::http::HeadersView;
+using ::tsdb2::http::Method;
+using ::tsdb2::http::Request;
+using ::tsdb2::http::StreamInterface;
+using ::tsdb2::testing::http::MockHandler;
+using ::tsdb2::testing::http::MockStream;
+
+class ExecutorHandlerTest : public ::testing::Test {
+ protected:
+  Scheduler scheduler_{Scheduler::Options{.num_workers = 2, .start_now = true}};
+};
+
+TEST_F(ExecutorHandlerTest, InlineHandlerIsNotWrapped) {
+  auto handler = std::make_unique<MockHandler>();
+  Handler* const raw_handler = handler.get();
+  EXPECT_EQ(ExecutorHandler::Create(std::move(handler), HandlerOptions()).get(), raw_handler);
+}
+
+TEST_F(ExecutorHandlerTest, RunsInScheduler) {
+  auto handler = std::make_unique<MockHandler>();
+  auto* const mock_handler = handler.get();
+  ExecutorHandler executor_handler{std::move(handler), &scheduler_, /*max_pending_requests=*/10};
+  MockStream stream;
+  absl::Notification done;
+  {
+    ::testing::InSequence sequence;
+    EXPECT_CALL(stream, Ref());
+    EXPECT_CALL(*mock_handler, Run(&stream, _))
+        .WillOnce([](StreamInterface* /*stream*/, Request const& request) {
+          EXPECT_EQ(request.method, Method::kGet);
+          EXPECT_EQ(request.path, "/foo");
+          EXPECT_THAT(request.headers.Find("lorem"), Optional(std::string_view("ipsum")));
+          EXPECT_THAT(request.headers.Find("dolor"), Optional(std::string_view("amet")));
+        });
+    EXPECT_CALL(stream, Unref()).WillOnce([&] {
+      done.Notify();
+      return false;
+    });
+  }
+  {
+    std::string name1 = "lorem";
+    std::string value1 = "ipsum";
+    std::string name2 = "dolor";
+    std::string value2 = "amet";
+    HeadersView::Field const fields[] = {{name1, value1}, {name2, value2}};
+    Request request{Method::kGet, "/foo"};
+    request.headers = HeadersView(fields);
+    executor_handler(&stream, request);
+    // Overwrite the original header storage to make sure the handler doesn't see it.
+    name1 = value1 = name2 = value2 = "xxxxx";
+  }
+  done.WaitForNotification();
+  EXPECT_EQ(executor_handler.num_pending_requests(), 0);
+}
+
+TEST_F(ExecutorHandlerTest, RejectsWhenFull) {
+  auto handler = std::make_unique<MockHandler>();
+  auto* const mock_handler = handler.get();
+  ExecutorHandler executor_handler{std::move(handler), &scheduler_, /*max_pending_requests=*/1};
+  MockStream stream1;
+  MockStream stream2;
+  absl::Notification started;
+  absl::Notification proceed;
+  absl::Notification done;
+  EXPECT_CALL(stream1, Ref());
+  EXPECT_CALL(*mock_handler, Run(&stream1, _)).WillOnce([&] {
+    started.Notify();
+    proceed.WaitForNotification();
+  });
+  EXPECT_CALL(stream1, Unref()).WillOnce([&] {
+    done.Notify();
+    return false;
+  });
+  EXPECT_CALL(stream2, Ref()).Times(0);
+  EXPECT_CALL(*mock_handler, Run(&stream2, _)).Times(0);
+  EXPECT_CALL(stream2, SendFields(ElementsAre(Pair(":status", "503")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  Request const request{Method::kGet, "/foo"};
+  executor_handler(&stream1, request);
+  started.WaitForNotification();
+  EXPECT_EQ(executor_handler.num_pending_requests(), 1);
+  executor_handler(&stream2, request);
+  proceed.Notify();
+  done.WaitForNotification();
+}
+
+TEST_F(ExecutorHandlerTest, DestroyedWithPendingRequests) {
+  auto handler = std::make_unique<MockHandler>();
+  auto* const mock_handler = handler.get();
+  auto executor_handler = std::make_unique<ExecutorHandler>(std::move(handler), &scheduler_,
+                                                            /*max_pending_requests=*/10);
+  MockStream stream;
+  absl::Notification started;
+  absl::Notification proceed;
+  absl::Notification done;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(*mock_handler, Run(&stream, _)).WillOnce([&] {
+    started.Notify();
+    proceed.WaitForNotification();
+  });
+  EXPECT_CALL(stream, Unref()).WillOnce([&] {
+    done.Notify();
+    return false;
+  });
+  (*executor_handler)(&stream, Request{Method::kGet, "/foo"});
+  started.WaitForNotification();
+  executor_handler.reset();
+  proceed.Notify();
+  done.WaitForNotification();
+}
+
+TEST_F(ExecutorHandlerTest, DedicatedPool) {
+  auto handler = std::make_unique<MockHandler>();
+  auto* const mock_handler = handler.get();
+  auto const executor_handler = ExecutorHandler::Create(
+      std::move(handler), HandlerOptions{
+                              .executor = HandlerOptions::Executor::kDedicatedPool,
+                              .num_workers = 1,
+                          });
+  MockStream stream;
+  absl::Notification done;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(*mock_handler, Run(&stream, _));
+  EXPECT_CALL(stream, Unref()).WillOnce([&] {
+    done.Notify();
+    return false;
+  });
+  (*executor_handler)(&stream, Request{Method::kGet, "/foo"});
+  done.WaitForNotification();
+}
+
+}  // namespace
@@ -4,8 +4,10 @@
 
 #include "absl/log/log.h"
 #include "absl/status/status.h"
+#include "common/promise.h"
 #include "common/utilities.h"
 #include "http/hpack.h"
+#include "io/cord.h"
 #include "net/base_sockets.h"
 
 namespace tsdb2 {
@@ -18,6 +20,14 @@ void StreamInterface::SendFieldsOrLog(hpack::HeaderSet const& fields, bool const
   }
 }
 
+void StreamInterface::SendFieldsOrLog(hpack::PrecompiledHeaders const& precompiled,
+                                      hpack::HeaderSet const& fields, bool const end_stream) {
+  auto const status = SendFields(precompiled, fields, end_stream);
+  if (!status.ok()) {
+    LOG(ERROR) << status;
+  }
+}
+
 void StreamInterface::SendDataOrLog(tsdb2::net::Buffer buffer, bool const end_stream) {
   auto const status = SendData(std::move(buffer), end_stream);
   if (!status.ok()) {
@@ -25,12 +35,31 @@ void StreamInterface::SendDataOrLog(tsdb2::net::Buffer buffer, bool const end_st
   }
 }
 
+tsdb2::common::Promise<void> StreamInterface::StreamData(tsdb2::net::Buffer buffer,
+                                                        bool const end_stream) {
+  return tsdb2::common::Promise<void>([&](auto resolve) {
+    StreamData(std::move(buffer), end_stream, std::move(resolve));
+  });
+}
+
+void StreamInterface::StreamCord(tsdb2::io::Cord cord, bool const end_stream,
+                                 WriteCallback callback) {
+  StreamData(std::move(cord).Flatten(), end_stream, std::move(callback));
+}
+
 absl::Status StreamInterface::SendResponse(hpack::HeaderSet const& fields,
                                            tsdb2::net::Buffer data) {
   RETURN_IF_ERROR(SendFields(fields, /*end_stream=*/false));
   return SendData(std::move(data), /*end_stream=*/true);
 }
 
+absl::Status StreamInterface::SendResponse(hpack::PrecompiledHeaders const& precompiled,
+                                           hpack::HeaderSet const& fields,
+                                           tsdb2::net::Buffer data) {
+  RETURN_IF_ERROR(SendFields(precompiled, fields, /*end_stream=*/false));
+  return SendData(std::move(data), /*end_stream=*/true);
+}
+
 void StreamInterface::SendResponseOrLog(hpack::HeaderSet const& fields, tsdb2::net::Buffer data) {
   auto const status = SendResponse(fields, std::move(data));
   if (!status.ok()) {
@@ -38,5 +67,13 @@ void StreamInterface::SendResponseOrLog(hpack::HeaderSet const& fields, tsdb2::n
   }
 }
 
+void StreamInterface::SendResponseOrLog(hpack::PrecompiledHeaders const& precompiled,
+                                        hpack::HeaderSet const& fields, tsdb2::net::Buffer data) {
+  auto const status = SendResponse(precompiled, fields, std::move(data));
+  if (!status.ok()) {
+    LOG(ERROR) << status;
+  }
+}
+
 }  // namespace http
 }  // namespace tsdb2
@@ -1,12 +1,19 @@
 #ifndef __TSDB2_HTTP_HANDLERS_H__
 #define __TSDB2_HTTP_HANDLERS_H__
 
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+
 #include "absl/functional/any_invocable.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "common/promise.h"
 #include "http/hpack.h"
 #include "http/http.h"
 #include "io/cord.h"
+#include "io/fd.h"
 #include "net/base_sockets.h"
 
 namespace tsdb2 {
@@ -18,9 +25,17 @@ class StreamInterface {
   using DataCallback =
       absl::AnyInvocable<void(absl::StatusOr<tsdb2::io::Cord> status_or_data, bool end)>;
 
+  using WriteCallback = absl::AnyInvocable<void(absl::Status status)>;
+
   explicit StreamInterface() = default;
   virtual ~StreamInterface() = default;
 
+  // `Ref` and `Unref` make streams suitable for `reffed_ptr`. A handler that needs to respond
+  // asynchronously (i.e. after its `operator()` returns) must hold a reference to the stream, which
+  // keeps the underlying connection alive until the response has been sent.
+  virtual void Ref() = 0;
+  virtual bool Unref() = 0;
+
   // Reads the next chunk of data for the stream.
   //
   // If any data is already buffered in the stream the callback is invoked immediately, otherwise it
@@ -31,28 +46,99 @@ class StreamInterface {
   //
   // In case of error the callback will receive an error status, the end flag is meaningless, and
   // the stream is no longer usable.
+  //
+  // The flow-control window granted to the peer is replenished as the handler reads, so a handler
+  // that reads one chunk at a time (issuing the next `ReadData` only after processing the previous
+  // chunk) never has more than about one window worth of request data buffered in memory.
   virtual void ReadData(DataCallback callback) = 0;
 
   // Sends a HEADERS frames, possibly followed by one or more CONTINUATION frames, and optionally
   // closes the local end of the stream.
   virtual absl::Status SendFields(hpack::HeaderSet const& fields, bool end_stream) = 0;
 
+  // Like the above, but the field block starts with the provided precompiled fields. Handlers that
+  // send the same fields on every response (e.g. `:status` and `content-type`) can precompile them
+  // once and skip most of the HPACK encoding work.
+  virtual absl::Status SendFields(hpack::PrecompiledHeaders const& precompiled,
+                                  hpack::HeaderSet const& fields, bool end_stream) = 0;
+
   // Like `SendFields` but logs any errors and returns void.
   void SendFieldsOrLog(hpack::HeaderSet const& fields, bool end_stream);
 
+  // Like `SendFields` but logs any errors and returns void.
+  void SendFieldsOrLog(hpack::PrecompiledHeaders const& precompiled,
+                       hpack::HeaderSet const& fields, bool end_stream);
+
   // Sends one or more DATA frames performing the necessary splitting automatically and optionally
   // closes the local end of the stream.
+  //
+  // The data is subject to HTTP/2 flow control: it's buffered in the stream until the peer grants
+  // enough window, so this method returns as soon as the data is enqueued. Use `StreamData` to find
+  // out when the data has actually been sent.
   virtual absl::Status SendData(tsdb2::net::Buffer buffer, bool end_stream) = 0;
 
+  // Like `SendData`, but `callback` is invoked once all of `buffer` has been handed to the socket,
+  // i.e. after the peer has granted enough flow-control window for it and all previously enqueued
+  // frames have been written. The callback receives an error status if the data can't be sent,
+  // e.g. because the stream was reset or the connection dropped.
+  //
+  // Handlers producing large responses should send them in chunks, issuing each chunk only after
+  // the previous one has completed. That way memory usage is bounded by the chunk size and the
+  // handler proceeds at the speed of the network and of the peer.
+  //
+  // The callback may run in an I/O thread, so it must not block. It may issue the next chunk.
+  virtual void StreamData(tsdb2::net::Buffer buffer, bool end_stream, WriteCallback callback) = 0;
+
+  // Like the above, but returns a promise that's resolved when the data has been sent.
+  tsdb2::common::Promise<void> StreamData(tsdb2::net::Buffer buffer, bool end_stream);
+
+  // Like `StreamData`, but sends `length` bytes of the file `fd` starting at `offset`. The content
+  // is not buffered in memory: on plaintext connections it goes from the file to the socket with
+  // `sendfile`, while TLS connections read it one frame at a time. Because of that the whole range
+  // can be sent with a single call regardless of its size.
+  //
+  // The stream takes ownership of `fd` and closes it once all the data has been sent or dropped.
+  // The file offset of `fd` is neither used nor changed.
+  //
+  // If the file is truncated while it's being sent the connection is dropped, because the peer
+  // has already been told the length of the DATA frames.
+  virtual void StreamFile(tsdb2::io::FD fd, off_t offset, size_t length, bool end_stream,
+                          WriteCallback callback) = 0;
+
+  // Like `StreamData`, but the data is a cord. The DATA frames reference the chunks of the cord
+  // rather than copying them into a contiguous buffer, so the cord is kept alive until all of them
+  // have been written or dropped.
+  //
+  // The default implementation flattens the cord and calls `StreamData`.
+  virtual void StreamCord(tsdb2::io::Cord cord, bool end_stream, WriteCallback callback);
+
+  // Registers a callback to be invoked once the frame closing the local end of the stream has been
+  // handed to the socket, regardless of which of the above methods closes it. The callback receives
+  // an error status if that never happens, e.g. because the stream was reset or the connection
+  // dropped. Used by handler wrappers to measure how long it takes to deliver a response.
+  //
+  // Multiple callbacks may be registered, but only before closing the local end of the stream.
+  // Like `WriteCallback`s, they may run in an I/O thread and must not block.
+  virtual void OnEndStreamSent(WriteCallback callback) = 0;
+
   // Like `SendData` but logs any errors and returns void.
   void SendDataOrLog(tsdb2::net::Buffer buffer, bool end_stream);
 
   // Sends HEADERS and DATA frames and closes the local end of the stream.
   absl::Status SendResponse(hpack::HeaderSet const& fields, tsdb2::net::Buffer data);
 
+  // Sends HEADERS and DATA frames and closes the local end of the stream. The field block starts
+  // with the provided precompiled fields.
+  absl::Status SendResponse(hpack::PrecompiledHeaders const& precompiled,
+                            hpack::HeaderSet const& fields, tsdb2::net::Buffer data);
+
   // Like `SendResponse` but logs any errors and returns void.
   void SendResponseOrLog(hpack::HeaderSet const& fields, tsdb2::net::Buffer data);
 
+  // Like `SendResponse` but logs any errors and returns void.
+  void SendResponseOrLog(hpack::PrecompiledHeaders const& precompiled,
+                         hpack::HeaderSet const& fields, tsdb2::net::Buffer data);
+
  private:
   StreamInterface(StreamInterface const&) = delete;
   StreamInterface& operator=(StreamInterface const&) = delete;
@@ -60,6 +146,50 @@ class StreamInterface {
   StreamInterface& operator=(StreamInterface&&) = delete;
 };
 
+// A response received by a client-side channel.
+struct Response {
+  // The value of the `:status` pseudo-header.
+  uint16_t status = 0;
+
+  // The response fields, excluding pseudo-headers. Trailers, if any, are appended at the end.
+  hpack::HeaderSet headers;
+
+  // The response body.
+  tsdb2::io::Cord body;
+};
+
+using ResponseCallback = absl::AnyInvocable<void(absl::StatusOr<Response>)>;
+
+// Receives the DATA of a streaming response as soon as it arrives, along with the response status.
+// The data delivered this way is not added to `Response::body`.
+using ResponseDataCallback = absl::AnyInvocable<void(uint16_t status, tsdb2::net::Buffer data)>;
+
+// Specifies how a handler is run.
+struct HandlerOptions {
+  enum class Executor {
+    // The handler runs in the I/O worker thread that decoded the request. Suitable for trivial
+    // handlers that never block.
+    kInline = 0,
+
+    // The handler runs in a pool of worker threads shared by all handlers registered with this
+    // executor. The size of the pool is specified by the `--num_http_handler_workers` flag.
+    kSharedPool = 1,
+
+    // The handler runs in its own pool of `num_workers` threads.
+    kDedicatedPool = 2,
+  };
+
+  Executor executor = Executor::kInline;
+
+  // Number of worker threads of the dedicated pool. Ignored by the other executors.
+  uint16_t num_workers = 2;
+
+  // Maximum number of requests that can be queued or running at any given time for this handler.
+  // Further requests are rejected with status 503 until some complete. Ignored by the inline
+  // executor.
+  size_t max_pending_requests = 1000;
+};
+
 // Abstract interface of an HTTP/2 request handler.
 class Handler {
  public:
@@ -6,11 +6,13 @@
 #include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include "absl/flags/flag.h"
 #include "absl/log/check.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/types/span.h"
 #include "common/flat_map.h"
@@ -18,7 +20,6 @@
 #include "http/http.h"
 #include "http/huffman.h"
 #include "io/buffer.h"
-#include "io/cord.h"
 
 namespace tsdb2 {
 namespace http {
@@ -27,7 +28,6 @@ namespace hpack {
 namespace {
 
 using ::tsdb2::io::Buffer;
-using ::tsdb2::io::Cord;
 
 // See https://httpwg.org/specs/rfc7541.html#static.table.definition for the static header table
 // definition.
@@ -107,6 +107,28 @@ constexpr auto IndexStaticHeaders(std::index_sequence<Is...> /*index_sequence*/)
 auto constexpr kIndexedStaticHeaders =
     IndexStaticHeaders(std::make_index_sequence<kNumStaticHeaders>());
 
+// Searches the specified header in the static header table, returning its 1-based index if found
+// or 0 otherwise.
+size_t FindStaticHeader(Header const &header) {
+  auto const it = kIndexedStaticHeaders.find(header);
+  if (it != kIndexedStaticHeaders.end()) {
+    return it->second + 1;
+  } else {
+    return 0;
+  }
+}
+
+// Searches the static header table for a header with the specified name, returning its 1-based
+// index if found or 0 otherwise.
+size_t FindStaticHeaderName(std::string_view const name) {
+  auto const it = kIndexedStaticHeaders.lower_bound(std::make_pair(name, std::string_view()));
+  if (it != kIndexedStaticHeaders.end() && it->first.first == name) {
+    return it->second + 1;
+  } else {
+    return 0;
+  }
+}
+
 }  // namespace
 
 void DynamicHeaderTable::SetMaxSize(size_t const new_size) {
@@ -154,7 +176,32 @@ Decoder::Decoder()
     : max_dynamic_header_table_size_(absl::GetFlag(FLAGS_http2_max_dynamic_header_table_size)) {}
 
 absl::StatusOr<HeaderSet> Decoder::Decode(absl::Span<uint8_t const> const data) {
+  std::vector<char> arena;
+  std::vector<HeaderRef> refs;
+  RETURN_IF_ERROR(DecodeRefs(data, &arena, &refs));
   HeaderSet headers;
+  headers.reserve(refs.size());
+  for (auto const &[name, value] : refs) {
+    headers.emplace_back(name.Resolve(arena), value.Resolve(arena));
+  }
+  return headers;
+}
+
+absl::StatusOr<DecodedHeaders> Decoder::DecodeFieldBlock(Buffer field_block) {
+  DecodedHeaders headers;
+  headers.field_block_ = std::make_unique<Buffer>(std::move(field_block));
+  std::vector<HeaderRef> refs;
+  RETURN_IF_ERROR(DecodeRefs(headers.field_block_->span(), &headers.arena_, &refs));
+  headers.fields_.reserve(refs.size());
+  for (auto const &[name, value] : refs) {
+    headers.fields_.emplace_back(name.Resolve(headers.arena_), value.Resolve(headers.arena_));
+  }
+  return headers;
+}
+
+absl::Status Decoder::DecodeRefs(absl::Span<uint8_t const> const data,
+                                 std::vector<char> *const arena,
+                                 std::vector<HeaderRef> *const headers) {
   size_t offset = 0;
   while (offset < data.size()) {
     auto const first_byte = data[offset];
@@ -164,21 +211,20 @@ absl::StatusOr<HeaderSet> Decoder::Decode(absl::Span<uint8_t const> const data)
         return absl::InvalidArgumentError(
             "invalid HPACK encoding: indices must be greater than zero");
       }
-      DEFINE_VAR_OR_RETURN(header, GetHeader(index - 1));
-      headers.emplace_back(std::move(header));
+      DEFINE_CONST_OR_RETURN(header, GetHeader(index - 1, arena));
+      headers->emplace_back(header);
     } else if ((first_byte & 0x40) != 0) {
       DEFINE_CONST_OR_RETURN(index, DecodeInteger(data, offset, 6));
+      StringRef name;
       if (index > 0) {
-        DEFINE_VAR_OR_RETURN(name, GetHeaderName(index - 1));
-        DEFINE_VAR_OR_RETURN(value, DecodeString(data, offset));
-        dynamic_headers_.Add(std::make_pair(name, value));
-        headers.emplace_back(std::move(name), std::move(value));
+        ASSIGN_OR_RETURN(name, GetHeaderName(index - 1, arena));
       } else {
-        DEFINE_VAR_OR_RETURN(name, DecodeString(data, offset));
-        DEFINE_VAR_OR_RETURN(value, DecodeString(data, offset));
-        dynamic_headers_.Add(std::make_pair(name, value));
-        headers.emplace_back(std::move(name), std::move(value));
+        ASSIGN_OR_RETURN(name, DecodeString(data, offset, arena));
       }
+      DEFINE_CONST_OR_RETURN(value, DecodeString(data, offset, arena));
+      dynamic_headers_.Add(
+          std::make_pair(std::string(name.Resolve(*arena)), std::string(value.Resolve(*arena))));
+      headers->emplace_back(name, value);
     } else if ((first_byte & 0x20) != 0) {
       DEFINE_CONST_OR_RETURN(new_size, DecodeInteger(data, offset, 5));
       if (new_size > max_dynamic_header_table_size_) {
@@ -188,31 +234,21 @@ absl::StatusOr<HeaderSet> Decoder::Decode(absl::Span<uint8_t const> const data)
                          max_dynamic_header_table_size_, ")"));
       }
       dynamic_headers_.SetMaxSize(new_size);
-    } else if ((first_byte & 0x10) != 0) {
-      DEFINE_CONST_OR_RETURN(index, DecodeInteger(data, offset, 4));
-      if (index > 0) {
-        DEFINE_VAR_OR_RETURN(name, GetHeaderName(index - 1));
-        DEFINE_VAR_OR_RETURN(value, DecodeString(data, offset));
-        headers.emplace_back(std::move(name), std::move(value));
-      } else {
-        DEFINE_VAR_OR_RETURN(name, DecodeString(data, offset));
-        DEFINE_VAR_OR_RETURN(value, DecodeString(data, offset));
-        headers.emplace_back(std::move(name), std::move(value));
-      }
     } else {
+      // Literal header field without indexing or never indexed. The two representations only
+      // differ in how intermediaries must re-encode them, so we decode them the same way.
       DEFINE_CONST_OR_RETURN(index, DecodeInteger(data, offset, 4));
+      StringRef name;
       if (index > 0) {
-        DEFINE_VAR_OR_RETURN(name, GetHeaderName(index - 1));
-        DEFINE_VAR_OR_RETURN(value, DecodeString(data, offset));
-        headers.emplace_back(std::move(name), std::move(value));
+        ASSIGN_OR_RETURN(name, GetHeaderName(index - 1, arena));
       } else {
-        DEFINE_VAR_OR_RETURN(name, DecodeString(data, offset));
-        DEFINE_VAR_OR_RETURN(value, DecodeString(data, offset));
-        headers.emplace_back(std::move(name), std::move(value));
+        ASSIGN_OR_RETURN(name, DecodeString(data, offset, arena));
       }
+      DEFINE_CONST_OR_RETURN(value, DecodeString(data, offset, arena));
+      headers->emplace_back(name, value);
     }
   }
-  return headers;
+  return absl::OkStatus();
 }
 
 absl::Status Decoder::IntegerDecodingError(std::string_view const message) {
@@ -249,8 +285,9 @@ absl::StatusOr<size_t> Decoder::DecodeInteger(absl::Span<uint8_t const> const da
   return value;
 }
 
-absl::StatusOr<std::string> Decoder::DecodeString(absl::Span<uint8_t const> const data,
-                                                  size_t &offset) {
+absl::StatusOr<Decoder::StringRef> Decoder::DecodeString(absl::Span<uint8_t const> const data,
+                                                        size_t &offset,
+                                                        std::vector<char> *const arena) {
   if (offset >= data.size()) {
     return StringDecodingError("reached end of input");
   }
@@ -262,98 +299,153 @@ absl::StatusOr<std::string> Decoder::DecodeString(absl::Span<uint8_t const> cons
   auto const subspan = data.subspan(offset, length);
   offset += length;
   if (use_huffman) {
-    return HuffmanCode::Decode(subspan);
+    size_t const arena_offset = arena->size();
+    arena->resize(arena_offset + HuffmanCode::GetMaxDecodedLength(length));
+    size_t const decoded_length = HuffmanCode::Decode(subspan, arena->data() + arena_offset);
+    arena->resize(arena_offset + decoded_length);
+    return StringRef{nullptr, arena_offset, decoded_length};
   } else {
-    return std::string{subspan.begin(), subspan.end()};
+    return StringRef::Stable(
+        std::string_view(reinterpret_cast<char const *>(subspan.data()), subspan.size()));
   }
 }
 
-absl::StatusOr<Header> Decoder::GetHeader(size_t const index) const {
+Decoder::StringRef Decoder::CopyToArena(std::string_view const string,
+                                        std::vector<char> *const arena) {
+  size_t const offset = arena->size();
+  arena->insert(arena->end(), string.begin(), string.end());
+  return StringRef{nullptr, offset, string.size()};
+}
+
+absl::StatusOr<Decoder::HeaderRef> Decoder::GetHeader(size_t const index,
+                                                      std::vector<char> *const arena) const {
   if (index < kNumStaticHeaders) {
     auto const &header = kStaticHeaders[index];
-    return Header(header[0], header[1]);
-  } else if (index - kNumStaticHeaders < dynamic_headers_.size()) {
-    return dynamic_headers_[index - kNumStaticHeaders];
+    return std::make_pair(StringRef::Stable(header[0]), StringRef::Stable(header[1]));
+  } else if (index - kNumStaticHeaders < dynamic_headers_.num_headers()) {
+    auto const &[name, value] = dynamic_headers_[index - kNumStaticHeaders];
+    return std::make_pair(CopyToArena(name, arena), CopyToArena(value, arena));
   } else {
     return absl::InvalidArgumentError("invalid header index");
   }
 }
 
-absl::StatusOr<std::string> Decoder::GetHeaderName(size_t const index) const {
+absl::StatusOr<Decoder::StringRef> Decoder::GetHeaderName(size_t const index,
+                                                          std::vector<char> *const arena) const {
   if (index < kNumStaticHeaders) {
-    return std::string(kStaticHeaders[index][0]);
-  } else if (index - kNumStaticHeaders < dynamic_headers_.size()) {
-    return dynamic_headers_[index - kNumStaticHeaders].first;
+    return StringRef::Stable(kStaticHeaders[index][0]);
+  } else if (index - kNumStaticHeaders < dynamic_headers_.num_headers()) {
+    return CopyToArena(dynamic_headers_[index - kNumStaticHeaders].first, arena);
   } else {
     return absl::InvalidArgumentError("invalid header index");
   }
 }
 
-Buffer Encoder::Encode(HeaderSet const &headers) {
-  Cord cord;
+HeaderSet DecodedHeaders::ToHeaderSet() const {
+  HeaderSet headers;
+  headers.reserve(fields_.size());
+  for (auto const &[name, value] : fields_) {
+    headers.emplace_back(name, value);
+  }
+  return headers;
+}
+
+PrecompiledHeaders Encoder::Precompile(HeaderSet const &headers) {
+  Buffer output;
+  output.set_growable(true);
+  uint32_t status = 0;
   for (auto const &header : headers) {
-    auto index = FindHeader(header);
+    if (header.first == kStatusHeaderName && status == 0 &&
+        (!absl::SimpleAtoi(header.second, &status) || status > 999)) {
+      status = 0;
+    }
+    auto index = FindStaticHeader(header);
     if (index > 0) {
-      auto buffer = EncodeInteger(index, 7);
-      buffer.at<uint8_t>(0) |= 0x80;
-      cord.Append(std::move(buffer));
+      EncodeInteger(index, /*prefix_bits=*/7, /*flags=*/0x80, &output);
       continue;
     }
-    index = FindHeaderName(header.first);
-    if (index > 0) {
-      auto buffer = EncodeInteger(index, 7);
-      buffer.at<uint8_t>(0) |= 0x40;
-      cord.Append(std::move(buffer));
-    } else {
-      uint8_t const code = 0x40;
-      cord.Append(Buffer(&code, 1));
-      cord.Append(EncodeString(header.first));
+    // Literal header field without indexing, see
+    // https://httpwg.org/specs/rfc7541.html#literal.header.without.indexing.
+    index = FindStaticHeaderName(header.first);
+    EncodeInteger(index, /*prefix_bits=*/4, /*flags=*/0x00, &output);
+    if (index < 1) {
+      EncodeString(header.first, &output);
     }
-    cord.Append(EncodeString(header.second));
-    dynamic_headers_.Add(header);
+    EncodeString(header.second, &output);
   }
-  return std::move(cord).Flatten();
+  output.set_growable(false);
+  return PrecompiledHeaders(std::move(output), status);
+}
+
+Buffer Encoder::Encode(HeaderSet const &headers) {
+  Buffer output;
+  output.set_growable(true);
+  EncodeHeaders(headers, &output);
+  output.set_growable(false);
+  return output;
 }
 
-Buffer Encoder::EncodeInteger(size_t value, size_t const prefix_bits) {
+Buffer Encoder::Encode(PrecompiledHeaders const &precompiled, HeaderSet const &headers) {
+  auto const prefix = precompiled.bytes();
+  Buffer output{prefix};
+  output.set_growable(true);
+  EncodeHeaders(headers, &output);
+  output.set_growable(false);
+  return output;
+}
+
+void Encoder::EncodeInteger(size_t value, size_t const prefix_bits, uint8_t const flags,
+                            Buffer *const output) {
   CHECK_GT(prefix_bits, 0);
   CHECK_LE(prefix_bits, 8);
   uint8_t const mask = (1 << prefix_bits) - 1;
   if (value < mask) {
-    uint8_t const byte = value;
-    return Buffer(&byte, 1);
+    output->Append<uint8_t>(flags | value);
+    return;
   }
-  static size_t constexpr kMaxEncodedSize = 11;
-  Buffer buffer{kMaxEncodedSize};
-  buffer.Append<uint8_t>(mask);
+  output->Append<uint8_t>(flags | mask);
   value -= mask;
   while (value > 0x7F) {
-    buffer.Append<uint8_t>(0x80 + (value & 0x7F));
+    output->Append<uint8_t>(0x80 | (value & 0x7F));
     value >>= 7;
   }
-  return buffer;
+  output->Append<uint8_t>(value);
 }
 
-Cord Encoder::EncodeString(std::string_view const string) {
-  Cord cord;
+void Encoder::EncodeString(std::string_view const string, Buffer *const output) {
   if (HuffmanCode::GetEncodedLength(string) < string.size()) {
-    auto buffer = HuffmanCode::Encode(string);
-    cord.Append(EncodeInteger(buffer.size(), /*prefix_bits=*/7));
-    cord[0] |= 0x80;
-    cord.Append(std::move(buffer));
+    auto const buffer = HuffmanCode::Encode(string);
+    EncodeInteger(buffer.size(), /*prefix_bits=*/7, /*flags=*/0x80, output);
+    output->Append(buffer);
   } else {
-    cord.Append(EncodeInteger(string.size(), /*prefix_bits=*/7));
-    Buffer buffer{string.size()};
-    buffer.MemCpy(string.data(), string.size());
-    cord.Append(std::move(buffer));
+    EncodeInteger(string.size(), /*prefix_bits=*/7, /*flags=*/0x00, output);
+    output->MemCpy(string.data(), string.size());
+  }
+}
+
+void Encoder::EncodeHeaders(HeaderSet const &headers, Buffer *const output) {
+  for (auto const &header : headers) {
+    auto index = FindHeader(header);
+    if (index > 0) {
+      EncodeInteger(index, /*prefix_bits=*/7, /*flags=*/0x80, output);
+      continue;
+    }
+    index = FindHeaderName(header.first);
+    if (index > 0) {
+      EncodeInteger(index, /*prefix_bits=*/6, /*flags=*/0x40, output);
+    } else {
+      output->Append<uint8_t>(0x40);
+      EncodeString(header.first, output);
+    }
+    EncodeString(header.second, output);
+    dynamic_headers_.Add(header);
   }
-  return cord;
 }
 
 size_t Encoder::FindHeader(Header const &header) {
-  auto const it = kIndexedStaticHeaders.find(header);
-  if (it != kIndexedStaticHeaders.end()) {
-    return it->second + 1;
+  auto const static_index = FindStaticHeader(header);
+  if (static_index > 0) {
+    return static_index;
   }
   auto const index = dynamic_headers_.FindHeader(header);
   if (index < 0) {
@@ -363,9 +455,9 @@ size_t Encoder::FindHeader(Header const &header) {
 }
 
 size_t Encoder::FindHeaderName(std::string_view const name) {
-  auto const it = kIndexedStaticHeaders.lower_bound(Header(name, ""));
-  if (it != kIndexedStaticHeaders.end() && it->first.first == name) {
-    return it->second + 1;
+  auto const static_index = FindStaticHeaderName(name);
+  if (static_index > 0) {
+    return static_index;
   }
   auto const index = dynamic_headers_.FindHeaderName(name);
   if (index < 0) {
@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <deque>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -14,7 +15,6 @@
 #include "absl/types/span.h"
 #include "http/http.h"
 #include "io/buffer.h"
-#include "io/cord.h"
 
 namespace tsdb2 {
 namespace http {
@@ -91,6 +91,55 @@ class DynamicHeaderTable final {
   std::deque<Header> headers_;
 };
 
+// A decoded field block whose names and values are string views rather than strings.
+//
+// Names and values that occur verbatim in the encoded block reference the block itself, which is
+// owned by this object. Names and values from the static table reference constant storage. Only
+// Huffman-encoded literals and dynamic table entries (which may be evicted while decoding the same
+// block) are copied, and they all go to a single arena. That way decoding a field block takes a
+// constant number of allocations regardless of the number of fields.
+//
+// The views remain valid when the object is moved.
+class DecodedHeaders final {
+ public:
+  using Field = HeadersView::Field;
+  using value_type = Field;
+  using const_iterator = std::vector<Field>::const_iterator;
+
+  explicit DecodedHeaders() = default;
+  ~DecodedHeaders() = default;
+
+  DecodedHeaders(DecodedHeaders &&) noexcept = default;
+  DecodedHeaders &operator=(DecodedHeaders &&) noexcept = default;
+
+  bool empty() const { return fields_.empty(); }
+  size_t size() const { return fields_.size(); }
+
+  const_iterator begin() const { return fields_.begin(); }
+  const_iterator end() const { return fields_.end(); }
+
+  Field const &operator[](size_t const index) const { return fields_[index]; }
+
+  // Returns a read-only view of the fields, e.g. for `Request::headers`. The view is valid as long
+  // as this object.
+  HeadersView view() const { return HeadersView(fields_); }
+
+  // Copies the fields to a `HeaderSet`.
+  HeaderSet ToHeaderSet() const;
+
+ private:
+  friend class Decoder;
+
+  DecodedHeaders(DecodedHeaders const &) = delete;
+  DecodedHeaders &operator=(DecodedHeaders const &) = delete;
+
+  // NOTE: the block is kept on the heap because small `Buffer`s store their bytes inline and would
+  // move them around, invalidating the views.
+  std::unique_ptr<tsdb2::io::Buffer> field_block_;
+  std::vector<char> arena_;
+  std::vector<Field> fields_;
+};
+
 // An HPACK decoder.
 //
 // This class is not thread-safe, only thread-friendly.
@@ -119,23 +168,60 @@ class Decoder final {
 
   absl::StatusOr<HeaderSet> Decode(absl::Span<uint8_t const> data);
 
+  // Like `Decode` but takes ownership of the field block and avoids copying names and values
+  // whenever possible. See `DecodedHeaders` for details.
+  absl::StatusOr<DecodedHeaders> DecodeFieldBlock(tsdb2::io::Buffer field_block);
+
  private:
+  // References a decoded name or value.
+  //
+  // Strings in stable storage (the static table or the field block) are referenced by pointer.
+  // Strings copied to the arena are referenced by offset because the arena may be reallocated
+  // while decoding; in that case `data` is null.
+  struct StringRef {
+    char const *data = nullptr;
+    size_t offset = 0;
+    size_t length = 0;
+
+    static StringRef Stable(std::string_view const string) {
+      return StringRef{string.data(), 0, string.size()};
+    }
+
+    std::string_view Resolve(std::vector<char> const &arena) const {
+      if (data != nullptr) {
+        return {data, length};
+      } else {
+        return {arena.data() + offset, length};
+      }
+    }
+  };
+
+  using HeaderRef = std::pair<StringRef, StringRef>;
+
   static absl::Status IntegerDecodingError(std::string_view message);
   static absl::Status StringDecodingError(std::string_view message);
 
   static absl::StatusOr<size_t> DecodeInteger(absl::Span<uint8_t const> data, size_t &offset,
                                               size_t prefix_bits);
 
-  static absl::StatusOr<std::string> DecodeString(absl::Span<uint8_t const> data, size_t &offset);
+  static absl::StatusOr<StringRef> DecodeString(absl::Span<uint8_t const> data, size_t &offset,
+                                                std::vector<char> *arena);
+
+  static StringRef CopyToArena(std::string_view string, std::vector<char> *arena);
+
+  // Decodes the field block in `data`, appending the fields to `headers`. Strings that can't be
+  // referenced in place are copied to `arena`.
+  absl::Status DecodeRefs(absl::Span<uint8_t const> data, std::vector<char> *arena,
+                          std::vector<HeaderRef> *headers);
 
   // Returns the i-th header from the unified address space of the static and dynamic tables.
   // `index` is zero based. If `index` is greater than the last available index, an error status is
-  // returned.
-  absl::StatusOr<Header> GetHeader(size_t index) const;
+  // returned. Dynamic table entries are copied to the `arena`.
+  absl::StatusOr<HeaderRef> GetHeader(size_t index, std::vector<char> *arena) const;
 
   // Like `GetHeader`, but returns the header name only. Used when parsing literal header fields
   // with incremental indexing.
-  absl::StatusOr<std::string> GetHeaderName(size_t index) const;
+  absl::StatusOr<StringRef> GetHeaderName(size_t index, std::vector<char> *arena) const;
 
   // The maximum size of the `dynamic_headers_` table calculated in octets as per
   // https://httpwg.org/specs/rfc7541.html#calculating.table.size).
@@ -144,6 +230,49 @@ class Decoder final {
   DynamicHeaderTable dynamic_headers_{max_dynamic_header_table_size_};
 };
 
+// A pre-encoded set of header fields that many field blocks have in common, e.g. `:status: 200`
+// and `content-type: text/plain` in the responses of a given handler. Use
+// `Encoder::Precompile` to create one.
+//
+// The fields are encoded only with representations that don't interact with the dynamic header
+// table (indexed static table entries and literals without indexing), so the resulting bytes are
+// valid regardless of the state of the encoder and can be spliced at the beginning of any field
+// block of any connection. That allows encoding such fields only once, e.g. at handler
+// construction time, rather than once per response.
+//
+// This class is immutable and therefore thread-safe.
+class PrecompiledHeaders final {
+ public:
+  ~PrecompiledHeaders() = default;
+
+  PrecompiledHeaders(PrecompiledHeaders &&) noexcept = default;
+  PrecompiledHeaders &operator=(PrecompiledHeaders &&) noexcept = default;
+
+  // Returns the encoded fields.
+  absl::Span<uint8_t const> bytes() const { return encoded_.span(); }
+
+  // Returns the value of the `:status` pseudo-header if it was among the precompiled fields, or 0
+  // otherwise. Handler wrappers use this to find out the status of responses sent with precompiled
+  // fields without decoding them.
+  uint16_t status() const { return status_; }
+
+  // Returns a deep copy of this object. Precompiled fields are stateless, so the copy can be used
+  // with any encoder.
+  PrecompiledHeaders Clone() const { return PrecompiledHeaders(encoded_.Clone(), status_); }
+
+ private:
+  friend class Encoder;
+
+  explicit PrecompiledHeaders(tsdb2::io::Buffer encoded, uint16_t const status)
+      : encoded_(std::move(encoded)), status_(status) {}
+
+  PrecompiledHeaders(PrecompiledHeaders const &) = delete;
+  PrecompiledHeaders &operator=(PrecompiledHeaders const &) = delete;
+
+  tsdb2::io::Buffer encoded_;
+  uint16_t status_;
+};
+
 // An HPACK encoder.
 //
 // This class is not thread-safe, only thread-friendly.
@@ -169,11 +298,30 @@ class Encoder final {
     }
   }
 
+  // Pre-encodes the provided `headers` so that they can be reused in any number of field blocks.
+  // See `PrecompiledHeaders` for more information.
+  static PrecompiledHeaders Precompile(HeaderSet const &headers);
+
   tsdb2::io::Buffer Encode(HeaderSet const &headers);
 
+  // Encodes a field block consisting of the `precompiled` fields followed by `headers`. The
+  // precompiled part is copied verbatim, so only `headers` are actually encoded and affect the
+  // state of the dynamic header table.
+  tsdb2::io::Buffer Encode(PrecompiledHeaders const &precompiled, HeaderSet const &headers);
+
  private:
-  static tsdb2::io::Buffer EncodeInteger(size_t value, size_t prefix_bits);
-  static tsdb2::io::Cord EncodeString(std::string_view string);
+  // Encodes `value` as per https://httpwg.org/specs/rfc7541.html#integer.representation and
+  // appends it to `output`. `flags` are OR'ed into the bits of the first byte that are not part of
+  // the prefix.
+  static void EncodeInteger(size_t value, size_t prefix_bits, uint8_t flags,
+                            tsdb2::io::Buffer *output);
+
+  // Encodes the provided string literal, appending it to `output`. Huffman encoding is used if it
+  // makes the string shorter.
+  static void EncodeString(std::string_view string, tsdb2::io::Buffer *output);
+
+  // Encodes `headers` and appends them to `output`, which must be growable.
+  void EncodeHeaders(HeaderSet const &headers, tsdb2::io::Buffer *output);
 
   // Searches the specified header in the static and dynamic header tables, returning its index if
   // found. Indices start from 1, so they're ready to be encoded as per the HPACK specs. 0 is
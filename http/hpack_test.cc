@@ -1,23 +1,35 @@
 #include "http/hpack.h"
 
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "absl/status/status_matchers.h"
 #include "common/testing.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "io/buffer.h"
 #include "io/buffer_testing.h"
 
 namespace {
 
 using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
 using ::testing::AnyOf;
+using ::testing::ElementsAre;
 using ::testing::ElementsAreArray;
+using ::testing::Optional;
 using ::testing::Pair;
 using ::testing::UnorderedElementsAreArray;
+using ::tsdb2::http::hpack::DecodedHeaders;
 using ::tsdb2::http::hpack::Decoder;
 using ::tsdb2::http::hpack::DynamicHeaderTable;
 using ::tsdb2::http::hpack::Encoder;
 using ::tsdb2::http::hpack::Header;
 using ::tsdb2::http::hpack::HeaderSet;
+using ::tsdb2::http::hpack::PrecompiledHeaders;
+using ::tsdb2::io::Buffer;
 using ::tsdb2::testing::io::BufferAsBytes;
 
 TEST(DynamicHeaderTableTest, InitialState) {
@@ -398,6 +410,69 @@ TEST_F(DecoderTest, ResponsesWithHuffman) {
       })));
 }
 
+TEST_F(DecoderTest, DecodeFieldBlock) {
+  std::vector<uint8_t> const bytes1{
+      0x82, 0x86, 0x84, 0x41, 0x8C, 0xF1, 0xE3, 0xC2, 0xE5, 0xF2,
+      0x3A, 0x6B, 0xA0, 0xAB, 0x90, 0xF4, 0xFF,
+  };
+  auto status_or_headers1 = decoder_.DecodeFieldBlock(Buffer(absl::Span<uint8_t const>(bytes1)));
+  ASSERT_OK(status_or_headers1);
+  auto const headers1 = std::move(status_or_headers1).value();
+  EXPECT_THAT(headers1, ElementsAre(Pair(":method", "GET"), Pair(":scheme", "http"),
+                                    Pair(":path", "/"), Pair(":authority", "www.example.com")));
+  std::vector<uint8_t> const bytes2{
+      0x82, 0x86, 0x84, 0xBE, 0x58, 0x08, 0x6E, 0x6F, 0x2D, 0x63, 0x61, 0x63, 0x68, 0x65,
+  };
+  EXPECT_THAT(decoder_.DecodeFieldBlock(Buffer(absl::Span<uint8_t const>(bytes2))),
+              IsOkAndHolds(ElementsAre(Pair(":method", "GET"), Pair(":scheme", "http"),
+                                       Pair(":path", "/"), Pair(":authority", "www.example.com"),
+                                       Pair("cache-control", "no-cache"))));
+}
+
+TEST_F(DecoderTest, DecodedHeadersSurviveMove) {
+  std::vector<uint8_t> const bytes{
+      0x82, 0x87, 0x85, 0x41, 0x8C, 0xF1, 0xE3, 0xC2, 0xE5, 0xF2, 0x3A, 0x6B, 0xA0, 0xAB, 0x90,
+      0xF4, 0xFF, 0x40, 0x0A, 0x63, 0x75, 0x73, 0x74, 0x6F, 0x6D, 0x2D, 0x6B, 0x65, 0x79, 0x0C,
+      0x63, 0x75, 0x73, 0x74, 0x6F, 0x6D, 0x2D, 0x76, 0x61, 0x6C, 0x75, 0x65, 0xBE,
+  };
+  auto status_or_headers = decoder_.DecodeFieldBlock(Buffer(absl::Span<uint8_t const>(bytes)));
+  ASSERT_OK(status_or_headers);
+  DecodedHeaders headers1 = std::move(status_or_headers).value();
+  DecodedHeaders headers2 = std::move(headers1);
+  EXPECT_THAT(headers2, ElementsAre(Pair(":method", "GET"), Pair(":scheme", "https"),
+                                    Pair(":path", "/index.html"),
+                                    Pair(":authority", "www.example.com"),
+                                    Pair("custom-key", "custom-value"),
+                                    Pair("custom-key", "custom-value")));
+  auto const view = headers2.view();
+  EXPECT_EQ(view.size(), 6);
+  EXPECT_THAT(view.Find(":path"), Optional(std::string_view("/index.html")));
+  EXPECT_THAT(view.Find("custom-key"), Optional(std::string_view("custom-value")));
+  EXPECT_EQ(view.Find("lorem"), std::nullopt);
+}
+
+TEST_F(DecoderTest, SmallDecodedHeadersSurviveMove) {
+  // Literal field without indexing, small enough for the field block to be stored inline.
+  std::vector<uint8_t> const bytes{
+      0x00, 0x0A, 0x63, 0x75, 0x73, 0x74, 0x6F, 0x6D, 0x2D, 0x6B, 0x65, 0x79, 0x0C,
+      0x63, 0x75, 0x73, 0x74, 0x6F, 0x6D, 0x2D, 0x76, 0x61, 0x6C, 0x75, 0x65,
+  };
+  ASSERT_LE(bytes.size(), Buffer::kInlineCapacity);
+  auto status_or_headers = decoder_.DecodeFieldBlock(Buffer(absl::Span<uint8_t const>(bytes)));
+  ASSERT_OK(status_or_headers);
+  DecodedHeaders headers1 = std::move(status_or_headers).value();
+  DecodedHeaders headers2 = std::move(headers1);
+  DecodedHeaders headers3;
+  headers3 = std::move(headers2);
+  EXPECT_THAT(headers3, ElementsAre(Pair("custom-key", "custom-value")));
+}
+
+TEST_F(DecoderTest, DecodeFieldBlockError) {
+  std::vector<uint8_t> const bytes{0x82, 0xFF};
+  EXPECT_THAT(decoder_.DecodeFieldBlock(Buffer(absl::Span<uint8_t const>(bytes))),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
 class EncoderTest : public ::testing::Test {
  protected:
   Encoder encoder_;
@@ -512,6 +587,52 @@ TEST_F(EncoderTest, Responses) {
       })));
 }
 
+TEST(PrecompiledHeadersTest, Empty) {
+  auto const precompiled = Encoder::Precompile({});
+  EXPECT_TRUE(precompiled.bytes().empty());
+  EXPECT_EQ(precompiled.status(), 0);
+}
+
+TEST(PrecompiledHeadersTest, StaticTableOnly) {
+  auto const precompiled = Encoder::Precompile({
+      {":status", "200"},
+      {":status", "404"},
+  });
+  EXPECT_THAT(precompiled.bytes(), ElementsAreArray({0x88, 0x8D}));
+  EXPECT_EQ(precompiled.status(), 200);
+  EXPECT_EQ(precompiled.Clone().status(), 200);
+}
+
+TEST(PrecompiledHeadersTest, Literals) {
+  auto const precompiled = Encoder::Precompile({
+      {"content-type", "text/plain"},
+      {"custom-key", "custom-value"},
+  });
+  EXPECT_THAT(precompiled.bytes(), ElementsAreArray({
+                                       0x0F, 0x10, 0x87, 0x49, 0x7C, 0xA5, 0x8A, 0xE8, 0x19,
+                                       0xAA, 0x00, 0x88, 0x25, 0xA8, 0x49, 0xE9, 0x5B, 0xA9,
+                                       0x7D, 0x7F, 0x89, 0x25, 0xA8, 0x49, 0xE9, 0x5B, 0xB8,
+                                       0xE8, 0xB4, 0xBF,
+                                   }));
+  EXPECT_EQ(precompiled.status(), 0);
+}
+
+TEST(PrecompiledHeadersTest, DoesNotAffectDynamicTable) {
+  HeaderSet const headers{
+      {":status", "200"},
+      {"content-type", "text/plain"},
+      {"custom-key", "custom-value"},
+  };
+  auto const precompiled = Encoder::Precompile(headers);
+  Encoder encoder;
+  Decoder decoder;
+  for (int i = 0; i < 3; ++i) {
+    auto const buffer = encoder.Encode(precompiled, {});
+    EXPECT_THAT(buffer.span(), ElementsAreArray(precompiled.bytes()));
+    EXPECT_THAT(decoder.Decode(buffer.span()), IsOkAndHolds(headers));
+  }
+}
+
 class PairTest : public ::testing::Test {
  protected:
   absl::StatusOr<HeaderSet> Transcode(HeaderSet const& headers);
@@ -581,4 +702,31 @@ TEST_F(PairTest, Responses) {
   EXPECT_THAT(Transcode(headers3), IsOkAndHolds(headers3));
 }
 
+TEST_F(PairTest, Precompiled) {
+  auto const precompiled = Encoder::Precompile({
+      {":status", "200"},
+      {"content-type", "text/plain"},
+      {"server", "tsdb2"},
+  });
+  for (auto const* const length : {"42", "123", "42"}) {
+    auto const buffer = encoder_.Encode(precompiled, {{"content-length", length}});
+    EXPECT_THAT(decoder_.Decode(buffer.span()), IsOkAndHolds(HeaderSet{
+                                                    {":status", "200"},
+                                                    {"content-type", "text/plain"},
+                                                    {"server", "tsdb2"},
+                                                    {"content-length", length},
+                                                }));
+  }
+}
+
+TEST_F(PairTest, LongValues) {
+  HeaderSet const headers{
+      {"lorem", std::string(300, 'a')},
+      {std::string(200, 'b'), "ipsum"},
+      {"dolor", std::string(20000, '\x80')},
+  };
+  EXPECT_THAT(Transcode(headers), IsOkAndHolds(headers));
+  EXPECT_THAT(Transcode(headers), IsOkAndHolds(headers));
+}
+
 }  // namespace
@@ -29,6 +29,23 @@ ABSL_FLAG(std::optional<size_t>, http2_max_concurrent_streams, std::nullopt,
 ABSL_FLAG(size_t, http2_initial_stream_window_size, tsdb2::http::kDefaultInitialWindowSize,
           "Initial flow control window size fore newly created streams.");
 
+ABSL_FLAG(bool, http2_bdp_probe, false,
+          "Whether to measure the round-trip time of HTTP/2 connections with PING frames and grow "
+          "the receive windows of the connections and their streams towards the estimated "
+          "bandwidth-delay product. The windows never exceed --http2_max_receive_window_size.");
+
+ABSL_FLAG(size_t, http2_max_receive_window_size, tsdb2::http::kDefaultMaxReceiveWindowSize,
+          "Maximum size of the connection-level and stream-level receive windows when they are "
+          "grown by --http2_bdp_probe. Bounds the amount of memory a single peer can make us "
+          "buffer.");
+
+ABSL_FLAG(size_t, http2_receive_memory_budget, tsdb2::http::kDefaultReceiveMemoryBudget,
+          "Bounds the sum of the stream-level receive windows of a connection, i.e. the amount of "
+          "request data that the handlers of a single peer may have to buffer. --http2_bdp_probe "
+          "never grows the stream windows beyond this budget divided by the number of open "
+          "streams, and shrinks them as more streams are opened. Stream windows never go below "
+          "--http2_initial_stream_window_size.");
+
 ABSL_FLAG(size_t, http2_max_frame_payload_size, tsdb2::http::kDefaultMaxFramePayloadSize,
           "Maximum frame payload size. Must be at least 16 KiB as per the specs, so we'll "
           "check-fail at startup if a lower value is specified in this flag.");
@@ -121,6 +138,15 @@ tsdb2::common::fixed_flat_map<int, std::string_view, kNumStatuses> constexpr kSt
         {505, "HTTP Version Not Supported"},
     });
 
+std::optional<std::string_view> HeadersView::Find(std::string_view const name) const {
+  for (auto it = fields_.rbegin(); it != fields_.rend(); ++it) {
+    if (it->first == name) {
+      return it->second;
+    }
+  }
+  return std::nullopt;
+}
+
 static tsdb2::init::Module<HttpModule> const http_module;
 
 absl::Status HttpModule::Initialize() {  // NOLINT(readability-convert-member-functions-to-static)
@@ -128,6 +154,10 @@ absl::Status HttpModule::Initialize() {  // NOLINT(readability-convert-member-fu
     return absl::InvalidArgumentError(
         "the --http2_max_frame_payload_size must be at least 16384 (= 16 KiB).");
   }
+  if (absl::GetFlag(FLAGS_http2_max_receive_window_size) > kMaxWindowSize) {
+    return absl::InvalidArgumentError(
+        "the --http2_max_receive_window_size must be at most 2147483647 (= 2^31 - 1).");
+  }
   return absl::OkStatus();
 }
 
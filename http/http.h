@@ -9,11 +9,13 @@
 #include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
 
 #include "absl/base/attributes.h"
 #include "absl/flags/declare.h"
 #include "absl/status/status.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "common/flat_map.h"
 #include "common/utilities.h"
 
@@ -22,6 +24,9 @@ ABSL_DECLARE_FLAG(absl::Duration, http2_io_timeout);
 ABSL_DECLARE_FLAG(size_t, http2_max_dynamic_header_table_size);
 ABSL_DECLARE_FLAG(std::optional<size_t>, http2_max_concurrent_streams);
 ABSL_DECLARE_FLAG(size_t, http2_initial_stream_window_size);
+ABSL_DECLARE_FLAG(bool, http2_bdp_probe);
+ABSL_DECLARE_FLAG(size_t, http2_max_receive_window_size);
+ABSL_DECLARE_FLAG(size_t, http2_receive_memory_budget);
 ABSL_DECLARE_FLAG(size_t, http2_max_frame_payload_size);
 ABSL_DECLARE_FLAG(size_t, http2_max_header_list_size);
 
@@ -32,9 +37,13 @@ inline std::string_view constexpr kClientPreface = "PRI * HTTP/2.0\r\n\r\nSM\r\n
 
 inline size_t constexpr kDefaultMaxDynamicHeaderTableSize = 4096;  // 4 KiB
 inline size_t constexpr kDefaultInitialWindowSize = 65535;         // 64 KiB
+inline size_t constexpr kMaxWindowSize = 2147483647;               // 2^31 - 1
+inline uint32_t constexpr kMaxStreamId = 2147483647;               // 2^31 - 1
 inline size_t constexpr kMinFramePayloadSizeLimit = 16384;         // 16 KiB
 inline size_t constexpr kDefaultMaxFramePayloadSize = kMinFramePayloadSizeLimit;
 inline size_t constexpr kDefaultMaxHeaderListSize = 1048576;  // 1 MiB
+inline size_t constexpr kDefaultMaxReceiveWindowSize = 16777216;  // 16 MiB
+inline size_t constexpr kDefaultReceiveMemoryBudget = 67108864;    // 64 MiB
 
 enum class StreamState {
   kIdle,
@@ -101,19 +110,19 @@ class ABSL_ATTRIBUTE_PACKED FrameHeader {
     return *this;
   }
 
-  uint32_t stream_id() const { return ::ntohl(stream_id_); }
+  // NOTE: the most significant bit is reserved and must be ignored when receiving.
+  uint32_t stream_id() const { return ::ntohl(stream_id_) & kMaxStreamId; }
 
   FrameHeader& set_stream_id(uint32_t const id) {
-    stream_id_ = ::htonl(id);
+    stream_id_ = ::htonl(id & kMaxStreamId);
     return *this;
   }
 
  private:
   unsigned int length_ : 24;
   unsigned int type_ : 8;
-  unsigned int flags_ : 8;
-  unsigned int reserved_ : 1 ABSL_ATTRIBUTE_UNUSED;
-  unsigned int stream_id_ : 31;
+  uint8_t flags_;
+  uint32_t stream_id_;
 };
 
 static_assert(sizeof(FrameHeader) == 9, "incorrect frame header size");
@@ -306,10 +315,11 @@ struct ABSL_ATTRIBUTE_PACKED GoAwayPayload {
   GoAwayPayload(GoAwayPayload&&) noexcept = default;
   GoAwayPayload& operator=(GoAwayPayload&&) noexcept = default;
 
-  uint32_t last_stream_id() const { return ::ntohl(last_stream_id_); }
+  // NOTE: the most significant bit is reserved and must be ignored when receiving.
+  uint32_t last_stream_id() const { return ::ntohl(last_stream_id_) & kMaxStreamId; }
 
   GoAwayPayload& set_last_stream_id(uint32_t const id) {
-    last_stream_id_ = ::htonl(id);
+    last_stream_id_ = ::htonl(id & kMaxStreamId);
     return *this;
   }
 
@@ -321,9 +331,8 @@ struct ABSL_ATTRIBUTE_PACKED GoAwayPayload {
   }
 
  private:
-  unsigned int reserved_ : 1 ABSL_ATTRIBUTE_UNUSED;
-  unsigned int last_stream_id_ : 31;
-  unsigned int error_code_ : 32;
+  uint32_t last_stream_id_;
+  uint32_t error_code_;
 };
 
 static_assert(sizeof(GoAwayPayload) == 8, "incorrect GOAWAY payload size");
@@ -345,16 +354,16 @@ struct ABSL_ATTRIBUTE_PACKED WindowUpdatePayload {
   WindowUpdatePayload(WindowUpdatePayload&&) noexcept = default;
   WindowUpdatePayload& operator=(WindowUpdatePayload&&) noexcept = default;
 
-  size_t window_size_increment() const { return ::ntohl(window_size_increment_); }
+  // NOTE: the most significant bit is reserved and must be ignored when receiving.
+  size_t window_size_increment() const { return ::ntohl(window_size_increment_) & kMaxWindowSize; }
 
   WindowUpdatePayload& set_window_size_increment(size_t const value) {
-    window_size_increment_ = ::htonl(value);
+    window_size_increment_ = ::htonl(value & kMaxWindowSize);
     return *this;
   }
 
  private:
-  unsigned int reserved_ : 1 ABSL_ATTRIBUTE_UNUSED;
-  unsigned int window_size_increment_ : 31;
+  uint32_t window_size_increment_;
 };
 
 static_assert(sizeof(WindowUpdatePayload) == 4, "incorrect WINDOW_UPDATE payload size");
@@ -428,6 +437,44 @@ inline size_t constexpr kNumStatuses = 42;
 
 extern tsdb2::common::fixed_flat_map<int, std::string_view, kNumStatuses> const kStatusNames;
 
+// Read-only view of the header fields of a request.
+//
+// Names and values are views into storage owned by the server (typically the decoded HPACK field
+// block), so they are only valid for the duration of the handler call. Handlers that need them
+// for longer must copy them.
+class HeadersView final {
+ public:
+  using Field = std::pair<std::string_view, std::string_view>;
+  using value_type = Field;
+  using const_iterator = absl::Span<Field const>::const_iterator;
+
+  explicit HeadersView() = default;
+  explicit HeadersView(absl::Span<Field const> const fields) : fields_(fields) {}
+  ~HeadersView() = default;
+
+  HeadersView(HeadersView const&) = default;
+  HeadersView& operator=(HeadersView const&) = default;
+  HeadersView(HeadersView&&) noexcept = default;
+  HeadersView& operator=(HeadersView&&) noexcept = default;
+
+  bool empty() const { return fields_.empty(); }
+  size_t size() const { return fields_.size(); }
+
+  const_iterator begin() const { return fields_.begin(); }
+  const_iterator end() const { return fields_.end(); }
+
+  Field const& operator[](size_t const index) const { return fields_[index]; }
+
+  // Returns the value of the field with the specified name, or an empty optional if no such field
+  // exists. If the field occurs more than once the last value is returned.
+  //
+  // Requests have few fields, so this performs a linear scan rather than indexing them.
+  std::optional<std::string_view> Find(std::string_view name) const;
+
+ private:
+  absl::Span<Field const> fields_;
+};
+
 struct Request {
   explicit Request(Method const method, std::string_view const path) : method(method), path(path) {}
   ~Request() = default;
@@ -439,7 +486,7 @@ struct Request {
 
   Method method;
   std::string path;
-  tsdb2::common::flat_map<std::string, std::string> headers;
+  HeadersView headers;
   tsdb2::common::flat_map<std::string, std::string> cookies;
 };
 
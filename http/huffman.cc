@@ -5,7 +5,6 @@
 #include <cstdint>
 #include <string>
 #include <string_view>
-#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/types/span.h"
@@ -338,74 +337,138 @@ std::array<Encoding, kNumLeaves - 1> constexpr codes{
     Encoding{.length = 27, .bits = 0x7FFFFF0},  Encoding{.length = 26, .bits = 0x3FFFFEE},
 };
 
+// A transition of the decoding automaton (see `decoder_table` below).
+struct ABSL_ATTRIBUTE_PACKED DecoderTransition {
+  // The index of the internal node reached after consuming the nibble.
+  uint8_t state;
+
+  // A bitwise OR of the `kEmitSymbol` and `kEndOfString` flags.
+  uint8_t flags;
+
+  // The decoded character. Only meaningful if `flags` contains `kEmitSymbol`.
+  uint8_t symbol;
+};
+
+// Indicates that the transition completes a character, which is stored in `symbol`.
+inline uint8_t constexpr kEmitSymbol = 1;
+
+// Indicates that the transition decodes the EOS symbol, so decoding must stop.
+inline uint8_t constexpr kEndOfString = 2;
+
+// Computes the transition resulting from feeding the 4 bits of `nibble` (MSB first) to the Huffman
+// tree starting at internal node `node`.
+//
+// Since the shortest code is 5 bits long and EOS is 30 bits long, consuming a nibble can complete
+// at most one symbol.
+constexpr DecoderTransition MakeDecoderTransition(int16_t node, uint8_t const nibble) {
+  DecoderTransition transition{.state = 0, .flags = 0, .symbol = 0};
+  for (int j = 0; j < 4; ++j) {
+    if (((nibble >> (3 - j)) & 1) != 0) {
+      node = nodes[node].right;
+    } else {
+      node = nodes[node].left;
+    }
+    if (node < 1) {
+      int16_t const label = -node;
+      if (label < 256) {
+        transition.flags |= kEmitSymbol;
+        transition.symbol = static_cast<uint8_t>(label);
+        node = 0;
+      } else {
+        transition.flags |= kEndOfString;
+        return transition;
+      }
+    }
+  }
+  transition.state = static_cast<uint8_t>(node);
+  return transition;
+}
+
+using DecoderTable = std::array<std::array<DecoderTransition, 16>, kNumLeaves - 1>;
+
+constexpr DecoderTable MakeDecoderTable() {
+  DecoderTable table{};
+  for (size_t node = 0; node < table.size(); ++node) {
+    for (uint8_t nibble = 0; nibble < 16; ++nibble) {
+      table[node][nibble] = MakeDecoderTransition(static_cast<int16_t>(node), nibble);
+    }
+  }
+  return table;
+}
+
+// Finite state automaton equivalent to the Huffman tree, used to decode 4 bits at a time rather
+// than walking the tree one bit at a time. The states are the internal nodes of the tree (their
+// indices in `nodes`) and each state has 16 transitions, one per possible nibble.
+DecoderTable constexpr decoder_table = MakeDecoderTable();
+
 }  // namespace
 
 std::string HuffmanCode::Decode(absl::Span<uint8_t const> const data) {
-  std::string result;
-  int16_t node = 0;
+  std::string result(GetMaxDecodedLength(data.size()), 0);
+  result.resize(Decode(data, result.data()));
+  return result;
+}
+
+size_t HuffmanCode::Decode(absl::Span<uint8_t const> const data, char* const output) {
+  size_t length = 0;
+  uint8_t state = 0;
   for (auto const byte : data) {
-    for (int j = 0; j < 8; ++j) {
-      if (((byte >> (7 - j)) & 1) != 0) {
-        node = nodes[node].right;
-      } else {
-        node = nodes[node].left;
+    for (int shift = 4; shift >= 0; shift -= 4) {
+      auto const& transition = decoder_table[state][(byte >> shift) & 0x0F];
+      if ((transition.flags & kEmitSymbol) != 0) {
+        output[length++] = static_cast<char>(transition.symbol);
       }
-      if (node < 1) {
-        int16_t const label = -node;
-        if (label < 256) {
-          result += static_cast<uint8_t>(label);
-          node = 0;
-        } else {
-          return result;
-        }
+      if ((transition.flags & kEndOfString) != 0) {
+        return length;
       }
+      state = transition.state;
     }
   }
-  return result;
+  return length;
 }
 
 size_t HuffmanCode::GetEncodedLength(std::string_view const text) {
   size_t num_bits = 0;
-  for (char const ch : text) {
+  for (uint8_t const ch : text) {
     num_bits += codes[ch].length;
   }
   return (num_bits + 7) >> 3;
 }
 
 Buffer HuffmanCode::Encode(std::string_view const text) {
-  std::vector<uint8_t> bytes;
-  bytes.reserve(text.size());
+  size_t const length = GetEncodedLength(text);
+  Buffer buffer{length};
+  uint8_t* const bytes = buffer.as_byte_array();
+  size_t offset = 0;
+  // The codes are accumulated in the least significant bits of `accumulator` and flushed in 32-bit
+  // words. Since no more than 31 bits are ever left pending and the longest code is 30 bits long,
+  // the accumulator never overflows.
+  uint64_t accumulator = 0;
   size_t num_bits = 0;
   for (uint8_t const ch : text) {
     auto const& encoding = codes[ch];
-    size_t const length = encoding.length;
-    size_t const tail = num_bits & 7;
-    uint64_t const bits = static_cast<uint64_t>(encoding.bits) << (40 - length - tail);
-    if (tail != 0) {
-      bytes.back() |= static_cast<uint8_t>(bits >> 32);
-    } else {
-      bytes.push_back(bits >> 32);
-    }
-    if (length > 8 - tail) {
-      bytes.push_back((bits >> 24) & 0xFF);
+    accumulator = (accumulator << encoding.length) | encoding.bits;
+    num_bits += encoding.length;
+    if (num_bits >= 32) {
+      num_bits -= 32;
+      auto const word = static_cast<uint32_t>(accumulator >> num_bits);
+      bytes[offset++] = static_cast<uint8_t>(word >> 24);
+      bytes[offset++] = static_cast<uint8_t>(word >> 16);
+      bytes[offset++] = static_cast<uint8_t>(word >> 8);
+      bytes[offset++] = static_cast<uint8_t>(word);
     }
-    if (length > 16 - tail) {
-      bytes.push_back((bits >> 16) & 0xFF);
-    }
-    if (length > 24 - tail) {
-      bytes.push_back((bits >> 8) & 0xFF);
-    }
-    if (length > 32 - tail) {
-      bytes.push_back(bits & 0xFF);
-    }
-    num_bits += length;
   }
-  size_t const tail = num_bits & 7;
-  if (tail != 0) {
-    bytes.back() |= (uint8_t{1} << (8 - tail)) - 1;
+  while (num_bits >= 8) {
+    num_bits -= 8;
+    bytes[offset++] = static_cast<uint8_t>(accumulator >> num_bits);
+  }
+  if (num_bits > 0) {
+    // Pad with the most significant bits of EOS, which are all 1's.
+    size_t const padding = 8 - num_bits;
+    bytes[offset++] =
+        static_cast<uint8_t>((accumulator << padding) | ((uint64_t{1} << padding) - 1));
   }
-  Buffer buffer{bytes.size()};
-  buffer.MemCpy(bytes.data(), bytes.size());
+  buffer.Advance(offset);
   return buffer;
 }
 
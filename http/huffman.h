@@ -17,9 +17,19 @@ namespace hpack {
 // HPACK header compression algorithm. See https://httpwg.org/specs/rfc7541.html#huffman.code.
 class HuffmanCode final {
  public:
+  // Returns the maximum number of characters that `encoded_length` bytes can decode to. Each
+  // character takes at least 5 bits.
+  static size_t constexpr GetMaxDecodedLength(size_t const encoded_length) {
+    return encoded_length * 8 / 5;
+  }
+
   // Decodes the provided byte array.
   static std::string Decode(absl::Span<uint8_t const> data);
 
+  // Decodes the provided byte array into `output`, which must have room for at least
+  // `GetMaxDecodedLength(data.size())` characters. Returns the number of decoded characters.
+  static size_t Decode(absl::Span<uint8_t const> data, char* output);
+
   // Returns the length (in bytes) of the provided `text` if it were encoded.
   static size_t GetEncodedLength(std::string_view text);
 
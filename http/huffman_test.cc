@@ -1,6 +1,7 @@
 #include "http/huffman.h"
 
 #include <cstdint>
+#include <string>
 #include <string_view>
 
 #include "gmock/gmock.h"
@@ -88,4 +89,36 @@ TEST(HuffmanTest, EncodedLength3) {
   EXPECT_THAT(HuffmanCode::GetEncodedLength(kText3), sizeof(kBytes3));
 }
 
+TEST(HuffmanTest, AllCharacters) {
+  std::string text;
+  for (int i = 0; i < 256; ++i) {
+    text += static_cast<char>(i);
+  }
+  auto const encoded = HuffmanCode::Encode(text);
+  EXPECT_EQ(encoded.size(), HuffmanCode::GetEncodedLength(text));
+  EXPECT_EQ(HuffmanCode::Decode(encoded.span()), text);
+}
+
+TEST(HuffmanTest, AllCharacterPairs) {
+  for (int i = 0; i < 256; ++i) {
+    for (int j = 0; j < 256; ++j) {
+      std::string const text{static_cast<char>(i), static_cast<char>(j)};
+      EXPECT_EQ(HuffmanCode::Decode(HuffmanCode::Encode(text).span()), text);
+    }
+  }
+}
+
+TEST(HuffmanTest, DecodeEmpty) { EXPECT_EQ(HuffmanCode::Decode({}), ""); }
+
+TEST(HuffmanTest, EncodeEmpty) {
+  EXPECT_EQ(HuffmanCode::Encode("").size(), 0);
+  EXPECT_EQ(HuffmanCode::GetEncodedLength(""), 0);
+}
+
+TEST(HuffmanTest, DecodeStopsAtEndOfString) {
+  // "a" (00011) followed by the 30-bit EOS symbol and then by "a" again.
+  uint8_t const bytes[] = {0x1F, 0xFF, 0xFF, 0xFF, 0xE3};
+  EXPECT_EQ(HuffmanCode::Decode(bytes), "a");
+}
+
 }  // namespace
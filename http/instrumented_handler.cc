@@ -0,0 +1,314 @@
+#include "http/instrumented_handler.h"
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "common/reffed_ptr.h"
+#include "common/utilities.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "http/stream_proxy.h"
+#include "io/cord.h"
+#include "io/fd.h"
+#include "net/base_sockets.h"
+#include "tsz/base.h"
+#include "tsz/counter.h"
+#include "tsz/event_metric.h"
+#include "tsz/metric.h"
+
+namespace tsdb2 {
+namespace http {
+
+namespace {
+
+using ::tsdb2::common::reffed_ptr;
+
+char constexpr kPathField[] = "path";
+char constexpr kMethodField[] = "method";
+char constexpr kStatusField[] = "status";
+
+using PathField = tsz::Field<std::string, kPathField>;
+using MethodField = tsz::Field<std::string, kMethodField>;
+using StatusField = tsz::Field<int, kStatusField>;
+
+tsz::NoDestructor<tsz::Counter<PathField, MethodField, StatusField>> requests{
+    "/http/server/requests",
+    tsz::Options{
+        .description = "Number of HTTP requests handled by the server.",
+    }};
+
+tsz::NoDestructor<tsz::EventMetric<PathField, MethodField>> latency{
+    "/http/server/latency",
+    tsz::Options{
+        .description = "Time from the dispatch of an HTTP request to the end of its response.",
+        .time_unit = tsz::TimeUnit::kMillisecond,
+    }};
+
+tsz::NoDestructor<tsz::EventMetric<PathField, MethodField>> request_bytes{
+    "/http/server/request_bytes",
+    tsz::Options{
+        .description = "Size of the HTTP request bodies received by the server.",
+    }};
+
+tsz::NoDestructor<tsz::EventMetric<PathField, MethodField>> response_bytes{
+    "/http/server/response_bytes",
+    tsz::Options{
+        .description = "Size of the HTTP response bodies sent by the server.",
+    }};
+
+tsz::NoDestructor<tsz::Metric<int64_t, PathField, MethodField>> in_flight{
+    "/http/server/in_flight",
+    tsz::Options{
+        .description = "Number of HTTP requests being handled by the server.",
+    }};
+
+// Returns the value of the `:status` pseudo-header in `fields`, or 0 if there's none.
+uint16_t FindStatus(hpack::HeaderSet const& fields) {
+  for (auto const& [name, value] : fields) {
+    if (name == kStatusHeaderName) {
+      uint32_t status = 0;
+      if (absl::SimpleAtoi(value, &status) && status <= 999) {
+        return status;
+      } else {
+        return 0;
+      }
+    }
+  }
+  return 0;
+}
+
+}  // namespace
+
+// Proxies a `StreamInterface` to collect the status and body sizes of a request, and records all
+// metrics once the end of the response has been sent or the handler releases the stream without
+// closing it.
+//
+// Proxies are recycled: when the handler has released the proxy and the end of the stream has been
+// sent, `Done` returns it to the pool of the handler. The pooled proxies don't reference the state,
+// otherwise the pool would keep it alive forever.
+class InstrumentedHandler::InstrumentedStream final : public StreamProxy {
+ public:
+  // Returns a proxy for a request of the handler owning `state`, reusing an idle one if possible.
+  static reffed_ptr<InstrumentedStream> Create(std::shared_ptr<State> state,
+                                               StreamInterface* const stream, Method const method) {
+    auto proxy = state->AcquireStream();
+    if (!proxy) {
+      proxy = std::make_unique<InstrumentedStream>();
+    }
+    proxy->Start(std::move(state), stream, method);
+    return reffed_ptr<InstrumentedStream>(proxy.release());
+  }
+
+  explicit InstrumentedStream() : StreamProxy(nullptr) {}
+  ~InstrumentedStream() override = default;
+
+  void ReadData(DataCallback callback) override {
+    StreamProxy::ReadData(
+        [self = reffed_ptr<InstrumentedStream>(this), callback = std::move(callback)](
+            absl::StatusOr<tsdb2::io::Cord> status_or_data, bool const end) mutable {
+          if (status_or_data.ok()) {
+            self->request_bytes_.fetch_add(status_or_data->size(), std::memory_order_relaxed);
+          }
+          callback(std::move(status_or_data), end);
+        });
+  }
+
+  absl::Status SendFields(hpack::HeaderSet const& fields, bool const end_stream) override {
+    MaybeSetStatus(FindStatus(fields));
+    MaybeClose(end_stream);
+    return StreamProxy::SendFields(fields, end_stream);
+  }
+
+  absl::Status SendFields(hpack::PrecompiledHeaders const& precompiled,
+                          hpack::HeaderSet const& fields, bool const end_stream) override {
+    MaybeSetStatus(precompiled.status() != 0 ? precompiled.status() : FindStatus(fields));
+    MaybeClose(end_stream);
+    return StreamProxy::SendFields(precompiled, fields, end_stream);
+  }
+
+  absl::Status SendData(tsdb2::net::Buffer buffer, bool const end_stream) override {
+    response_bytes_.fetch_add(buffer.size(), std::memory_order_relaxed);
+    MaybeClose(end_stream);
+    return StreamProxy::SendData(std::move(buffer), end_stream);
+  }
+
+  void StreamData(tsdb2::net::Buffer buffer, bool const end_stream,
+                  WriteCallback callback) override {
+    response_bytes_.fetch_add(buffer.size(), std::memory_order_relaxed);
+    MaybeClose(end_stream);
+    StreamProxy::StreamData(std::move(buffer), end_stream, std::move(callback));
+  }
+
+  void StreamFile(tsdb2::io::FD fd, off_t const offset, size_t const length, bool const end_stream,
+                  WriteCallback callback) override {
+    response_bytes_.fetch_add(length, std::memory_order_relaxed);
+    MaybeClose(end_stream);
+    StreamProxy::StreamFile(std::move(fd), offset, length, end_stream, std::move(callback));
+  }
+
+  void StreamCord(tsdb2::io::Cord cord, bool const end_stream, WriteCallback callback) override {
+    response_bytes_.fetch_add(cord.size(), std::memory_order_relaxed);
+    MaybeClose(end_stream);
+    StreamProxy::StreamCord(std::move(cord), end_stream, std::move(callback));
+  }
+
+ protected:
+  void OnLastUnref() override {
+    Rebind(nullptr);
+    if (!closed_.exchange(true, std::memory_order_relaxed)) {
+      Record(/*ended=*/false);
+    }
+    Done();
+  }
+
+ private:
+  void Start(std::shared_ptr<State> state, StreamInterface* const stream, Method const method) {
+    Rebind(stream);
+    state_ = std::move(state);
+    method_ = method;
+    start_time_ = state_->clock->TimeNow();
+    status_.store(0, std::memory_order_relaxed);
+    request_bytes_.store(0, std::memory_order_relaxed);
+    response_bytes_.store(0, std::memory_order_relaxed);
+    closed_.store(false, std::memory_order_relaxed);
+    outstanding_.store(1, std::memory_order_relaxed);
+    state_->BeginRequest(method_);
+  }
+
+  // Only the status of the first HEADERS frame is retained, trailers don't have one anyway.
+  void MaybeSetStatus(uint16_t const status) {
+    uint16_t expected = 0;
+    if (status != 0) {
+      status_.compare_exchange_strong(expected, status, std::memory_order_relaxed);
+    }
+  }
+
+  // Must be called before forwarding a call that may close the local end of the stream, because
+  // the `OnEndStreamSent` callbacks must be registered before that.
+  //
+  // NOTE: the callback doesn't reference the wrapped stream, otherwise a stream dropped along with
+  // its connection would keep itself alive.
+  void MaybeClose(bool const end_stream) {
+    if (end_stream && !closed_.exchange(true, std::memory_order_relaxed)) {
+      outstanding_.fetch_add(1, std::memory_order_relaxed);
+      StreamProxy::OnEndStreamSent([this](absl::Status const status) {
+        Record(/*ended=*/status.ok());
+        Done();
+      });
+    }
+  }
+
+  void Record(bool const ended) {
+    auto const& fields_ref = state_->fields_refs[tsdb2::util::to_underlying(method_)];
+    if (ended) {
+      latency->Record(absl::ToDoubleMilliseconds(state_->clock->TimeNow() - start_time_),
+                      fields_ref);
+    }
+    request_bytes->Record(request_bytes_.load(std::memory_order_relaxed), fields_ref);
+    response_bytes->Record(response_bytes_.load(std::memory_order_relaxed), fields_ref);
+    state_->EndRequest(method_, status_.load(std::memory_order_relaxed));
+  }
+
+  // Invoked when the handler releases the proxy and when the `OnEndStreamSent` callback runs. The
+  // last of them recycles the proxy.
+  void Done() {
+    if (outstanding_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      auto const state = std::move(state_);
+      state->ReleaseStream(std::unique_ptr<InstrumentedStream>(this));
+    }
+  }
+
+  std::shared_ptr<State> state_;
+  Method method_ = Method::kGet;
+  absl::Time start_time_;
+  std::atomic<uint16_t> status_{0};
+  std::atomic<size_t> request_bytes_{0};
+  std::atomic<size_t> response_bytes_{0};
+  std::atomic<bool> closed_{false};
+  std::atomic<int> outstanding_{0};
+};
+
+InstrumentedHandler::State::State(std::string_view const path,
+                                  tsdb2::common::Clock const* const clock)
+    : path(path),
+      clock(clock),
+      fields_refs(MakeFieldsRefs(this->path, std::make_index_sequence<kNumMethods>())) {}
+
+InstrumentedHandler::State::~State() = default;
+
+template <size_t... Indices>
+InstrumentedHandler::FieldsRefs InstrumentedHandler::State::MakeFieldsRefs(
+    std::string_view const path, std::index_sequence<Indices...> /*indices*/) {
+  // All metrics have the same `path` and `method` fields, so the refs of one fit all of them.
+  return FieldsRefs{{latency->MakeFieldsRef(path, kMethodNames.at(Method(Indices)))...}};
+}
+
+std::unique_ptr<InstrumentedHandler::InstrumentedStream>
+InstrumentedHandler::State::AcquireStream() {
+  absl::MutexLock lock{&pool_mutex};
+  if (pool.empty()) {
+    return nullptr;
+  }
+  auto proxy = std::move(pool.back());
+  pool.pop_back();
+  return proxy;
+}
+
+void InstrumentedHandler::State::ReleaseStream(std::unique_ptr<InstrumentedStream> proxy) {
+  absl::MutexLock lock{&pool_mutex};
+  if (pool.size() < kMaxPooledStreams) {
+    pool.emplace_back(std::move(proxy));
+  }
+}
+
+void InstrumentedHandler::State::BeginRequest(Method const method) {
+  auto const index = tsdb2::util::to_underlying(method);
+  absl::MutexLock lock{&mutex};
+  in_flight->Set(++in_flight_counts[index], fields_refs[index]);
+}
+
+void InstrumentedHandler::State::EndRequest(Method const method, uint16_t const status) {
+  auto const index = tsdb2::util::to_underlying(method);
+  absl::MutexLock lock{&mutex};
+  auto const key = std::make_pair(method, status);
+  auto it = requests_fields_refs.find(key);
+  if (it == requests_fields_refs.end()) {
+    it = requests_fields_refs
+             .try_emplace(key, requests->MakeFieldsRef(path, kMethodNames.at(method), status))
+             .first;
+  }
+  requests->Increment(it->second);
+  in_flight->Set(--in_flight_counts[index], fields_refs[index]);
+}
+
+InstrumentedHandler::InstrumentedHandler(std::string_view const path,
+                                         std::unique_ptr<Handler> handler,
+                                         tsdb2::common::Clock const* const clock)
+    : handler_(std::move(handler)), state_(std::make_shared<State>(path, clock)) {}
+
+InstrumentedHandler::HandlerSet InstrumentedHandler::WrapAll(HandlerSet handlers) {
+  for (auto&& [path, handler] : handlers) {
+    handler = std::make_unique<InstrumentedHandler>(path, std::move(handler));
+  }
+  return handlers;
+}
+
+void InstrumentedHandler::operator()(StreamInterface* const stream, Request const& request) {
+  (*handler_)(InstrumentedStream::Create(state_, stream, request.method).get(), request);
+}
+
+}  // namespace http
+}  // namespace tsdb2
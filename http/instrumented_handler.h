@@ -0,0 +1,118 @@
+#ifndef __TSDB2_HTTP_INSTRUMENTED_HANDLER_H__
+#define __TSDB2_HTTP_INSTRUMENTED_HANDLER_H__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "common/clock.h"
+#include "common/trie_map.h"
+#include "http/handlers.h"
+#include "http/http.h"
+#include "tsz/base.h"
+
+namespace tsdb2 {
+namespace http {
+
+// Wraps a `Handler` to record the following tsz metrics for every request, all of them with the
+// registered path and the request method in the `path` and `method` metric fields:
+//
+//   * `/http/server/requests`: counter of completed requests, with the response status in the
+//     `status` field (0 if the handler released the stream without responding);
+//   * `/http/server/latency`: distribution of the time from the dispatch of the request until the
+//     end of the response has been handed to the socket, in milliseconds;
+//   * `/http/server/request_bytes`: distribution of the request body sizes;
+//   * `/http/server/response_bytes`: distribution of the response body sizes;
+//   * `/http/server/in_flight`: number of requests being handled.
+//
+// `Server` wraps all of its handlers automatically, so none of them need to record these metrics
+// themselves.
+class InstrumentedHandler final : public Handler {
+ public:
+  using HandlerSet = tsdb2::common::trie_map<std::unique_ptr<Handler>>;
+
+  // Wraps every handler in `handlers` with an `InstrumentedHandler`.
+  static HandlerSet WrapAll(HandlerSet handlers);
+
+  explicit InstrumentedHandler(std::string_view const path, std::unique_ptr<Handler> handler,
+                               tsdb2::common::Clock const* const clock =
+                                   tsdb2::common::RealClock::GetInstance());
+
+  ~InstrumentedHandler() override = default;
+
+  std::string_view path() const { return state_->path; }
+
+  void operator()(StreamInterface* stream, Request const& request) override;
+
+ private:
+  class InstrumentedStream;
+
+  // Maximum number of idle proxies retained by each handler for reuse.
+  static size_t constexpr kMaxPooledStreams = 64;
+
+  // Pre-hashed `path` and `method` fields of the metric cells, one per method.
+  using FieldsRefs = std::array<tsz::FieldMapRef<2>, kNumMethods>;
+
+  // The state shared with the proxies, which may outlive the `InstrumentedHandler` because they
+  // record the metrics of a request only once its response has been sent.
+  struct State {
+    explicit State(std::string_view path, tsdb2::common::Clock const* clock);
+    ~State();
+
+    template <size_t... Indices>
+    static FieldsRefs MakeFieldsRefs(std::string_view path, std::index_sequence<Indices...>);
+
+    // Returns an idle proxy, or nullptr if there's none.
+    std::unique_ptr<InstrumentedStream> AcquireStream() ABSL_LOCKS_EXCLUDED(pool_mutex);
+
+    // Retains `proxy` for reuse, or deletes it if `kMaxPooledStreams` proxies are already idle.
+    void ReleaseStream(std::unique_ptr<InstrumentedStream> proxy) ABSL_LOCKS_EXCLUDED(pool_mutex);
+
+    // Increments the in-flight count of `method`.
+    void BeginRequest(Method method) ABSL_LOCKS_EXCLUDED(mutex);
+
+    // Decrements the in-flight count of `method` and counts a request with the provided status.
+    void EndRequest(Method method, uint16_t status) ABSL_LOCKS_EXCLUDED(mutex);
+
+    std::string const path;
+    tsdb2::common::Clock const* const clock;
+
+    // Refer to `path`, so they must be declared after it.
+    FieldsRefs const fields_refs;
+
+    absl::Mutex mutable mutex;
+
+    // The in-flight counts are published to the gauge while holding `mutex`, otherwise concurrent
+    // updates may overwrite it with a stale count.
+    std::array<int64_t, kNumMethods> in_flight_counts ABSL_GUARDED_BY(mutex){};
+
+    // Pre-hashed fields of the `requests` cells, built as the statuses show up. They refer to
+    // `path`.
+    absl::flat_hash_map<std::pair<Method, uint16_t>, tsz::FieldMapRef<3>> requests_fields_refs
+        ABSL_GUARDED_BY(mutex);
+
+    absl::Mutex mutable pool_mutex;
+    std::vector<std::unique_ptr<InstrumentedStream>> pool ABSL_GUARDED_BY(pool_mutex);
+  };
+
+  InstrumentedHandler(InstrumentedHandler const&) = delete;
+  InstrumentedHandler& operator=(InstrumentedHandler const&) = delete;
+  InstrumentedHandler(InstrumentedHandler&&) = delete;
+  InstrumentedHandler& operator=(InstrumentedHandler&&) = delete;
+
+  std::unique_ptr<Handler> const handler_;
+  std::shared_ptr<State> const state_;
+};
+
+}  // namespace http
+}  // namespace tsdb2
+
+#endif  // __TSDB2_HTTP_INSTRUMENTED_HANDLER_H__
@@ -0,0 +1,276 @@
+#include "http/instrumented_handler.h"
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/time/time.h"
+#include "common/mock_clock.h"
+#include "common/reffed_ptr.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "http/testing.h"
+#include "io/cord.h"
+#include "tsz/base.h"
+#include "tsz/cell_reader.h"
+#include "tsz/distribution_testing.h"
+
+namespace {
+
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::_;
+using ::testing::Return;
+using ::tsdb2::common::MockClock;
+using ::tsdb2::common::reffed_ptr;
+using ::tsdb2::http::InstrumentedHandler;
+using ::tsdb2::http::Method;
+using ::tsdb2::http::Request;
+using ::tsdb2::http::StreamInterface;
+using ::tsdb2::http::hpack::Encoder;
+using ::tsdb2::io::Cord;
+using ::tsdb2::net::Buffer;
+using ::tsdb2::testing::http::MockHandler;
+using ::tsdb2::testing::http::MockStream;
+using ::tsz::Distribution;
+using ::tsz::testing::CellReader;
+using ::tsz::testing::DistributionSumAndCountAre;
+
+char constexpr kPathField[] = "path";
+char constexpr kMethodField[] = "method";
+char constexpr kStatusField[] = "status";
+
+using PathField = tsz::Field<std::string, kPathField>;
+using MethodField = tsz::Field<std::string, kMethodField>;
+using StatusField = tsz::Field<int, kStatusField>;
+
+class InstrumentedHandlerTest : public ::testing::Test {
+ protected:
+  explicit InstrumentedHandlerTest() {
+    auto handler = std::make_unique<MockHandler>();
+    mock_handler_ = handler.get();
+    handler_.emplace("/foo", std::move(handler), &clock_);
+  }
+
+  CellReader<int64_t, tsz::EntityLabels<>, tsz::MetricFields<PathField, MethodField, StatusField>>
+      requests_{"/http/server/requests"};
+  CellReader<Distribution, tsz::EntityLabels<>, tsz::MetricFields<PathField, MethodField>>
+      latency_{"/http/server/latency"};
+  CellReader<Distribution, tsz::EntityLabels<>, tsz::MetricFields<PathField, MethodField>>
+      request_bytes_{"/http/server/request_bytes"};
+  CellReader<Distribution, tsz::EntityLabels<>, tsz::MetricFields<PathField, MethodField>>
+      response_bytes_{"/http/server/response_bytes"};
+  CellReader<int64_t, tsz::EntityLabels<>, tsz::MetricFields<PathField, MethodField>> in_flight_{
+      "/http/server/in_flight"};
+
+  MockClock clock_;
+  MockHandler* mock_handler_ = nullptr;
+  std::optional<InstrumentedHandler> handler_;
+};
+
+TEST_F(InstrumentedHandlerTest, Path) { EXPECT_EQ(handler_->path(), "/foo"); }
+
+TEST_F(InstrumentedHandlerTest, RecordsResponse) {
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  StreamInterface::WriteCallback end_stream_sent;
+  EXPECT_CALL(stream, OnEndStreamSent(_)).WillOnce([&](StreamInterface::WriteCallback callback) {
+    end_stream_sent = std::move(callback);
+  });
+  EXPECT_CALL(stream, SendFields(_, false)).WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(stream, SendData(_, true)).WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) {
+        EXPECT_THAT(in_flight_.Read("/foo", "GET"), IsOkAndHolds(1));
+        clock_.AdvanceTime(absl::Milliseconds(42));
+        proxy->SendResponseOrLog({{":status", "200"}}, Buffer("lorem", 5));
+      });
+  (*handler_)(&stream, Request{Method::kGet, "/foo"});
+  EXPECT_THAT(requests_.Read("/foo", "GET", 200), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(in_flight_.Read("/foo", "GET"), IsOkAndHolds(1));
+  clock_.AdvanceTime(absl::Milliseconds(8));
+  end_stream_sent(absl::OkStatus());
+  EXPECT_THAT(requests_.Read("/foo", "GET", 200), IsOkAndHolds(1));
+  EXPECT_THAT(latency_.Read("/foo", "GET"), IsOkAndHolds(DistributionSumAndCountAre(50, 1)));
+  EXPECT_THAT(request_bytes_.Read("/foo", "GET"), IsOkAndHolds(DistributionSumAndCountAre(0, 1)));
+  EXPECT_THAT(response_bytes_.Read("/foo", "GET"), IsOkAndHolds(DistributionSumAndCountAre(5, 1)));
+  EXPECT_THAT(in_flight_.Read("/foo", "GET"), IsOkAndHolds(0));
+}
+
+TEST_F(InstrumentedHandlerTest, PrecompiledStatus) {
+  auto const precompiled = Encoder::Precompile({{":status", "204"}});
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  EXPECT_CALL(stream, OnEndStreamSent(_)).WillOnce([](StreamInterface::WriteCallback callback) {
+    callback(absl::OkStatus());
+  });
+  EXPECT_CALL(stream, SendFields(_, _, true)).WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) {
+        proxy->SendFieldsOrLog(precompiled, {}, /*end_stream=*/true);
+      });
+  (*handler_)(&stream, Request{Method::kPost, "/foo"});
+  EXPECT_THAT(requests_.Read("/foo", "POST", 204), IsOkAndHolds(1));
+}
+
+TEST_F(InstrumentedHandlerTest, RecordsRequestBytes) {
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  EXPECT_CALL(stream, ReadData(_)).WillOnce([](StreamInterface::DataCallback callback) {
+    callback(Cord(Buffer("lorem ipsum", 11)), /*end=*/true);
+  });
+  StreamInterface::WriteCallback end_stream_sent;
+  EXPECT_CALL(stream, OnEndStreamSent(_)).WillOnce([&](StreamInterface::WriteCallback callback) {
+    end_stream_sent = std::move(callback);
+  });
+  EXPECT_CALL(stream, SendFields(_, true)).WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) {
+        proxy->ReadData([proxy](absl::StatusOr<Cord> status_or_data, bool const end) {
+          EXPECT_TRUE(status_or_data.ok());
+          EXPECT_TRUE(end);
+          proxy->SendFieldsOrLog({{":status", "204"}}, /*end_stream=*/true);
+        });
+      });
+  (*handler_)(&stream, Request{Method::kPut, "/foo"});
+  end_stream_sent(absl::OkStatus());
+  EXPECT_THAT(requests_.Read("/foo", "PUT", 204), IsOkAndHolds(1));
+  EXPECT_THAT(request_bytes_.Read("/foo", "PUT"), IsOkAndHolds(DistributionSumAndCountAre(11, 1)));
+}
+
+TEST_F(InstrumentedHandlerTest, AsyncResponse) {
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  reffed_ptr<StreamInterface> held;
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) { held = proxy; });
+  (*handler_)(&stream, Request{Method::kGet, "/foo"});
+  EXPECT_THAT(in_flight_.Read("/foo", "GET"), IsOkAndHolds(1));
+  EXPECT_THAT(requests_.Read("/foo", "GET", 404), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_CALL(stream, OnEndStreamSent(_)).WillOnce([](StreamInterface::WriteCallback callback) {
+    callback(absl::OkStatus());
+  });
+  EXPECT_CALL(stream, SendFields(_, true)).WillOnce(Return(absl::OkStatus()));
+  held->SendFieldsOrLog({{":status", "404"}}, /*end_stream=*/true);
+  EXPECT_THAT(requests_.Read("/foo", "GET", 404), IsOkAndHolds(1));
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  held.reset();
+  EXPECT_THAT(requests_.Read("/foo", "GET", 404), IsOkAndHolds(1));
+  EXPECT_THAT(in_flight_.Read("/foo", "GET"), IsOkAndHolds(0));
+}
+
+TEST_F(InstrumentedHandlerTest, EndStreamNotSent) {
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  StreamInterface::WriteCallback end_stream_sent;
+  EXPECT_CALL(stream, OnEndStreamSent(_)).WillOnce([&](StreamInterface::WriteCallback callback) {
+    end_stream_sent = std::move(callback);
+  });
+  EXPECT_CALL(stream, SendFields(_, true)).WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) {
+        proxy->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/true);
+      });
+  (*handler_)(&stream, Request{Method::kGet, "/foo"});
+  end_stream_sent(absl::CancelledError());
+  EXPECT_THAT(requests_.Read("/foo", "GET", 200), IsOkAndHolds(1));
+  EXPECT_THAT(latency_.Read("/foo", "GET"), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(in_flight_.Read("/foo", "GET"), IsOkAndHolds(0));
+}
+
+TEST_F(InstrumentedHandlerTest, EndStreamSentAfterHandlerDestruction) {
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  StreamInterface::WriteCallback end_stream_sent;
+  EXPECT_CALL(stream, OnEndStreamSent(_)).WillOnce([&](StreamInterface::WriteCallback callback) {
+    end_stream_sent = std::move(callback);
+  });
+  EXPECT_CALL(stream, SendFields(_, true)).WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) {
+        proxy->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/true);
+      });
+  (*handler_)(&stream, Request{Method::kGet, "/foo"});
+  handler_.reset();
+  clock_.AdvanceTime(absl::Milliseconds(42));
+  end_stream_sent(absl::OkStatus());
+  EXPECT_THAT(requests_.Read("/foo", "GET", 200), IsOkAndHolds(1));
+  EXPECT_THAT(latency_.Read("/foo", "GET"), IsOkAndHolds(DistributionSumAndCountAre(42, 1)));
+  EXPECT_THAT(in_flight_.Read("/foo", "GET"), IsOkAndHolds(0));
+}
+
+TEST_F(InstrumentedHandlerTest, ReusesProxies) {
+  MockStream stream1;
+  EXPECT_CALL(stream1, Ref());
+  EXPECT_CALL(stream1, Unref()).WillOnce(Return(false));
+  EXPECT_CALL(stream1, ReadData(_)).WillOnce([](StreamInterface::DataCallback callback) {
+    callback(Cord(Buffer("lorem", 5)), /*end=*/true);
+  });
+  EXPECT_CALL(stream1, OnEndStreamSent(_)).WillOnce([](StreamInterface::WriteCallback callback) {
+    callback(absl::OkStatus());
+  });
+  EXPECT_CALL(stream1, SendFields(_, true)).WillOnce(Return(absl::OkStatus()));
+  MockStream stream2;
+  EXPECT_CALL(stream2, Ref());
+  EXPECT_CALL(stream2, Unref()).WillOnce(Return(false));
+  EXPECT_CALL(stream2, OnEndStreamSent(_)).WillOnce([](StreamInterface::WriteCallback callback) {
+    callback(absl::OkStatus());
+  });
+  EXPECT_CALL(stream2, SendFields(_, true)).WillOnce(Return(absl::OkStatus()));
+  StreamInterface* first_proxy = nullptr;
+  EXPECT_CALL(*mock_handler_, Run(_, _))
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) {
+        first_proxy = proxy;
+        proxy->ReadData([proxy](absl::StatusOr<Cord> /*status_or_data*/, bool const /*end*/) {
+          proxy->SendFieldsOrLog({{":status", "200"}}, /*end_stream=*/true);
+        });
+      })
+      .WillOnce([&](StreamInterface* const proxy, Request const& /*request*/) {
+        EXPECT_EQ(proxy, first_proxy);
+        proxy->SendFieldsOrLog({{":status", "404"}}, /*end_stream=*/true);
+      });
+  (*handler_)(&stream1, Request{Method::kGet, "/foo"});
+  (*handler_)(&stream2, Request{Method::kGet, "/foo"});
+  EXPECT_THAT(requests_.Read("/foo", "GET", 200), IsOkAndHolds(1));
+  EXPECT_THAT(requests_.Read("/foo", "GET", 404), IsOkAndHolds(1));
+  EXPECT_THAT(request_bytes_.Read("/foo", "GET"), IsOkAndHolds(DistributionSumAndCountAre(5, 2)));
+  EXPECT_THAT(in_flight_.Read("/foo", "GET"), IsOkAndHolds(0));
+}
+
+TEST_F(InstrumentedHandlerTest, NoResponse) {
+  MockStream stream;
+  EXPECT_CALL(stream, Ref());
+  EXPECT_CALL(stream, Unref()).WillOnce(Return(false));
+  EXPECT_CALL(*mock_handler_, Run(_, _));
+  (*handler_)(&stream, Request{Method::kGet, "/foo"});
+  EXPECT_THAT(requests_.Read("/foo", "GET", 0), IsOkAndHolds(1));
+  EXPECT_THAT(latency_.Read("/foo", "GET"), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(in_flight_.Read("/foo", "GET"), IsOkAndHolds(0));
+}
+
+TEST_F(InstrumentedHandlerTest, WrapAll) {
+  InstrumentedHandler::HandlerSet handlers;
+  handlers.try_emplace("/foo", std::make_unique<MockHandler>());
+  handlers.try_emplace("/bar", std::make_unique<MockHandler>());
+  handlers = InstrumentedHandler::WrapAll(std::move(handlers));
+  auto const* const foo = dynamic_cast<InstrumentedHandler*>(handlers["/foo"].get());
+  auto const* const bar = dynamic_cast<InstrumentedHandler*>(handlers["/bar"].get());
+  ASSERT_NE(foo, nullptr);
+  ASSERT_NE(bar, nullptr);
+  EXPECT_EQ(foo->path(), "/foo");
+  EXPECT_EQ(bar->path(), "/bar");
+}
+
+}  // namespace
@@ -1,20 +1,30 @@
 #include "http/processor.h"
 
+#include <sys/types.h>
+
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <memory>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "absl/flags/flag.h"
+#include "absl/functional/any_invocable.h"
 #include "absl/functional/bind_front.h"
+#include "absl/log/check.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
-#include "common/flat_map.h"
+#include "absl/time/time.h"
+#include "common/default_scheduler.h"
 #include "common/utilities.h"
 #include "http/channel.h"
 #include "http/handlers.h"
@@ -22,6 +32,7 @@
 #include "http/http.h"
 #include "io/buffer.h"
 #include "io/cord.h"
+#include "io/fd.h"
 
 namespace tsdb2 {
 namespace http {
@@ -30,15 +41,25 @@ namespace {
 
 using ::tsdb2::io::Buffer;
 using ::tsdb2::io::Cord;
+using ::tsdb2::io::FD;
+
+// Lower bound for RTT measurements, so that we don't divide by zero when computing bandwidths.
+absl::Duration constexpr kMinBdpRtt = absl::Microseconds(1);
 
 }  // namespace
 
 ChannelProcessor::ChannelProcessor(internal::ChannelInterface* const parent)
     : parent_(parent),
+      is_client_(parent_->is_client()),
+      enable_push_(!is_client_),
       max_concurrent_streams_(absl::GetFlag(FLAGS_http2_max_concurrent_streams)),
       initial_stream_window_size_(absl::GetFlag(FLAGS_http2_initial_stream_window_size)),
       max_frame_payload_size_(absl::GetFlag(FLAGS_http2_max_frame_payload_size)),
       max_header_list_size_(absl::GetFlag(FLAGS_http2_max_header_list_size)),
+      bdp_probe_(absl::GetFlag(FLAGS_http2_bdp_probe)),
+      max_receive_window_size_(absl::GetFlag(FLAGS_http2_max_receive_window_size)),
+      receive_memory_budget_(absl::GetFlag(FLAGS_http2_receive_memory_budget)),
+      stream_recv_window_(initial_stream_window_size_),
       write_queue_(parent_->socket(), max_frame_payload_size_) {}
 
 Error ChannelProcessor::ValidateFrameHeader(FrameHeader const& header) {
@@ -72,7 +93,7 @@ void ChannelProcessor::ProcessFrame(FrameHeader const& header, Buffer payload) {
       // PRIORITY is deprecated, nothing to do here.
       break;
     case FrameType::kResetStream:
-      ProcessResetStreamFrame(header);
+      ProcessResetStreamFrame(header, payload);
       break;
     case FrameType::kSettings:
       ProcessSettingsFrame(header, payload);
@@ -87,7 +108,7 @@ void ChannelProcessor::ProcessFrame(FrameHeader const& header, Buffer payload) {
       ProcessGoAwayFrame(header, std::move(payload));
       break;
     case FrameType::kWindowUpdate:
-      // TODO: process WINDOW_UPDATE frames.
+      ProcessWindowUpdateFrame(header, payload);
       break;
     case FrameType::kContinuation:
       // NOTE: proper CONTINUATION frames are handled inside the processing of HEADERS or
@@ -104,10 +125,86 @@ void ChannelProcessor::SendSettings() {
   write_queue_.AppendFrame(MakeSettingsFrame());
 }
 
+void ChannelProcessor::SendClientPreface(absl::AnyInvocable<void(absl::Status)> callback) {
+  {
+    absl::MutexLock lock{&responses_mutex_};
+    if (!responses_shut_down_) {
+      settings_callback_ = std::exchange(callback, nullptr);
+    }
+  }
+  if (callback) {
+    return callback(absl::UnavailableError("the connection is closed"));
+  }
+  absl::MutexLock lock{&mutex_};
+  std::vector<Buffer> frames;
+  frames.emplace_back(kClientPreface.data(), kClientPreface.size());
+  frames.emplace_back(MakeSettingsFrame());
+  write_queue_.AppendFrames(std::move(frames));
+}
+
+absl::Status ChannelProcessor::SendRequest(hpack::HeaderSet const& fields, Buffer&& body,
+                                           ResponseCallback&& callback,
+                                           ResponseDataCallback&& data_callback) {
+  if (!is_client_) {
+    return absl::FailedPreconditionError("requests can only be sent by client-side channels");
+  }
+  {
+    absl::MutexLock lock{&responses_mutex_};
+    if (responses_shut_down_) {
+      return absl::UnavailableError("the connection is closed");
+    }
+  }
+  absl::MutexLock lock{&mutex_};
+  if (going_away_) {
+    return absl::UnavailableError("the connection is going away");
+  }
+  size_t const max_streams = peer_max_concurrent_streams_;
+  if (num_local_streams_ >= max_streams) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat("the peer doesn't allow more than ", max_streams, " concurrent streams"));
+  }
+  if (next_local_stream_id_ > kMaxStreamId) {
+    // Stream IDs can't be reused, so the connection must be replaced by a new one.
+    going_away_ = true;
+    accepting_requests_ = false;
+    write_queue_.GoAway(ErrorCode::kNoError, last_processed_stream_id_, /*reset_queue=*/false,
+                        /*callback=*/nullptr);
+    return absl::UnavailableError("stream IDs exhausted");
+  }
+  uint32_t const stream_id = next_local_stream_id_;
+  {
+    absl::MutexLock responses_lock{&responses_mutex_};
+    if (responses_shut_down_) {
+      return absl::UnavailableError("the connection is closed");
+    }
+    pending_responses_.try_emplace(stream_id, std::move(callback));
+  }
+  next_local_stream_id_ += 2;
+  ++num_local_streams_;
+  auto* const stream = CreateStreamLocked(stream_id);
+  stream->local_ = true;
+  stream->attached_ = true;
+  if (data_callback) {
+    stream->response_data_callback_ =
+        std::make_shared<ResponseDataCallback>(std::move(data_callback));
+  }
+  // NOTE: the HEADERS frame is enqueued while holding `mutex_` so that new streams reach the peer
+  // in increasing ID order, as required by https://httpwg.org/specs/rfc9113.html#StreamIdentifiers.
+  bool const end_stream = body.empty();
+  CHECK_OK(stream->PrepareToSendFields(end_stream));
+  SendFields(stream, /*precompiled=*/nullptr, fields, end_stream);
+  if (!end_stream) {
+    CHECK_OK(stream->PrepareToSendData(/*end_stream=*/true));
+    SendData(stream, std::move(body), /*end_stream=*/true, /*callback=*/nullptr);
+  }
+  return absl::OkStatus();
+}
+
 void ChannelProcessor::GoAway(ErrorCode const error_code) {
   absl::MutexLock lock{&mutex_};
   if (!going_away_) {
     going_away_ = true;
+    accepting_requests_ = false;
     write_queue_.GoAway(error_code, last_processed_stream_id_, /*reset_queue=*/false,
                         /*callback=*/nullptr);
   }
@@ -120,6 +217,45 @@ void ChannelProcessor::GoAwayNow(ErrorCode const error_code) {
   }
 }
 
+void ChannelProcessor::Shutdown() {
+  absl::flat_hash_map<uint32_t, ResponseCallback> responses;
+  absl::AnyInvocable<void(absl::Status)> settings_callback;
+  {
+    absl::MutexLock lock{&responses_mutex_};
+    responses_shut_down_ = true;
+    accepting_requests_ = false;
+    pending_responses_.swap(responses);
+    settings_callback = std::exchange(settings_callback_, nullptr);
+  }
+  {
+    std::vector<std::deque<OutboundItem>> dropped;
+    absl::MutexLock lock{&flow_mutex_};
+    shut_down_ = true;
+    while (!blocked_streams_.empty()) {
+      dropped.emplace_back(DropOutboundLocked(*blocked_streams_.begin()));
+    }
+  }
+  if (settings_callback) {
+    settings_callback(absl::UnavailableError("the connection was closed before the handshake"));
+  }
+  for (auto& [unused_stream_id, callback] : responses) {
+    callback(absl::UnavailableError("the connection was closed before receiving the response"));
+  }
+}
+
+ChannelProcessor::WriteCompletion::~WriteCompletion() {
+  if (callback_) {
+    callback_(absl::CancelledError("the stream was closed before the data could be sent"));
+  }
+}
+
+void ChannelProcessor::WriteCompletion::Run() {
+  auto callback = std::exchange(callback_, nullptr);
+  if (callback) {
+    callback(absl::OkStatus());
+  }
+}
+
 void ChannelProcessor::DataBuffer::AddChunk(Buffer buffer, bool const last) {
   DataCallback callback;
   bool ended;
@@ -127,7 +263,7 @@ void ChannelProcessor::DataBuffer::AddChunk(Buffer buffer, bool const last) {
     absl::MutexLock lock{&mutex_};
     if (callback_) {
       callback_.swap(callback);
-      ended = ended_;
+      ended = last;
     } else {
       data_.Append(std::move(buffer));
       ended_ = last;
@@ -142,7 +278,7 @@ void ChannelProcessor::DataBuffer::Read(DataCallback callback) {
   bool ended;
   {
     absl::MutexLock lock{&mutex_};
-    if (data_.empty()) {
+    if (data_.empty() && !ended_) {
       callback_ = std::move(callback);
       return;
     } else {
@@ -153,64 +289,108 @@ void ChannelProcessor::DataBuffer::Read(DataCallback callback) {
   callback(std::move(data), ended);
 }
 
+void ChannelProcessor::DataBuffer::Reset() {
+  DataCallback callback;
+  {
+    absl::MutexLock lock{&mutex_};
+    data_ = Cord();
+    ended_ = false;
+    callback_.swap(callback);
+  }
+  if (callback) {
+    callback(absl::CancelledError("the stream was closed"), /*end=*/true);
+  }
+}
+
+void ChannelProcessor::Stream::Reset(uint32_t const id, size_t const window_size,
+                                     int64_t const send_window) {
+  id_ = id;
+  {
+    absl::MutexLock lock{&parent_->stream_state_mutex_};
+    state_ = StreamState::kIdle;
+  }
+  attached_ = false;
+  window_size_ = window_size;
+  data_buffer_.Reset();
+  local_ = false;
+  response_.reset();
+  response_complete_ = false;
+  response_data_callback_.reset();
+  settled_ = false;
+  // Normally empty because reclaimed streams are closed, but a stream closed by an error may still
+  // have some callbacks, which must not be carried over to the next stream.
+  end_stream_completions_.clear();
+  send_window_ = send_window;
+  recv_consumed_ = 0;
+}
+
 Error ChannelProcessor::Stream::ProcessData(Buffer buffer, bool const end_stream) {
-  switch (state_) {
-    case StreamState::kIdle:
-    case StreamState::kReservedLocal:
-    case StreamState::kReservedRemote:
-    case StreamState::kHalfClosedRemote:
-      return ConnectionError(ErrorCode::kProtocolError);
-    case StreamState::kClosed:
-      return ConnectionError(ErrorCode::kStreamClosed);
-    default:
-      data_buffer_.AddChunk(std::move(buffer), end_stream);
-      if (end_stream) {
-        if (state_ != StreamState::kOpen) {
-          state_ = StreamState::kClosed;
-        } else {
-          state_ = StreamState::kHalfClosedRemote;
+  {
+    absl::MutexLock lock{&parent_->stream_state_mutex_};
+    switch (state_) {
+      case StreamState::kIdle:
+      case StreamState::kReservedLocal:
+      case StreamState::kReservedRemote:
+      case StreamState::kHalfClosedRemote:
+        return ConnectionError(ErrorCode::kProtocolError);
+      case StreamState::kClosed:
+        return ConnectionError(ErrorCode::kStreamClosed);
+      default:
+        if (end_stream) {
+          if (state_ != StreamState::kOpen) {
+            state_ = StreamState::kClosed;
+          } else {
+            state_ = StreamState::kHalfClosedRemote;
+          }
         }
-      }
-      break;
+        break;
+    }
   }
+  // NOTE: this may run a read callback of the handler, so it must be done after releasing
+  // `stream_state_mutex_`.
+  data_buffer_.AddChunk(std::move(buffer), end_stream);
   return NoError();
 }
 
-Error ChannelProcessor::Stream::ProcessFields(hpack::HeaderSet fields) {
-  switch (state_) {
-    case StreamState::kIdle:
-      state_ = StreamState::kOpen;
-      break;
-    case StreamState::kReservedRemote:
-      state_ = StreamState::kHalfClosedLocal;
-      break;
-    case StreamState::kHalfClosedRemote:
-      state_ = StreamState::kClosed;
-      return StreamError(ErrorCode::kStreamClosed);
-    case StreamState::kClosed:
-      return ConnectionError(ErrorCode::kStreamClosed);
-    default:
-      state_ = StreamState::kClosed;
-      return ConnectionError(ErrorCode::kProtocolError);
+Error ChannelProcessor::Stream::ProcessFields(hpack::DecodedHeaders const& fields,
+                                              bool const end_stream) {
+  {
+    absl::MutexLock lock{&parent_->stream_state_mutex_};
+    switch (state_) {
+      case StreamState::kIdle:
+        state_ = end_stream ? StreamState::kHalfClosedRemote : StreamState::kOpen;
+        break;
+      case StreamState::kReservedRemote:
+        state_ = end_stream ? StreamState::kClosed : StreamState::kHalfClosedLocal;
+        break;
+      case StreamState::kHalfClosedRemote:
+        state_ = StreamState::kClosed;
+        return StreamError(ErrorCode::kStreamClosed);
+      case StreamState::kClosed:
+        return ConnectionError(ErrorCode::kStreamClosed);
+      default:
+        state_ = StreamState::kClosed;
+        return ConnectionError(ErrorCode::kProtocolError);
+    }
   }
 
-  auto field_map = FlattenFields(std::move(fields));
+  auto const headers = fields.view();
 
-  auto const method_name_it = field_map.find(kMethodHeaderName);
-  if (method_name_it == field_map.end()) {
+  auto const maybe_method_name = headers.Find(kMethodHeaderName);
+  if (!maybe_method_name.has_value()) {
     return ErrorOut(Status::k400);
   }
-  auto const method_it = kMethodsByName.find(method_name_it->second);
+  auto const method_it = kMethodsByName.find(maybe_method_name.value());
   if (method_it == kMethodsByName.end()) {
     return ErrorOut(Status::k405);
   }
   Method const method = method_it->second;
 
-  auto const path_it = field_map.find(kPathHeaderName);
-  if (path_it == field_map.end()) {
+  auto const maybe_path = headers.Find(kPathHeaderName);
+  if (!maybe_path.has_value()) {
     return ErrorOut(Status::k400);
   }
-  std::string_view const path = path_it->second;
+  std::string_view const path = maybe_path.value();
 
   auto const status_or_handler = parent_->GetHandler(path);
   if (!status_or_handler.ok()) {
@@ -218,16 +398,119 @@ Error ChannelProcessor::Stream::ProcessFields(hpack::HeaderSet fields) {
   }
   auto& handler = *status_or_handler.value();
 
+  if (end_stream) {
+    data_buffer_.AddChunk(Buffer(), /*last=*/true);
+  }
+
   Request request(method, path);
-  request.headers = std::move(field_map);
+  request.headers = headers;
+  attached_ = true;
   handler(this, request);
 
   return NoError();
 }
 
-void ChannelProcessor::Stream::ProcessReset() { state_ = StreamState::kClosed; }
+Error ChannelProcessor::Stream::ProcessResponseData(Buffer buffer, bool const end_stream,
+                                                    std::optional<ResponseChunk>* const chunk) {
+  absl::MutexLock lock{&parent_->stream_state_mutex_};
+  switch (state_) {
+    case StreamState::kOpen:
+    case StreamState::kHalfClosedLocal:
+      break;
+    case StreamState::kClosed:
+      return ConnectionError(ErrorCode::kStreamClosed);
+    default:
+      return ConnectionError(ErrorCode::kProtocolError);
+  }
+  if (!response_.has_value()) {
+    // DATA before the response HEADERS.
+    state_ = StreamState::kClosed;
+    return StreamError(ErrorCode::kProtocolError);
+  }
+  if (response_data_callback_ && !buffer.empty()) {
+    chunk->emplace(ResponseChunk{
+        .callback = response_data_callback_,
+        .status = response_->status,
+        .data = std::move(buffer),
+    });
+  } else {
+    response_->body.Append(std::move(buffer));
+  }
+  if (end_stream) {
+    state_ = state_ == StreamState::kOpen ? StreamState::kHalfClosedRemote : StreamState::kClosed;
+    response_complete_ = true;
+  }
+  return NoError();
+}
+
+Error ChannelProcessor::Stream::ProcessResponseFields(hpack::DecodedHeaders const& fields,
+                                                      bool const end_stream) {
+  absl::MutexLock lock{&parent_->stream_state_mutex_};
+  switch (state_) {
+    case StreamState::kOpen:
+      if (end_stream) {
+        state_ = StreamState::kHalfClosedRemote;
+      }
+      break;
+    case StreamState::kHalfClosedLocal:
+      if (end_stream) {
+        state_ = StreamState::kClosed;
+      }
+      break;
+    case StreamState::kHalfClosedRemote:
+      state_ = StreamState::kClosed;
+      return StreamError(ErrorCode::kStreamClosed);
+    case StreamState::kClosed:
+      return ConnectionError(ErrorCode::kStreamClosed);
+    default:
+      state_ = StreamState::kClosed;
+      return ConnectionError(ErrorCode::kProtocolError);
+  }
+  if (response_.has_value()) {
+    // A second field block carries the trailers, which must end the stream.
+    if (!end_stream) {
+      state_ = StreamState::kClosed;
+      return StreamError(ErrorCode::kProtocolError);
+    }
+  } else {
+    auto const maybe_status = fields.view().Find(kStatusHeaderName);
+    int status = 0;
+    if (!maybe_status.has_value() || !absl::SimpleAtoi(maybe_status.value(), &status) ||
+        status < 100 || status > 999) {
+      state_ = StreamState::kClosed;
+      return StreamError(ErrorCode::kProtocolError);
+    }
+    if (status < 200) {
+      // Interim responses are followed by the final one, so we skip them. They must not end the
+      // stream.
+      if (end_stream) {
+        state_ = StreamState::kClosed;
+        return StreamError(ErrorCode::kProtocolError);
+      }
+      return NoError();
+    }
+    response_.emplace().status = status;
+  }
+  for (auto const& [name, value] : fields) {
+    if (!name.empty() && name.front() != ':') {
+      response_->headers.emplace_back(name, value);
+    }
+  }
+  response_complete_ = end_stream;
+  return NoError();
+}
+
+void ChannelProcessor::Stream::ProcessReset() {
+  {
+    absl::MutexLock lock{&parent_->stream_state_mutex_};
+    state_ = StreamState::kClosed;
+  }
+  // Fail any pending read so that the handler finds out and drops the stream.
+  data_buffer_.Reset();
+}
 
 Error ChannelProcessor::Stream::ProcessPushPromise() {
+  absl::MutexLock lock{&parent_->stream_state_mutex_};
   switch (state_) {
     case StreamState::kIdle:
       state_ = StreamState::kReservedRemote;
@@ -242,59 +525,89 @@ Error ChannelProcessor::Stream::ProcessPushPromise() {
   }
 }
 
+void ChannelProcessor::Stream::Ref() {
+  num_refs_.fetch_add(1, std::memory_order_relaxed);
+  parent_->parent_->Ref();
+}
+
+bool ChannelProcessor::Stream::Unref() {
+  // NOTE: the stream may be reclaimed as soon as the last reference is dropped, so we must not
+  // touch it afterwards.
+  auto* const parent = parent_;
+  if (num_refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    parent->UnrefStream(id_);
+  }
+  return parent->parent_->Unref();
+}
+
 void ChannelProcessor::Stream::ReadData(DataCallback callback) {
-  data_buffer_.Read(std::move(callback));
+  data_buffer_.Read([this, callback = std::move(callback)](
+                        absl::StatusOr<Cord> status_or_data, bool const end) mutable {
+    if (status_or_data.ok() && !end) {
+      parent_->ConsumeStreamData(this, status_or_data->size());
+    }
+    callback(std::move(status_or_data), end);
+  });
 }
 
 absl::Status ChannelProcessor::Stream::SendFields(hpack::HeaderSet const& fields,
                                                   bool const end_stream) {
-  switch (state_) {
-    case StreamState::kIdle:
-      state_ = StreamState::kOpen;
-      break;
-    case StreamState::kReservedLocal:
-      state_ = StreamState::kHalfClosedRemote;
-      break;
-    case StreamState::kOpen:
-      break;
-    default:
-      return absl::FailedPreconditionError(
-          absl::StrCat("cannot send HEADERS from a stream that's already closed ",
-                       GetStreamDescriptionForErrors()));
-  }
-  if (end_stream) {
-    RETURN_IF_ERROR(EndStream());
-  }
-  parent_->SendFields(id_, fields, end_stream);
+  RETURN_IF_ERROR(PrepareToSendFields(end_stream));
+  parent_->SendFields(this, /*precompiled=*/nullptr, fields, end_stream);
   return absl::OkStatus();
 }
 
-absl::Status ChannelProcessor::Stream::SendData(Buffer const buffer, bool const end_stream) {
-  if (state_ != StreamState::kOpen && state_ != StreamState::kHalfClosedRemote) {
-    return absl::FailedPreconditionError(absl::StrCat(
-        "cannot send DATA from a stream that's already closed ", GetStreamDescriptionForErrors()));
+absl::Status ChannelProcessor::Stream::SendFields(hpack::PrecompiledHeaders const& precompiled,
+                                                  hpack::HeaderSet const& fields,
+                                                  bool const end_stream) {
+  RETURN_IF_ERROR(PrepareToSendFields(end_stream));
+  parent_->SendFields(this, &precompiled, fields, end_stream);
+  return absl::OkStatus();
+}
+
+absl::Status ChannelProcessor::Stream::SendData(Buffer buffer, bool const end_stream) {
+  RETURN_IF_ERROR(PrepareToSendData(end_stream));
+  parent_->SendData(this, std::move(buffer), end_stream, /*callback=*/nullptr);
+  return absl::OkStatus();
+}
+
+void ChannelProcessor::Stream::StreamData(Buffer buffer, bool const end_stream,
+                                          WriteCallback callback) {
+  auto status = PrepareToSendData(end_stream);
+  if (!status.ok()) {
+    return callback(std::move(status));
   }
-  if (end_stream) {
-    RETURN_IF_ERROR(EndStream());
+  parent_->SendData(this, std::move(buffer), end_stream, std::move(callback));
+}
+
+void ChannelProcessor::Stream::StreamFile(FD fd, off_t const offset, size_t const length,
+                                          bool const end_stream, WriteCallback callback) {
+  auto status = PrepareToSendData(end_stream);
+  if (!status.ok()) {
+    return callback(std::move(status));
   }
-  parent_->SendData(id_, buffer, end_stream);
-  return absl::OkStatus();
+  parent_->SendFile(this, std::move(fd), offset, length, end_stream, std::move(callback));
 }
 
-tsdb2::common::flat_map<std::string, std::string> ChannelProcessor::Stream::FlattenFields(
-    hpack::HeaderSet fields) {
-  tsdb2::common::flat_map<std::string, std::string> result;
-  result.reserve(fields.size());
-  for (auto& [key, value] : fields) {
-    result.insert_or_assign(std::move(key), std::move(value));
+void ChannelProcessor::Stream::StreamCord(Cord cord, bool const end_stream,
+                                          WriteCallback callback) {
+  auto status = PrepareToSendData(end_stream);
+  if (!status.ok()) {
+    return callback(std::move(status));
   }
-  return result;
+  parent_->SendCord(this, std::move(cord), end_stream, std::move(callback));
+}
+
+void ChannelProcessor::Stream::OnEndStreamSent(WriteCallback callback) {
+  absl::MutexLock lock{&parent_->flow_mutex_};
+  end_stream_completions_.emplace_back(std::move(callback));
 }
 
 Error ChannelProcessor::Stream::ErrorOut(Status const http_status) {
   parent_->write_queue_.AppendFieldsFrames(
       id_, {{":status", absl::StrCat(tsdb2::util::to_underlying(http_status))}},
       /*end_of_stream=*/true);
+  absl::MutexLock lock{&parent_->stream_state_mutex_};
   if (state_ == StreamState::kOpen) {
     state_ = StreamState::kHalfClosedLocal;
   } else {
@@ -307,7 +620,13 @@ std::string ChannelProcessor::Stream::GetStreamDescriptionForErrors() {
   return absl::StrCat("(ID: ", id_, ", state: ", kStreamStateNames.at(state_), ")");
 }
 
-absl::Status ChannelProcessor::Stream::EndStream() {
+bool ChannelProcessor::Stream::reclaimable() const {
+  absl::MutexLock lock{&parent_->stream_state_mutex_};
+  return state_ == StreamState::kClosed && !attached_ &&
+         num_refs_.load(std::memory_order_acquire) == 0;
+}
+
+absl::Status ChannelProcessor::Stream::EndStreamLocked() {
   switch (state_) {
     case StreamState::kOpen:
       state_ = StreamState::kHalfClosedLocal;
@@ -322,6 +641,307 @@ absl::Status ChannelProcessor::Stream::EndStream() {
   return absl::OkStatus();
 }
 
+absl::Status ChannelProcessor::Stream::PrepareToSendFields(bool const end_stream) {
+  absl::MutexLock lock{&parent_->stream_state_mutex_};
+  switch (state_) {
+    case StreamState::kIdle:
+      state_ = StreamState::kOpen;
+      break;
+    case StreamState::kReservedLocal:
+      state_ = StreamState::kHalfClosedRemote;
+      break;
+    case StreamState::kOpen:
+    case StreamState::kHalfClosedRemote:
+      break;
+    default:
+      return absl::FailedPreconditionError(
+          absl::StrCat("cannot send HEADERS from a stream that's already closed ",
+                       GetStreamDescriptionForErrors()));
+  }
+  if (end_stream) {
+    RETURN_IF_ERROR(EndStreamLocked());
+  }
+  return absl::OkStatus();
+}
+
+absl::Status ChannelProcessor::Stream::PrepareToSendData(bool const end_stream) {
+  absl::MutexLock lock{&parent_->stream_state_mutex_};
+  if (state_ != StreamState::kOpen && state_ != StreamState::kHalfClosedRemote) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "cannot send DATA from a stream that's already closed ", GetStreamDescriptionForErrors()));
+  }
+  if (end_stream) {
+    RETURN_IF_ERROR(EndStreamLocked());
+  }
+  return absl::OkStatus();
+}
+
+void ChannelProcessor::SendFields(Stream* const stream,
+                                  hpack::PrecompiledHeaders const* const precompiled,
+                                  hpack::HeaderSet const& fields, bool const end_stream) {
+  std::optional<WriteQueue::Frame> first_frame;
+  {
+    absl::MutexLock lock{&flow_mutex_};
+    std::vector<WriteCompletion> completions;
+    if (end_stream) {
+      completions = std::move(stream->end_stream_completions_);
+      stream->end_stream_completions_.clear();
+    }
+    if (!stream->outbound_.empty()) {
+      auto& item = stream->outbound_.emplace_back();
+      if (precompiled != nullptr) {
+        item.precompiled_fields.emplace(precompiled->Clone());
+      }
+      item.fields.emplace(fields);
+      item.end_stream = end_stream;
+      item.end_stream_completions = std::move(completions);
+      return;
+    }
+    if (precompiled != nullptr) {
+      first_frame = write_queue_.EnqueueFieldsFrames(stream->id(), *precompiled, fields, end_stream,
+                                                     MakeWriteCallback(std::move(completions)));
+    } else {
+      first_frame = write_queue_.EnqueueFieldsFrames(stream->id(), fields, end_stream,
+                                                     MakeWriteCallback(std::move(completions)));
+    }
+  }
+  if (end_stream) {
+    ReleaseStream(stream->id());
+  }
+  write_queue_.Flush(std::move(first_frame));
+}
+
+void ChannelProcessor::SendData(Stream* const stream, Buffer data, bool const end_stream,
+                                StreamInterface::WriteCallback callback) {
+  OutboundItem item;
+  item.data = std::make_shared<Buffer const>(std::move(data));
+  item.end_stream = end_stream;
+  item.completion = WriteCompletion(std::move(callback));
+  EnqueueOutbound(stream, std::move(item));
+}
+
+void ChannelProcessor::SendFile(Stream* const stream, FD fd, off_t const offset,
+                                size_t const length, bool const end_stream,
+                                StreamInterface::WriteCallback callback) {
+  OutboundItem item;
+  item.file = std::make_shared<FD const>(std::move(fd));
+  item.file_offset = offset;
+  item.file_length = length;
+  item.end_stream = end_stream;
+  item.completion = WriteCompletion(std::move(callback));
+  EnqueueOutbound(stream, std::move(item));
+}
+
+void ChannelProcessor::SendCord(Stream* const stream, Cord cord, bool const end_stream,
+                                StreamInterface::WriteCallback callback) {
+  OutboundItem item;
+  item.cord = std::make_shared<Cord const>(std::move(cord));
+  item.end_stream = end_stream;
+  item.completion = WriteCompletion(std::move(callback));
+  EnqueueOutbound(stream, std::move(item));
+}
+
+void ChannelProcessor::EnqueueOutbound(Stream* const stream, OutboundItem item) {
+  std::optional<WriteQueue::Frame> first_frame;
+  {
+    absl::MutexLock lock{&flow_mutex_};
+    if (item.end_stream) {
+      item.end_stream_completions = std::move(stream->end_stream_completions_);
+      stream->end_stream_completions_.clear();
+    }
+    if (!shut_down_) {
+      stream->outbound_.emplace_back(std::move(item));
+      FlushStreamLocked(stream, &first_frame);
+    }
+  }
+  write_queue_.Flush(std::move(first_frame));
+}
+
+std::optional<WriteQueue::Frame> ChannelProcessor::EnqueueOutboundData(
+    uint32_t const stream_id, OutboundItem const& item, size_t const length,
+    bool const end_stream, WriteQueue::WriteCallback callback) {
+  if (item.file) {
+    return write_queue_.EnqueueFileDataFrames(stream_id, item.file,
+                                              item.file_offset + item.offset, length, end_stream,
+                                              std::move(callback));
+  } else if (item.cord) {
+    return write_queue_.EnqueueCordDataFrames(stream_id, item.cord, item.offset, length,
+                                              end_stream, std::move(callback));
+  } else {
+    return write_queue_.EnqueueDataFrames(stream_id, item.data,
+                                          item.data->span(item.offset, length), end_stream,
+                                          std::move(callback));
+  }
+}
+
+void ChannelProcessor::FlushStreamLocked(Stream* const stream,
+                                         std::optional<WriteQueue::Frame>* const first_frame) {
+  auto const stream_id = stream->id();
+  auto& outbound = stream->outbound_;
+  while (!outbound.empty()) {
+    auto& item = outbound.front();
+    std::optional<WriteQueue::Frame> frame;
+    if (item.fields.has_value()) {
+      auto callback = MakeWriteCallback(std::move(item.end_stream_completions));
+      if (item.precompiled_fields.has_value()) {
+        frame = write_queue_.EnqueueFieldsFrames(stream_id, *item.precompiled_fields, *item.fields,
+                                                 item.end_stream, std::move(callback));
+      } else {
+        frame = write_queue_.EnqueueFieldsFrames(stream_id, *item.fields, item.end_stream,
+                                                 std::move(callback));
+      }
+    } else {
+      int64_t const remaining = item.size() - item.offset;
+      int64_t const window = std::min(stream->send_window_, connection_send_window_);
+      if (remaining > window) {
+        if (window > 0) {
+          frame = EnqueueOutboundData(stream_id, item, window, /*end_stream=*/false,
+                                      /*callback=*/nullptr);
+          item.offset += window;
+          stream->send_window_ -= window;
+          connection_send_window_ -= window;
+          if (frame.has_value()) {
+            *first_frame = std::move(frame);
+          }
+        }
+        blocked_streams_.insert(stream);
+        return;
+      }
+      stream->send_window_ -= remaining;
+      connection_send_window_ -= remaining;
+      frame = EnqueueOutboundData(
+          stream_id, item, remaining, item.end_stream,
+          [completion = std::move(item.completion),
+           end_stream_completions = std::move(item.end_stream_completions)]() mutable {
+            completion.Run();
+            for (auto& end_stream_completion : end_stream_completions) {
+              end_stream_completion.Run();
+            }
+          });
+    }
+    bool const end_stream = item.end_stream;
+    outbound.pop_front();
+    if (frame.has_value()) {
+      *first_frame = std::move(frame);
+    }
+    if (end_stream) {
+      // NOTE: the stream may be reclaimed as soon as it's released, so we must not touch it
+      // afterwards.
+      ReleaseStream(stream_id);
+      break;
+    }
+  }
+  blocked_streams_.erase(stream);
+}
+
+std::deque<ChannelProcessor::OutboundItem> ChannelProcessor::DropOutboundLocked(
+    Stream* const stream) {
+  blocked_streams_.erase(stream);
+  if (!stream->end_stream_completions_.empty()) {
+    // The end of the stream won't be sent either, so the `OnEndStreamSent` callbacks are dropped
+    // along with the outbound items.
+    auto& item = stream->outbound_.emplace_back();
+    item.end_stream_completions = std::move(stream->end_stream_completions_);
+    stream->end_stream_completions_.clear();
+  }
+  return std::exchange(stream->outbound_, std::deque<OutboundItem>());
+}
+
+WriteQueue::WriteCallback ChannelProcessor::MakeWriteCallback(
+    std::vector<WriteCompletion> completions) {
+  if (completions.empty()) {
+    return nullptr;
+  }
+  return [completions = std::move(completions)]() mutable {
+    for (auto& completion : completions) {
+      completion.Run();
+    }
+  };
+}
+
+void ChannelProcessor::ConsumeStreamData(Stream* const stream, size_t const size) {
+  auto const stream_id = stream->id();
+  size_t increment = 0;
+  {
+    absl::MutexLock lock{&flow_mutex_};
+    stream->recv_consumed_ += size;
+    // Batch the updates to avoid sending a WINDOW_UPDATE for every chunk.
+    if (stream->recv_consumed_ >= stream_recv_window_ / 2) {
+      increment = std::exchange(stream->recv_consumed_, 0);
+    }
+  }
+  if (increment > 0) {
+    write_queue_.AppendWindowUpdateFrame(stream_id, increment);
+  }
+}
+
+std::optional<uint64_t> ChannelProcessor::SampleBdpLocked(size_t const length) {
+  if (bdp_ping_payload_.has_value()) {
+    bdp_sample_ += length;
+    return std::nullopt;
+  }
+  if (connection_recv_window_ >= max_receive_window_size_ &&
+      stream_recv_window_ >= GetMaxStreamRecvWindow(/*num_streams=*/1)) {
+    return std::nullopt;
+  }
+  bdp_ping_payload_ = next_bdp_ping_payload_++;
+  bdp_ping_time_ = tsdb2::common::default_scheduler->clock()->TimeNow();
+  bdp_sample_ = length;
+  return bdp_ping_payload_;
+}
+
+bool ChannelProcessor::ProcessBdpPingAck(uint64_t const payload) {
+  size_t num_streams;
+  {
+    absl::MutexLock lock{&mutex_};
+    num_streams = streams_.size();
+  }
+  size_t connection_increment = 0;
+  std::optional<size_t> stream_window;
+  {
+    absl::MutexLock lock{&flow_mutex_};
+    if (!bdp_ping_payload_.has_value() || bdp_ping_payload_.value() != payload) {
+      return false;
+    }
+    bdp_ping_payload_.reset();
+    auto const rtt =
+        std::max(tsdb2::common::default_scheduler->clock()->TimeNow() - bdp_ping_time_, kMinBdpRtt);
+    double const bandwidth = static_cast<double>(bdp_sample_) / absl::ToDoubleSeconds(rtt);
+    // Same heuristic as gRPC: the window is likely what's limiting the peer if the sample filled
+    // most of it, and it's only worth growing if the bandwidth is higher than we've seen so far.
+    if (bdp_sample_ * 3 < connection_recv_window_ * 2 || bandwidth <= bdp_max_bandwidth_) {
+      return true;
+    }
+    bdp_max_bandwidth_ = bandwidth;
+    size_t const target = std::min(bdp_sample_ * 2, max_receive_window_size_);
+    if (target > connection_recv_window_) {
+      connection_increment = target - connection_recv_window_;
+      connection_recv_window_ = target;
+    }
+    // Each stream gets the same window, so the more streams are open the less it can grow. If more
+    // streams are opened later `CreateStreamLocked` shrinks it back.
+    size_t const stream_target = std::min(target, GetMaxStreamRecvWindow(num_streams));
+    if (stream_target > stream_recv_window_) {
+      stream_recv_window_ = stream_target;
+      stream_window = stream_target;
+    }
+  }
+  if (connection_increment > 0) {
+    write_queue_.AppendWindowUpdateFrame(/*stream_id=*/0, connection_increment);
+  }
+  if (stream_window.has_value()) {
+    // As per https://httpwg.org/specs/rfc9113.html#rfc.section.6.9.2, the peer applies the new
+    // initial window size to all existing streams as well.
+    write_queue_.AppendFrame(MakeInitialWindowSizeSettingsFrame(stream_window.value()));
+  }
+  return true;
+}
+
+size_t ChannelProcessor::GetMaxStreamRecvWindow(size_t const num_streams) const {
+  size_t const budget = receive_memory_budget_ / std::max<size_t>(num_streams, 1);
+  return std::max(initial_stream_window_size_, std::min(budget, max_receive_window_size_));
+}
+
 Buffer ChannelProcessor::MakeSettingsFrame() const {
   size_t const num_entries = max_concurrent_streams_ ? kNumSettings : kNumSettings - 1;
   auto const header = FrameHeader()
@@ -356,26 +976,186 @@ Buffer ChannelProcessor::MakeSettingsFrame() const {
   return buffer;
 }
 
+Buffer ChannelProcessor::MakeInitialWindowSizeSettingsFrame(size_t const window_size) {
+  auto const header = FrameHeader()
+                          .set_length(sizeof(SettingsEntry))
+                          .set_frame_type(FrameType::kSettings)
+                          .set_flags(0)
+                          .set_stream_id(0);
+  auto const entry =
+      SettingsEntry().set_identifier(SettingsIdentifier::kInitialWindowSize).set_value(window_size);
+  Buffer buffer{sizeof(FrameHeader) + sizeof(SettingsEntry)};
+  buffer.MemCpy(&header, sizeof(FrameHeader));
+  buffer.MemCpy(&entry, sizeof(SettingsEntry));
+  return buffer;
+}
+
 void ChannelProcessor::GoAwayNowLocked(ErrorCode const error_code) {
   going_away_ = true;
+  accepting_requests_ = false;
   write_queue_.GoAway(error_code, last_processed_stream_id_, /*reset_queue=*/true,
                       absl::bind_front(&internal::ChannelInterface::CloseConnection, parent_));
 }
 
 absl::StatusOr<ChannelProcessor::Stream*> ChannelProcessor::GetOrCreateStreamLocked(
     uint32_t const id) {
-  auto it = streams_.find(id);
+  ProcessReleasedStreamsLocked();
+  if (reset_stream_ids_.contains(id)) {
+    // We reset the stream but the peer may have sent more frames before learning about it.
+    return absl::NotFoundError("stream reset");
+  }
+  auto const it = streams_.find(id);
   if (it != streams_.end()) {
-    return it->get();
+    return it->second.get();
+  }
+  if (is_client_) {
+    // Client-side streams are only opened by `SendRequest` because we don't accept server push.
+    if (id % 2 != 0 && id < next_local_stream_id_) {
+      // The stream has been settled and reclaimed, but the peer may have sent more frames before
+      // learning about it. We ignore them.
+      return absl::NotFoundError("stream closed");
+    }
+    return absl::FailedPreconditionError("unknown stream");
+  }
+  if (id <= last_processed_stream_id_) {
+    // As per https://httpwg.org/specs/rfc9113.html#rfc.section.5.1.1, any unknown stream with a
+    // lower ID than the latest one is closed. The peer may legitimately send frames on a stream
+    // that we closed (e.g. DATA that was in flight when our response ended it), so this is a stream
+    // error rather than a connection error. We also remember the ID so that we only reset it once.
+    RememberResetStreamLocked(id);
+    return absl::OutOfRangeError("stream closed");
   }
   if (going_away_) {
     return absl::CancelledError("going away");
   }
-  bool unused;
-  std::tie(it, unused) =
-      streams_.emplace(std::make_unique<Stream>(this, id, initial_stream_window_size_));
   last_processed_stream_id_ = id;
-  return it->get();
+  return CreateStreamLocked(id);
+}
+
+ChannelProcessor::Stream* ChannelProcessor::CreateStreamLocked(uint32_t const id) {
+  size_t const max_window_size = GetMaxStreamRecvWindow(streams_.size() + 1);
+  bool shrink = false;
+  size_t window_size;
+  int64_t send_window;
+  {
+    absl::MutexLock lock{&flow_mutex_};
+    if (stream_recv_window_ > max_window_size) {
+      // The windows grown by the BDP probes would exceed the memory budget with one more stream.
+      stream_recv_window_ = max_window_size;
+      shrink = true;
+    }
+    window_size = stream_recv_window_;
+    send_window = peer_initial_window_size_;
+  }
+  if (shrink) {
+    // As per https://httpwg.org/specs/rfc9113.html#rfc.section.6.9.2 the peer reduces the windows
+    // of the existing streams as well, possibly making them negative. Their WINDOW_UPDATEs are
+    // sent as usual as the handlers consume the data, so they settle on the new size.
+    write_queue_.AppendFrame(MakeInitialWindowSizeSettingsFrame(window_size));
+  }
+  std::unique_ptr<Stream> stream;
+  if (stream_pool_.empty()) {
+    stream = std::make_unique<Stream>(this, id, window_size, send_window);
+  } else {
+    stream = std::move(stream_pool_.back());
+    stream_pool_.pop_back();
+    stream->Reset(id, window_size, send_window);
+  }
+  auto* const result = stream.get();
+  streams_.try_emplace(id, std::move(stream));
+  return result;
+}
+
+std::optional<absl::StatusOr<Response>> ChannelProcessor::SettleResponseLocked(
+    Stream* const stream, Error const& error) {
+  if (!stream->local_ || stream->settled_) {
+    return std::nullopt;
+  }
+  if (error.ok() && !stream->response_complete_) {
+    return std::nullopt;
+  }
+  stream->settled_ = true;
+  --num_local_streams_;
+  if (!error.ok()) {
+    return absl::StatusOr<Response>(absl::UnavailableError(
+        absl::StrCat("HTTP/2 error ", tsdb2::util::to_underlying(error.code()), " on stream ",
+                     stream->id())));
+  }
+  auto response = std::move(stream->response_).value();
+  stream->response_.reset();
+  return absl::StatusOr<Response>(std::move(response));
+}
+
+void ChannelProcessor::DeliverResponse(uint32_t const stream_id,
+                                       absl::StatusOr<Response> response) {
+  ResponseCallback callback;
+  {
+    absl::MutexLock lock{&responses_mutex_};
+    auto node = pending_responses_.extract(stream_id);
+    if (!node) {
+      return;
+    }
+    callback = std::move(node.mapped());
+  }
+  callback(std::move(response));
+}
+
+void ChannelProcessor::RememberResetStreamLocked(uint32_t const stream_id) {
+  if (!reset_stream_ids_.insert(stream_id).second) {
+    return;
+  }
+  reset_stream_order_.push_back(stream_id);
+  if (reset_stream_order_.size() > kMaxResetStreams) {
+    reset_stream_ids_.erase(reset_stream_order_.front());
+    reset_stream_order_.pop_front();
+  }
+}
+
+void ChannelProcessor::MaybeReclaimStreamLocked(Stream* const stream) {
+  if (!stream->reclaimable()) {
+    return;
+  }
+  auto const node = streams_.extract(stream->id());
+  if (node && stream_pool_.size() < kMaxPooledStreams) {
+    stream_pool_.emplace_back(std::move(node.mapped()));
+  }
+}
+
+void ChannelProcessor::ReleaseStream(uint32_t const stream_id) {
+  absl::MutexLock lock{&released_mutex_};
+  released_stream_ids_.emplace_back(stream_id);
+}
+
+void ChannelProcessor::UnrefStream(uint32_t const stream_id) {
+  absl::MutexLock lock{&released_mutex_};
+  unreferenced_stream_ids_.emplace_back(stream_id);
+}
+
+void ChannelProcessor::ProcessReleasedStreamsLocked() {
+  std::vector<uint32_t> released_ids;
+  std::vector<uint32_t> unreferenced_ids;
+  {
+    absl::MutexLock lock{&released_mutex_};
+    if (released_stream_ids_.empty() && unreferenced_stream_ids_.empty()) {
+      return;
+    }
+    released_stream_ids_.swap(released_ids);
+    unreferenced_stream_ids_.swap(unreferenced_ids);
+  }
+  for (auto const stream_id : released_ids) {
+    auto const it = streams_.find(stream_id);
+    if (it != streams_.end()) {
+      auto* const stream = it->second.get();
+      stream->Detach();
+      MaybeReclaimStreamLocked(stream);
+    }
+  }
+  for (auto const stream_id : unreferenced_ids) {
+    auto const it = streams_.find(stream_id);
+    if (it != streams_.end()) {
+      MaybeReclaimStreamLocked(it->second.get());
+    }
+  }
 }
 
 Error ChannelProcessor::ValidateDataHeader(FrameHeader const& header) {
@@ -456,9 +1236,7 @@ Error ChannelProcessor::ValidatePingHeader(FrameHeader const& header) {
   if (header.length() != kPingPayloadSize) {
     return ConnectionError(ErrorCode::kFrameSizeError);
   }
-  if ((header.flags() & kFlagAck) != 0) {
-    return ConnectionError(ErrorCode::kProtocolError);
-  }
+  // NOTE: ACKs are checked against the outstanding BDP probe in `ProcessPingFrame`.
   return NoError();
 }
 
@@ -532,42 +1310,111 @@ void ChannelProcessor::ProcessDataFrame(FrameHeader const& header, Buffer payloa
   }
   bool const end_of_stream = (flags & kFlagEndStream) != 0;
   auto const stream_id = header.stream_id();
+  // The connection-level window is replenished as soon as the data is received, while
+  // stream-level windows are replenished as the handlers consume the data (see
+  // `ConsumeStreamData`). That way a slow handler only throttles its own stream. Note that this
+  // includes the DATA frames ignored below because their stream was reset, which still count
+  // against the connection window as per https://httpwg.org/specs/rfc9113.html#rfc.section.5.1.
+  size_t connection_increment = 0;
+  std::optional<uint64_t> bdp_ping;
+  {
+    absl::MutexLock lock{&flow_mutex_};
+    connection_recv_consumed_ += length;
+    if (connection_recv_consumed_ >= connection_recv_window_ / 2) {
+      connection_increment = std::exchange(connection_recv_consumed_, 0);
+    }
+    if (bdp_probe_) {
+      bdp_ping = SampleBdpLocked(length);
+    }
+  }
+  if (connection_increment > 0) {
+    write_queue_.AppendWindowUpdateFrame(/*stream_id=*/0, connection_increment);
+  }
+  if (bdp_ping.has_value()) {
+    write_queue_.AppendPingFrame(bdp_ping.value());
+  }
   absl::ReleasableMutexLock lock{&mutex_};
   auto const status_or_stream = GetOrCreateStreamLocked(stream_id);
-  if (!status_or_stream.ok()) {
+  if (absl::IsFailedPrecondition(status_or_stream.status())) {
+    return GoAwayNowLocked(ErrorCode::kStreamClosed);
+  } else if (absl::IsOutOfRange(status_or_stream.status())) {
+    lock.Release();
+    return write_queue_.AppendResetStreamFrame(stream_id, ErrorCode::kStreamClosed);
+  } else if (!status_or_stream.ok()) {
     return;
   }
   auto* const stream = status_or_stream.value();
-  auto const error = stream->ProcessData(std::move(data), end_of_stream);
-  if (!error.ok()) {
-    if (error.type() == ErrorType::kConnectionError) {
-      GoAwayNowLocked(error.code());
-    } else {
-      lock.Release();
-      write_queue_.AppendResetStreamFrame(stream_id, error.code());
-    }
+  if (data.size() < length) {
+    // Padding counts against the flow-control window but never reaches the handler.
+    absl::MutexLock flow_lock{&flow_mutex_};
+    stream->recv_consumed_ += length - data.size();
+  }
+  size_t const size = data.size();
+  std::optional<ResponseChunk> chunk;
+  auto const error = stream->is_local()
+                         ? stream->ProcessResponseData(std::move(data), end_of_stream, &chunk)
+                         : stream->ProcessData(std::move(data), end_of_stream);
+  if (stream->is_local() && error.ok()) {
+    // Responses are either buffered whole or handed to the data callback synchronously, so the
+    // window is replenished right away.
+    ConsumeStreamData(stream, size);
+  }
+  auto settled = SettleResponseLocked(stream, error);
+  MaybeReclaimStreamLocked(stream);
+  bool const reset = !error.ok() && error.type() != ErrorType::kConnectionError;
+  if (reset) {
+    RememberResetStreamLocked(stream_id);
+  } else if (!error.ok()) {
+    GoAwayNowLocked(error.code());
+  }
+  lock.Release();
+  if (reset) {
+    write_queue_.AppendResetStreamFrame(stream_id, error.code());
+  }
+  if (chunk.has_value()) {
+    (*chunk->callback)(chunk->status, std::move(chunk->data));
+  }
+  if (settled.has_value()) {
+    DeliverResponse(stream_id, std::move(settled).value());
   }
 }
 
-void ChannelProcessor::ProcessFieldBlock(uint32_t const stream_id, Buffer field_block) {
+void ChannelProcessor::ProcessFieldBlock(uint32_t const stream_id, Buffer field_block,
+                                         bool const end_stream) {
   absl::ReleasableMutexLock lock{&mutex_};
-  auto status_or_fields = field_decoder_.Decode(field_block.span());
+  auto const status_or_fields = field_decoder_.DecodeFieldBlock(std::move(field_block));
   if (!status_or_fields.ok()) {
     return GoAwayNowLocked(ErrorCode::kCompressionError);
   }
   auto const status_or_stream = GetOrCreateStreamLocked(stream_id);
-  if (!status_or_stream.ok()) {
+  if (absl::IsFailedPrecondition(status_or_stream.status())) {
+    return GoAwayNowLocked(ErrorCode::kStreamClosed);
+  } else if (absl::IsOutOfRange(status_or_stream.status())) {
+    lock.Release();
+    return write_queue_.AppendResetStreamFrame(stream_id, ErrorCode::kStreamClosed);
+  } else if (!status_or_stream.ok()) {
     return;
   }
   auto* const stream = status_or_stream.value();
-  auto const error = stream->ProcessFields(std::move(status_or_fields).value());
-  if (!error.ok()) {
-    if (error.type() == ErrorType::kConnectionError) {
-      GoAwayNowLocked(error.code());
-    } else {
-      lock.Release();
-      write_queue_.AppendResetStreamFrame(stream_id, error.code());
-    }
+  auto const& fields = status_or_fields.value();
+  auto const error = stream->is_local() ? stream->ProcessResponseFields(fields, end_stream)
+                                        : stream->ProcessFields(fields, end_stream);
+  auto settled = SettleResponseLocked(stream, error);
+  // Synchronous handlers may have already closed the stream.
+  ProcessReleasedStreamsLocked();
+  MaybeReclaimStreamLocked(stream);
+  bool const reset = !error.ok() && error.type() != ErrorType::kConnectionError;
+  if (reset) {
+    RememberResetStreamLocked(stream_id);
+  } else if (!error.ok()) {
+    GoAwayNowLocked(error.code());
+  }
+  lock.Release();
+  if (reset) {
+    write_queue_.AppendResetStreamFrame(stream_id, error.code());
+  }
+  if (settled.has_value()) {
+    DeliverResponse(stream_id, std::move(settled).value());
   }
 }
 
@@ -587,42 +1434,108 @@ void ChannelProcessor::ProcessHeadersFrame(FrameHeader const& header, Buffer pay
     return GoAwayNow(ErrorCode::kFrameSizeError);
   }
   auto const stream_id = header.stream_id();
-  Cord field_block{Buffer(payload.span(offset, length - offset - pad_length))};
+  bool const end_stream = (flags & kFlagEndStream) != 0;
+  Cord field_block{std::move(payload)};
+  field_block.RemovePrefix(offset);
+  field_block.RemoveSuffix(pad_length);
   if ((flags & kFlagEndHeaders) != 0) {
-    ProcessFieldBlock(stream_id, std::move(field_block).Flatten());
+    ProcessFieldBlock(stream_id, std::move(field_block).Flatten(), end_stream);
     parent_->Continue();
   } else {
     parent_->ReadContinuationFrame(
         stream_id, absl::bind_front(&ChannelProcessor::ProcessContinuationFrame, this, stream_id,
-                                    std::move(field_block)));
+                                    std::move(field_block), end_stream));
   }
 }
 
 void ChannelProcessor::ProcessContinuationFrame(uint32_t const stream_id, Cord field_block,
-                                                FrameHeader const& header, Buffer payload) {
+                                                bool const end_stream, FrameHeader const& header,
+                                                Buffer payload) {
   field_block.Append(std::move(payload));
   if ((header.flags() & kFlagEndHeaders) != 0) {
-    ProcessFieldBlock(stream_id, std::move(field_block).Flatten());
+    ProcessFieldBlock(stream_id, std::move(field_block).Flatten(), end_stream);
     parent_->Continue();
   } else {
     parent_->ReadContinuationFrame(
         stream_id, absl::bind_front(&ChannelProcessor::ProcessContinuationFrame, this, stream_id,
-                                    std::move(field_block)));
+                                    std::move(field_block), end_stream));
   }
 }
 
-void ChannelProcessor::ProcessResetStreamFrame(FrameHeader const& header) {
-  absl::MutexLock lock{&mutex_};
-  auto const status_or_stream = GetOrCreateStreamLocked(header.stream_id());
-  if (status_or_stream.ok()) {
-    auto* const stream = status_or_stream.value();
-    stream->ProcessReset();
+void ChannelProcessor::ProcessResetStreamFrame(FrameHeader const& header,
+                                               Buffer const& payload) {
+  auto const stream_id = header.stream_id();
+  // Must be destroyed after releasing the locks, see `flow_mutex_`.
+  std::deque<OutboundItem> dropped;
+  std::optional<absl::StatusOr<Response>> settled;
+  {
+    absl::MutexLock lock{&mutex_};
+    auto const status_or_stream = GetOrCreateStreamLocked(stream_id);
+    if (status_or_stream.ok()) {
+      auto* const stream = status_or_stream.value();
+      stream->ProcessReset();
+      {
+        absl::MutexLock flow_lock{&flow_mutex_};
+        dropped = DropOutboundLocked(stream);
+      }
+      settled =
+          SettleResponseLocked(stream, StreamError(payload.as<ResetStreamPayload>().error_code()));
+      // Nothing else will be sent on this stream, so we don't need to wait for the handler to close
+      // it. The stream is reclaimed as soon as the handler drops its references, if it holds any.
+      stream->Detach();
+      MaybeReclaimStreamLocked(stream);
+    }
+  }
+  if (settled.has_value()) {
+    DeliverResponse(stream_id, std::move(settled).value());
   }
 }
 
 void ChannelProcessor::ProcessSettingsFrame(FrameHeader const& header, Buffer const& payload) {
-  if ((header.flags() & kFlagAck) == 0) {
-    write_queue_.AppendSettingsAckFrame();
+  if ((header.flags() & kFlagAck) != 0) {
+    return;
+  }
+  auto const entries = payload.span<SettingsEntry>();
+  for (auto const& entry : entries) {
+    if (entry.identifier() == SettingsIdentifier::kInitialWindowSize &&
+        entry.value() > kMaxWindowSize) {
+      return GoAwayNow(ErrorCode::kFlowControlError);
+    }
+  }
+  std::optional<WriteQueue::Frame> first_frame;
+  {
+    absl::MutexLock lock{&mutex_};
+    absl::MutexLock flow_lock{&flow_mutex_};
+    for (auto const& entry : entries) {
+      if (entry.identifier() == SettingsIdentifier::kMaxConcurrentStreams) {
+        peer_max_concurrent_streams_ = entry.value();
+        continue;
+      }
+      if (entry.identifier() != SettingsIdentifier::kInitialWindowSize) {
+        continue;
+      }
+      // As per https://httpwg.org/specs/rfc9113.html#rfc.section.6.9.2, changes to the initial
+      // window size apply to all existing streams.
+      int64_t const delta = static_cast<int64_t>(entry.value()) - peer_initial_window_size_;
+      peer_initial_window_size_ = entry.value();
+      for (auto const& [unused_id, stream] : streams_) {
+        stream->send_window_ += delta;
+      }
+    }
+    std::vector<Stream*> const blocked_streams{blocked_streams_.begin(), blocked_streams_.end()};
+    for (auto* const stream : blocked_streams) {
+      FlushStreamLocked(stream, &first_frame);
+    }
+  }
+  write_queue_.Flush(std::move(first_frame));
+  write_queue_.AppendSettingsAckFrame();
+  absl::AnyInvocable<void(absl::Status)> settings_callback;
+  {
+    absl::MutexLock lock{&responses_mutex_};
+    settings_callback = std::exchange(settings_callback_, nullptr);
+  }
+  if (settings_callback) {
+    settings_callback(absl::OkStatus());
   }
 }
 
@@ -630,7 +1543,12 @@ void ChannelProcessor::ProcessPushPromiseFrame(FrameHeader const& header) {
   auto const stream_id = header.stream_id();
   absl::ReleasableMutexLock lock{&mutex_};
   auto const status_or_stream = GetOrCreateStreamLocked(stream_id);
-  if (!status_or_stream.ok()) {
+  if (absl::IsFailedPrecondition(status_or_stream.status())) {
+    return GoAwayNowLocked(ErrorCode::kStreamClosed);
+  } else if (absl::IsOutOfRange(status_or_stream.status())) {
+    lock.Release();
+    return write_queue_.AppendResetStreamFrame(stream_id, ErrorCode::kStreamClosed);
+  } else if (!status_or_stream.ok()) {
     return;
   }
   auto* const stream = status_or_stream.value();
@@ -639,6 +1557,7 @@ void ChannelProcessor::ProcessPushPromiseFrame(FrameHeader const& header) {
     if (error.type() == ErrorType::kConnectionError) {
       GoAwayNowLocked(error.code());
     } else {
+      RememberResetStreamLocked(stream_id);
       lock.Release();
       write_queue_.AppendResetStreamFrame(stream_id, error.code());
     }
@@ -647,7 +1566,10 @@ void ChannelProcessor::ProcessPushPromiseFrame(FrameHeader const& header) {
 
 void ChannelProcessor::ProcessPingFrame(FrameHeader const& header, Buffer const& payload) {
   if ((header.flags() & kFlagAck) != 0) {
-    GoAwayNow(ErrorCode::kProtocolError);
+    // We only send PINGs to probe the BDP, so any other ACK is unsolicited.
+    if (!ProcessBdpPingAck(payload.as<uint64_t>())) {
+      GoAwayNow(ErrorCode::kProtocolError);
+    }
   } else {
     write_queue_.AppendPingAckFrame(payload);
   }
@@ -662,13 +1584,64 @@ void ChannelProcessor::ProcessGoAwayFrame(FrameHeader const& header, Buffer payl
   }
 }
 
-void ChannelProcessor::ProcessWindowUpdateFrame(FrameHeader const& header, Buffer buffer) {
-  auto const& payload = buffer.as<WindowUpdatePayload>();
-  absl::MutexLock lock{&mutex_};
-  if (payload.window_size_increment() == 0) {
-    return GoAwayNowLocked(ErrorCode::kProtocolError);
+void ChannelProcessor::ProcessWindowUpdateFrame(FrameHeader const& header,
+                                                Buffer const& payload) {
+  int64_t const increment = payload.as<WindowUpdatePayload>().window_size_increment();
+  auto const stream_id = header.stream_id();
+  std::optional<WriteQueue::Frame> first_frame;
+  // Must be destroyed after releasing the locks, see `flow_mutex_`.
+  std::deque<OutboundItem> dropped;
+  bool overflow = false;
+  {
+    absl::MutexLock lock{&mutex_};
+    if (increment == 0) {
+      return GoAwayNowLocked(ErrorCode::kProtocolError);
+    }
+    Stream* stream = nullptr;
+    if (stream_id != 0) {
+      auto const it = streams_.find(stream_id);
+      if (it == streams_.end()) {
+        // WINDOW_UPDATE frames may still arrive for streams that have just been closed, we simply
+        // ignore them.
+        return;
+      }
+      stream = it->second.get();
+    }
+    {
+      absl::MutexLock flow_lock{&flow_mutex_};
+      auto& window = stream ? stream->send_window_ : connection_send_window_;
+      window += increment;
+      overflow = window > static_cast<int64_t>(kMaxWindowSize);
+      if (overflow) {
+        if (stream) {
+          dropped = DropOutboundLocked(stream);
+        }
+      } else if (stream) {
+        FlushStreamLocked(stream, &first_frame);
+      } else {
+        std::vector<Stream*> const blocked_streams{blocked_streams_.begin(),
+                                                   blocked_streams_.end()};
+        for (auto* const blocked_stream : blocked_streams) {
+          FlushStreamLocked(blocked_stream, &first_frame);
+        }
+      }
+    }
+    if (overflow) {
+      // As per https://httpwg.org/specs/rfc9113.html#rfc.section.6.9.1, overflowing a window is a
+      // stream error for stream-level windows and a connection error for the connection window.
+      if (!stream) {
+        return GoAwayNowLocked(ErrorCode::kFlowControlError);
+      }
+      stream->ProcessReset();
+      RememberResetStreamLocked(stream_id);
+      MaybeReclaimStreamLocked(stream);
+    }
+  }
+  if (overflow) {
+    write_queue_.AppendResetStreamFrame(stream_id, ErrorCode::kFlowControlError);
+  } else {
+    write_queue_.Flush(std::move(first_frame));
   }
-  // TODO
 }
 
 absl::StatusOr<Handler*> ChannelProcessor::GetHandler(std::string_view const path) const {
@@ -1,25 +1,35 @@
 #ifndef __TSDB2_HTTP_PROCESSOR_H__
 #define __TSDB2_HTTP_PROCESSOR_H__
 
+#include <sys/types.h>
+
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <deque>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
-#include "absl/container/btree_set.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/functional/any_invocable.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
-#include "common/flat_map.h"
+#include "absl/time/time.h"
 #include "http/handlers.h"
 #include "http/hpack.h"
 #include "http/http.h"
 #include "http/write_queue.h"
 #include "io/buffer.h"
 #include "io/cord.h"
+#include "io/fd.h"
 
 namespace tsdb2 {
 namespace http {
@@ -30,6 +40,12 @@ class ChannelInterface;
 
 class ChannelProcessor final {
  public:
+  // Maximum number of closed streams kept around for reuse by each connection.
+  static size_t constexpr kMaxPooledStreams = 64;
+
+  // Maximum number of reset streams remembered by each connection, see `reset_stream_ids_`.
+  static size_t constexpr kMaxResetStreams = 128;
+
   explicit ChannelProcessor(internal::ChannelInterface* parent);
   ~ChannelProcessor() = default;
 
@@ -41,6 +57,49 @@ class ChannelProcessor final {
 
   void SendSettings() ABSL_LOCKS_EXCLUDED(mutex_);
 
+  // Client-side only. Sends the HTTP/2 client preface followed by our SETTINGS frame. `callback` is
+  // invoked once the first SETTINGS frame of the server has been processed, or with an error if the
+  // connection is closed before that.
+  void SendClientPreface(absl::AnyInvocable<void(absl::Status)> callback)
+      ABSL_LOCKS_EXCLUDED(mutex_, responses_mutex_);
+
+  // Client-side only. Opens a new stream and sends a request on it. `fields` must contain the
+  // request pseudo-headers (`:method`, `:scheme`, `:authority`, and `:path`). An empty `body`
+  // results in a request without DATA frames.
+  //
+  // If `data_callback` is not null the response is streamed: its DATA is passed to `data_callback`
+  // as soon as it's received rather than being buffered in `Response::body`. When the response is
+  // received successfully `callback` runs after the last call to `data_callback`.
+  //
+  // If the request is sent this method returns OK and `callback` is later invoked exactly once,
+  // with either the response or an error. Otherwise none of `body`, `callback`, and `data_callback`
+  // are consumed, so the caller can retry elsewhere. In particular `RESOURCE_EXHAUSTED` indicates
+  // that the peer's SETTINGS_MAX_CONCURRENT_STREAMS has been reached, while `UNAVAILABLE` indicates
+  // that the connection is going away.
+  //
+  // The callbacks never run with `mutex_` held, but they may run in an I/O thread so they must not
+  // block.
+  absl::Status SendRequest(hpack::HeaderSet const& fields, tsdb2::io::Buffer&& body,
+                           ResponseCallback&& callback, ResponseDataCallback&& data_callback)
+      ABSL_LOCKS_EXCLUDED(mutex_, flow_mutex_, responses_mutex_);
+
+  // The three accessors below don't acquire any locks, so they're safe to call from anywhere
+  // (including response callbacks) but their results are only hints: `SendRequest` may still fail.
+
+  // Indicates whether `SendRequest` can open new streams on this connection.
+  bool is_accepting_requests() const {
+    return accepting_requests_.load(std::memory_order_relaxed);
+  }
+
+  // Returns the number of requests sent by `SendRequest` and still waiting for a response.
+  size_t num_active_requests() const { return num_local_streams_.load(std::memory_order_relaxed); }
+
+  // Returns the maximum number of concurrent requests allowed by the peer's
+  // SETTINGS_MAX_CONCURRENT_STREAMS.
+  size_t max_concurrent_requests() const {
+    return peer_max_concurrent_streams_.load(std::memory_order_relaxed);
+  }
+
   // Shuts down the connection gracefully, waiting for the peer to process all outstanding frames.
   void GoAway(ErrorCode error_code) ABSL_LOCKS_EXCLUDED(mutex_);
 
@@ -48,7 +107,89 @@ class ChannelProcessor final {
   // (as per https://httpwg.org/specs/rfc9113.html#rfc.section.5.4.1).
   void GoAwayNow(ErrorCode error_code) ABSL_LOCKS_EXCLUDED(mutex_);
 
+  // Invoked by the channel when the connection has been closed. Fails all outbound data still
+  // waiting for flow-control window, as the peer will never grant it, and all requests still
+  // waiting for a response.
+  void Shutdown() ABSL_LOCKS_EXCLUDED(flow_mutex_, responses_mutex_);
+
  private:
+  // Wraps a `StreamInterface::WriteCallback` so that it's invoked exactly once. If the wrapper is
+  // destroyed without running (e.g. because the connection dropped and the data was never sent) the
+  // callback receives a `CANCELLED` error.
+  class WriteCompletion final {
+   public:
+    explicit WriteCompletion(StreamInterface::WriteCallback callback)
+        : callback_(std::move(callback)) {}
+
+    ~WriteCompletion();
+
+    WriteCompletion(WriteCompletion&& other) noexcept
+        : callback_(std::exchange(other.callback_, nullptr)) {}
+
+    WriteCompletion& operator=(WriteCompletion&& other) noexcept {
+      callback_.swap(other.callback_);
+      return *this;
+    }
+
+    void Run();
+
+   private:
+    WriteCompletion(WriteCompletion const&) = delete;
+    WriteCompletion& operator=(WriteCompletion const&) = delete;
+
+    StreamInterface::WriteCallback callback_;
+  };
+
+  // An outbound item queued in a stream while waiting for flow-control window. It's either a chunk
+  // of data, a cord, a range of a file, or a field block (e.g. trailers) that must not overtake the
+  // data enqueued before it.
+  struct OutboundItem {
+    // Total number of bytes of data to send, either from `data`, `cord`, or `file`.
+    size_t size() const {
+      if (file) {
+        return file_length;
+      } else if (cord) {
+        return cord->size();
+      } else {
+        return data->size();
+      }
+    }
+
+    // Data to send. `offset` is the amount that has already been sent. The data is shared with the
+    // DATA frames in the write queue, which reference it without copying.
+    std::shared_ptr<tsdb2::io::Buffer const> data;
+    size_t offset = 0;
+
+    // A cord to send instead of `data`. Shared with the DATA frames in the write queue, which
+    // reference its pieces.
+    std::shared_ptr<tsdb2::io::Cord const> cord;
+
+    // A file range to send instead of `data`. `offset` is relative to `file_offset`. The file is
+    // shared with the DATA frames in the write queue, which keep it open.
+    std::shared_ptr<tsdb2::io::FD const> file;
+    off_t file_offset = 0;
+    size_t file_length = 0;
+
+    // A field block to send instead of data.
+    std::optional<hpack::PrecompiledHeaders> precompiled_fields;
+    std::optional<hpack::HeaderSet> fields;
+
+    bool end_stream = false;
+    WriteCompletion completion{nullptr};
+
+    // The callbacks registered with `OnEndStreamSent`, if `end_stream` is true. They run after
+    // `completion`.
+    std::vector<WriteCompletion> end_stream_completions;
+  };
+
+  // DATA of a streamed response, to be handed to the `ResponseDataCallback` of the request after
+  // releasing `mutex_`.
+  struct ResponseChunk {
+    std::shared_ptr<ResponseDataCallback> callback;
+    uint16_t status;
+    tsdb2::io::Buffer data;
+  };
+
   // Buffers any DATA packets that have been received but not yet processed by the corresponding
   // stream handler.
   //
@@ -66,6 +207,10 @@ class ChannelProcessor final {
 
     void Read(DataCallback callback) ABSL_LOCKS_EXCLUDED(mutex_);
 
+    // Drops any buffered data so that the buffer can be reused by another stream. A pending read
+    // callback, if any, is invoked with an error.
+    void Reset() ABSL_LOCKS_EXCLUDED(mutex_);
+
    private:
     DataBuffer(DataBuffer const&) = delete;
     DataBuffer& operator=(DataBuffer const&) = delete;
@@ -81,62 +226,139 @@ class ChannelProcessor final {
   // Holds per-stream state.
   //
   // Save for the `DataBuffer` field which is thread-safe in its own, this class is NOT thread-safe.
-  // Per-stream data is guarded by the parent processor's mutex.
+  // Per-stream data is guarded by the parent processor's mutex, except for the state which is
+  // guarded by the parent's `stream_state_mutex_` (see below) and the flow-control fields which are
+  // guarded by the parent's `flow_mutex_`.
+  //
+  // Streams are recycled: when a stream is closed and no longer referenced by its handler it's
+  // returned to a per-connection pool (see `MaybeReclaimStreamLocked`), and `Reset` prepares it for
+  // another stream ID.
   class Stream final : public StreamInterface {
    public:
-    // Allows indexing streams by ID in ordered data structures.
-    struct Compare {
-      using is_transparent = void;
-      static uint32_t ToId(std::unique_ptr<Stream> const& stream) { return stream->id(); }
-      static uint32_t ToId(uint32_t const id) { return id; }
-      template <typename LHS, typename RHS>
-      bool operator()(LHS&& lhs, RHS&& rhs) const {
-        return ToId(std::forward<LHS>(lhs)) < ToId(std::forward<RHS>(rhs));
-      }
-    };
-
-    explicit Stream(ChannelProcessor* const parent, uint32_t const id, size_t const window_size)
-        : parent_(parent), id_(id), window_size_(window_size) {}
+    explicit Stream(ChannelProcessor* const parent, uint32_t const id, size_t const window_size,
+                    int64_t const send_window)
+        : parent_(parent), id_(id), window_size_(window_size), send_window_(send_window) {}
 
     ~Stream() override = default;
 
     uint32_t id() const { return id_; }
 
+    // Reinitializes a pooled stream for the specified ID.
+    void Reset(uint32_t id, size_t window_size, int64_t send_window);
+
+    // Indicates whether the stream was opened by us, i.e. it carries a request sent by
+    // `SendRequest`.
+    bool is_local() const { return local_; }
+
+    // Invoked by the parent processor when the handler has released the stream, or when the stream
+    // has been reset and the handler won't be able to send anything else on it.
+    void Detach() { attached_ = false; }
+
+    // Indicates whether the stream is closed and no longer referenced by a handler, so that the
+    // parent processor can reclaim it. A detached stream is still referenced by its handler until
+    // the handler has dropped all the references it acquired with `Ref`.
+    bool reclaimable() const;
+
+    void Ref() override;
+    bool Unref() override;
+
     Error ProcessData(tsdb2::io::Buffer buffer, bool end_stream);
-    Error ProcessFields(hpack::HeaderSet fields);
+    Error ProcessFields(hpack::DecodedHeaders const& fields, bool end_stream);
+    // If the response is streamed the data is moved to `chunk` rather than being buffered.
+    Error ProcessResponseData(tsdb2::io::Buffer buffer, bool end_stream,
+                              std::optional<ResponseChunk>* chunk);
+    Error ProcessResponseFields(hpack::DecodedHeaders const& fields, bool end_stream);
     void ProcessReset();
     Error ProcessPushPromise();
 
     void ReadData(DataCallback callback) override;
     absl::Status SendFields(hpack::HeaderSet const& fields, bool end_stream) override;
+    absl::Status SendFields(hpack::PrecompiledHeaders const& precompiled,
+                            hpack::HeaderSet const& fields, bool end_stream) override;
     absl::Status SendData(tsdb2::io::Buffer buffer, bool end_stream) override;
+    void StreamData(tsdb2::io::Buffer buffer, bool end_stream, WriteCallback callback) override;
+    void StreamFile(tsdb2::io::FD fd, off_t offset, size_t length, bool end_stream,
+                    WriteCallback callback) override;
+    void StreamCord(tsdb2::io::Cord cord, bool end_stream, WriteCallback callback) override;
+    void OnEndStreamSent(WriteCallback callback) override;
 
    private:
+    friend class ChannelProcessor;
+
     Stream(Stream const&) = delete;
     Stream& operator=(Stream const&) = delete;
     Stream(Stream&&) = delete;
     Stream& operator=(Stream&&) = delete;
 
-    static tsdb2::common::flat_map<std::string, std::string> FlattenFields(hpack::HeaderSet fields);
-
     Error ErrorOut(Status http_status);
 
+    // REQUIRES: the parent's `stream_state_mutex_` must be held.
     std::string GetStreamDescriptionForErrors();
 
-    absl::Status EndStream();
+    // REQUIRES: the parent's `stream_state_mutex_` must be held.
+    absl::Status EndStreamLocked();
+
+    // Performs the state transition required to send a field block.
+    absl::Status PrepareToSendFields(bool end_stream);
+
+    // Performs the state transition required to send data.
+    absl::Status PrepareToSendData(bool end_stream);
 
     ChannelProcessor* const parent_;
-    uint32_t const id_;
+    uint32_t id_;
 
-    // Stream state.
+    // Stream state, guarded by the parent's `stream_state_mutex_`.
     StreamState state_ = StreamState::kIdle;
 
+    // Indicates whether a handler holds a reference to this stream. The handler gives it up when it
+    // closes the local end of the stream.
+    bool attached_ = false;
+
+    // Number of references acquired by the handler with `Ref`. Handlers that respond asynchronously
+    // keep using the stream after `operator()` returns, so the stream can't be reclaimed until this
+    // drops to zero even if it's detached.
+    std::atomic<size_t> num_refs_{0};
+
+    // The fields below are only used by streams opened by `SendRequest`.
+
+    bool local_ = false;
+
+    // The response being received. Empty until the response HEADERS arrive.
+    std::optional<Response> response_;
+
+    // Set when the whole response has been received.
+    bool response_complete_ = false;
+
+    // Receives the response data of streaming requests. Shared so that it can be invoked without
+    // holding any locks.
+    std::shared_ptr<ResponseDataCallback> response_data_callback_;
+
+    // Set when the outcome of the request has been handed over for delivery to the callback.
+    bool settled_ = false;
+
     // Flow control window size.
     size_t window_size_;
 
     // Chunks of data received by DATA packets that are not yet processed by the handler are
     // buffered here.
     DataBuffer data_buffer_;
+
+    // The fields below are guarded by the parent processor's `flow_mutex_`.
+
+    // Flow-control window granted by the peer. May become negative if the peer shrinks its initial
+    // window size (see https://httpwg.org/specs/rfc9113.html#rfc.section.6.9.2).
+    int64_t send_window_;
+
+    // Outbound items waiting for flow-control window.
+    std::deque<OutboundItem> outbound_;
+
+    // Callbacks registered with `OnEndStreamSent`. They're moved to the frame or outbound item that
+    // closes the local end of the stream.
+    std::vector<WriteCompletion> end_stream_completions_;
+
+    // Bytes received and consumed by the handler (or discarded as padding) but not yet returned to
+    // the peer in a WINDOW_UPDATE frame.
+    size_t recv_consumed_ = 0;
   };
 
   ChannelProcessor(ChannelProcessor const&) = delete;
@@ -144,21 +366,116 @@ class ChannelProcessor final {
   ChannelProcessor(ChannelProcessor&&) = delete;
   ChannelProcessor& operator=(ChannelProcessor&&) = delete;
 
-  void SendFields(uint32_t const stream_id, hpack::HeaderSet const& fields, bool const end_stream) {
-    write_queue_.AppendFieldsFrames(stream_id, fields, end_stream);
-  }
-
-  void SendData(uint32_t const stream_id, tsdb2::io::Buffer const& data, bool const end_of_stream) {
-    write_queue_.AppendDataFrames(stream_id, data, end_of_stream);
-  }
+  // Sends a field block on behalf of a stream. If the stream has outbound data waiting for
+  // flow-control window the field block is queued behind it.
+  void SendFields(Stream* stream, hpack::PrecompiledHeaders const* precompiled,
+                  hpack::HeaderSet const& fields, bool end_stream) ABSL_LOCKS_EXCLUDED(flow_mutex_);
+
+  // Enqueues outbound data on behalf of a stream and sends as much as the flow-control windows
+  // allow.
+  void SendData(Stream* stream, tsdb2::io::Buffer data, bool end_stream,
+                StreamInterface::WriteCallback callback) ABSL_LOCKS_EXCLUDED(flow_mutex_);
+
+  // Like `SendData`, but the data is a range of a file.
+  void SendFile(Stream* stream, tsdb2::io::FD fd, off_t offset, size_t length, bool end_stream,
+                StreamInterface::WriteCallback callback) ABSL_LOCKS_EXCLUDED(flow_mutex_);
+
+  // Like `SendData`, but the data is a cord whose pieces are referenced by the DATA frames.
+  void SendCord(Stream* stream, tsdb2::io::Cord cord, bool end_stream,
+                StreamInterface::WriteCallback callback) ABSL_LOCKS_EXCLUDED(flow_mutex_);
+
+  // Adds an item to the outbound queue of `stream` and sends as much as the flow-control windows
+  // allow. The item is dropped (thus failing its completion callback) if the processor has shut
+  // down.
+  void EnqueueOutbound(Stream* stream, OutboundItem item) ABSL_LOCKS_EXCLUDED(flow_mutex_);
+
+  // Returns a write queue callback that runs `completions`, or an empty callback if there are none.
+  static WriteQueue::WriteCallback MakeWriteCallback(std::vector<WriteCompletion> completions);
+
+  // Enqueues DATA frames for the next `length` bytes of `item`, i.e. starting at `item.offset`.
+  std::optional<WriteQueue::Frame> EnqueueOutboundData(uint32_t stream_id, OutboundItem const& item,
+                                                       size_t length, bool end_stream,
+                                                       WriteQueue::WriteCallback callback);
+
+  // Sends the outbound items of `stream` as far as the flow-control windows allow. The first frame
+  // is stored in `first_frame` if the write queue was idle, and the caller must flush it after
+  // releasing `flow_mutex_`.
+  void FlushStreamLocked(Stream* stream, std::optional<WriteQueue::Frame>* first_frame)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(flow_mutex_);
+
+  // Removes and returns the outbound items of `stream`. The caller must destroy them (thus failing
+  // their completion callbacks) after releasing `flow_mutex_`.
+  std::deque<OutboundItem> DropOutboundLocked(Stream* stream)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(flow_mutex_);
+
+  // Invoked when the handler of `stream` has consumed `size` bytes of data. Replenishes the
+  // stream's receive window when enough data has been consumed.
+  void ConsumeStreamData(Stream* stream, size_t size) ABSL_LOCKS_EXCLUDED(flow_mutex_);
+
+  // Accounts `length` bytes of received DATA to the outstanding BDP probe, or starts a new probe
+  // if none is outstanding and the receive windows can still grow. Returns the payload of the PING
+  // frame to send if a probe was started.
+  std::optional<uint64_t> SampleBdpLocked(size_t length) ABSL_EXCLUSIVE_LOCKS_REQUIRED(flow_mutex_);
+
+  // Completes the outstanding BDP probe upon receiving the PING ACK with the specified payload, and
+  // grows the receive windows if the peer was limited by them. Returns false if `payload` doesn't
+  // belong to the outstanding probe.
+  bool ProcessBdpPingAck(uint64_t payload) ABSL_LOCKS_EXCLUDED(mutex_, flow_mutex_);
+
+  // Returns the largest stream-level receive window that keeps the sum of the windows of
+  // `num_streams` streams within `receive_memory_budget_`, but no less than the initial window.
+  size_t GetMaxStreamRecvWindow(size_t num_streams) const;
 
   tsdb2::io::Buffer MakeSettingsFrame() const ABSL_SHARED_LOCKS_REQUIRED(mutex_);
 
+  // Makes a SETTINGS frame announcing only the specified SETTINGS_INITIAL_WINDOW_SIZE.
+  static tsdb2::io::Buffer MakeInitialWindowSizeSettingsFrame(size_t window_size);
+
   void GoAwayNowLocked(ErrorCode error_code) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Returns the stream with the specified ID, creating it if it's a new one. Returns an
+  // `OUT_OF_RANGE` error if the ID belongs to a stream that has already been closed and reclaimed,
+  // in which case the caller must reset it with STREAM_CLOSED, `NOT_FOUND` if the frames of the
+  // stream must be silently ignored (e.g. because we reset it), `FAILED_PRECONDITION` if the peer
+  // used a stream ID it's not allowed to, and `CANCELLED` if the connection is going away.
   absl::StatusOr<Stream*> GetOrCreateStreamLocked(uint32_t id)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Creates a new stream with the specified ID, possibly reusing a pooled one.
+  Stream* CreateStreamLocked(uint32_t id) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Returns the outcome of the request carried by `stream` if it has just been settled, i.e. if the
+  // whole response has been received or the stream failed with `error`. Returns an empty optional
+  // for streams that are not local or are not settled yet. The caller must pass the result to
+  // `DeliverResponse` after releasing `mutex_`.
+  std::optional<absl::StatusOr<Response>> SettleResponseLocked(Stream* stream, Error const& error)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Invokes the response callback of the specified stream, unless `Shutdown` already did.
+  void DeliverResponse(uint32_t stream_id, absl::StatusOr<Response> response)
+      ABSL_LOCKS_EXCLUDED(mutex_, responses_mutex_);
+
+  // Records that we're sending RST_STREAM for the specified stream, so that the frames the peer
+  // sent before receiving it are ignored.
+  void RememberResetStreamLocked(uint32_t stream_id) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Moves the stream to the free pool if it's reclaimable.
+  void MaybeReclaimStreamLocked(Stream* stream) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Invoked by a stream when its handler closes the local end. Handlers may or may not hold
+  // `mutex_` at that point (depending on whether they respond synchronously), so the stream ID is
+  // only queued here and the stream is detached and possibly reclaimed by
+  // `ProcessReleasedStreamsLocked` later.
+  void ReleaseStream(uint32_t stream_id) ABSL_LOCKS_EXCLUDED(released_mutex_);
+
+  // Invoked by a stream when its handler drops the last reference to it. Like `ReleaseStream` the
+  // stream ID is only queued here, and the stream is possibly reclaimed by
+  // `ProcessReleasedStreamsLocked` later.
+  void UnrefStream(uint32_t stream_id) ABSL_LOCKS_EXCLUDED(released_mutex_);
+
+  void ProcessReleasedStreamsLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_)
+      ABSL_LOCKS_EXCLUDED(released_mutex_);
+
   static Error ValidateDataHeader(FrameHeader const& header);
   static Error ValidateHeadersHeader(FrameHeader const& header);
   static Error ValidatePriorityHeader(FrameHeader const& header);
@@ -175,17 +492,19 @@ class ChannelProcessor final {
   void ProcessDataFrame(FrameHeader const& header, tsdb2::io::Buffer payload)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
-  void ProcessFieldBlock(uint32_t stream_id, tsdb2::io::Buffer field_block)
+  void ProcessFieldBlock(uint32_t stream_id, tsdb2::io::Buffer field_block, bool end_stream)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
   void ProcessHeadersFrame(FrameHeader const& header, tsdb2::io::Buffer payload);
 
-  void ProcessContinuationFrame(uint32_t stream_id, tsdb2::io::Cord field_block,
+  void ProcessContinuationFrame(uint32_t stream_id, tsdb2::io::Cord field_block, bool end_stream,
                                 FrameHeader const& header, tsdb2::io::Buffer payload);
 
-  void ProcessResetStreamFrame(FrameHeader const& header) ABSL_LOCKS_EXCLUDED(mutex_);
+  void ProcessResetStreamFrame(FrameHeader const& header, tsdb2::io::Buffer const& payload)
+      ABSL_LOCKS_EXCLUDED(mutex_);
 
-  void ProcessSettingsFrame(FrameHeader const& header, tsdb2::io::Buffer const& payload);
+  void ProcessSettingsFrame(FrameHeader const& header, tsdb2::io::Buffer const& payload)
+      ABSL_LOCKS_EXCLUDED(mutex_, flow_mutex_, responses_mutex_);
 
   void ProcessPushPromiseFrame(FrameHeader const& header) ABSL_LOCKS_EXCLUDED(mutex_);
 
@@ -194,29 +513,137 @@ class ChannelProcessor final {
   void ProcessGoAwayFrame(FrameHeader const& header, tsdb2::io::Buffer payload)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
-  void ProcessWindowUpdateFrame(FrameHeader const& header, tsdb2::io::Buffer buffer)
-      ABSL_LOCKS_EXCLUDED(mutex_);
+  void ProcessWindowUpdateFrame(FrameHeader const& header, tsdb2::io::Buffer const& payload)
+      ABSL_LOCKS_EXCLUDED(mutex_, flow_mutex_);
 
   absl::StatusOr<Handler*> GetHandler(std::string_view path) const;
 
   internal::ChannelInterface* const parent_;
 
+  bool const is_client_;
+
   // Most of our local settings are stored here. The max HPACK dynamic header table size is inside
   // the decoder below.
-  bool const enable_push_ = true;
+  bool const enable_push_;
   std::optional<size_t> const max_concurrent_streams_;
   size_t const initial_stream_window_size_;
   size_t const max_frame_payload_size_;
   size_t const max_header_list_size_;
 
+  // Receive window tuning, see `--http2_bdp_probe`, `--http2_max_receive_window_size`, and
+  // `--http2_receive_memory_budget`.
+  bool const bdp_probe_;
+  size_t const max_receive_window_size_;
+  size_t const receive_memory_budget_;
+
   absl::Mutex mutable mutex_;
 
   hpack::Decoder field_decoder_ ABSL_GUARDED_BY(mutex_);
 
-  absl::btree_set<std::unique_ptr<Stream>, Stream::Compare> streams_ ABSL_GUARDED_BY(mutex_);
+  // Live streams, keyed by ID.
+  absl::flat_hash_map<uint32_t, std::unique_ptr<Stream>> streams_ ABSL_GUARDED_BY(mutex_);
+
+  // Reclaimed streams available for reuse. Capped to `kMaxPooledStreams`.
+  std::vector<std::unique_ptr<Stream>> stream_pool_ ABSL_GUARDED_BY(mutex_);
+
+  // IDs of the streams we reset most recently. As per
+  // https://httpwg.org/specs/rfc9113.html#rfc.section.5.1 the peer may have sent more frames on
+  // them before receiving our RST_STREAM, and those must be ignored rather than treated as
+  // connection errors. The same IDs are kept in a deque in order of insertion so that the oldest
+  // ones can be forgotten when there are more than `kMaxResetStreams`.
+  absl::flat_hash_set<uint32_t> reset_stream_ids_ ABSL_GUARDED_BY(mutex_);
+  std::deque<uint32_t> reset_stream_order_ ABSL_GUARDED_BY(mutex_);
+
   uint32_t last_processed_stream_id_ ABSL_GUARDED_BY(mutex_) = 0;
   bool going_away_ ABSL_GUARDED_BY(mutex_) = false;
 
+  // ID of the next stream opened by `SendRequest`. Client-initiated streams have odd IDs.
+  uint32_t next_local_stream_id_ ABSL_GUARDED_BY(mutex_) = 1;
+
+  // The three atomics below are only modified while holding `mutex_`, but they're read without
+  // it.
+
+  // Number of streams opened by `SendRequest` and not yet settled.
+  std::atomic<size_t> num_local_streams_{0};
+
+  // The peer's SETTINGS_MAX_CONCURRENT_STREAMS. Unlimited until the peer says otherwise, as per
+  // https://httpwg.org/specs/rfc9113.html#SETTINGS_MAX_CONCURRENT_STREAMS.
+  std::atomic<size_t> peer_max_concurrent_streams_{std::numeric_limits<uint32_t>::max()};
+
+  // Cleared when the connection starts going away.
+  std::atomic<bool> accepting_requests_{true};
+
+  // IDs of the streams released or unreferenced by their handlers but not yet processed by
+  // `ProcessReleasedStreamsLocked`. Guarded by a separate mutex because `ReleaseStream` and
+  // `UnrefStream` may run with or without `mutex_`.
+  absl::Mutex released_mutex_ ABSL_ACQUIRED_AFTER(mutex_);
+  std::vector<uint32_t> released_stream_ids_ ABSL_GUARDED_BY(released_mutex_);
+  std::vector<uint32_t> unreferenced_stream_ids_ ABSL_GUARDED_BY(released_mutex_);
+
+  // Guards the state of the streams (see `Stream::state_`). This is separate from `mutex_` because
+  // handlers transition their streams when sending fields or data, and they may do so with or
+  // without holding `mutex_` (e.g. inline handlers run while it's held, while the ones wrapped in
+  // an `ExecutorHandler` run in other threads). Nothing else is acquired nor invoked while holding
+  // this mutex.
+  absl::Mutex mutable stream_state_mutex_ ABSL_ACQUIRED_AFTER(mutex_, flow_mutex_);
+
+  // Guards flow-control state, including the flow-control fields of the streams. This is separate
+  // from `mutex_` because handlers may send data with or without holding `mutex_`.
+  //
+  // NOTE: completion callbacks of outbound data may run synchronously when frames are written, so
+  // `flow_mutex_` must never be held while writing (see `WriteQueue::Flush`) nor while destroying
+  // an `OutboundItem`.
+  absl::Mutex flow_mutex_ ABSL_ACQUIRED_AFTER(mutex_);
+
+  // Initial flow-control window of new streams, as per the peer's SETTINGS_INITIAL_WINDOW_SIZE.
+  int64_t peer_initial_window_size_ ABSL_GUARDED_BY(flow_mutex_) = kDefaultInitialWindowSize;
+
+  // Connection-level flow-control window granted by the peer.
+  int64_t connection_send_window_ ABSL_GUARDED_BY(flow_mutex_) = kDefaultInitialWindowSize;
+
+  // Streams with outbound items waiting for flow-control window.
+  absl::flat_hash_set<Stream*> blocked_streams_ ABSL_GUARDED_BY(flow_mutex_);
+
+  // Bytes received but not yet returned to the peer in a connection-level WINDOW_UPDATE.
+  size_t connection_recv_consumed_ ABSL_GUARDED_BY(flow_mutex_) = 0;
+
+  // Connection-level receive window. Starts at the default mandated by the spec and only changes
+  // if BDP probing grows it.
+  size_t connection_recv_window_ ABSL_GUARDED_BY(flow_mutex_) = kDefaultInitialWindowSize;
+
+  // Receive window of the streams, i.e. the last SETTINGS_INITIAL_WINDOW_SIZE we announced.
+  size_t stream_recv_window_ ABSL_GUARDED_BY(flow_mutex_);
+
+  // BDP probing state. A probe is a PING frame sent upon receiving DATA; the DATA received until
+  // the ACK arrives is the bandwidth-delay product sample, and the time it took is the RTT.
+  //
+  // The payload of the outstanding probe is stored in `bdp_ping_payload_`, which is empty if
+  // there's none.
+  std::optional<uint64_t> bdp_ping_payload_ ABSL_GUARDED_BY(flow_mutex_);
+  uint64_t next_bdp_ping_payload_ ABSL_GUARDED_BY(flow_mutex_) = 1;
+  absl::Time bdp_ping_time_ ABSL_GUARDED_BY(flow_mutex_);
+  size_t bdp_sample_ ABSL_GUARDED_BY(flow_mutex_) = 0;
+
+  // Highest bandwidth measured so far, in bytes per second.
+  double bdp_max_bandwidth_ ABSL_GUARDED_BY(flow_mutex_) = 0;
+
+  // Set by `Shutdown`. Any data sent afterwards fails right away.
+  bool shut_down_ ABSL_GUARDED_BY(flow_mutex_) = false;
+
+  // Callbacks of the requests sent by `SendRequest`, keyed by stream ID. Guarded by a separate
+  // mutex because `Shutdown` may run with or without `mutex_`.
+  //
+  // NOTE: `SendRequest` checks `responses_shut_down_` before acquiring `mutex_`, so that the
+  // callbacks failed by `Shutdown` (which may run while `mutex_` is held) can safely send new
+  // requests.
+  absl::Mutex mutable responses_mutex_ ABSL_ACQUIRED_AFTER(mutex_);
+  absl::flat_hash_map<uint32_t, ResponseCallback> pending_responses_
+      ABSL_GUARDED_BY(responses_mutex_);
+  bool responses_shut_down_ ABSL_GUARDED_BY(responses_mutex_) = false;
+
+  // The callback provided to `SendClientPreface`, cleared when the first SETTINGS frame arrives.
+  absl::AnyInvocable<void(absl::Status)> settings_callback_ ABSL_GUARDED_BY(responses_mutex_);
+
   WriteQueue write_queue_;
 };
 
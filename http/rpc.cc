@@ -0,0 +1,403 @@
+#include "http/rpc.h"
+
+#include <arpa/inet.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "common/no_destructor.h"
+#include "common/promise.h"
+#include "common/reffed_ptr.h"
+#include "common/trie_map.h"
+#include "common/utilities.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "io/buffer.h"
+#include "io/cord.h"
+
+namespace tsdb2 {
+namespace http {
+
+namespace {
+
+using ::tsdb2::common::Promise;
+using ::tsdb2::common::reffed_ptr;
+using ::tsdb2::io::Cord;
+using ::tsdb2::util::to_underlying;
+
+using RpcRequestCallback =
+    absl::AnyInvocable<void(reffed_ptr<StreamInterface>, RpcMessageReader)>;
+
+std::string_view constexpr kHexDigits = "0123456789ABCDEF";
+
+// Percent-encodes `grpc-message` values as per the gRPC specification: all bytes outside the
+// printable ASCII range, as well as `%` itself, are encoded.
+std::string PercentEncode(std::string_view const text) {
+  std::string result;
+  result.reserve(text.size());
+  for (char const ch : text) {
+    auto const byte = static_cast<uint8_t>(ch);
+    if (byte < 0x20 || byte > 0x7E || ch == '%') {
+      result.push_back('%');
+      result.push_back(kHexDigits[byte >> 4]);
+      result.push_back(kHexDigits[byte & 0x0F]);
+    } else {
+      result.push_back(ch);
+    }
+  }
+  return result;
+}
+
+std::optional<uint8_t> ParseHexDigit(char const ch) {
+  if (ch >= '0' && ch <= '9') {
+    return ch - '0';
+  } else if (ch >= 'A' && ch <= 'F') {
+    return ch - 'A' + 10;
+  } else if (ch >= 'a' && ch <= 'f') {
+    return ch - 'a' + 10;
+  } else {
+    return std::nullopt;
+  }
+}
+
+// Decodes `grpc-message` values. Malformed escape sequences are kept verbatim, as recommended by
+// the gRPC specification.
+std::string PercentDecode(std::string_view const text) {
+  std::string result;
+  result.reserve(text.size());
+  for (size_t i = 0; i < text.size(); ++i) {
+    if (text[i] == '%' && i + 2 < text.size()) {
+      auto const high = ParseHexDigit(text[i + 1]);
+      auto const low = ParseHexDigit(text[i + 2]);
+      if (high.has_value() && low.has_value()) {
+        result.push_back(static_cast<char>((high.value() << 4) | low.value()));
+        i += 2;
+        continue;
+      }
+    }
+    result.push_back(text[i]);
+  }
+  return result;
+}
+
+// Maps the HTTP status of a failed RPC response to an RPC status code as per
+// https://github.com/grpc/grpc/blob/master/doc/http-grpc-status-mapping.md.
+absl::StatusCode HttpStatusToRpcCode(uint16_t const status) {
+  switch (status) {
+    case 400:
+      return absl::StatusCode::kInternal;
+    case 401:
+      return absl::StatusCode::kUnauthenticated;
+    case 403:
+      return absl::StatusCode::kPermissionDenied;
+    case 404:
+      return absl::StatusCode::kUnimplemented;
+    case 429:
+    case 502:
+    case 503:
+    case 504:
+      return absl::StatusCode::kUnavailable;
+    default:
+      return absl::StatusCode::kUnknown;
+  }
+}
+
+hpack::PrecompiledHeaders const& GetResponseHeaders() {
+  static tsdb2::common::NoDestructor<hpack::PrecompiledHeaders> const kResponseHeaders{
+      hpack::Encoder::Precompile({
+          {":status", absl::StrCat(to_underlying(Status::k200))},
+          {"content-type", std::string(kRpcContentType)},
+      })};
+  return *kResponseHeaders;
+}
+
+void ReadRpcRequestChunk(reffed_ptr<StreamInterface> stream, RpcMessageReader reader,
+                         RpcRequestCallback callback) {
+  auto* const ptr = stream.get();
+  ptr->ReadData([stream = std::move(stream), reader = std::move(reader),
+                 callback = std::move(callback)](absl::StatusOr<Cord> status_or_data,
+                                                 bool const end) mutable {
+    if (!status_or_data.ok()) {
+      // The client may have reset the stream, in which case sending the trailers fails too, but we
+      // try anyway so that the RPC is never left without a status.
+      auto const& status = status_or_data.status();
+      auto const code = absl::IsCancelled(status) ? absl::StatusCode::kCancelled
+                                                  : absl::StatusCode::kInternal;
+      return internal::SendRpcError(
+          stream.get(),
+          absl::Status(code, absl::StrCat("failed to read the RPC request: ", status.message())));
+    }
+    reader.Append(std::move(status_or_data).value());
+    if (reader.pending_size() > kRpcMessagePrefixSize + kMaxRpcMessageSize) {
+      return internal::SendRpcError(stream.get(),
+                                    absl::ResourceExhaustedError("the RPC request is too large"));
+    }
+    if (end) {
+      callback(std::move(stream), std::move(reader));
+    } else {
+      ReadRpcRequestChunk(std::move(stream), std::move(reader), std::move(callback));
+    }
+  });
+}
+
+}  // namespace
+
+tsdb2::net::Buffer EncodeRpcMessage(Cord const& message) {
+  size_t const size = message.size();
+  tsdb2::net::Buffer buffer{kRpcMessagePrefixSize + size};
+  buffer.Append<uint8_t>(0);
+  buffer.Append<uint32_t>(::htonl(size));
+  message.CopyRange(0, size, &buffer);
+  return buffer;
+}
+
+Cord EncodeRpcMessageCord(Cord message) {
+  tsdb2::net::Buffer prefix{kRpcMessagePrefixSize};
+  prefix.Append<uint8_t>(0);
+  prefix.Append<uint32_t>(::htonl(message.size()));
+  Cord result{std::move(prefix)};
+  result.Append(std::move(message));
+  return result;
+}
+
+hpack::HeaderSet MakeRpcStatusFields(absl::Status const& status) {
+  hpack::HeaderSet fields;
+  fields.emplace_back(kRpcStatusHeaderName, absl::StrCat(to_underlying(status.code())));
+  if (!status.message().empty()) {
+    fields.emplace_back(kRpcMessageHeaderName, PercentEncode(status.message()));
+  }
+  return fields;
+}
+
+absl::Status ParseRpcStatusFields(hpack::HeaderSet const& fields) {
+  std::optional<std::string_view> code_field;
+  std::optional<std::string_view> message_field;
+  for (auto const& [name, value] : fields) {
+    if (name == kRpcStatusHeaderName) {
+      code_field = value;
+    } else if (name == kRpcMessageHeaderName) {
+      message_field = value;
+    }
+  }
+  if (!code_field.has_value()) {
+    return absl::InternalError("missing grpc-status");
+  }
+  int code = 0;
+  if (!absl::SimpleAtoi(code_field.value(), &code) || code < 0) {
+    return absl::InternalError(absl::StrCat("invalid grpc-status: ", code_field.value()));
+  }
+  if (code > to_underlying(absl::StatusCode::kUnauthenticated)) {
+    code = to_underlying(absl::StatusCode::kUnknown);
+  }
+  return absl::Status(static_cast<absl::StatusCode>(code),
+                      PercentDecode(message_field.value_or("")));
+}
+
+void RpcMessageReader::Append(Cord data) {
+  // Drop the consumed data. Only the chunks that are entirely consumed are released, a partially
+  // consumed one stays shared.
+  data_.RemovePrefix(offset_);
+  offset_ = 0;
+  data_.Append(std::move(data));
+}
+
+absl::StatusOr<std::optional<absl::Span<uint8_t const>>> RpcMessageReader::NextMessage(
+    tsdb2::io::Buffer* const scratch) {
+  if (pending_size() < kRpcMessagePrefixSize) {
+    return std::nullopt;
+  }
+  if (data_.at(offset_) != 0) {
+    return absl::UnimplementedError("compressed RPC messages are not supported");
+  }
+  size_t length = 0;
+  for (size_t i = 1; i < kRpcMessagePrefixSize; ++i) {
+    length = (length << 8) | data_.at(offset_ + i);
+  }
+  if (length > kMaxRpcMessageSize) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat("RPC message too large (", length, " bytes, max ", kMaxRpcMessageSize, ")"));
+  }
+  if (pending_size() < kRpcMessagePrefixSize + length) {
+    return std::nullopt;
+  }
+  size_t const start = offset_ + kRpcMessagePrefixSize;
+  offset_ = start + length;
+  auto const maybe_range = data_.GetContiguousRange(start, length);
+  if (maybe_range.has_value()) {
+    return maybe_range;
+  }
+  *scratch = tsdb2::io::Buffer(length);
+  data_.CopyRange(start, length, scratch);
+  return std::make_optional(scratch->span());
+}
+
+RpcServerStream::~RpcServerStream() {
+  if (!finished_) {
+    Finish(absl::InternalError("the RPC handler didn't complete the call"));
+  }
+}
+
+void RpcServerStream::Finish(absl::Status const& status) {
+  if (finished_.exchange(true)) {
+    return;
+  }
+  if (headers_sent_) {
+    stream_->SendFieldsOrLog(MakeRpcStatusFields(status), /*end_stream=*/true);
+  } else {
+    internal::SendRpcError(stream_.get(), status);
+  }
+}
+
+void RpcServerStream::WriteMessage(Cord message, StreamInterface::WriteCallback callback) {
+  if (finished_) {
+    return callback(absl::FailedPreconditionError("the RPC is already finished"));
+  }
+  if (!headers_sent_.exchange(true)) {
+    auto status = stream_->SendFields(GetResponseHeaders(), {}, /*end_stream=*/false);
+    if (!status.ok()) {
+      return callback(std::move(status));
+    }
+  }
+  stream_->StreamCord(EncodeRpcMessageCord(std::move(message)), /*end_stream=*/false,
+                      std::move(callback));
+}
+
+namespace internal {
+
+bool CheckRpcRequest(StreamInterface* const stream, Request const& request) {
+  if (request.method != Method::kPost) {
+    stream->SendFieldsOrLog({{":status", absl::StrCat(to_underlying(Status::k405))}},
+                            /*end_stream=*/true);
+    return false;
+  }
+  auto const content_type = request.headers.Find("content-type");
+  if (!content_type.has_value() || !absl::StartsWith(content_type.value(), kRpcContentType)) {
+    stream->SendFieldsOrLog({{":status", absl::StrCat(to_underlying(Status::k415))}},
+                            /*end_stream=*/true);
+    return false;
+  }
+  return true;
+}
+
+void ReadRpcRequest(reffed_ptr<StreamInterface> stream, RpcRequestCallback callback) {
+  ReadRpcRequestChunk(std::move(stream), RpcMessageReader(), std::move(callback));
+}
+
+void SendRpcResponse(StreamInterface* const stream, Cord message) {
+  auto status = stream->SendFields(GetResponseHeaders(), {}, /*end_stream=*/false);
+  if (status.ok()) {
+    status = stream->SendData(EncodeRpcMessage(message), /*end_stream=*/false);
+  }
+  if (status.ok()) {
+    status = stream->SendFields(MakeRpcStatusFields(absl::OkStatus()), /*end_stream=*/true);
+  }
+  if (!status.ok()) {
+    LOG(ERROR) << "failed to send RPC response: " << status;
+  }
+}
+
+void SendRpcError(StreamInterface* const stream, absl::Status const& status) {
+  hpack::HeaderSet fields = MakeRpcStatusFields(status);
+  stream->SendFieldsOrLog(GetResponseHeaders(), fields, /*end_stream=*/true);
+}
+
+}  // namespace internal
+
+absl::Status RpcService::AddHandlers(
+    tsdb2::common::trie_map<std::unique_ptr<Handler>>* const handlers) {
+  auto list = MakeHandlers();
+  for (auto const& [path, handler] : list) {
+    if (handlers->contains(path)) {
+      return absl::AlreadyExistsError(
+          absl::StrCat("path \"", absl::CEscape(path), "\" is already registered"));
+    }
+  }
+  for (auto& [path, handler] : list) {
+    handlers->try_emplace(path, std::move(handler));
+  }
+  return absl::OkStatus();
+}
+
+Promise<RpcMessageReader> RpcStub::Call(std::string_view const path, Cord request) const {
+  return client_
+      ->Request(host_, port_, Method::kPost, path,
+                {{"content-type", std::string(kRpcContentType)}, {"te", "trailers"}},
+                EncodeRpcMessage(request))
+      .Then([](absl::StatusOr<Response> status_or_response) -> absl::StatusOr<RpcMessageReader> {
+        RETURN_IF_ERROR(status_or_response.status());
+        auto& response = status_or_response.value();
+        if (response.status != to_underlying(Status::k200)) {
+          return absl::Status(HttpStatusToRpcCode(response.status),
+                              absl::StrCat("HTTP status ", response.status));
+        }
+        RETURN_IF_ERROR(ParseRpcStatusFields(response.headers));
+        RpcMessageReader reader;
+        reader.Append(std::move(response.body));
+        return reader;
+      });
+}
+
+Promise<void> RpcStub::CallStreaming(std::string_view const path, Cord request,
+                                     MessageCallback callback) const {
+  struct State {
+    explicit State(MessageCallback callback) : callback(std::move(callback)) {}
+
+    absl::Mutex mutex;
+    MessageCallback callback ABSL_GUARDED_BY(mutex);
+    RpcMessageReader reader ABSL_GUARDED_BY(mutex);
+
+    // The first error returned by `callback`. The data received afterwards is dropped.
+    absl::Status status ABSL_GUARDED_BY(mutex);
+  };
+  auto state = std::make_shared<State>(std::move(callback));
+  return client_
+      ->StreamingRequest(
+          host_, port_, Method::kPost, path,
+          {{"content-type", std::string(kRpcContentType)}, {"te", "trailers"}},
+          EncodeRpcMessage(request),
+          [state](uint16_t const status, tsdb2::net::Buffer data) {
+            if (status != to_underlying(Status::k200)) {
+              // The RPC has failed, we'll report the HTTP status when the response is complete.
+              return;
+            }
+            absl::MutexLock lock{&state->mutex};
+            if (state->status.ok()) {
+              state->reader.Append(Cord(std::move(data)));
+              state->status = state->callback(&state->reader);
+            }
+          })
+      .Then([state](absl::StatusOr<Response> status_or_response) -> absl::Status {
+        RETURN_IF_ERROR(status_or_response.status());
+        auto const& response = status_or_response.value();
+        if (response.status != to_underlying(Status::k200)) {
+          return absl::Status(HttpStatusToRpcCode(response.status),
+                              absl::StrCat("HTTP status ", response.status));
+        }
+        RETURN_IF_ERROR(ParseRpcStatusFields(response.headers));
+        absl::MutexLock lock{&state->mutex};
+        RETURN_IF_ERROR(state->status);
+        if (!state->reader.empty()) {
+          return absl::InternalError("truncated RPC message");
+        }
+        return absl::OkStatus();
+      });
+}
+
+}  // namespace http
+}  // namespace tsdb2
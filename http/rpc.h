@@ -0,0 +1,376 @@
+#ifndef __TSDB2_HTTP_RPC_H__
+#define __TSDB2_HTTP_RPC_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/functional/any_invocable.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "common/promise.h"
+#include "common/ref_count.h"
+#include "common/reffed_ptr.h"
+#include "common/trie_map.h"
+#include "common/utilities.h"
+#include "http/client.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "io/buffer.h"
+#include "io/cord.h"
+#include "net/base_sockets.h"
+
+namespace tsdb2 {
+namespace http {
+
+// This file implements a gRPC-compatible RPC layer on top of our HTTP/2 stack. Only the wire
+// format of https://github.com/grpc/grpc/blob/master/doc/PROTOCOL-HTTP2.md is implemented:
+// compression, deadlines, and client-streaming and bidirectional RPCs are not supported.
+//
+// Services are usually not implemented with these classes directly: the proto compiler emits a
+// typed server base class and a client stub for every service when `--proto_emit_rpc_services` is
+// set (see the `enable_rpc_services` attribute of `tsdb2_cc_proto_library`).
+
+inline std::string_view constexpr kRpcContentType = "application/grpc";
+inline std::string_view constexpr kRpcStatusHeaderName = "grpc-status";
+inline std::string_view constexpr kRpcMessageHeaderName = "grpc-message";
+
+// Every message of an RPC stream is prefixed with a 1-byte compression flag and its length as a
+// 4-byte big-endian integer.
+inline size_t constexpr kRpcMessagePrefixSize = 5;
+
+// Maximum size of a received message. Same as the gRPC default.
+inline size_t constexpr kMaxRpcMessageSize = 4 << 20;
+
+// Frames an encoded message for an RPC stream. The prefix and the message are written in a single
+// buffer that can be sent in DATA frames as it is, so the message is copied exactly once.
+tsdb2::net::Buffer EncodeRpcMessage(tsdb2::io::Cord const& message);
+
+// Like `EncodeRpcMessage`, but the message isn't copied: the returned cord shares its chunks and
+// can be sent with `StreamInterface::StreamCord`.
+tsdb2::io::Cord EncodeRpcMessageCord(tsdb2::io::Cord message);
+
+// Converts an error status into the `grpc-status` and `grpc-message` fields. `absl::StatusCode` is
+// numerically identical to the gRPC status codes.
+hpack::HeaderSet MakeRpcStatusFields(absl::Status const& status);
+
+// Parses the `grpc-status` and `grpc-message` fields of a response. The last occurrence wins, so
+// that trailers take precedence over headers. Fails with INTERNAL if `grpc-status` is missing.
+absl::Status ParseRpcStatusFields(hpack::HeaderSet const& fields);
+
+// Splits the data of an RPC stream into messages.
+//
+// Data is accumulated in a cord without flattening it. Messages that happen to lie in a single
+// piece of the cord are decoded in place, the others are copied in a scratch buffer first.
+class RpcMessageReader final {
+ public:
+  explicit RpcMessageReader() = default;
+  ~RpcMessageReader() = default;
+
+  RpcMessageReader(RpcMessageReader&&) noexcept = default;
+  RpcMessageReader& operator=(RpcMessageReader&&) noexcept = default;
+
+  // Appends data received from the stream.
+  void Append(tsdb2::io::Cord data);
+
+  // Returns the number of bytes received but not consumed yet.
+  size_t pending_size() const { return data_.size() - offset_; }
+
+  // Returns true iff all received data has been consumed.
+  bool empty() const { return pending_size() == 0; }
+
+  // Decodes the next message. Returns an empty optional if a complete message hasn't been received
+  // yet.
+  template <typename Message>
+  absl::StatusOr<std::optional<Message>> Next();
+
+  // Decodes exactly one message, failing if there's less or more data than that.
+  template <typename Message>
+  absl::StatusOr<Message> ReadSingle();
+
+  // Decodes all messages, failing if the data ends with a partial message.
+  template <typename Message>
+  absl::StatusOr<std::vector<Message>> ReadAll();
+
+ private:
+  RpcMessageReader(RpcMessageReader const&) = delete;
+  RpcMessageReader& operator=(RpcMessageReader const&) = delete;
+
+  // Consumes the next message and returns its bytes. The returned span refers either to `data_` or
+  // to `scratch`, so it's only valid until the next call to `Append`.
+  absl::StatusOr<std::optional<absl::Span<uint8_t const>>> NextMessage(tsdb2::io::Buffer* scratch);
+
+  tsdb2::io::Cord data_;
+  size_t offset_ = 0;
+};
+
+template <typename Message>
+absl::StatusOr<std::optional<Message>> RpcMessageReader::Next() {
+  tsdb2::io::Buffer scratch;
+  DEFINE_CONST_OR_RETURN(maybe_bytes, NextMessage(&scratch));
+  if (!maybe_bytes.has_value()) {
+    return std::optional<Message>();
+  }
+  DEFINE_VAR_OR_RETURN(message, Message::Decode(maybe_bytes.value()));
+  return std::make_optional(std::move(message));
+}
+
+template <typename Message>
+absl::StatusOr<Message> RpcMessageReader::ReadSingle() {
+  DEFINE_VAR_OR_RETURN(maybe_message, Next<Message>());
+  if (!maybe_message.has_value()) {
+    return absl::InternalError("missing RPC message");
+  }
+  if (!empty()) {
+    return absl::InternalError("unexpected data after the RPC message");
+  }
+  return std::move(maybe_message).value();
+}
+
+template <typename Message>
+absl::StatusOr<std::vector<Message>> RpcMessageReader::ReadAll() {
+  std::vector<Message> messages;
+  while (true) {
+    DEFINE_VAR_OR_RETURN(maybe_message, Next<Message>());
+    if (!maybe_message.has_value()) {
+      break;
+    }
+    messages.emplace_back(std::move(maybe_message).value());
+  }
+  if (!empty()) {
+    return absl::InternalError("truncated RPC message");
+  }
+  return std::move(messages);
+}
+
+// Completes a unary RPC with either a response message or an error.
+template <typename Message>
+using UnaryRpcCallback = absl::AnyInvocable<void(absl::StatusOr<Message>)>;
+
+// Server side of a server-streaming RPC. The handler sends any number of response messages with
+// `Write` and completes the RPC with `Finish`. If the last reference is dropped without calling
+// `Finish`, the RPC fails with INTERNAL.
+//
+// Calls to `Write` and `Finish` must not overlap, but it's not necessary to wait for a `Write` to
+// complete before issuing the next one. Handlers streaming many messages should do so anyway,
+// because that's how they get backpressure from HTTP/2 flow control.
+class RpcServerStream : public tsdb2::common::SimpleRefCounted {
+ public:
+  explicit RpcServerStream(tsdb2::common::reffed_ptr<StreamInterface> stream)
+      : stream_(std::move(stream)) {}
+
+  ~RpcServerStream() override;
+
+  // Completes the RPC with the provided status. Subsequent calls are ignored.
+  void Finish(absl::Status const& status);
+
+ protected:
+  void WriteMessage(tsdb2::io::Cord message, StreamInterface::WriteCallback callback);
+
+ private:
+  tsdb2::common::reffed_ptr<StreamInterface> const stream_;
+  std::atomic<bool> headers_sent_{false};
+  std::atomic<bool> finished_{false};
+};
+
+template <typename Message>
+class RpcServerWriter final : public RpcServerStream {
+ public:
+  using RpcServerStream::RpcServerStream;
+
+  // Sends a response message. `callback` is invoked once the message has been handed to the
+  // socket, or with an error if the stream is no longer usable.
+  void Write(Message const& message, StreamInterface::WriteCallback callback) {
+    WriteMessage(Message::Encode(message), std::move(callback));
+  }
+
+  // Like the above, but returns a promise that's resolved when the message has been sent.
+  tsdb2::common::Promise<void> Write(Message const& message) {
+    return tsdb2::common::Promise<void>([&](auto resolve) { Write(message, std::move(resolve)); });
+  }
+};
+
+namespace internal {
+
+// Checks that `request` is a gRPC request, responding with an HTTP error if it isn't. Returns true
+// iff the request is valid.
+bool CheckRpcRequest(StreamInterface* stream, Request const& request);
+
+// Reads the whole request stream and then invokes `callback` with the received data. The RPC fails
+// with RESOURCE_EXHAUSTED if the request exceeds `kMaxRpcMessageSize`, and with CANCELLED or
+// INTERNAL if the request can't be read (e.g. because the client reset the stream). `callback` is
+// not invoked in those cases.
+void ReadRpcRequest(
+    tsdb2::common::reffed_ptr<StreamInterface> stream,
+    absl::AnyInvocable<void(tsdb2::common::reffed_ptr<StreamInterface>, RpcMessageReader)>
+        callback);
+
+// Completes a unary RPC successfully, sending the response headers, the message, and the trailers.
+void SendRpcResponse(StreamInterface* stream, tsdb2::io::Cord message);
+
+// Fails an RPC with a "trailers-only" response.
+void SendRpcError(StreamInterface* stream, absl::Status const& status);
+
+}  // namespace internal
+
+// HTTP handler for a unary RPC method.
+template <typename RequestMessage, typename ResponseMessage>
+class UnaryRpcHandler final : public Handler {
+ public:
+  using Method =
+      absl::AnyInvocable<void(RequestMessage, UnaryRpcCallback<ResponseMessage>) const>;
+
+  explicit UnaryRpcHandler(Method method) : method_(std::move(method)) {}
+
+  void operator()(StreamInterface* const stream, Request const& request) override {
+    if (!internal::CheckRpcRequest(stream, request)) {
+      return;
+    }
+    internal::ReadRpcRequest(
+        tsdb2::common::reffed_ptr<StreamInterface>(stream),
+        [this](tsdb2::common::reffed_ptr<StreamInterface> stream, RpcMessageReader reader) {
+          auto status_or_request = reader.template ReadSingle<RequestMessage>();
+          if (!status_or_request.ok()) {
+            return internal::SendRpcError(stream.get(), status_or_request.status());
+          }
+          method_(std::move(status_or_request).value(),
+                  [stream = std::move(stream)](absl::StatusOr<ResponseMessage> status_or_response) {
+                    if (status_or_response.ok()) {
+                      internal::SendRpcResponse(
+                          stream.get(), ResponseMessage::Encode(status_or_response.value()));
+                    } else {
+                      internal::SendRpcError(stream.get(), status_or_response.status());
+                    }
+                  });
+        });
+  }
+
+ private:
+  Method const method_;
+};
+
+// HTTP handler for a server-streaming RPC method.
+template <typename RequestMessage, typename ResponseMessage>
+class ServerStreamingRpcHandler final : public Handler {
+ public:
+  using Method = absl::AnyInvocable<void(
+      RequestMessage, tsdb2::common::reffed_ptr<RpcServerWriter<ResponseMessage>>) const>;
+
+  explicit ServerStreamingRpcHandler(Method method) : method_(std::move(method)) {}
+
+  void operator()(StreamInterface* const stream, Request const& request) override {
+    if (!internal::CheckRpcRequest(stream, request)) {
+      return;
+    }
+    internal::ReadRpcRequest(
+        tsdb2::common::reffed_ptr<StreamInterface>(stream),
+        [this](tsdb2::common::reffed_ptr<StreamInterface> stream, RpcMessageReader reader) {
+          auto status_or_request = reader.template ReadSingle<RequestMessage>();
+          if (!status_or_request.ok()) {
+            return internal::SendRpcError(stream.get(), status_or_request.status());
+          }
+          method_(std::move(status_or_request).value(),
+                  tsdb2::common::WrapReffed(
+                      new RpcServerWriter<ResponseMessage>(std::move(stream))));
+        });
+  }
+
+ private:
+  Method const method_;
+};
+
+// Base class for the RPC services generated by the proto compiler.
+class RpcService {
+ public:
+  using HandlerList = std::vector<std::pair<std::string, std::unique_ptr<Handler>>>;
+
+  explicit RpcService() = default;
+  virtual ~RpcService() = default;
+
+  // Returns the handlers of the methods of the service along with their paths. The handlers refer
+  // to this service, so it must outlive them.
+  virtual HandlerList MakeHandlers() = 0;
+
+  // Adds the handlers of the service to `handlers`, e.g. a `Server::HandlerSet`. Fails with
+  // ALREADY_EXISTS without adding anything if any of the paths is already taken.
+  absl::Status AddHandlers(tsdb2::common::trie_map<std::unique_ptr<Handler>>* handlers);
+
+ private:
+  RpcService(RpcService const&) = delete;
+  RpcService& operator=(RpcService const&) = delete;
+  RpcService(RpcService&&) = delete;
+  RpcService& operator=(RpcService&&) = delete;
+};
+
+// Base class for the RPC client stubs generated by the proto compiler. Sends RPCs to a single
+// target through an `http::Client`, which must outlive the stub.
+class RpcStub {
+ public:
+  explicit RpcStub(Client* const client, std::string_view const host, uint16_t const port)
+      : client_(client), host_(host), port_(port) {}
+
+  virtual ~RpcStub() = default;
+
+  RpcStub(RpcStub const&) = default;
+  RpcStub& operator=(RpcStub const&) = default;
+  RpcStub(RpcStub&&) noexcept = default;
+  RpcStub& operator=(RpcStub&&) noexcept = default;
+
+  template <typename ResponseMessage>
+  tsdb2::common::Promise<ResponseMessage> CallUnary(std::string_view const path,
+                                                    tsdb2::io::Cord request) const {
+    return Call(path, std::move(request))
+        .Then([](RpcMessageReader reader) -> absl::StatusOr<ResponseMessage> {
+          return reader.template ReadSingle<ResponseMessage>();
+        });
+  }
+
+  // Invokes `callback` with every response message as soon as it's received. The returned promise
+  // is resolved with the status of the RPC after the last call to `callback`. Like the promise,
+  // `callback` runs in an I/O thread so it must not block.
+  template <typename ResponseMessage>
+  tsdb2::common::Promise<void> CallServerStreaming(
+      std::string_view const path, tsdb2::io::Cord request,
+      absl::AnyInvocable<void(ResponseMessage)> callback) const {
+    return CallStreaming(
+        path, std::move(request),
+        [callback = std::move(callback)](RpcMessageReader* const reader) mutable -> absl::Status {
+          while (true) {
+            DEFINE_VAR_OR_RETURN(maybe_message, reader->template Next<ResponseMessage>());
+            if (!maybe_message.has_value()) {
+              return absl::OkStatus();
+            }
+            callback(std::move(maybe_message).value());
+          }
+        });
+  }
+
+ private:
+  // Consumes the complete messages received so far. An error fails the RPC.
+  using MessageCallback = absl::AnyInvocable<absl::Status(RpcMessageReader*)>;
+
+  // Sends the request and returns the response data, or the status of the RPC if it failed.
+  tsdb2::common::Promise<RpcMessageReader> Call(std::string_view path,
+                                                tsdb2::io::Cord request) const;
+
+  // Sends the request and invokes `callback` every time more response data is received.
+  tsdb2::common::Promise<void> CallStreaming(std::string_view path, tsdb2::io::Cord request,
+                                             MessageCallback callback) const;
+
+  Client* client_;
+  std::string host_;
+  uint16_t port_;
+};
+
+}  // namespace http
+}  // namespace tsdb2
+
+#endif  // __TSDB2_HTTP_RPC_H__
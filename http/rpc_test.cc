@@ -0,0 +1,391 @@
+#include "http/rpc.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "common/reffed_ptr.h"
+#include "common/testing.h"
+#include "common/trie_map.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "http/testing.h"
+#include "io/buffer.h"
+#include "io/cord.h"
+
+namespace {
+
+using ::absl_testing::IsOk;
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::_;
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Field;
+using ::testing::Optional;
+using ::testing::Pair;
+using ::testing::Return;
+using ::tsdb2::common::reffed_ptr;
+using ::tsdb2::common::trie_map;
+using ::tsdb2::http::EncodeRpcMessage;
+using ::tsdb2::http::EncodeRpcMessageCord;
+using ::tsdb2::http::Handler;
+using ::tsdb2::http::HeadersView;
+using ::tsdb2::http::MakeRpcStatusFields;
+using ::tsdb2::http::Method;
+using ::tsdb2::http::ParseRpcStatusFields;
+using ::tsdb2::http::Request;
+using ::tsdb2::http::RpcMessageReader;
+using ::tsdb2::http::RpcServerWriter;
+using ::tsdb2::http::RpcService;
+using ::tsdb2::http::ServerStreamingRpcHandler;
+using ::tsdb2::http::StreamInterface;
+using ::tsdb2::http::UnaryRpcCallback;
+using ::tsdb2::http::UnaryRpcHandler;
+using ::tsdb2::io::Buffer;
+using ::tsdb2::io::Cord;
+using ::tsdb2::testing::http::MockStream;
+
+// Stand-in for a generated message type. The encoding is just the text.
+struct TestMessage {
+  static absl::StatusOr<TestMessage> Decode(absl::Span<uint8_t const> const bytes) {
+    std::string text{bytes.begin(), bytes.end()};
+    if (text == "bad") {
+      return absl::InvalidArgumentError("bad message");
+    }
+    return TestMessage{std::move(text)};
+  }
+
+  static Cord Encode(TestMessage const& message) {
+    return Cord(Buffer(message.text.data(), message.text.size()));
+  }
+
+  std::string text;
+};
+
+Cord MakeCord(std::string_view const text) { return Cord(Buffer(text.data(), text.size())); }
+
+// Splits the framed message into single-byte pieces, so that it's never contiguous.
+Cord Fragment(Buffer const& buffer) {
+  Cord cord;
+  for (uint8_t const byte : buffer.span()) {
+    cord.Append(Buffer(&byte, 1));
+  }
+  return cord;
+}
+
+std::string ToString(Buffer const& buffer) {
+  return std::string(buffer.as_char_array(), buffer.size());
+}
+
+TEST(RpcMessageTest, Encode) {
+  EXPECT_EQ(ToString(EncodeRpcMessage(MakeCord("lorem"))), std::string("\0\0\0\0\5lorem", 10));
+  EXPECT_EQ(ToString(EncodeRpcMessage(Cord())), std::string("\0\0\0\0\0", 5));
+}
+
+TEST(RpcMessageTest, EncodeCord) {
+  EXPECT_EQ(ToString(EncodeRpcMessageCord(MakeCord("lorem")).Flatten()),
+            std::string("\0\0\0\0\5lorem", 10));
+  EXPECT_EQ(ToString(EncodeRpcMessageCord(Cord()).Flatten()), std::string("\0\0\0\0\0", 5));
+}
+
+TEST(RpcMessageTest, EncodeFragmented) {
+  Cord message{Buffer("lorem", 5), Buffer(" ipsum", 6)};
+  EXPECT_EQ(ToString(EncodeRpcMessage(message)), std::string("\0\0\0\0\13lorem ipsum", 16));
+}
+
+TEST(RpcMessageReaderTest, Empty) {
+  RpcMessageReader reader;
+  EXPECT_TRUE(reader.empty());
+  EXPECT_THAT(reader.Next<TestMessage>(), IsOkAndHolds(Eq(std::nullopt)));
+  EXPECT_THAT(reader.ReadSingle<TestMessage>(), StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(RpcMessageReaderTest, ReadSingle) {
+  RpcMessageReader reader;
+  reader.Append(Cord(EncodeRpcMessage(MakeCord("lorem"))));
+  EXPECT_THAT(reader.ReadSingle<TestMessage>(),
+              IsOkAndHolds(Field(&TestMessage::text, "lorem")));
+  EXPECT_TRUE(reader.empty());
+}
+
+TEST(RpcMessageReaderTest, ReadSingleFragmented) {
+  RpcMessageReader reader;
+  reader.Append(Fragment(EncodeRpcMessage(MakeCord("lorem"))));
+  EXPECT_THAT(reader.ReadSingle<TestMessage>(),
+              IsOkAndHolds(Field(&TestMessage::text, "lorem")));
+}
+
+TEST(RpcMessageReaderTest, ExtraData) {
+  RpcMessageReader reader;
+  reader.Append(Cord(EncodeRpcMessage(MakeCord("lorem")), EncodeRpcMessage(MakeCord("ipsum"))));
+  EXPECT_THAT(reader.ReadSingle<TestMessage>(), StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(RpcMessageReaderTest, PartialMessage) {
+  auto const buffer = EncodeRpcMessage(MakeCord("lorem"));
+  RpcMessageReader reader;
+  reader.Append(Cord(Buffer(buffer.span(0, 7))));
+  EXPECT_THAT(reader.Next<TestMessage>(), IsOkAndHolds(Eq(std::nullopt)));
+  reader.Append(Cord(Buffer(buffer.span(7))));
+  EXPECT_THAT(reader.Next<TestMessage>(),
+              IsOkAndHolds(Optional(Field(&TestMessage::text, "lorem"))));
+  EXPECT_TRUE(reader.empty());
+}
+
+TEST(RpcMessageReaderTest, ReadAll) {
+  RpcMessageReader reader;
+  reader.Append(Cord(EncodeRpcMessage(MakeCord("lorem")), EncodeRpcMessage(MakeCord("ipsum")),
+                     EncodeRpcMessage(MakeCord("dolor"))));
+  EXPECT_THAT(reader.ReadAll<TestMessage>(),
+              IsOkAndHolds(ElementsAre(Field(&TestMessage::text, "lorem"),
+                                       Field(&TestMessage::text, "ipsum"),
+                                       Field(&TestMessage::text, "dolor"))));
+}
+
+TEST(RpcMessageReaderTest, ReadAllTruncated) {
+  auto const buffer = EncodeRpcMessage(MakeCord("ipsum"));
+  RpcMessageReader reader;
+  reader.Append(Cord(EncodeRpcMessage(MakeCord("lorem")), Buffer(buffer.span(0, 7))));
+  EXPECT_THAT(reader.ReadAll<TestMessage>(), StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(RpcMessageReaderTest, DecodeError) {
+  RpcMessageReader reader;
+  reader.Append(Cord(EncodeRpcMessage(MakeCord("bad"))));
+  EXPECT_THAT(reader.ReadSingle<TestMessage>(), StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(RpcMessageReaderTest, Compressed) {
+  RpcMessageReader reader;
+  reader.Append(MakeCord(std::string_view("\1\0\0\0\5lorem", 10)));
+  EXPECT_THAT(reader.Next<TestMessage>(), StatusIs(absl::StatusCode::kUnimplemented));
+}
+
+TEST(RpcMessageReaderTest, TooLarge) {
+  RpcMessageReader reader;
+  reader.Append(MakeCord(std::string_view("\0\1\0\0\0lorem", 10)));
+  EXPECT_THAT(reader.Next<TestMessage>(), StatusIs(absl::StatusCode::kResourceExhausted));
+}
+
+TEST(RpcStatusTest, Ok) {
+  auto const fields = MakeRpcStatusFields(absl::OkStatus());
+  EXPECT_THAT(fields, ElementsAre(Pair("grpc-status", "0")));
+  EXPECT_OK(ParseRpcStatusFields(fields));
+}
+
+TEST(RpcStatusTest, Error) {
+  auto const fields = MakeRpcStatusFields(absl::NotFoundError("lorem 100% ipsum\n"));
+  EXPECT_THAT(fields, ElementsAre(Pair("grpc-status", "5"),
+                                  Pair("grpc-message", "lorem 100%25 ipsum%0A")));
+  EXPECT_THAT(ParseRpcStatusFields(fields),
+              StatusIs(absl::StatusCode::kNotFound, "lorem 100% ipsum\n"));
+}
+
+TEST(RpcStatusTest, LastFieldWins) {
+  EXPECT_THAT(ParseRpcStatusFields({{"grpc-status", "0"}, {"grpc-status", "14"}}),
+              StatusIs(absl::StatusCode::kUnavailable));
+}
+
+TEST(RpcStatusTest, Missing) {
+  EXPECT_THAT(ParseRpcStatusFields({{"lorem", "ipsum"}}), StatusIs(absl::StatusCode::kInternal));
+}
+
+TEST(RpcStatusTest, Invalid) {
+  EXPECT_THAT(ParseRpcStatusFields({{"grpc-status", "lorem"}}),
+              StatusIs(absl::StatusCode::kInternal));
+  EXPECT_THAT(ParseRpcStatusFields({{"grpc-status", "123"}}),
+              StatusIs(absl::StatusCode::kUnknown));
+}
+
+TEST(RpcStatusTest, MalformedMessage) {
+  EXPECT_THAT(ParseRpcStatusFields({{"grpc-status", "2"}, {"grpc-message", "lorem%2"}}),
+              StatusIs(absl::StatusCode::kUnknown, "lorem%2"));
+}
+
+class RpcHandlerTest : public ::testing::Test {
+ protected:
+  explicit RpcHandlerTest() {
+    ON_CALL(stream_, Unref()).WillByDefault(Return(false));
+    request_headers_[0] = {"content-type", "application/grpc"};
+    request_.headers = HeadersView(request_headers_);
+  }
+
+  // Makes the stream deliver the provided request body in a single chunk.
+  void ExpectRead(Buffer body) {
+    EXPECT_CALL(stream_, ReadData(_))
+        .WillOnce([body = std::move(body)](StreamInterface::DataCallback callback) mutable {
+          callback(Cord(std::move(body)), /*end=*/true);
+        });
+  }
+
+  ::testing::NiceMock<MockStream> stream_;
+  HeadersView::Field request_headers_[1];
+  Request request_{Method::kPost, "/lorem.Ipsum/Dolor"};
+};
+
+TEST_F(RpcHandlerTest, Unary) {
+  UnaryRpcHandler<TestMessage, TestMessage> handler{
+      [](TestMessage request, UnaryRpcCallback<TestMessage> callback) {
+        callback(TestMessage{request.text + " ipsum"});
+      }};
+  ExpectRead(EncodeRpcMessage(MakeCord("lorem")));
+  {
+    ::testing::InSequence sequence;
+    EXPECT_CALL(stream_, SendFields(_, ElementsAre(), false)).WillOnce(Return(absl::OkStatus()));
+    EXPECT_CALL(stream_, SendData(_, false)).WillOnce([](Buffer const& data, bool) {
+      EXPECT_EQ(ToString(data), std::string("\0\0\0\0\13lorem ipsum", 16));
+      return absl::OkStatus();
+    });
+    EXPECT_CALL(stream_, SendFields(ElementsAre(Pair("grpc-status", "0")), true))
+        .WillOnce(Return(absl::OkStatus()));
+  }
+  handler(&stream_, request_);
+}
+
+TEST_F(RpcHandlerTest, UnaryError) {
+  UnaryRpcHandler<TestMessage, TestMessage> handler{
+      [](TestMessage /*request*/, UnaryRpcCallback<TestMessage> callback) {
+        callback(absl::PermissionDeniedError("nope"));
+      }};
+  ExpectRead(EncodeRpcMessage(MakeCord("lorem")));
+  EXPECT_CALL(stream_, SendFields(_, ElementsAre(Pair("grpc-status", "7"),
+                                                 Pair("grpc-message", "nope")),
+                                  true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler(&stream_, request_);
+}
+
+TEST_F(RpcHandlerTest, InvalidRequestMessage) {
+  UnaryRpcHandler<TestMessage, TestMessage> handler{
+      [](TestMessage /*request*/, UnaryRpcCallback<TestMessage> /*callback*/) {
+        ADD_FAILURE() << "the method must not be invoked";
+      }};
+  ExpectRead(EncodeRpcMessage(MakeCord("bad")));
+  EXPECT_CALL(stream_, SendFields(_, ElementsAre(Pair("grpc-status", "3"), _), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler(&stream_, request_);
+}
+
+TEST_F(RpcHandlerTest, RequestCancelled) {
+  UnaryRpcHandler<TestMessage, TestMessage> handler{
+      [](TestMessage /*request*/, UnaryRpcCallback<TestMessage> /*callback*/) {
+        ADD_FAILURE() << "the method must not be invoked";
+      }};
+  EXPECT_CALL(stream_, ReadData(_)).WillOnce([](StreamInterface::DataCallback callback) {
+    callback(absl::CancelledError("the stream was closed"), /*end=*/true);
+  });
+  EXPECT_CALL(stream_, SendFields(_, ElementsAre(Pair("grpc-status", "1"), _), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler(&stream_, request_);
+}
+
+TEST_F(RpcHandlerTest, RequestReadError) {
+  UnaryRpcHandler<TestMessage, TestMessage> handler{
+      [](TestMessage /*request*/, UnaryRpcCallback<TestMessage> /*callback*/) {
+        ADD_FAILURE() << "the method must not be invoked";
+      }};
+  EXPECT_CALL(stream_, ReadData(_)).WillOnce([](StreamInterface::DataCallback callback) {
+    callback(absl::DataLossError("oops"), /*end=*/true);
+  });
+  EXPECT_CALL(stream_, SendFields(_, ElementsAre(Pair("grpc-status", "13"), _), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler(&stream_, request_);
+}
+
+TEST_F(RpcHandlerTest, WrongMethod) {
+  UnaryRpcHandler<TestMessage, TestMessage> handler{
+      [](TestMessage /*request*/, UnaryRpcCallback<TestMessage> /*callback*/) {
+        ADD_FAILURE() << "the method must not be invoked";
+      }};
+  EXPECT_CALL(stream_, ReadData(_)).Times(0);
+  EXPECT_CALL(stream_, SendFields(ElementsAre(Pair(":status", "405")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  request_.method = Method::kGet;
+  handler(&stream_, request_);
+}
+
+TEST_F(RpcHandlerTest, WrongContentType) {
+  UnaryRpcHandler<TestMessage, TestMessage> handler{
+      [](TestMessage /*request*/, UnaryRpcCallback<TestMessage> /*callback*/) {
+        ADD_FAILURE() << "the method must not be invoked";
+      }};
+  EXPECT_CALL(stream_, ReadData(_)).Times(0);
+  EXPECT_CALL(stream_, SendFields(ElementsAre(Pair(":status", "415")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  request_headers_[0] = {"content-type", "application/json"};
+  handler(&stream_, request_);
+}
+
+TEST_F(RpcHandlerTest, ServerStreaming) {
+  ServerStreamingRpcHandler<TestMessage, TestMessage> handler{
+      [](TestMessage request, reffed_ptr<RpcServerWriter<TestMessage>> writer) {
+        writer->Write(TestMessage{request.text + " ipsum"}, [](absl::Status status) {
+          EXPECT_OK(status);
+        });
+        writer->Write(TestMessage{request.text + " dolor"}, [](absl::Status status) {
+          EXPECT_OK(status);
+        });
+        writer->Finish(absl::OkStatus());
+      }};
+  ExpectRead(EncodeRpcMessage(MakeCord("lorem")));
+  {
+    ::testing::InSequence sequence;
+    EXPECT_CALL(stream_, SendFields(_, ElementsAre(), false)).WillOnce(Return(absl::OkStatus()));
+    EXPECT_CALL(stream_, StreamData(_, false, _))
+        .WillOnce([](Buffer const& data, bool, StreamInterface::WriteCallback callback) {
+          EXPECT_EQ(ToString(data), std::string("\0\0\0\0\13lorem ipsum", 16));
+          callback(absl::OkStatus());
+        });
+    EXPECT_CALL(stream_, StreamData(_, false, _))
+        .WillOnce([](Buffer const& data, bool, StreamInterface::WriteCallback callback) {
+          EXPECT_EQ(ToString(data), std::string("\0\0\0\0\13lorem dolor", 16));
+          callback(absl::OkStatus());
+        });
+    EXPECT_CALL(stream_, SendFields(ElementsAre(Pair("grpc-status", "0")), true))
+        .WillOnce(Return(absl::OkStatus()));
+  }
+  handler(&stream_, request_);
+}
+
+TEST_F(RpcHandlerTest, ServerStreamingNotFinished) {
+  ServerStreamingRpcHandler<TestMessage, TestMessage> handler{
+      [](TestMessage /*request*/, reffed_ptr<RpcServerWriter<TestMessage>> /*writer*/) {}};
+  ExpectRead(EncodeRpcMessage(MakeCord("lorem")));
+  EXPECT_CALL(stream_, SendFields(_, ElementsAre(Pair("grpc-status", "13"), _), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler(&stream_, request_);
+}
+
+class TestService : public RpcService {
+ public:
+  HandlerList MakeHandlers() override {
+    HandlerList handlers;
+    handlers.emplace_back("/lorem.Ipsum/Dolor",
+                          std::make_unique<UnaryRpcHandler<TestMessage, TestMessage>>(
+                              [](TestMessage request, UnaryRpcCallback<TestMessage> callback) {
+                                callback(std::move(request));
+                              }));
+    return handlers;
+  }
+};
+
+TEST(RpcServiceTest, AddHandlers) {
+  TestService service;
+  trie_map<std::unique_ptr<Handler>> handlers;
+  EXPECT_OK(service.AddHandlers(&handlers));
+  EXPECT_TRUE(handlers.contains("/lorem.Ipsum/Dolor"));
+  EXPECT_THAT(service.AddHandlers(&handlers), StatusIs(absl::StatusCode::kAlreadyExists));
+}
+
+}  // namespace
@@ -8,6 +8,7 @@
 #include <utility>
 
 #include "absl/base/thread_annotations.h"
+#include "absl/flags/flag.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/memory/memory.h"
@@ -19,7 +20,9 @@
 #include "common/utilities.h"
 #include "http/channel.h"
 #include "http/channel_listener.h"
+#include "http/concurrency_limiter.h"
 #include "http/handlers.h"
+#include "http/instrumented_handler.h"
 #include "net/base_sockets.h"
 #include "net/sockets.h"
 #include "net/ssl_sockets.h"
@@ -46,6 +49,11 @@ absl::StatusOr<std::unique_ptr<Server>> Server::Create(std::string_view const ad
                                                        uint16_t const port, bool const use_ssl,
                                                        SocketOptions const& options,
                                                        HandlerSet handlers) {
+  if (absl::GetFlag(FLAGS_http_adaptive_concurrency_limit)) {
+    handlers = ConcurrencyLimitingHandler::WrapAll(std::move(handlers),
+                                                   ConcurrencyLimiter::Options(), port);
+  }
+  handlers = InstrumentedHandler::WrapAll(std::move(handlers));
   auto server = absl::WrapUnique(new Server(std::move(handlers)));
   RETURN_IF_ERROR(server->Listen(address, port, use_ssl, options));
   return server;
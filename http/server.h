@@ -45,6 +45,12 @@ class Server final : public ChannelManager {
 
   // Constructs an HTTP server bound to the specified address and listening on the specified port.
   // If the address is an empty string the server will bind to `INADDR6_ANY`.
+  //
+  // If `--http_adaptive_concurrency_limit` is set all handlers share a `ConcurrencyLimiter`, so
+  // that the server rejects requests early rather than queueing them when it's overloaded.
+  //
+  // All handlers are wrapped in an `InstrumentedHandler`, so the server exports request metrics
+  // for every registered path.
   static absl::StatusOr<std::unique_ptr<Server>> Create(std::string_view address, uint16_t port,
                                                         bool use_ssl,
                                                         tsdb2::net::SocketOptions const& options,
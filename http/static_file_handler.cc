@@ -0,0 +1,111 @@
+#include "http/static_file_handler.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "io/fd.h"
+
+namespace tsdb2 {
+namespace http {
+
+namespace {
+
+using ::tsdb2::io::FD;
+
+std::string_view constexpr kIfNoneMatchHeaderName = "if-none-match";
+
+std::string MakeETag(struct stat const& info) {
+  uint64_t const mtime_ns = static_cast<uint64_t>(info.st_mtim.tv_sec) * 1000000000 +
+                            static_cast<uint64_t>(info.st_mtim.tv_nsec);
+  return absl::StrCat("\"", absl::Hex(info.st_ino), "-", absl::Hex(info.st_size), "-",
+                      absl::Hex(mtime_ns), "\"");
+}
+
+// Checks whether the value of an `if-none-match` field matches `etag`. As per
+// https://httpwg.org/specs/rfc9110.html#field.if-none-match the comparison is weak, so the `W/`
+// prefix is ignored.
+bool MatchesETag(std::string_view const if_none_match, std::string_view const etag) {
+  for (std::string_view candidate : absl::StrSplit(if_none_match, ',')) {
+    candidate = absl::StripAsciiWhitespace(candidate);
+    if (candidate == "*") {
+      return true;
+    }
+    absl::ConsumePrefix(&candidate, "W/");
+    if (candidate == etag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+StaticFileHandler::StaticFileHandler(std::string_view const file_path,
+                                     std::string_view const content_type)
+    : file_path_(file_path),
+      ok_headers_(hpack::Encoder::Precompile({
+          {":status", "200"},
+          {"content-type", std::string(content_type)},
+      })) {}
+
+void StaticFileHandler::operator()(StreamInterface* const stream, Request const& request) {
+  if (request.method != Method::kGet && request.method != Method::kHead) {
+    return stream->SendFieldsOrLog({{":status", "405"}, {"allow", "GET, HEAD"}},
+                                   /*end_stream=*/true);
+  }
+  FD fd{::open(file_path_.c_str(), O_RDONLY | O_CLOEXEC)};  // NOLINT(*-vararg)
+  struct stat info {};
+  if (!fd || ::fstat(*fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+    if (!fd && errno != ENOENT) {
+      LOG(ERROR) << absl::ErrnoToStatus(errno,
+                                        absl::StrCat("open(\"", absl::CEscape(file_path_), "\")"));
+    }
+    return stream->SendFieldsOrLog({{":status", "404"}}, /*end_stream=*/true);
+  }
+  auto const etag = MakeETag(info);
+  auto const if_none_match = request.headers.Find(kIfNoneMatchHeaderName);
+  if (if_none_match.has_value() && MatchesETag(*if_none_match, etag)) {
+    return stream->SendFieldsOrLog({{":status", "304"}, {"etag", etag}}, /*end_stream=*/true);
+  }
+  size_t const size = info.st_size;
+  bool const has_body = request.method != Method::kHead && size > 0;
+  auto const status =
+      stream->SendFields(ok_headers_, {{"content-length", absl::StrCat(size)}, {"etag", etag}},
+                         /*end_stream=*/!has_body);
+  if (!status.ok()) {
+    LOG(ERROR) << status;
+    return;
+  }
+  if (has_body) {
+    // There's nothing left to do once the file has been sent. If sending fails (e.g. because the
+    // peer reset the stream or the connection dropped) the stream is already unusable, so all we
+    // can do is log.
+    stream->StreamFile(std::move(fd), /*offset=*/0, size, /*end_stream=*/true,
+                       [file_path = file_path_](absl::Status const status) {
+                         if (!status.ok()) {
+                           LOG(ERROR) << "failed to send \"" << absl::CEscape(file_path)
+                                      << "\": " << status;
+                         }
+                       });
+  }
+}
+
+}  // namespace http
+}  // namespace tsdb2
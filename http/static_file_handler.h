@@ -0,0 +1,59 @@
+#ifndef __TSDB2_HTTP_STATIC_FILE_HANDLER_H__
+#define __TSDB2_HTTP_STATIC_FILE_HANDLER_H__
+
+#include <string>
+#include <string_view>
+
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+
+namespace tsdb2 {
+namespace http {
+
+// Serves the content of a file on disk.
+//
+// The file is opened for every request, so it can be replaced or modified while the server runs.
+// The body is sent with `StreamInterface::StreamFile`, so it's never buffered in memory as a whole:
+// on plaintext connections it goes from the page cache to the socket with `sendfile`, while TLS
+// connections read it one DATA frame at a time as the socket drains.
+//
+// Files must be replaced (e.g. renamed over) rather than truncated in place while they're being
+// served: a response whose file shrinks midway can't be completed, and its connection is dropped.
+//
+// Responses carry an `etag` derived from the inode number, size, and modification time of the file.
+// Requests whose `if-none-match` field matches the current tag get an empty 304 response.
+//
+// Only GET and HEAD are supported, other methods get a 405 response. A 404 is sent if the file
+// doesn't exist or isn't a regular file.
+//
+// NOTE: opening a file may block, so this handler should run in a pool (see `HandlerOptions`)
+// rather than inline in the I/O threads. The content itself is read by the I/O threads as they
+// write it, which is cheap as long as the served files stay in the page cache.
+class StaticFileHandler final : public Handler {
+ public:
+  explicit StaticFileHandler(std::string_view file_path,
+                             std::string_view content_type = "application/octet-stream");
+
+  ~StaticFileHandler() override = default;
+
+  std::string_view file_path() const { return file_path_; }
+
+  void operator()(StreamInterface* stream, Request const& request) override;
+
+ private:
+  StaticFileHandler(StaticFileHandler const&) = delete;
+  StaticFileHandler& operator=(StaticFileHandler const&) = delete;
+  StaticFileHandler(StaticFileHandler&&) = delete;
+  StaticFileHandler& operator=(StaticFileHandler&&) = delete;
+
+  std::string const file_path_;
+
+  // The `:status` and `content-type` fields of successful responses.
+  hpack::PrecompiledHeaders const ok_headers_;
+};
+
+}  // namespace http
+}  // namespace tsdb2
+
+#endif  // __TSDB2_HTTP_STATIC_FILE_HANDLER_H__
@@ -0,0 +1,227 @@
+#include "http/static_file_handler.h"
+
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "common/testing.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "http/http.h"
+#include "http/testing.h"
+#include "io/fd.h"
+
+namespace {
+
+using ::testing::_;
+using ::testing::AllOf;
+using ::testing::Contains;
+using ::testing::ElementsAre;
+using ::testing::Key;
+using ::testing::Not;
+using ::testing::Pair;
+using ::testing::Return;
+using ::testing::TestTempFile;
+using ::tsdb2::http::HeadersView;
+using ::tsdb2::http::Method;
+using ::tsdb2::http::Request;
+using ::tsdb2::http::StaticFileHandler;
+using ::tsdb2::http::StreamInterface;
+using ::tsdb2::http::hpack::HeaderSet;
+using ::tsdb2::http::hpack::PrecompiledHeaders;
+using ::tsdb2::io::FD;
+using ::tsdb2::testing::http::MockStream;
+
+std::string_view constexpr kTestFileName = "static_file_handler_test";
+
+// Reads the range of `fd` passed to `StreamInterface::StreamFile`.
+std::string ReadRange(FD const& fd, off_t const offset, size_t const length) {
+  std::string content(length, 0);
+  CHECK_EQ(::pread(*fd, content.data(), length, offset), static_cast<ssize_t>(length));
+  return content;
+}
+
+class StaticFileHandlerTest : public ::testing::Test {
+ protected:
+  explicit StaticFileHandlerTest() : file_(CreateFile()), handler_(file_.path(), "text/plain") {}
+
+  static TestTempFile CreateFile() {
+    auto status_or_file = TestTempFile::Create(kTestFileName);
+    CHECK_OK(status_or_file);
+    return std::move(status_or_file).value();
+  }
+
+  void WriteFile(std::string_view const content) {
+    CHECK_EQ(::ftruncate(*file_.fd(), 0), 0);
+    CHECK_EQ(::pwrite(*file_.fd(), content.data(), content.size(), 0),
+             static_cast<ssize_t>(content.size()));
+  }
+
+  // Sends a GET request and returns the `etag` field of the response.
+  std::string GetETag() {
+    std::optional<std::string> etag;
+    MockStream stream;
+    EXPECT_CALL(stream, SendFields(_, _, true))
+        .WillOnce([&](PrecompiledHeaders const& /*precompiled*/, HeaderSet const& fields,
+                      bool /*end_stream*/) {
+          for (auto const& [name, value] : fields) {
+            if (name == "etag") {
+              etag = value;
+            }
+          }
+          return absl::OkStatus();
+        });
+    handler_(&stream, Request{Method::kHead, "/foo"});
+    CHECK(etag.has_value());
+    return std::move(etag).value();
+  }
+
+  TestTempFile file_;
+  StaticFileHandler handler_;
+};
+
+TEST_F(StaticFileHandlerTest, FilePath) { EXPECT_EQ(handler_.file_path(), file_.path()); }
+
+TEST_F(StaticFileHandlerTest, ServeFile) {
+  WriteFile("lorem ipsum");
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(_, AllOf(Contains(Pair("content-length", "11")),
+                                          Contains(Key("etag"))),
+                                 false))
+      .WillOnce(Return(absl::OkStatus()));
+  std::optional<std::string> content;
+  EXPECT_CALL(stream, StreamFile(_, 0, 11, true, _))
+      .WillOnce([&](FD fd, off_t const offset, size_t const length, bool /*end_stream*/,
+                    StreamInterface::WriteCallback callback) {
+        content = ReadRange(fd, offset, length);
+        callback(absl::OkStatus());
+      });
+  handler_(&stream, Request{Method::kGet, "/foo"});
+  EXPECT_EQ(content, "lorem ipsum");
+}
+
+TEST_F(StaticFileHandlerTest, ServeLargeFileInOneCall) {
+  size_t constexpr kSize = (1 << 20) + 10;
+  WriteFile(std::string(kSize, 'x'));
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(_, Contains(Pair("content-length", absl::StrCat(kSize))), false))
+      .WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(stream, StreamFile(_, 0, kSize, true, _))
+      .WillOnce([](FD /*fd*/, off_t /*offset*/, size_t /*length*/, bool /*end_stream*/,
+                   StreamInterface::WriteCallback callback) { callback(absl::OkStatus()); });
+  handler_(&stream, Request{Method::kGet, "/foo"});
+}
+
+TEST_F(StaticFileHandlerTest, IgnoreWriteError) {
+  WriteFile("lorem ipsum");
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(_, _, false)).WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(stream, StreamFile(_, _, _, true, _))
+      .WillOnce([](FD /*fd*/, off_t /*offset*/, size_t /*length*/, bool /*end_stream*/,
+                   StreamInterface::WriteCallback callback) {
+        callback(absl::CancelledError("stream reset"));
+      });
+  EXPECT_CALL(stream, SendData(_, _)).Times(0);
+  handler_(&stream, Request{Method::kGet, "/foo"});
+}
+
+TEST_F(StaticFileHandlerTest, ServeEmptyFile) {
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(_, Contains(Pair("content-length", "0")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler_(&stream, Request{Method::kGet, "/foo"});
+}
+
+TEST_F(StaticFileHandlerTest, Head) {
+  WriteFile("lorem ipsum");
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(_, Contains(Pair("content-length", "11")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  EXPECT_CALL(stream, StreamFile(_, _, _, _, _)).Times(0);
+  handler_(&stream, Request{Method::kHead, "/foo"});
+}
+
+TEST_F(StaticFileHandlerTest, NotModified) {
+  WriteFile("lorem ipsum");
+  auto const etag = GetETag();
+  std::vector<HeadersView::Field> const fields{{"if-none-match", etag}};
+  Request request{Method::kGet, "/foo"};
+  request.headers = HeadersView(fields);
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(ElementsAre(Pair(":status", "304"), Pair("etag", etag)), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler_(&stream, request);
+}
+
+TEST_F(StaticFileHandlerTest, WeakETagMatches) {
+  WriteFile("lorem ipsum");
+  auto const etag = GetETag();
+  auto const if_none_match = absl::StrCat("\"foo\", W/", etag);
+  std::vector<HeadersView::Field> const fields{{"if-none-match", if_none_match}};
+  Request request{Method::kGet, "/foo"};
+  request.headers = HeadersView(fields);
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(Contains(Pair(":status", "304")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler_(&stream, request);
+}
+
+TEST_F(StaticFileHandlerTest, WildcardMatches) {
+  WriteFile("lorem ipsum");
+  std::vector<HeadersView::Field> const fields{{"if-none-match", "*"}};
+  Request request{Method::kGet, "/foo"};
+  request.headers = HeadersView(fields);
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(Contains(Pair(":status", "304")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler_(&stream, request);
+}
+
+TEST_F(StaticFileHandlerTest, Modified) {
+  WriteFile("lorem ipsum");
+  auto const etag = GetETag();
+  WriteFile("dolor sit amet");
+  std::vector<HeadersView::Field> const fields{{"if-none-match", etag}};
+  Request request{Method::kGet, "/foo"};
+  request.headers = HeadersView(fields);
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(_, Not(Contains(Pair("etag", etag))), false))
+      .WillOnce(Return(absl::OkStatus()));
+  std::optional<std::string> content;
+  EXPECT_CALL(stream, StreamFile(_, 0, 14, true, _))
+      .WillOnce([&](FD fd, off_t const offset, size_t const length, bool /*end_stream*/,
+                    StreamInterface::WriteCallback callback) {
+        content = ReadRange(fd, offset, length);
+        callback(absl::OkStatus());
+      });
+  handler_(&stream, request);
+  EXPECT_EQ(content, "dolor sit amet");
+}
+
+TEST_F(StaticFileHandlerTest, NotFound) {
+  StaticFileHandler handler{absl::StrCat(file_.path(), ".missing")};
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(ElementsAre(Pair(":status", "404")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler(&stream, Request{Method::kGet, "/foo"});
+}
+
+TEST_F(StaticFileHandlerTest, MethodNotAllowed) {
+  MockStream stream;
+  EXPECT_CALL(stream, SendFields(Contains(Pair(":status", "405")), true))
+      .WillOnce(Return(absl::OkStatus()));
+  handler_(&stream, Request{Method::kPost, "/foo"});
+}
+
+}  // namespace
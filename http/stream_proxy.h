@@ -0,0 +1,96 @@
+#ifndef __TSDB2_HTTP_STREAM_PROXY_H__
+#define __TSDB2_HTTP_STREAM_PROXY_H__
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "common/ref_count.h"
+#include "common/reffed_ptr.h"
+#include "http/handlers.h"
+#include "http/hpack.h"
+#include "io/cord.h"
+#include "io/fd.h"
+#include "net/base_sockets.h"
+
+namespace tsdb2 {
+namespace http {
+
+// Base class for `StreamInterface` decorators used by handler wrappers. All calls are forwarded to
+// the wrapped stream, and subclasses override the ones they need to observe.
+//
+// Proxies are reference-counted separately from the wrapped stream, which they keep alive, and
+// delete themselves when the last reference goes away. That allows subclasses to detect when the
+// wrapped handler is done with the stream by means of their destructor. Subclasses that recycle
+// their instances can override `OnLastUnref` instead.
+class StreamProxy : public StreamInterface {
+ public:
+  explicit StreamProxy(StreamInterface* const stream) : stream_(stream) {}
+  ~StreamProxy() override = default;
+
+  void Ref() override { ref_count_.Ref(); }
+
+  bool Unref() override {
+    if (ref_count_.Unref()) {
+      OnLastUnref();
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  void ReadData(DataCallback callback) override { stream_->ReadData(std::move(callback)); }
+
+  absl::Status SendFields(hpack::HeaderSet const& fields, bool const end_stream) override {
+    return stream_->SendFields(fields, end_stream);
+  }
+
+  absl::Status SendFields(hpack::PrecompiledHeaders const& precompiled,
+                          hpack::HeaderSet const& fields, bool const end_stream) override {
+    return stream_->SendFields(precompiled, fields, end_stream);
+  }
+
+  absl::Status SendData(tsdb2::net::Buffer buffer, bool const end_stream) override {
+    return stream_->SendData(std::move(buffer), end_stream);
+  }
+
+  void StreamData(tsdb2::net::Buffer buffer, bool const end_stream,
+                  WriteCallback callback) override {
+    stream_->StreamData(std::move(buffer), end_stream, std::move(callback));
+  }
+
+  using StreamInterface::StreamData;
+
+  void StreamFile(tsdb2::io::FD fd, off_t const offset, size_t const length, bool const end_stream,
+                  WriteCallback callback) override {
+    stream_->StreamFile(std::move(fd), offset, length, end_stream, std::move(callback));
+  }
+
+  void StreamCord(tsdb2::io::Cord cord, bool const end_stream, WriteCallback callback) override {
+    stream_->StreamCord(std::move(cord), end_stream, std::move(callback));
+  }
+
+  void OnEndStreamSent(WriteCallback callback) override {
+    stream_->OnEndStreamSent(std::move(callback));
+  }
+
+ protected:
+  // Invoked when the last reference to the proxy goes away. The default implementation deletes the
+  // proxy.
+  virtual void OnLastUnref() { delete this; }
+
+  // Makes the proxy wrap `stream`, releasing the previously wrapped stream. `stream` may be null,
+  // in which case the proxy must not be used until it's rebound. Used to recycle proxies.
+  void Rebind(StreamInterface* const stream) { stream_ = stream; }
+
+ private:
+  tsdb2::common::RefCount ref_count_;
+  tsdb2::common::reffed_ptr<StreamInterface> stream_;
+};
+
+}  // namespace http
+}  // namespace tsdb2
+
+#endif  // __TSDB2_HTTP_STREAM_PROXY_H__
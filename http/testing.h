@@ -1,18 +1,41 @@
 #ifndef __TSDB2_HTTP_TESTING_H__
 #define __TSDB2_HTTP_TESTING_H__
 
+#include <sys/types.h>
+
+#include <cstddef>
 #include <string_view>
 
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "gmock/gmock.h"
 #include "http/channel.h"
 #include "http/handlers.h"
+#include "http/hpack.h"
 #include "http/http.h"
+#include "io/fd.h"
+#include "net/base_sockets.h"
 
 namespace tsdb2 {
 namespace testing {
 namespace http {
 
+class MockStream : public tsdb2::http::StreamInterface {
+ public:
+  MOCK_METHOD(void, Ref, (), (override));
+  MOCK_METHOD(bool, Unref, (), (override));
+  MOCK_METHOD(void, ReadData, (DataCallback), (override));
+  MOCK_METHOD(absl::Status, SendFields, (tsdb2::http::hpack::HeaderSet const&, bool), (override));
+  MOCK_METHOD(absl::Status, SendFields,
+              (tsdb2::http::hpack::PrecompiledHeaders const&,
+               tsdb2::http::hpack::HeaderSet const&, bool),
+              (override));
+  MOCK_METHOD(absl::Status, SendData, (tsdb2::net::Buffer, bool), (override));
+  MOCK_METHOD(void, StreamData, (tsdb2::net::Buffer, bool, WriteCallback), (override));
+  MOCK_METHOD(void, StreamFile, (tsdb2::io::FD, off_t, size_t, bool, WriteCallback), (override));
+  MOCK_METHOD(void, OnEndStreamSent, (WriteCallback), (override));
+};
+
 class MockHandler : public tsdb2::http::Handler {
  public:
   MOCK_METHOD(void, Run, (tsdb2::http::StreamInterface*, tsdb2::http::Request const&));
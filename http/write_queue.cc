@@ -1,20 +1,28 @@
 #include "http/write_queue.h"
 
+#include <sys/types.h>
+
 #include <algorithm>
 #include <cstddef>
 #include <cstdint>
-#include <tuple>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <optional>
 #include <utility>
+#include <variant>
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/flags/flag.h"
 #include "absl/status/status.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "http/hpack.h"
 #include "http/http.h"
 #include "io/buffer.h"
 #include "io/cord.h"
+#include "io/fd.h"
 #include "net/base_sockets.h"
 
 namespace tsdb2 {
@@ -24,6 +32,8 @@ namespace {
 
 using ::tsdb2::io::Buffer;
 using ::tsdb2::io::Cord;
+using ::tsdb2::io::FD;
+using ::tsdb2::net::FileRange;
 
 }  // namespace
 
@@ -36,7 +46,7 @@ void WriteQueue::AppendFrame(Buffer buffer, WriteCallback callback) {
     }
     writing_ = true;
   }
-  Write(std::move(buffer), std::move(callback));
+  Write(Frame(std::move(buffer), std::move(callback)));
 }
 
 void WriteQueue::AppendFrames(std::vector<Buffer> buffers) {
@@ -58,7 +68,7 @@ void WriteQueue::AppendFrames(std::vector<Buffer> buffers) {
     }
     writing_ = true;
   }
-  Write(std::move(first), /*callback=*/nullptr);
+  Write(Frame(std::move(first), /*callback=*/nullptr));
 }
 
 void WriteQueue::AppendFrameSkippingQueue(Buffer buffer, WriteCallback callback) {
@@ -70,54 +80,62 @@ void WriteQueue::AppendFrameSkippingQueue(Buffer buffer, WriteCallback callback)
     }
     writing_ = true;
   }
-  Write(std::move(buffer), std::move(callback));
+  Write(Frame(std::move(buffer), std::move(callback)));
 }
 
-void WriteQueue::AppendFieldsFrames(uint32_t const stream_id, hpack::HeaderSet const& fields,
-                                    bool const end_of_stream) {
-  absl::ReleasableMutexLock lock{&mutex_};
-  auto buffers = MakeHeadersFrames(stream_id, end_of_stream, fields);
-  auto it = buffers.begin();
-  if (it == buffers.end()) {
-    return;
-  }
-  auto first = std::move(*it++);
-  if (writing_) {
-    frame_queue_.emplace_back(std::move(first), /*callback=*/nullptr);
-  }
-  while (it != buffers.end()) {
-    frame_queue_.emplace_back(std::move(*it++), /*callback=*/nullptr);
-  }
-  if (writing_) {
-    return;
-  }
-  writing_ = true;
-  lock.Release();
-  Write(std::move(first), /*callback=*/nullptr);
+std::optional<WriteQueue::Frame> WriteQueue::EnqueueFieldsFrames(uint32_t const stream_id,
+                                                                 hpack::HeaderSet const& fields,
+                                                                 bool const end_of_stream,
+                                                                 WriteCallback callback) {
+  absl::MutexLock lock{&mutex_};
+  return EnqueueFramesLocked(
+      MakeHeadersFrames(stream_id, end_of_stream, field_encoder_.Encode(fields)),
+      std::move(callback));
 }
 
-void WriteQueue::AppendDataFrames(uint32_t const stream_id, Buffer const& data,
-                                  bool const end_of_stream) {
-  for (size_t offset = 0; offset < data.size(); offset += frame_size_) {
-    auto const header =
-        FrameHeader()
-            .set_length(data.size())
-            .set_frame_type(FrameType::kData)
-            .set_flags(end_of_stream && (offset + frame_size_ >= data.size()) ? kFlagEndStream : 0)
-            .set_stream_id(stream_id);
-    AppendFrame(Cord(Buffer(&header, sizeof(FrameHeader)),
-                     Buffer(data.span(offset, std::min(frame_size_, data.size() - offset))))
-                    .Flatten());
-  }
+std::optional<WriteQueue::Frame> WriteQueue::EnqueueFieldsFrames(
+    uint32_t const stream_id, hpack::PrecompiledHeaders const& precompiled,
+    hpack::HeaderSet const& fields, bool const end_of_stream, WriteCallback callback) {
+  absl::MutexLock lock{&mutex_};
+  return EnqueueFramesLocked(
+      MakeHeadersFrames(stream_id, end_of_stream, field_encoder_.Encode(precompiled, fields)),
+      std::move(callback));
+}
+
+std::optional<WriteQueue::Frame> WriteQueue::EnqueueDataFrames(
+    uint32_t const stream_id, std::shared_ptr<Buffer const> owner,
+    absl::Span<uint8_t const> const data, bool const end_of_stream, WriteCallback callback) {
+  auto frames = MakeDataFrames(stream_id, end_of_stream, owner, data);
+  absl::MutexLock lock{&mutex_};
+  return EnqueueFramesLocked(std::move(frames), std::move(callback));
+}
+
+std::optional<WriteQueue::Frame> WriteQueue::EnqueueFileDataFrames(
+    uint32_t const stream_id, std::shared_ptr<FD const> file, off_t const offset,
+    size_t const length, bool const end_of_stream, WriteCallback callback) {
+  auto frames = MakeFileDataFrames(stream_id, end_of_stream, file, offset, length);
+  absl::MutexLock lock{&mutex_};
+  return EnqueueFramesLocked(std::move(frames), std::move(callback));
+}
+
+std::optional<WriteQueue::Frame> WriteQueue::EnqueueCordDataFrames(
+    uint32_t const stream_id, std::shared_ptr<Cord const> cord, size_t const offset,
+    size_t const length, bool const end_of_stream, WriteCallback callback) {
+  auto frames = MakeCordDataFrames(stream_id, end_of_stream, cord, offset, length);
+  absl::MutexLock lock{&mutex_};
+  return EnqueueFramesLocked(std::move(frames), std::move(callback));
 }
 
 void WriteQueue::GoAway(ErrorCode const error_code, uint32_t const last_processed_stream_id,
                         bool const reset_queue, WriteCallback callback) {
   auto frame = MakeGoAwayFrame(error_code, last_processed_stream_id);
+  // The dropped frames are destroyed after releasing the lock because their callbacks may need to
+  // run code that enqueues more frames.
+  std::list<Frame> dropped_frames;
   {
     absl::MutexLock lock{&mutex_};
     if (reset_queue) {
-      frame_queue_.clear();
+      frame_queue_.swap(dropped_frames);
     }
     if (writing_) {
       frame_queue_.emplace_front(std::move(frame), std::move(callback));
@@ -125,45 +143,174 @@ void WriteQueue::GoAway(ErrorCode const error_code, uint32_t const last_processe
     }
     writing_ = true;
   }
-  Write(std::move(frame), std::move(callback));
+  Write(Frame(std::move(frame), std::move(callback)));
 }
 
-std::vector<Buffer> WriteQueue::MakeHeadersFrames(uint32_t const stream_id,
-                                                  bool const end_of_stream,
-                                                  hpack::HeaderSet const& fields) {
-  auto buffer = field_encoder_.Encode(fields);
-  std::vector<Buffer> result;
-  result.reserve(buffer.size() / (frame_size_ + 1));
+std::vector<WriteQueue::Frame> WriteQueue::MakeHeadersFrames(uint32_t const stream_id,
+                                                             bool const end_of_stream,
+                                                             Buffer field_block) const {
+  std::vector<Frame> result;
+  result.reserve(field_block.size() / (frame_size_ + 1) + 1);
   uint8_t const flags = end_of_stream ? kFlagEndStream : 0;
-  if (buffer.size() > frame_size_) {
+  if (field_block.size() <= frame_size_) {
     auto const header = FrameHeader()
-                            .set_length(buffer.size())
-                            .set_frame_type(FrameType::kHeaders)
-                            .set_flags(flags)
-                            .set_stream_id(stream_id);
-    result.emplace_back(
-        Cord(Buffer(&header, sizeof(header)), Buffer(buffer.span(0, frame_size_))).Flatten());
-  } else {
-    auto const header = FrameHeader()
-                            .set_length(buffer.size())
+                            .set_length(field_block.size())
                             .set_frame_type(FrameType::kHeaders)
                             .set_flags(flags | kFlagEndHeaders)
                             .set_stream_id(stream_id);
-    result.emplace_back(Cord(Buffer(&header, sizeof(header)), std::move(buffer)).Flatten());
+    result.emplace_back(Cord(Buffer(&header, sizeof(header)), std::move(field_block)).Flatten(),
+                        /*callback=*/nullptr);
     return result;
   }
-  for (size_t offset = frame_size_; offset < buffer.size(); offset += frame_size_) {
+  for (size_t offset = 0; offset < field_block.size(); offset += frame_size_) {
+    size_t const length = std::min(frame_size_, field_block.size() - offset);
+    bool const last = offset + length >= field_block.size();
     auto const header = FrameHeader()
-                            .set_length(buffer.size())
-                            .set_frame_type(FrameType::kContinuation)
-                            .set_flags(offset + frame_size_ < buffer.size() ? 0 : kFlagEndHeaders)
+                            .set_length(length)
+                            .set_frame_type(offset > 0 ? FrameType::kContinuation
+                                                       : FrameType::kHeaders)
+                            .set_flags((offset > 0 ? 0 : flags) | (last ? kFlagEndHeaders : 0))
                             .set_stream_id(stream_id);
     result.emplace_back(
-        Cord(Buffer(&header, sizeof(header)), Buffer(buffer.span(offset, frame_size_))).Flatten());
+        Cord(Buffer(&header, sizeof(header)), Buffer(field_block.span(offset, length))).Flatten(),
+        /*callback=*/nullptr);
+  }
+  return result;
+}
+
+std::vector<WriteQueue::Frame> WriteQueue::MakeDataFrames(
+    uint32_t const stream_id, bool const end_of_stream, std::shared_ptr<Buffer const> const& owner,
+    absl::Span<uint8_t const> const data) const {
+  std::vector<Frame> result;
+  result.reserve(data.size() / (frame_size_ + 1) + 1);
+  size_t offset = 0;
+  do {
+    size_t const length = std::min(frame_size_, data.size() - offset);
+    bool const last = offset + length >= data.size();
+    auto const header = FrameHeader()
+                            .set_length(length)
+                            .set_frame_type(FrameType::kData)
+                            .set_flags(end_of_stream && last ? kFlagEndStream : 0)
+                            .set_stream_id(stream_id);
+    result.emplace_back(Buffer(&header, sizeof(header)), owner, data.subspan(offset, length));
+    offset += length;
+  } while (offset < data.size());
+  return result;
+}
+
+std::vector<WriteQueue::Frame> WriteQueue::MakeFileDataFrames(
+    uint32_t const stream_id, bool const end_of_stream, std::shared_ptr<FD const> const& file,
+    off_t const offset, size_t const length) const {
+  std::vector<Frame> result;
+  result.reserve(length / (frame_size_ + 1) + 1);
+  size_t position = 0;
+  do {
+    size_t const frame_length = std::min(frame_size_, length - position);
+    bool const last = position + frame_length >= length;
+    auto const header = FrameHeader()
+                            .set_length(frame_length)
+                            .set_frame_type(FrameType::kData)
+                            .set_flags(end_of_stream && last ? kFlagEndStream : 0)
+                            .set_stream_id(stream_id);
+    result.emplace_back(Buffer(&header, sizeof(header)), file,
+                        FileRange{**file, static_cast<off_t>(offset + position), frame_length});
+    position += frame_length;
+  } while (position < length);
+  return result;
+}
+
+std::vector<WriteQueue::Frame> WriteQueue::MakeCordDataFrames(
+    uint32_t const stream_id, bool const end_of_stream, std::shared_ptr<Cord const> const& cord,
+    size_t const offset, size_t const length) const {
+  // The payload of each frame is either a span referencing a piece of the cord or a buffer with
+  // the content of one or more short pieces.
+  std::vector<std::variant<absl::Span<uint8_t const>, Buffer>> payloads;
+  Buffer copy;
+  size_t skip = offset;
+  size_t remaining = length;
+  for (auto piece : cord->chunks()) {
+    if (remaining == 0) {
+      break;
+    }
+    if (skip >= piece.size()) {
+      skip -= piece.size();
+      continue;
+    }
+    piece = piece.subspan(skip, std::min(remaining, piece.size() - skip));
+    skip = 0;
+    remaining -= piece.size();
+    while (!piece.empty()) {
+      if (piece.size() >= kMinReferencedPieceSize) {
+        if (!copy.empty()) {
+          payloads.emplace_back(std::exchange(copy, Buffer()));
+        }
+        size_t const frame_length = std::min(frame_size_, piece.size());
+        payloads.emplace_back(piece.first(frame_length));
+        piece.remove_prefix(frame_length);
+      } else {
+        if (copy.capacity() == 0) {
+          copy = Buffer(std::min(frame_size_, piece.size() + remaining));
+        }
+        size_t const copy_length = std::min(copy.capacity() - copy.size(), piece.size());
+        copy.MemCpy(piece.data(), copy_length);
+        piece.remove_prefix(copy_length);
+        if (copy.size() >= copy.capacity()) {
+          payloads.emplace_back(std::exchange(copy, Buffer()));
+        }
+      }
+    }
+  }
+  if (!copy.empty()) {
+    payloads.emplace_back(std::move(copy));
+  }
+  std::vector<Frame> result;
+  if (payloads.empty()) {
+    auto const header = FrameHeader()
+                            .set_length(0)
+                            .set_frame_type(FrameType::kData)
+                            .set_flags(end_of_stream ? kFlagEndStream : 0)
+                            .set_stream_id(stream_id);
+    result.emplace_back(Buffer(&header, sizeof(header)), /*callback=*/nullptr);
+    return result;
+  }
+  result.reserve(payloads.size());
+  for (size_t i = 0; i < payloads.size(); ++i) {
+    auto& payload = payloads[i];
+    bool const last = i + 1 == payloads.size();
+    auto const header =
+        FrameHeader()
+            .set_length(std::visit([](auto const& data) -> size_t { return data.size(); }, payload))
+            .set_frame_type(FrameType::kData)
+            .set_flags(end_of_stream && last ? kFlagEndStream : 0)
+            .set_stream_id(stream_id);
+    if (auto* const span = std::get_if<absl::Span<uint8_t const>>(&payload)) {
+      result.emplace_back(Buffer(&header, sizeof(header)), cord, *span);
+    } else {
+      result.emplace_back(
+          Cord(Buffer(&header, sizeof(header)), std::get<Buffer>(std::move(payload))).Flatten(),
+          /*callback=*/nullptr);
+    }
   }
   return result;
 }
 
+std::optional<WriteQueue::Frame> WriteQueue::EnqueueFramesLocked(std::vector<Frame> frames,
+                                                                 WriteCallback callback) {
+  if (frames.empty()) {
+    return std::nullopt;
+  }
+  frames.back().callback = std::move(callback);
+  auto it = frames.begin();
+  std::optional<Frame> first;
+  if (!writing_) {
+    writing_ = true;
+    first.emplace(std::move(*it++));
+  }
+  frame_queue_.insert(frame_queue_.end(), std::make_move_iterator(it),
+                      std::make_move_iterator(frames.end()));
+  return first;
+}
+
 Buffer WriteQueue::MakeResetStreamFrame(uint32_t const stream_id, ErrorCode const error_code) {
   auto const header = FrameHeader()
                           .set_length(sizeof(ResetStreamPayload))
@@ -186,6 +333,18 @@ Buffer WriteQueue::MakeSettingsAckFrame() {
   return Buffer{&header, sizeof(FrameHeader)};
 }
 
+Buffer WriteQueue::MakePingFrame(uint64_t const payload) {
+  auto const header = FrameHeader()
+                          .set_length(kPingPayloadSize)
+                          .set_frame_type(FrameType::kPing)
+                          .set_flags(0)
+                          .set_stream_id(0);
+  Buffer buffer{sizeof(FrameHeader) + kPingPayloadSize};
+  buffer.MemCpy(&header, sizeof(header));
+  buffer.MemCpy(&payload, kPingPayloadSize);
+  return buffer;
+}
+
 Buffer WriteQueue::MakePingAckFrame(Buffer const& payload) {
   auto const header = FrameHeader()
                           .set_length(kPingPayloadSize)
@@ -198,6 +357,19 @@ Buffer WriteQueue::MakePingAckFrame(Buffer const& payload) {
   return buffer;
 }
 
+Buffer WriteQueue::MakeWindowUpdateFrame(uint32_t const stream_id, size_t const increment) {
+  auto const header = FrameHeader()
+                          .set_length(sizeof(WindowUpdatePayload))
+                          .set_frame_type(FrameType::kWindowUpdate)
+                          .set_flags(0)
+                          .set_stream_id(stream_id);
+  auto const payload = WindowUpdatePayload().set_window_size_increment(increment);
+  Buffer buffer{sizeof(FrameHeader) + sizeof(WindowUpdatePayload)};
+  buffer.MemCpy(&header, sizeof(header));
+  buffer.MemCpy(&payload, sizeof(payload));
+  return buffer;
+}
+
 Buffer WriteQueue::MakeGoAwayFrame(ErrorCode const error_code,
                                    uint32_t const last_processed_stream_id) {
   auto const header = FrameHeader()
@@ -213,12 +385,18 @@ Buffer WriteQueue::MakeGoAwayFrame(ErrorCode const error_code,
   return buffer;
 }
 
-void WriteQueue::Write(Buffer buffer, WriteCallback callback) {
-  auto const status = socket_->WriteWithTimeout(
-      std::move(buffer),
-      [this, callback = std::move(callback)](absl::Status const status)
+void WriteQueue::Write(Frame frame) {
+  auto const payload = frame.payload;
+  auto const file = frame.file;
+  // The payload owner is captured in the socket callback so that the payload outlives the write.
+  tsdb2::net::BaseSocket::WriteCallback socket_callback =
+      [this, payload_owner = std::move(frame.payload_owner),
+       callback = std::move(frame.callback)](absl::Status const status)
           ABSL_LOCKS_EXCLUDED(mutex_) mutable {
+            payload_owner.reset();
             if (!status.ok()) {
+              callback = nullptr;
+              Fail();
               socket_->Close();
               return;
             }
@@ -226,23 +404,39 @@ void WriteQueue::Write(Buffer buffer, WriteCallback callback) {
               callback();
               callback = nullptr;
             }
-            Buffer next;
+            Frame next;
             {
               absl::MutexLock lock{&mutex_};
               if (frame_queue_.empty()) {
                 writing_ = false;
                 return;
               }
-              std::tie(next, callback) = std::move(frame_queue_.front());
+              next = std::move(frame_queue_.front());
               frame_queue_.pop_front();
             }
-            Write(std::move(next), std::move(callback));
-          },
-      absl::GetFlag(FLAGS_http2_io_timeout));
+            Write(std::move(next));
+          };
+  auto const timeout = absl::GetFlag(FLAGS_http2_io_timeout);
+  absl::Status status;
+  if (file.has_value()) {
+    status = socket_->SendFileWithTimeout(std::move(frame.buffer), *file,
+                                          std::move(socket_callback), timeout);
+  } else {
+    status = socket_->WriteWithTimeout(std::move(frame.buffer), payload,
+                                       std::move(socket_callback), timeout);
+  }
   if (!status.ok()) {
+    Fail();
     socket_->Close();
   }
 }
 
+void WriteQueue::Fail() {
+  std::list<Frame> dropped_frames;
+  absl::MutexLock lock{&mutex_};
+  writing_ = false;
+  frame_queue_.swap(dropped_frames);
+}
+
 }  // namespace http
 }  // namespace tsdb2
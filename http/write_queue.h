@@ -1,17 +1,24 @@
 #ifndef __TSDB2_HTTP_WRITE_QUEUE_H__
 #define __TSDB2_HTTP_WRITE_QUEUE_H__
 
+#include <sys/types.h>
+
 #include <cstddef>
 #include <cstdint>
 #include <list>
+#include <memory>
+#include <optional>
 #include <utility>
 #include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/functional/any_invocable.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
 #include "http/hpack.h"
 #include "http/http.h"
+#include "io/cord.h"
+#include "io/fd.h"
 #include "net/base_sockets.h"
 
 namespace tsdb2 {
@@ -21,6 +28,41 @@ class WriteQueue final {
  public:
   using WriteCallback = absl::AnyInvocable<void()>;
 
+  // A serialized frame along with the callback to invoke after writing it.
+  //
+  // DATA frames don't embed their payload: `buffer` only contains the frame header while `payload`
+  // refers to a slice of the caller's data, which is kept alive by `payload_owner` and written
+  // together with the header without being copied.
+  //
+  // NOTE: frames are moved around, and so is `buffer`, whose data is stored inline if it's small
+  // (e.g. a frame header). That's why `payload` never refers to the data of a `Buffer` owned by
+  // value: the owner is always a heap object (a shared `Buffer` or `Cord`, whose chunks are
+  // refcounted and immutable) that stays put until the frame has been written.
+  //
+  // The payload of a DATA frame may also be a range of an open file (`file`), in which case
+  // `payload_owner` keeps the file open and the range is written with
+  // `BaseSocket::SendFileWithTimeout`.
+  struct Frame {
+    Frame() = default;
+
+    explicit Frame(tsdb2::net::Buffer buffer, WriteCallback callback)
+        : buffer(std::move(buffer)), callback(std::move(callback)) {}
+
+    explicit Frame(tsdb2::net::Buffer header, std::shared_ptr<void const> payload_owner,
+                   absl::Span<uint8_t const> const payload)
+        : buffer(std::move(header)), payload_owner(std::move(payload_owner)), payload(payload) {}
+
+    explicit Frame(tsdb2::net::Buffer header, std::shared_ptr<void const> payload_owner,
+                   tsdb2::net::FileRange const& file)
+        : buffer(std::move(header)), payload_owner(std::move(payload_owner)), file(file) {}
+
+    tsdb2::net::Buffer buffer;
+    std::shared_ptr<void const> payload_owner;
+    absl::Span<uint8_t const> payload;
+    std::optional<tsdb2::net::FileRange> file;
+    WriteCallback callback;
+  };
+
   explicit WriteQueue(tsdb2::net::BaseSocket* const socket, size_t const frame_size)
       : frame_size_(frame_size), socket_(socket) {}
 
@@ -43,14 +85,82 @@ class WriteQueue final {
 
   // Serializes the provided `HeaderSet` into a HEADERS frame and zero or more CONTINUATION frames,
   // and appends the generated frames to the queue.
-  void AppendFieldsFrames(uint32_t stream_id, hpack::HeaderSet const& fields, bool end_of_stream)
+  void AppendFieldsFrames(uint32_t const stream_id, hpack::HeaderSet const& fields,
+                          bool const end_of_stream) ABSL_LOCKS_EXCLUDED(mutex_) {
+    Flush(EnqueueFieldsFrames(stream_id, fields, end_of_stream, /*callback=*/nullptr));
+  }
+
+  // Like the above, but the field block starts with the provided precompiled fields. Only the
+  // additional `fields` go through the stateful HPACK encoder.
+  void AppendFieldsFrames(uint32_t const stream_id, hpack::PrecompiledHeaders const& precompiled,
+                          hpack::HeaderSet const& fields, bool const end_of_stream)
+      ABSL_LOCKS_EXCLUDED(mutex_) {
+    Flush(EnqueueFieldsFrames(stream_id, precompiled, fields, end_of_stream, /*callback=*/nullptr));
+  }
+
+  // Serializes one or more DATA frames and appends them to the queue. The frames reference `data`
+  // rather than copying it, so the queue takes ownership of it.
+  void AppendDataFrames(uint32_t const stream_id, tsdb2::net::Buffer data,
+                        bool const end_of_stream) ABSL_LOCKS_EXCLUDED(mutex_) {
+    auto owner = std::make_shared<tsdb2::net::Buffer const>(std::move(data));
+    auto const span = owner->span();
+    Flush(EnqueueDataFrames(stream_id, std::move(owner), span, end_of_stream,
+                            /*callback=*/nullptr));
+  }
+
+  // The `Enqueue*` methods below serialize frames and append them to the queue, but unlike their
+  // `Append*` counterparts they don't start writing. If the queue was idle the first frame is
+  // returned rather than enqueued, and the caller must pass it to `Flush`.
+  //
+  // Since writing may run completion callbacks synchronously, these methods allow the caller to
+  // enqueue frames while holding its own locks (thus preserving the relative order of the frames of
+  // a stream) and to start writing only after releasing them.
+
+  // Serializes `fields` into a HEADERS frame and zero or more CONTINUATION frames and enqueues
+  // them. `callback` is invoked after the last frame has been written.
+  std::optional<Frame> EnqueueFieldsFrames(uint32_t stream_id, hpack::HeaderSet const& fields,
+                                           bool end_of_stream, WriteCallback callback)
       ABSL_LOCKS_EXCLUDED(mutex_);
 
-  // Serializes one or more DATA frames and appends them to the queue.
+  std::optional<Frame> EnqueueFieldsFrames(uint32_t stream_id,
+                                           hpack::PrecompiledHeaders const& precompiled,
+                                           hpack::HeaderSet const& fields, bool end_of_stream,
+                                           WriteCallback callback) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Splits `data` into one or more DATA frames (at least one, even if `data` is empty) and enqueues
+  // them. The frames reference slices of `data` without copying it, and `owner` keeps the memory
+  // alive until all of them have been written or dropped. `callback` is invoked after the last
+  // frame has been written.
+  std::optional<Frame> EnqueueDataFrames(uint32_t stream_id,
+                                         std::shared_ptr<tsdb2::net::Buffer const> owner,
+                                         absl::Span<uint8_t const> data, bool end_of_stream,
+                                         WriteCallback callback) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Like `EnqueueDataFrames`, but the payload is the range of `length` bytes of `file` starting at
+  // `offset`. The frames keep `file` open until all of them have been written or dropped.
+  std::optional<Frame> EnqueueFileDataFrames(uint32_t stream_id,
+                                             std::shared_ptr<tsdb2::io::FD const> file,
+                                             off_t offset, size_t length, bool end_of_stream,
+                                             WriteCallback callback) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Like `EnqueueDataFrames`, but the payload is the range of `length` bytes of `cord` starting at
+  // `offset`. The frames keep `cord` alive until all of them have been written or dropped.
   //
-  // TODO: we should probably take the `data` as a `Cord` rather than a `Buffer` so that the caller
-  // doesn't have to flatten it and we can improve the framing process.
-  void AppendDataFrames(uint32_t stream_id, tsdb2::net::Buffer const& data, bool end_of_stream);
+  // The payload of each frame is written with a single `iovec` after the header, so frames
+  // referencing the cord don't straddle its pieces. Pieces shorter than `kMinReferencedPieceSize`
+  // are copied and coalesced instead, otherwise a cord made of many small pieces would turn into as
+  // many tiny DATA frames.
+  std::optional<Frame> EnqueueCordDataFrames(uint32_t stream_id,
+                                             std::shared_ptr<tsdb2::io::Cord const> cord,
+                                             size_t offset, size_t length, bool end_of_stream,
+                                             WriteCallback callback) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Starts writing the frame returned by one of the `Enqueue*` methods, if any.
+  void Flush(std::optional<Frame> frame) ABSL_LOCKS_EXCLUDED(mutex_) {
+    if (frame.has_value()) {
+      Write(std::move(frame).value());
+    }
+  }
 
   void AppendResetStreamFrame(uint32_t const stream_id, ErrorCode const error_code) {
     AppendFrame(MakeResetStreamFrame(stream_id, error_code));
@@ -58,10 +168,16 @@ class WriteQueue final {
 
   void AppendSettingsAckFrame() { AppendFrame(MakeSettingsAckFrame()); }
 
+  void AppendPingFrame(uint64_t const payload) { AppendFrame(MakePingFrame(payload)); }
+
   void AppendPingAckFrame(tsdb2::net::Buffer const& payload) {
     AppendFrame(MakePingAckFrame(payload));
   }
 
+  void AppendWindowUpdateFrame(uint32_t const stream_id, size_t const increment) {
+    AppendFrame(MakeWindowUpdateFrame(stream_id, increment));
+  }
+
   // Serializes and enqueues a GOAWAY frame.
   //
   // If the `reset_queue` flag is true this method will also clear the queue. The `reset_queue` flag
@@ -70,25 +186,60 @@ class WriteQueue final {
               WriteCallback callback) ABSL_LOCKS_EXCLUDED(mutex_);
 
  private:
+  // Minimum size of the pieces of a cord that DATA frames reference rather than copy. Below that
+  // the cost of a separate frame header and `iovec` exceeds the cost of copying.
+  static size_t constexpr kMinReferencedPieceSize = 512;
+
   WriteQueue(WriteQueue const&) = delete;
   WriteQueue& operator=(WriteQueue const&) = delete;
   WriteQueue(WriteQueue&&) = delete;
   WriteQueue& operator=(WriteQueue&&) = delete;
 
-  std::vector<tsdb2::net::Buffer> MakeHeadersFrames(uint32_t stream_id, bool end_of_stream,
-                                                    hpack::HeaderSet const& fields)
+  // Splits an encoded field block into a HEADERS frame and zero or more CONTINUATION frames.
+  std::vector<Frame> MakeHeadersFrames(uint32_t stream_id, bool end_of_stream,
+                                       tsdb2::net::Buffer field_block) const;
+
+  // Splits `data` into one or more DATA frames referencing it.
+  std::vector<Frame> MakeDataFrames(uint32_t stream_id, bool end_of_stream,
+                                    std::shared_ptr<tsdb2::net::Buffer const> const& owner,
+                                    absl::Span<uint8_t const> data) const;
+
+  // Splits a file range into one or more DATA frames referencing it.
+  std::vector<Frame> MakeFileDataFrames(uint32_t stream_id, bool end_of_stream,
+                                        std::shared_ptr<tsdb2::io::FD const> const& file,
+                                        off_t offset, size_t length) const;
+
+  // Splits a range of a cord into one or more DATA frames referencing or copying its pieces.
+  std::vector<Frame> MakeCordDataFrames(uint32_t stream_id, bool end_of_stream,
+                                        std::shared_ptr<tsdb2::io::Cord const> const& cord,
+                                        size_t offset, size_t length) const;
+
+  // Enqueues a sequence of frames atomically, associating `callback` to the last one. The frames of
+  // a field block are enqueued while still holding the lock that was used to encode them, so that
+  // the peer's decoder sees field blocks in encoding order. If the queue was idle the first frame
+  // is returned rather than enqueued, and the caller must `Write` it after releasing the lock.
+  std::optional<Frame> EnqueueFramesLocked(std::vector<Frame> frames, WriteCallback callback)
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   static tsdb2::net::Buffer MakeResetStreamFrame(uint32_t stream_id, ErrorCode error_code);
 
   static tsdb2::net::Buffer MakeSettingsAckFrame();
 
+  static tsdb2::net::Buffer MakePingFrame(uint64_t payload);
+
   static tsdb2::net::Buffer MakePingAckFrame(tsdb2::net::Buffer const& payload);
 
+  static tsdb2::net::Buffer MakeWindowUpdateFrame(uint32_t stream_id, size_t increment);
+
   static tsdb2::net::Buffer MakeGoAwayFrame(ErrorCode error_code,
                                             uint32_t last_processed_stream_id);
 
-  void Write(tsdb2::net::Buffer buffer, WriteCallback callback) ABSL_LOCKS_EXCLUDED(mutex_);
+  void Write(Frame frame) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Invoked when a write fails. Drops all queued frames so that their callbacks are destroyed and
+  // marks the queue as idle, so that any frames appended later go straight to the (closed) socket
+  // and fail right away rather than waiting forever.
+  void Fail() ABSL_LOCKS_EXCLUDED(mutex_);
 
   size_t const frame_size_;
 
@@ -96,7 +247,7 @@ class WriteQueue final {
 
   absl::Mutex mutable mutex_;
   bool writing_ ABSL_GUARDED_BY(mutex_) = false;
-  std::list<std::pair<tsdb2::net::Buffer, WriteCallback>> frame_queue_ ABSL_GUARDED_BY(mutex_);
+  std::list<Frame> frame_queue_ ABSL_GUARDED_BY(mutex_);
 
   // NOTE: the HPACK encoder MUST be guarded by the same mutex used to synchronize outbound packets
   // because the status of the encoder (i.e. the dynamic table) is mirrored by the peer endpoint and
@@ -1,8 +1,12 @@
 #include "http/write_queue.h"
 
+#include <unistd.h>
+
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
 #include <utility>
 #include <vector>
@@ -11,6 +15,7 @@
 #include "absl/log/check.h"
 #include "absl/status/status_matchers.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
@@ -18,12 +23,15 @@
 #include "common/reffed_ptr.h"
 #include "common/scheduler.h"
 #include "common/simple_condition.h"
+#include "common/testing.h"
 #include "common/utilities.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "http/hpack.h"
 #include "http/http.h"
 #include "io/buffer_testing.h"
+#include "io/cord.h"
+#include "io/fd.h"
 #include "net/base_sockets.h"
 #include "net/sockets.h"
 #include "net/ssl_sockets.h"
@@ -36,6 +44,7 @@ using ::testing::AllOf;
 using ::testing::AnyOf;
 using ::testing::ElementsAreArray;
 using ::testing::Property;
+using ::testing::TestTempFile;
 using ::tsdb2::common::MockClock;
 using ::tsdb2::common::reffed_ptr;
 using ::tsdb2::common::Scheduler;
@@ -49,8 +58,12 @@ using ::tsdb2::http::kFlagEndHeaders;
 using ::tsdb2::http::kFlagEndStream;
 using ::tsdb2::http::kPingPayloadSize;
 using ::tsdb2::http::ResetStreamPayload;
+using ::tsdb2::http::WindowUpdatePayload;
 using ::tsdb2::http::WriteQueue;
+using ::tsdb2::http::hpack::Encoder;
 using ::tsdb2::http::hpack::HeaderSet;
+using ::tsdb2::io::Cord;
+using ::tsdb2::io::FD;
 using ::tsdb2::net::Buffer;
 using ::tsdb2::testing::io::BufferAs;
 using ::tsdb2::testing::io::BufferAsBytes;
@@ -255,6 +268,43 @@ TYPED_TEST(WriteQueueTest, AppendOtherHeaders) {
                              }))));
 }
 
+TYPED_TEST(WriteQueueTest, AppendPrecompiledHeaders) {
+  auto const precompiled = Encoder::Precompile({{":status", "200"}});
+  this->write_queue_.AppendFieldsFrames(123, precompiled, {{"content-length", "42"}},
+                                        /*end_of_stream=*/false);
+  ASSERT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 5),
+                        Property(&FrameHeader::frame_type, FrameType::kHeaders),
+                        Property(&FrameHeader::flags, kFlagEndHeaders),
+                        Property(&FrameHeader::stream_id, 123)))));
+  ASSERT_THAT(this->Read(5),
+              IsOkAndHolds(BufferAsBytes(ElementsAreArray({0x88, 0x5C, 0x02, 0x34, 0x32}))));
+}
+
+TYPED_TEST(WriteQueueTest, AppendHeadersWithContinuation) {
+  size_t const frame_size = absl::GetFlag(FLAGS_http2_max_frame_payload_size);
+  size_t const value_size = frame_size + 1000;
+  // Name index, 4 bytes of value length, and the value itself (not Huffman-encoded).
+  size_t const field_block_size = value_size + 5;
+  this->write_queue_.AppendFieldsFrames(123, {{"set-cookie", std::string(value_size, '\x80')}},
+                                        /*end_of_stream=*/true);
+  ASSERT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, frame_size),
+                        Property(&FrameHeader::frame_type, FrameType::kHeaders),
+                        Property(&FrameHeader::flags, kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 123)))));
+  ASSERT_OK(this->Read(frame_size));
+  ASSERT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, field_block_size - frame_size),
+                        Property(&FrameHeader::frame_type, FrameType::kContinuation),
+                        Property(&FrameHeader::flags, kFlagEndHeaders),
+                        Property(&FrameHeader::stream_id, 123)))));
+  ASSERT_OK(this->Read(field_block_size - frame_size));
+}
+
 TYPED_TEST(WriteQueueTest, AppendDataFrame) {
   std::string_view constexpr kData = "0123456789";
   this->write_queue_.AppendDataFrames(123, Buffer(kData.data(), kData.size()),
@@ -280,6 +330,142 @@ TYPED_TEST(WriteQueueTest, AppendDataFrameEndingStream) {
   EXPECT_THAT(this->Read(kData.size()), IsOkAndHolds(BufferAsString(kData)));
 }
 
+TYPED_TEST(WriteQueueTest, AppendMultipleDataFrames) {
+  size_t const frame_size = absl::GetFlag(FLAGS_http2_max_frame_payload_size);
+  std::string const data(frame_size + 10, 'x');
+  this->write_queue_.AppendDataFrames(123, Buffer(data.data(), data.size()),
+                                      /*end_of_stream=*/true);
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(AllOf(
+                  Property(&FrameHeader::length, frame_size),
+                  Property(&FrameHeader::frame_type, FrameType::kData),
+                  Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 123)))));
+  ASSERT_OK(this->Read(frame_size));
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 10),
+                        Property(&FrameHeader::frame_type, FrameType::kData),
+                        Property(&FrameHeader::flags, kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 123)))));
+  EXPECT_THAT(this->Read(10), IsOkAndHolds(BufferAsString("xxxxxxxxxx")));
+}
+
+TYPED_TEST(WriteQueueTest, EnqueueEmptyDataFrame) {
+  absl::Notification written;
+  this->write_queue_.Flush(this->write_queue_.EnqueueDataFrames(
+      123, std::make_shared<Buffer const>(), /*data=*/{}, /*end_of_stream=*/true,
+      [&] { written.Notify(); }));
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 0),
+                        Property(&FrameHeader::frame_type, FrameType::kData),
+                        Property(&FrameHeader::flags, kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 123)))));
+  written.WaitForNotification();
+}
+
+TYPED_TEST(WriteQueueTest, EnqueueDataSlices) {
+  std::string_view constexpr kData = "0123456789";
+  auto const owner = std::make_shared<Buffer const>(kData.data(), kData.size());
+  auto first = this->write_queue_.EnqueueDataFrames(123, owner, owner->span(0, 4),
+                                                    /*end_of_stream=*/false, /*callback=*/nullptr);
+  ASSERT_TRUE(first.has_value());
+  absl::Notification written;
+  EXPECT_FALSE(this->write_queue_
+                   .EnqueueDataFrames(123, owner, owner->span(4), /*end_of_stream=*/true,
+                                      [&] { written.Notify(); })
+                   .has_value());
+  this->write_queue_.Flush(std::move(first));
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(AllOf(
+                  Property(&FrameHeader::length, 4),
+                  Property(&FrameHeader::frame_type, FrameType::kData),
+                  Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 123)))));
+  EXPECT_THAT(this->Read(4), IsOkAndHolds(BufferAsString("0123")));
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 6),
+                        Property(&FrameHeader::frame_type, FrameType::kData),
+                        Property(&FrameHeader::flags, kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 123)))));
+  EXPECT_THAT(this->Read(6), IsOkAndHolds(BufferAsString("456789")));
+  written.WaitForNotification();
+}
+
+TYPED_TEST(WriteQueueTest, EnqueueFileDataFrames) {
+  auto status_or_file = TestTempFile::Create("write_queue_test");
+  ASSERT_OK(status_or_file);
+  auto const& file = status_or_file.value();
+  size_t const frame_size = absl::GetFlag(FLAGS_http2_max_frame_payload_size);
+  std::string const content = absl::StrCat("ab", std::string(frame_size, 'x'), "0123456789");
+  ASSERT_EQ(::pwrite(*file.fd(), content.data(), content.size(), 0),
+            static_cast<ssize_t>(content.size()));
+  absl::Notification written;
+  this->write_queue_.Flush(this->write_queue_.EnqueueFileDataFrames(
+      123, std::make_shared<FD const>(::dup(*file.fd())), /*offset=*/2,
+      /*length=*/frame_size + 10, /*end_of_stream=*/true, [&] { written.Notify(); }));
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(AllOf(
+                  Property(&FrameHeader::length, frame_size),
+                  Property(&FrameHeader::frame_type, FrameType::kData),
+                  Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 123)))));
+  EXPECT_THAT(this->Read(frame_size), IsOkAndHolds(BufferAsString(std::string(frame_size, 'x'))));
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 10),
+                        Property(&FrameHeader::frame_type, FrameType::kData),
+                        Property(&FrameHeader::flags, kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 123)))));
+  EXPECT_THAT(this->Read(10), IsOkAndHolds(BufferAsString("0123456789")));
+  written.WaitForNotification();
+}
+
+TYPED_TEST(WriteQueueTest, EnqueueCordDataFrames) {
+  std::string const large(1000, 'x');
+  auto const cord = std::make_shared<Cord const>(Buffer("ab", 2), Buffer("cd", 2),
+                                                 Buffer(large.data(), large.size()),
+                                                 Buffer("ef", 2));
+  absl::Notification written;
+  this->write_queue_.Flush(this->write_queue_.EnqueueCordDataFrames(
+      123, cord, /*offset=*/1, /*length=*/large.size() + 4, /*end_of_stream=*/true,
+      [&] { written.Notify(); }));
+  // The short pieces are copied and coalesced, while the large one is referenced.
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(AllOf(
+                  Property(&FrameHeader::length, 3),
+                  Property(&FrameHeader::frame_type, FrameType::kData),
+                  Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 123)))));
+  EXPECT_THAT(this->Read(3), IsOkAndHolds(BufferAsString("bcd")));
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(AllOf(
+                  Property(&FrameHeader::length, large.size()),
+                  Property(&FrameHeader::frame_type, FrameType::kData),
+                  Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 123)))));
+  EXPECT_THAT(this->Read(large.size()), IsOkAndHolds(BufferAsString(large)));
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 1),
+                        Property(&FrameHeader::frame_type, FrameType::kData),
+                        Property(&FrameHeader::flags, kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 123)))));
+  EXPECT_THAT(this->Read(1), IsOkAndHolds(BufferAsString("e")));
+  written.WaitForNotification();
+}
+
+TYPED_TEST(WriteQueueTest, EnqueueEmptyCordDataFrame) {
+  absl::Notification written;
+  this->write_queue_.Flush(this->write_queue_.EnqueueCordDataFrames(
+      123, std::make_shared<Cord const>(), /*offset=*/0, /*length=*/0, /*end_of_stream=*/true,
+      [&] { written.Notify(); }));
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(
+                  AllOf(Property(&FrameHeader::length, 0),
+                        Property(&FrameHeader::frame_type, FrameType::kData),
+                        Property(&FrameHeader::flags, kFlagEndStream),
+                        Property(&FrameHeader::stream_id, 123)))));
+  written.WaitForNotification();
+}
+
 TYPED_TEST(WriteQueueTest, AppendResetStream) {
   this->write_queue_.AppendResetStreamFrame(123, ErrorCode::kStreamClosed);
   EXPECT_THAT(this->Read(sizeof(FrameHeader)),
@@ -301,6 +487,17 @@ TYPED_TEST(WriteQueueTest, AppendSettingsAck) {
                   Property(&FrameHeader::flags, kFlagAck), Property(&FrameHeader::stream_id, 0)))));
 }
 
+TYPED_TEST(WriteQueueTest, AppendPing) {
+  uint64_t const payload = 71104;
+  this->write_queue_.AppendPingFrame(payload);
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(AllOf(
+                  Property(&FrameHeader::length, kPingPayloadSize),
+                  Property(&FrameHeader::frame_type, FrameType::kPing),
+                  Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 0)))));
+  EXPECT_THAT(this->Read(kPingPayloadSize), IsOkAndHolds(BufferAs<uint64_t>(payload)));
+}
+
 TYPED_TEST(WriteQueueTest, AppendPingAck) {
   uint64_t const payload = 71104;
   this->write_queue_.AppendPingAckFrame(Buffer(&payload, kPingPayloadSize));
@@ -312,6 +509,18 @@ TYPED_TEST(WriteQueueTest, AppendPingAck) {
   EXPECT_THAT(this->Read(kPingPayloadSize), IsOkAndHolds(BufferAs<uint64_t>(payload)));
 }
 
+TYPED_TEST(WriteQueueTest, AppendWindowUpdate) {
+  this->write_queue_.AppendWindowUpdateFrame(123, 65535);
+  EXPECT_THAT(this->Read(sizeof(FrameHeader)),
+              IsOkAndHolds(BufferAs<FrameHeader>(AllOf(
+                  Property(&FrameHeader::length, sizeof(WindowUpdatePayload)),
+                  Property(&FrameHeader::frame_type, FrameType::kWindowUpdate),
+                  Property(&FrameHeader::flags, 0), Property(&FrameHeader::stream_id, 123)))));
+  EXPECT_THAT(this->Read(sizeof(WindowUpdatePayload)),
+              IsOkAndHolds(BufferAs<WindowUpdatePayload>(
+                  Property(&WindowUpdatePayload::window_size_increment, 65535))));
+}
+
 TYPED_TEST(WriteQueueTest, GoAway) {
   absl::Notification done;
   this->write_queue_.GoAway(/*error_code=*/ErrorCode::kStreamClosed,
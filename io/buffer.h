@@ -11,20 +11,38 @@
 #include "absl/log/check.h"
 #include "absl/types/span.h"
 #include "common/utilities.h"
+#include "io/buffer_pool.h"
 
 namespace tsdb2 {
 namespace io {
 
 // Manages an owned, preallocated memory buffer.
+//
+// Buffers with a capacity of up to `kInlineCapacity` bytes are stored inline in the `Buffer`
+// object and don't need any heap allocation. Larger buffers allocated by `Buffer` itself draw their
+// memory from `BufferPool` and return it there upon destruction. Buffers constructed from a raw
+// pointer are not pooled and are freed with `delete[]`.
+//
+// NOTE: since inline data is moved along with the `Buffer` object, moving or swapping invalidates
+// any pointers and spans referring to the data of small buffers.
+//
+// By default the capacity is fixed and writing past it check-fails. A buffer can opt into growable
+// mode with `set_growable`, in which case `Append` and `MemCpy` reallocate the data as needed,
+// growing the capacity geometrically.
 class Buffer {
  public:
+  // Maximum capacity of the buffers stored inline.
+  static size_t constexpr kInlineCapacity = 32;
+
   // Constructs an empty `Buffer` object. The wrapped buffer is not allocated, methods like `get()`
   // return nullptr, and both the size and capacity are 0.
-  explicit Buffer() = default;
+  //
+  // NOTE: the constructor is user-provided rather than defaulted so that const instances can be
+  // declared without initializing the inline storage.
+  explicit Buffer() {}
 
   // Constructs a Buffer with an allocated `capacity` and initial length 0.
-  explicit Buffer(size_t const capacity)
-      : capacity_(capacity), length_(0), data_(new uint8_t[capacity_]) {}
+  explicit Buffer(size_t const capacity) : capacity_(capacity), length_(0) { Allocate(); }
 
   // Takes ownership of the buffer pointed to by the `data` raw pointer, which must have `capacity`
   // bytes of capacity and at least `length` initialized bytes.
@@ -35,44 +53,61 @@ class Buffer {
 
   // Allocates a buffer with `size` capacity and length and copies `data` into it. This constructor
   // does not take ownership of `data`.
-  explicit Buffer(void const* const data, size_t const size)
-      : capacity_(size), length_(size), data_(new uint8_t[size]) {
+  explicit Buffer(void const* const data, size_t const size) : capacity_(size), length_(size) {
+    Allocate();
     std::memcpy(data_, data, size);
   }
 
   explicit Buffer(absl::Span<uint8_t const> const bytes)
-      : capacity_(bytes.size()), length_(bytes.size()), data_(new uint8_t[bytes.size()]) {
+      : capacity_(bytes.size()), length_(bytes.size()) {
+    Allocate();
     std::memcpy(data_, bytes.data(), bytes.size());
   }
 
   // Frees any memory used by the buffer.
-  ~Buffer() { delete[] data_; }
+  ~Buffer() { Free(); }
 
-  // Moving transfers ownership of the buffer.
+  // Moving transfers ownership of the buffer. Inline data is copied.
 
-  Buffer(Buffer&& other) noexcept
-      : capacity_(other.capacity_), length_(other.length_), data_(other.Release()) {}
+  Buffer(Buffer&& other) noexcept { MoveFrom(&other); }
 
   Buffer& operator=(Buffer&& other) noexcept {
     if (this != &other) {
-      delete[] data_;
-      capacity_ = other.capacity_;
-      length_ = other.length_;
-      data_ = other.Release();
+      Free();
+      MoveFrom(&other);
     }
     return *this;
   }
 
   void swap(Buffer& other) noexcept {
     if (this != &other) {
-      std::swap(capacity_, other.capacity_);
-      std::swap(length_, other.length_);
-      std::swap(data_, other.data_);
+      Buffer temp{std::move(other)};
+      other = std::move(*this);
+      *this = std::move(temp);
     }
   }
 
   friend void swap(Buffer& lhs, Buffer& rhs) noexcept { lhs.swap(rhs); }
 
+  // Indicates whether `Append` and `MemCpy` grow the buffer as needed rather than check-failing.
+  bool growable() const { return growable_; }
+
+  // Enables or disables growable mode. A growable buffer reallocates its data when `Append` or
+  // `MemCpy` would overflow it, at least doubling the capacity every time so that the amortized
+  // cost of appending is constant.
+  //
+  // NOTE: reallocation invalidates any pointers and spans referring to the data of the buffer.
+  void set_growable(bool const value) { growable_ = value; }
+
+  // Reallocates the buffer so that its capacity is at least `capacity`, preserving its content.
+  // Does nothing if the capacity is already large enough. Works regardless of growable mode, so it
+  // can also be used before writing directly to the memory pointed to by `get()`.
+  void Reserve(size_t const capacity) {
+    if (capacity > capacity_) {
+      Reallocate(capacity);
+    }
+  }
+
   // Returns the allocated capacity.
   size_t capacity() const { return capacity_; }
 
@@ -272,7 +307,7 @@ class Buffer {
   // types don't make sense in the context of another process.
   //
   // This method check-fails in case of a buffer overflow, i.e. if `size() + sizeof(Word) >
-  // capacity()`.
+  // capacity()`, unless the buffer is growable.
   //
   // NOTE: `Buffer` is mainly intended for IPC but it doesn't perform any endianness conversion, so
   // it's the caller's responsibility to ensure the correct endianness. Bytes would typically be
@@ -280,7 +315,7 @@ class Buffer {
   // like `hton*`.
   template <typename Word, std::enable_if_t<std::is_arithmetic_v<Word>, bool> = true>
   Buffer& Append(Word const word) {
-    CHECK_LE(length_ + sizeof(Word), capacity_) << "buffer overflow";
+    EnsureSpace(sizeof(Word));
     *reinterpret_cast<Word*>(data_ + length_) = word;
     length_ += sizeof(word);
     return *this;
@@ -288,7 +323,7 @@ class Buffer {
 
   // Copies the entire content of `other` appending it to the end of this buffer. `other` is not
   // changed. Check-fails if this buffer doesn't have enough capacity (that is, if
-  // `size() + other.size() > capacity()`).
+  // `size() + other.size() > capacity()`) and is not growable.
   //
   // NOTE: this method may be expensive because the data from `other` is copied (we use
   // `std::memcpy`).
@@ -297,8 +332,10 @@ class Buffer {
   // overload takes a buffer that's supposed to contain data already in network byte order.
   // Therefore not endianness conversion is needed by this overload.
   Buffer& Append(Buffer const& other) {
-    CHECK_LE(length_ + other.length_, capacity_) << "buffer overflow";
-    std::memcpy(data_ + length_, other.data_, other.length_);
+    EnsureSpace(other.length_);
+    if (other.length_ > 0) {
+      std::memcpy(data_ + length_, other.data_, other.length_);
+    }
     length_ += other.length_;
     return *this;
   }
@@ -314,7 +351,8 @@ class Buffer {
   //
   // Note that you can use the `MemCpy` method instead of `std::memcpy`+`Advance`.
   //
-  // `Advance` check-fails if the resulting size is greater than the capacity.
+  // `Advance` check-fails if the resulting size is greater than the capacity, even if the buffer is
+  // growable. Use `Reserve` to make room before writing.
   void Advance(size_t const delta) {
     length_ += delta;
     CHECK_LE(length_, capacity_) << "buffer overflow";
@@ -334,10 +372,12 @@ class Buffer {
   //   buffer.MemCpy(source, 10);
   //   std::cout << buffer.size() << std::endl;  // prints "14"
   //
-  // `MemCpy` check-fails if the buffer capacity would be exceeded.
+  // `MemCpy` check-fails if the buffer capacity would be exceeded, unless the buffer is growable.
   void MemCpy(void const* const source, size_t const length) {
-    CHECK_LE(length_ + length, capacity_) << "buffer overflow";
-    std::memcpy(data_ + length_, source, length);
+    EnsureSpace(length);
+    if (length > 0) {
+      std::memcpy(data_ + length_, source, length);
+    }
     length_ += length;
   }
 
@@ -351,21 +391,25 @@ class Buffer {
     }
   }
 
-  // Destroys the buffer, resetting it to an empty state.
+  // Destroys the buffer, resetting it to an empty state. Growable mode is retained.
   void Clear() {
-    delete[] data_;
-    data_ = nullptr;
-    capacity_ = 0;
-    length_ = 0;
+    Free();
+    Forget();
   }
 
   // Releases ownership of the buffer, invalidating this object and returning a pointer to the
-  // previously wrapped data.
+  // previously wrapped data. The returned pointer can be freed with `delete[]` even if the buffer
+  // was pooled.
+  //
+  // NOTE: inline data is copied to a new heap allocation of `capacity()` bytes.
   gsl::owner<uint8_t*> Release() {
-    gsl::owner<uint8_t*> const data = data_;
-    capacity_ = 0;
-    length_ = 0;
-    data_ = nullptr;
+    gsl::owner<uint8_t*> data = data_;
+    if (storage_ == Storage::kInline) {
+      data = new uint8_t[capacity_];
+      std::memcpy(data, data_, length_);
+    }
+    Forget();
+    growable_ = false;
     return data;
   }
 
@@ -375,9 +419,90 @@ class Buffer {
   Buffer(Buffer const&) = delete;
   Buffer& operator=(Buffer const&) = delete;
 
+  enum class Storage { kHeap, kPooled, kInline };
+
+  // Allocates `capacity_` bytes, either inline or from `BufferPool`.
+  void Allocate() {
+    if (capacity_ > kInlineCapacity) {
+      data_ = BufferPool::Allocate(capacity_);
+      storage_ = Storage::kPooled;
+    } else {
+      data_ = inline_data_;
+      storage_ = Storage::kInline;
+    }
+  }
+
+  // Frees the wrapped memory, returning it to `BufferPool` if it came from there.
+  void Free() {
+    switch (storage_) {
+      case Storage::kHeap:
+        delete[] data_;
+        break;
+      case Storage::kPooled:
+        BufferPool::Deallocate(data_, capacity_);
+        break;
+      case Storage::kInline:
+        break;
+    }
+  }
+
+  // Resets the buffer to an empty state without freeing the wrapped memory.
+  void Forget() {
+    capacity_ = 0;
+    length_ = 0;
+    data_ = nullptr;
+    storage_ = Storage::kHeap;
+  }
+
+  // Takes over the content of `other`, leaving it empty. The wrapped memory must have been freed.
+  void MoveFrom(Buffer* const other) {
+    capacity_ = other->capacity_;
+    length_ = other->length_;
+    storage_ = other->storage_;
+    growable_ = other->growable_;
+    if (storage_ == Storage::kInline) {
+      std::memcpy(inline_data_, other->inline_data_, length_);
+      data_ = inline_data_;
+    } else {
+      data_ = other->data_;
+    }
+    other->Forget();
+    other->growable_ = false;
+  }
+
+  // Moves the content of the buffer to a new allocation of `capacity` bytes.
+  void Reallocate(size_t const capacity) {
+    if (storage_ == Storage::kInline && capacity <= kInlineCapacity) {
+      capacity_ = capacity;
+      return;
+    }
+    Buffer other{capacity};
+    if (length_ > 0) {
+      std::memcpy(other.data_, data_, length_);
+    }
+    other.length_ = length_;
+    other.growable_ = growable_;
+    *this = std::move(other);
+  }
+
+  // Makes sure `length` more bytes can be appended, growing the buffer if it's growable and
+  // check-failing otherwise.
+  void EnsureSpace(size_t const length) {
+    if (length_ + length > capacity_) {
+      CHECK(growable_) << "buffer overflow";
+      Reallocate(std::max(length_ + length, std::max(capacity_ * 2, kInlineCapacity)));
+    }
+  }
+
   size_t capacity_ = 0;
   size_t length_ = 0;
   gsl::owner<uint8_t*> data_ = nullptr;
+  Storage storage_ = Storage::kHeap;
+  bool growable_ = false;
+
+  // Holds the data of small buffers. `data_` points here if `storage_` is `kInline`. Aligned like
+  // heap allocations so that words can be appended at aligned offsets.
+  alignas(std::max_align_t) uint8_t inline_data_[kInlineCapacity];
 };
 
 }  // namespace io
@@ -0,0 +1,201 @@
+#include "io/buffer_pool.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "absl/base/attributes.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/flags/flag.h"
+#include "absl/numeric/bits.h"
+#include "absl/synchronization/mutex.h"
+#include "common/utilities.h"
+
+ABSL_FLAG(size_t, io_buffer_pool_thread_cache_size, 4194304,
+          "Maximum total size of the free buffer blocks cached by each thread, in bytes. 0 "
+          "disables buffer pooling. The flag is read by every thread the first time it allocates "
+          "or frees a buffer.");
+
+namespace tsdb2 {
+namespace io {
+
+namespace {
+
+// Increments a counter that's only written by one thread but may be read by others.
+void Increment(std::atomic<size_t>* const counter, size_t const delta = 1) {
+  counter->store(counter->load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+void Decrement(std::atomic<size_t>* const counter, size_t const delta) {
+  counter->store(counter->load(std::memory_order_relaxed) - delta, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+class BufferPool::ThreadCache {
+ public:
+  // Returns the cache of the calling thread, or nullptr if the thread is exiting and its cache has
+  // already been destroyed. In the latter case blocks must go straight to the heap.
+  static ThreadCache* Get() {
+    if (state_ == State::kDestroyed) {
+      return nullptr;
+    }
+    thread_local ThreadCache instance;
+    return &instance;
+  }
+
+  // Returns the statistics of all threads.
+  static Stats GetStats() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  uint8_t* Allocate(size_t const size_class) {
+    Increment(&allocations_);
+    auto& free_list = free_lists_[size_class];
+    if (free_list.empty()) {
+      return new uint8_t[GetBlockSize(size_class)];
+    }
+    Increment(&cache_hits_);
+    Decrement(&cached_bytes_, GetBlockSize(size_class));
+    auto* const data = free_list.back();
+    free_list.pop_back();
+    return data;
+  }
+
+  void Deallocate(gsl::owner<uint8_t*> const data, size_t const size_class) {
+    Increment(&deallocations_);
+    size_t const block_size = GetBlockSize(size_class);
+    if (cached_bytes_.load(std::memory_order_relaxed) + block_size > max_cached_bytes_) {
+      delete[] data;
+      return;
+    }
+    Increment(&cache_returns_);
+    Increment(&cached_bytes_, block_size);
+    free_lists_[size_class].push_back(data);
+  }
+
+  void Flush() {
+    for (auto& free_list : free_lists_) {
+      for (auto* const data : free_list) {
+        delete[] data;
+      }
+      free_list.clear();
+    }
+    cached_bytes_.store(0, std::memory_order_relaxed);
+  }
+
+ private:
+  enum class State { kAlive, kDestroyed };
+
+  static ABSL_CONST_INIT thread_local State state_;
+
+  // Statistics of the threads that have exited.
+  static Stats retired_stats_ ABSL_GUARDED_BY(mutex_);
+
+  static absl::Mutex mutex_;
+  static absl::flat_hash_set<ThreadCache*>* const caches_ ABSL_GUARDED_BY(mutex_);
+
+  explicit ThreadCache()
+      : max_cached_bytes_(absl::GetFlag(FLAGS_io_buffer_pool_thread_cache_size)) {
+    absl::MutexLock lock{&mutex_};
+    caches_->emplace(this);
+  }
+
+  ~ThreadCache() {
+    state_ = State::kDestroyed;
+    Flush();
+    absl::MutexLock lock{&mutex_};
+    caches_->erase(this);
+    retired_stats_.allocations += allocations_.load(std::memory_order_relaxed);
+    retired_stats_.cache_hits += cache_hits_.load(std::memory_order_relaxed);
+    retired_stats_.deallocations += deallocations_.load(std::memory_order_relaxed);
+    retired_stats_.cache_returns += cache_returns_.load(std::memory_order_relaxed);
+  }
+
+  ThreadCache(ThreadCache const&) = delete;
+  ThreadCache& operator=(ThreadCache const&) = delete;
+  ThreadCache(ThreadCache&&) = delete;
+  ThreadCache& operator=(ThreadCache&&) = delete;
+
+  size_t const max_cached_bytes_;
+
+  std::array<std::vector<gsl::owner<uint8_t*>>, kNumSizeClasses> free_lists_;
+
+  // The counters are only written by the owning thread. They're atomic because `GetStats` may read
+  // them from any thread.
+  std::atomic<size_t> allocations_{0};
+  std::atomic<size_t> cache_hits_{0};
+  std::atomic<size_t> deallocations_{0};
+  std::atomic<size_t> cache_returns_{0};
+  std::atomic<size_t> cached_bytes_{0};
+};
+
+ABSL_CONST_INIT thread_local BufferPool::ThreadCache::State BufferPool::ThreadCache::state_ =
+    BufferPool::ThreadCache::State::kAlive;
+
+BufferPool::Stats BufferPool::ThreadCache::retired_stats_;
+
+ABSL_CONST_INIT absl::Mutex BufferPool::ThreadCache::mutex_{absl::kConstInit};
+
+absl::flat_hash_set<BufferPool::ThreadCache*>* const BufferPool::ThreadCache::caches_ =
+    new absl::flat_hash_set<BufferPool::ThreadCache*>();
+
+BufferPool::Stats BufferPool::ThreadCache::GetStats() {
+  absl::MutexLock lock{&mutex_};
+  Stats stats = retired_stats_;
+  for (auto const* const cache : *caches_) {
+    stats.allocations += cache->allocations_.load(std::memory_order_relaxed);
+    stats.cache_hits += cache->cache_hits_.load(std::memory_order_relaxed);
+    stats.deallocations += cache->deallocations_.load(std::memory_order_relaxed);
+    stats.cache_returns += cache->cache_returns_.load(std::memory_order_relaxed);
+    stats.cached_bytes += cache->cached_bytes_.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+std::optional<size_t> BufferPool::GetSizeClass(size_t const capacity) {
+  if (capacity <= kMinBlockSize) {
+    return 0;
+  } else if (capacity <= kMaxBlockSize) {
+    return absl::bit_width(capacity - 1) - absl::bit_width(kMinBlockSize - 1);
+  } else {
+    return std::nullopt;
+  }
+}
+
+gsl::owner<uint8_t*> BufferPool::Allocate(size_t const capacity) {
+  auto const size_class = GetSizeClass(capacity);
+  if (!size_class.has_value()) {
+    return new uint8_t[capacity];
+  }
+  auto* const cache = ThreadCache::Get();
+  if (cache != nullptr) {
+    return cache->Allocate(size_class.value());
+  } else {
+    return new uint8_t[GetBlockSize(size_class.value())];
+  }
+}
+
+void BufferPool::Deallocate(gsl::owner<uint8_t*> const data, size_t const capacity) {
+  auto const size_class = GetSizeClass(capacity);
+  auto* const cache = size_class.has_value() ? ThreadCache::Get() : nullptr;
+  if (cache != nullptr) {
+    cache->Deallocate(data, size_class.value());
+  } else {
+    delete[] data;
+  }
+}
+
+BufferPool::Stats BufferPool::GetStats() { return ThreadCache::GetStats(); }
+
+void BufferPool::FlushThreadCache() {
+  auto* const cache = ThreadCache::Get();
+  if (cache != nullptr) {
+    cache->Flush();
+  }
+}
+
+}  // namespace io
+}  // namespace tsdb2
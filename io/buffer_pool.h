@@ -0,0 +1,79 @@
+#ifndef __TSDB2_IO_BUFFER_POOL_H__
+#define __TSDB2_IO_BUFFER_POOL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "absl/flags/declare.h"
+#include "common/utilities.h"
+
+ABSL_DECLARE_FLAG(size_t, io_buffer_pool_thread_cache_size);
+
+namespace tsdb2 {
+namespace io {
+
+// Recycles the memory blocks of `Buffer` objects so that the network hot path, which creates and
+// destroys many short-lived buffers, doesn't hit the heap allocator every time.
+//
+// Capacities up to `kMaxBlockSize` are rounded up to a power of two (at least `kMinBlockSize`),
+// and every thread keeps a cache of free blocks for each size class. Blocks are returned to the
+// cache of the thread that frees them, which isn't necessarily the one that allocated them. The
+// total size of the blocks cached by a thread is capped by `--io_buffer_pool_thread_cache_size`;
+// pooling is disabled if the flag is 0. Larger capacities are always allocated on the heap.
+//
+// All blocks are allocated with `new uint8_t[]`, so they can always be freed with `delete[]`. That
+// keeps `Buffer::Release` working as before.
+class BufferPool {
+ public:
+  static size_t constexpr kMinBlockSize = 64;
+  static size_t constexpr kMaxBlockSize = 65536;
+  static size_t constexpr kNumSizeClasses = 11;
+
+  // Allocator statistics, summed over all threads.
+  struct Stats {
+    // Number of blocks allocated through the pool.
+    size_t allocations = 0;
+
+    // Number of allocations served from a thread cache.
+    size_t cache_hits = 0;
+
+    // Number of blocks deallocated through the pool.
+    size_t deallocations = 0;
+
+    // Number of deallocated blocks retained by a thread cache rather than freed.
+    size_t cache_returns = 0;
+
+    // Total size of the blocks currently cached by all threads, in bytes.
+    size_t cached_bytes = 0;
+  };
+
+  // Returns the size class of `capacity`, or an empty optional if `capacity` is too large to be
+  // pooled.
+  static std::optional<size_t> GetSizeClass(size_t capacity);
+
+  // Returns the block size of the specified size class.
+  static size_t GetBlockSize(size_t const size_class) { return kMinBlockSize << size_class; }
+
+  // Allocates a block with at least `capacity` bytes.
+  static gsl::owner<uint8_t*> Allocate(size_t capacity);
+
+  // Deallocates a block previously returned by `Allocate(capacity)`.
+  static void Deallocate(gsl::owner<uint8_t*> data, size_t capacity);
+
+  // Returns the statistics of all threads, including the ones that have already exited.
+  static Stats GetStats();
+
+  // Frees all blocks cached by the calling thread.
+  static void FlushThreadCache();
+
+ private:
+  class ThreadCache;
+
+  explicit BufferPool() = delete;
+};
+
+}  // namespace io
+}  // namespace tsdb2
+
+#endif  // __TSDB2_IO_BUFFER_POOL_H__
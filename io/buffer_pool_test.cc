@@ -0,0 +1,183 @@
+#include "io/buffer_pool.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <utility>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "io/buffer.h"
+
+namespace {
+
+using ::testing::Optional;
+using ::tsdb2::io::Buffer;
+using ::tsdb2::io::BufferPool;
+
+class BufferPoolTest : public ::testing::Test {
+ protected:
+  explicit BufferPoolTest() { BufferPool::FlushThreadCache(); }
+  ~BufferPoolTest() override { BufferPool::FlushThreadCache(); }
+};
+
+TEST_F(BufferPoolTest, SizeClasses) {
+  EXPECT_THAT(BufferPool::GetSizeClass(0), Optional(0));
+  EXPECT_THAT(BufferPool::GetSizeClass(1), Optional(0));
+  EXPECT_THAT(BufferPool::GetSizeClass(64), Optional(0));
+  EXPECT_THAT(BufferPool::GetSizeClass(65), Optional(1));
+  EXPECT_THAT(BufferPool::GetSizeClass(128), Optional(1));
+  EXPECT_THAT(BufferPool::GetSizeClass(129), Optional(2));
+  EXPECT_THAT(BufferPool::GetSizeClass(4096), Optional(6));
+  EXPECT_THAT(BufferPool::GetSizeClass(32769), Optional(10));
+  EXPECT_THAT(BufferPool::GetSizeClass(65536), Optional(10));
+  EXPECT_EQ(BufferPool::GetSizeClass(65537), std::nullopt);
+}
+
+TEST_F(BufferPoolTest, BlockSizes) {
+  EXPECT_EQ(BufferPool::GetBlockSize(0), 64);
+  EXPECT_EQ(BufferPool::GetBlockSize(1), 128);
+  EXPECT_EQ(BufferPool::GetBlockSize(6), 4096);
+  EXPECT_EQ(BufferPool::GetBlockSize(BufferPool::kNumSizeClasses - 1), BufferPool::kMaxBlockSize);
+}
+
+TEST_F(BufferPoolTest, Reuse) {
+  auto const before = BufferPool::GetStats();
+  auto* const data1 = BufferPool::Allocate(100);
+  BufferPool::Deallocate(data1, 100);
+  auto const middle = BufferPool::GetStats();
+  EXPECT_EQ(middle.allocations - before.allocations, 1);
+  EXPECT_EQ(middle.cache_hits - before.cache_hits, 0);
+  EXPECT_EQ(middle.deallocations - before.deallocations, 1);
+  EXPECT_EQ(middle.cache_returns - before.cache_returns, 1);
+  EXPECT_EQ(middle.cached_bytes - before.cached_bytes, 128);
+  auto* const data2 = BufferPool::Allocate(120);
+  EXPECT_EQ(data2, data1);
+  auto const after = BufferPool::GetStats();
+  EXPECT_EQ(after.allocations - before.allocations, 2);
+  EXPECT_EQ(after.cache_hits - before.cache_hits, 1);
+  EXPECT_EQ(after.cached_bytes, before.cached_bytes);
+  BufferPool::Deallocate(data2, 120);
+}
+
+TEST_F(BufferPoolTest, DifferentSizeClass) {
+  auto* const data1 = BufferPool::Allocate(100);
+  BufferPool::Deallocate(data1, 100);
+  auto const before = BufferPool::GetStats();
+  auto* const data2 = BufferPool::Allocate(200);
+  auto const after = BufferPool::GetStats();
+  EXPECT_EQ(after.cache_hits, before.cache_hits);
+  BufferPool::Deallocate(data2, 200);
+}
+
+TEST_F(BufferPoolTest, LargeBlocksAreNotPooled) {
+  auto const before = BufferPool::GetStats();
+  auto* const data = BufferPool::Allocate(100000);
+  BufferPool::Deallocate(data, 100000);
+  auto const after = BufferPool::GetStats();
+  EXPECT_EQ(after.allocations, before.allocations);
+  EXPECT_EQ(after.deallocations, before.deallocations);
+  EXPECT_EQ(after.cached_bytes, before.cached_bytes);
+}
+
+TEST_F(BufferPoolTest, FlushThreadCache) {
+  auto* const data = BufferPool::Allocate(100);
+  BufferPool::Deallocate(data, 100);
+  auto const before = BufferPool::GetStats();
+  BufferPool::FlushThreadCache();
+  auto const after = BufferPool::GetStats();
+  EXPECT_EQ(before.cached_bytes - after.cached_bytes, 128);
+}
+
+TEST_F(BufferPoolTest, CacheSizeLimit) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_io_buffer_pool_thread_cache_size, 256);
+  std::thread([] {
+    auto const before = BufferPool::GetStats();
+    auto* const data1 = BufferPool::Allocate(128);
+    auto* const data2 = BufferPool::Allocate(128);
+    auto* const data3 = BufferPool::Allocate(128);
+    BufferPool::Deallocate(data1, 128);
+    BufferPool::Deallocate(data2, 128);
+    BufferPool::Deallocate(data3, 128);
+    auto const after = BufferPool::GetStats();
+    EXPECT_EQ(after.deallocations - before.deallocations, 3);
+    EXPECT_EQ(after.cache_returns - before.cache_returns, 2);
+    EXPECT_EQ(after.cached_bytes - before.cached_bytes, 256);
+  }).join();
+}
+
+TEST_F(BufferPoolTest, PoolingDisabled) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_io_buffer_pool_thread_cache_size, 0);
+  std::thread([] {
+    auto const before = BufferPool::GetStats();
+    auto* const data = BufferPool::Allocate(100);
+    BufferPool::Deallocate(data, 100);
+    auto const after = BufferPool::GetStats();
+    EXPECT_EQ(after.cache_returns, before.cache_returns);
+    EXPECT_EQ(after.cached_bytes, before.cached_bytes);
+  }).join();
+}
+
+TEST_F(BufferPoolTest, ExitingThreadFreesCache) {
+  auto const before = BufferPool::GetStats();
+  std::thread([] {
+    auto* const data = BufferPool::Allocate(100);
+    BufferPool::Deallocate(data, 100);
+  }).join();
+  auto const after = BufferPool::GetStats();
+  EXPECT_EQ(after.allocations - before.allocations, 1);
+  EXPECT_EQ(after.deallocations - before.deallocations, 1);
+  EXPECT_EQ(after.cached_bytes, before.cached_bytes);
+}
+
+TEST_F(BufferPoolTest, BufferReusesBlocks) {
+  uint8_t const* data = nullptr;
+  {
+    Buffer buffer{100};
+    data = buffer.as_byte_array();
+  }
+  Buffer buffer{120};
+  EXPECT_EQ(buffer.as_byte_array(), data);
+  EXPECT_EQ(buffer.capacity(), 120);
+}
+
+TEST_F(BufferPoolTest, MovedBufferReturnsBlock) {
+  uint8_t const* data = nullptr;
+  {
+    Buffer buffer1{100};
+    data = buffer1.as_byte_array();
+    Buffer buffer2{std::move(buffer1)};
+  }
+  Buffer buffer{100};
+  EXPECT_EQ(buffer.as_byte_array(), data);
+}
+
+TEST_F(BufferPoolTest, ClearedBufferReturnsBlock) {
+  Buffer buffer1{100};
+  uint8_t const* const data = buffer1.as_byte_array();
+  buffer1.Clear();
+  Buffer buffer2{100};
+  EXPECT_EQ(buffer2.as_byte_array(), data);
+}
+
+TEST_F(BufferPoolTest, UnpooledBuffer) {
+  auto const before = BufferPool::GetStats();
+  { Buffer buffer{new uint8_t[100], 100, 0}; }
+  auto const after = BufferPool::GetStats();
+  EXPECT_EQ(after.deallocations, before.deallocations);
+}
+
+TEST_F(BufferPoolTest, ReleasedBlock) {
+  Buffer buffer{100};
+  auto const before = BufferPool::GetStats();
+  delete[] buffer.Release();
+  auto const after = BufferPool::GetStats();
+  EXPECT_EQ(after.deallocations, before.deallocations);
+}
+
+}  // namespace
@@ -694,4 +694,151 @@ TEST(BufferTest, Release) {
   delete[] data;
 }
 
+TEST(BufferTest, SmallBufferIsInline) {
+  Buffer buffer{Buffer::kInlineCapacity};
+  auto const* const object = reinterpret_cast<uint8_t const*>(&buffer);
+  EXPECT_GE(buffer.as_byte_array(), object);
+  EXPECT_LT(buffer.as_byte_array(), object + sizeof(Buffer));
+}
+
+TEST(BufferTest, LargeBufferIsNotInline) {
+  Buffer buffer{Buffer::kInlineCapacity + 1};
+  auto const* const object = reinterpret_cast<uint8_t const*>(&buffer);
+  EXPECT_TRUE(buffer.as_byte_array() < object || buffer.as_byte_array() >= object + sizeof(Buffer));
+}
+
+TEST(BufferTest, MoveConstructSmallBuffer) {
+  std::string_view constexpr kData = "lorem";
+  Buffer b1{kData.data(), kData.size()};
+  Buffer b2{std::move(b1)};
+  EXPECT_EQ(b1.capacity(), 0);
+  EXPECT_EQ(b1.size(), 0);
+  EXPECT_EQ(b1.get(), nullptr);
+  EXPECT_EQ(b2.capacity(), kData.size());
+  EXPECT_THAT(b2.span(), ElementsAreArray(kData));
+}
+
+TEST(BufferTest, MoveAssignSmallBuffer) {
+  std::string_view constexpr kData = "lorem";
+  Buffer b1{kData.data(), kData.size()};
+  Buffer b2{100};
+  b2 = std::move(b1);
+  EXPECT_EQ(b1.capacity(), 0);
+  EXPECT_EQ(b1.size(), 0);
+  EXPECT_EQ(b1.get(), nullptr);
+  EXPECT_EQ(b2.capacity(), kData.size());
+  EXPECT_THAT(b2.span(), ElementsAreArray(kData));
+}
+
+TEST(BufferTest, SwapSmallAndLargeBuffers) {
+  std::string_view constexpr kSmallData = "lorem";
+  std::string_view constexpr kLargeData = "lorem ipsum dolor sit amet, consectetur adipiscing elit";
+  Buffer b1{kSmallData.data(), kSmallData.size()};
+  Buffer b2{kLargeData.data(), kLargeData.size()};
+  auto const* const large_data = b2.get();
+  b1.swap(b2);
+  EXPECT_EQ(b1.capacity(), kLargeData.size());
+  EXPECT_EQ(b1.get(), large_data);
+  EXPECT_THAT(b1.span(), ElementsAreArray(kLargeData));
+  EXPECT_EQ(b2.capacity(), kSmallData.size());
+  EXPECT_THAT(b2.span(), ElementsAreArray(kSmallData));
+}
+
+TEST(BufferTest, ReleaseSmallBuffer) {
+  Buffer buffer{10};
+  buffer.Append<uint8_t>(12);
+  buffer.Append<uint8_t>(34);
+  gsl::owner<uint8_t*> const data = buffer.Release();
+  EXPECT_EQ(buffer.capacity(), 0);
+  EXPECT_EQ(buffer.size(), 0);
+  EXPECT_EQ(buffer.get(), nullptr);
+  EXPECT_EQ(data[0], 12);
+  EXPECT_EQ(data[1], 34);
+  delete[] data;
+}
+
+TEST(BufferTest, NotGrowableByDefault) {
+  Buffer buffer{10};
+  EXPECT_FALSE(buffer.growable());
+}
+
+TEST(BufferTest, GrowableAppend) {
+  Buffer buffer;
+  buffer.set_growable(true);
+  EXPECT_TRUE(buffer.growable());
+  for (uint32_t i = 0; i < 100; ++i) {
+    buffer.Append<uint32_t>(i);
+  }
+  EXPECT_EQ(buffer.size(), sizeof(uint32_t) * 100);
+  EXPECT_GE(buffer.capacity(), buffer.size());
+  EXPECT_LT(buffer.capacity(), buffer.size() * 2);
+  for (uint32_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(buffer.at<uint32_t>(i * sizeof(uint32_t)), i);
+  }
+}
+
+TEST(BufferTest, GrowableAppendBuffer) {
+  std::string_view constexpr kData = "lorem ipsum dolor sit amet";
+  Buffer b1{4};
+  b1.set_growable(true);
+  b1.Append<uint32_t>(42);
+  Buffer const b2{kData.data(), kData.size()};
+  b1.Append(b2);
+  b1.Append(b2);
+  EXPECT_EQ(b1.size(), 4 + kData.size() * 2);
+  EXPECT_EQ(b1.at<uint32_t>(0), 42);
+  EXPECT_THAT(b1.span(4, kData.size()), ElementsAreArray(kData));
+  EXPECT_THAT(b1.span(4 + kData.size()), ElementsAreArray(kData));
+}
+
+TEST(BufferTest, GrowableMemCpy) {
+  std::string_view constexpr kData = "lorem ipsum dolor sit amet";
+  Buffer buffer{10};
+  buffer.set_growable(true);
+  buffer.MemCpy(kData.data(), kData.size());
+  buffer.MemCpy(kData.data(), kData.size());
+  EXPECT_EQ(buffer.size(), kData.size() * 2);
+  EXPECT_THAT(buffer.span(0, kData.size()), ElementsAreArray(kData));
+  EXPECT_THAT(buffer.span(kData.size()), ElementsAreArray(kData));
+}
+
+TEST(BufferTest, MoveGrowableBuffer) {
+  Buffer b1;
+  b1.set_growable(true);
+  Buffer b2{std::move(b1)};
+  EXPECT_FALSE(b1.growable());
+  EXPECT_TRUE(b2.growable());
+}
+
+TEST(BufferTest, Reserve) {
+  std::string_view constexpr kData = "lorem";
+  Buffer buffer{kData.data(), kData.size()};
+  buffer.Reserve(100);
+  EXPECT_EQ(buffer.capacity(), 100);
+  EXPECT_EQ(buffer.size(), kData.size());
+  EXPECT_THAT(buffer.span(), ElementsAreArray(kData));
+  EXPECT_FALSE(buffer.growable());
+  buffer.Reserve(10);
+  EXPECT_EQ(buffer.capacity(), 100);
+}
+
+TEST(BufferTest, ReserveWithinInlineCapacity) {
+  Buffer buffer{10};
+  buffer.Append<uint32_t>(42);
+  auto const* const data = buffer.get();
+  buffer.Reserve(Buffer::kInlineCapacity);
+  EXPECT_EQ(buffer.capacity(), Buffer::kInlineCapacity);
+  EXPECT_EQ(buffer.get(), data);
+  EXPECT_EQ(buffer.at<uint32_t>(0), 42);
+}
+
+TEST(BufferTest, ClearKeepsGrowableMode) {
+  Buffer buffer{10};
+  buffer.set_growable(true);
+  buffer.Clear();
+  EXPECT_TRUE(buffer.growable());
+  buffer.Append<uint64_t>(42);
+  EXPECT_EQ(buffer.at<uint64_t>(0), 42);
+}
+
 }  // namespace
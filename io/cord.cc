@@ -1,74 +1,189 @@
 #include "io/cord.h"
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <optional>
 #include <utility>
 
 #include "absl/log/check.h"
+#include "absl/types/span.h"
+#include "common/reffed_ptr.h"
 #include "io/buffer.h"
 
 namespace tsdb2 {
 namespace io {
 
-size_t Cord::size() const {
+using ::tsdb2::common::reffed_ptr;
+
+void Cord::Append(Buffer buffer) {
+  if (!buffer.empty()) {
+    size_t const length = buffer.size();
+    pieces_.emplace_back(end_offset(), reffed_ptr<Chunk>(new Chunk(std::move(buffer))), 0, length);
+  }
+}
+
+void Cord::Append(Cord other) {
+  size_t offset = end_offset();
+  for (size_t i = other.first_; i < other.pieces_.size(); ++i) {
+    auto& piece = other.pieces_[i];
+    piece.offset = offset;
+    offset += piece.length;
+    pieces_.emplace_back(std::move(piece));
+  }
+}
+
+Cord Cord::Subcord(size_t const offset, size_t length) const {
+  CHECK_LE(offset, size());
+  CHECK_LE(length, size() - offset);
+  Cord result;
+  if (length == 0) {
+    return result;
+  }
+  size_t i = GetPieceIndex(offset);
+  size_t start = base_ + offset - pieces_[i].offset;
+  size_t result_offset = 0;
+  while (length > 0) {
+    auto const& piece = pieces_[i++];
+    size_t const piece_length = std::min(length, piece.length - start);
+    result.pieces_.emplace_back(result_offset, piece.chunk, piece.start + start, piece_length);
+    result_offset += piece_length;
+    length -= piece_length;
+    start = 0;
+  }
+  return result;
+}
+
+void Cord::RemovePrefix(size_t const length) {
+  CHECK_LE(length, size());
+  if (length == 0) {
+    return;
+  } else if (length == size()) {
+    return Clear();
+  }
+  size_t const i = GetPieceIndex(length);
+  for (; first_ < i; ++first_) {
+    pieces_[first_].chunk.reset();
+  }
+  base_ += length;
+  auto& first = pieces_[first_];
+  size_t const delta = base_ - first.offset;
+  first.offset = base_;
+  first.start += delta;
+  first.length -= delta;
+  if (first_ > pieces_.size() - first_) {
+    pieces_.erase(pieces_.begin(), pieces_.begin() + first_);
+    first_ = 0;
+  }
+}
+
+void Cord::RemoveSuffix(size_t const length) {
+  size_t const cord_size = size();
+  CHECK_LE(length, cord_size);
+  if (length == 0) {
+    return;
+  } else if (length == cord_size) {
+    return Clear();
+  }
+  size_t const new_size = cord_size - length;
+  size_t const i = GetPieceIndex(new_size - 1);
+  pieces_.erase(pieces_.begin() + i + 1, pieces_.end());
+  auto& last = pieces_.back();
+  last.length = base_ + new_size - last.offset;
+}
+
+Cord Cord::Split(size_t const length) {
+  auto prefix = Subcord(0, length);
+  RemovePrefix(length);
+  return prefix;
+}
+
+std::optional<absl::Span<uint8_t const>> Cord::TryFlat() const {
   if (pieces_.empty()) {
-    return 0;
+    return absl::Span<uint8_t const>();
+  } else if (num_chunks() < 2) {
+    return pieces_[first_].span();
   } else {
-    auto const& last_piece = pieces_.back();
-    return last_piece.offset + last_piece.buffer.size();
+    return std::nullopt;
   }
 }
 
-void Cord::Append(Buffer buffer) {
-  if (!buffer.empty()) {
-    pieces_.emplace_back(size(), std::move(buffer));
+std::optional<absl::Span<uint8_t const>> Cord::GetContiguousRange(size_t const offset,
+                                                                  size_t const length) const {
+  CHECK_LE(offset + length, size());
+  if (length == 0) {
+    return absl::Span<uint8_t const>();
+  }
+  auto const& piece = GetPieceForIndex(offset);
+  size_t const start = base_ + offset - piece.offset;
+  if (start + length > piece.length) {
+    return std::nullopt;
   }
+  return piece.span().subspan(start, length);
 }
 
-void Cord::Append(Cord other) {
-  size_t offset = size();
-  for (auto& [unused_offset, buffer] : other.pieces_) {
-    auto const piece_size = buffer.size();
-    pieces_.emplace_back(offset, std::move(buffer));
-    offset += piece_size;
+void Cord::CopyRange(size_t offset, size_t length, Buffer* const buffer) const {
+  CHECK_LE(offset + length, size());
+  if (length == 0) {
+    return;
+  }
+  size_t i = GetPieceIndex(offset);
+  size_t start = base_ + offset - pieces_[i].offset;
+  while (length > 0) {
+    auto const span = pieces_[i++].span();
+    size_t const chunk_length = std::min(length, span.size() - start);
+    buffer->MemCpy(span.data() + start, chunk_length);
+    length -= chunk_length;
+    start = 0;
   }
 }
 
 Buffer Cord::Flatten() && {
-  if (pieces_.size() < 1) {
+  if (pieces_.empty()) {
     return Buffer();
-  } else if (pieces_.size() < 2) {
-    return std::move(pieces_.front().buffer);
-  } else {
-    auto const& last = pieces_.back();
-    auto const size = last.offset + last.buffer.size();
-    Buffer buffer{size};
-    for (auto const& [unused_offset, piece] : pieces_) {
-      buffer.Append(piece);
+  }
+  if (num_chunks() < 2) {
+    auto& piece = pieces_[first_];
+    auto const& buffer = piece.chunk->buffer();
+    if (piece.chunk->is_last() && piece.start == 0 && piece.length == buffer.size()) {
+      auto result = std::move(*piece.chunk).Release();
+      Clear();
+      return result;
     }
-    return buffer;
   }
+  size_t const cord_size = size();
+  Buffer buffer{cord_size};
+  for (auto const span : chunks()) {
+    buffer.MemCpy(span.data(), span.size());
+  }
+  Clear();
+  return buffer;
 }
 
-Cord::Piece& Cord::GetPieceForIndex(size_t const index) {
+size_t Cord::GetPieceIndex(size_t index) const {
   CHECK(!pieces_.empty());
-  {
-    auto const& last_piece = pieces_.back();
-    CHECK_LT(index, last_piece.offset + last_piece.buffer.size());
-  }
-  size_t i = 0;
+  index += base_;
+  CHECK_LT(index, end_offset());
+  size_t i = first_;
   size_t j = pieces_.size() - 1;
   while (i < j) {
     size_t k = j - ((j - i) >> 1);
-    auto& piece = pieces_[k];
+    auto const& piece = pieces_[k];
     if (index < piece.offset) {
       j = k - 1;
     } else if (index > piece.offset) {
       i = k;
     } else {
-      return piece;
+      return k;
     }
   }
-  return pieces_[i];
+  return i;
+}
+
+void Cord::Clear() {
+  pieces_.clear();
+  first_ = 0;
+  base_ = 0;
 }
 
 }  // namespace io
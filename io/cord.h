@@ -3,17 +3,95 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <iterator>
+#include <optional>
 #include <type_traits>
 #include <utility>
 
 #include "absl/container/inlined_vector.h"
+#include "absl/types/span.h"
+#include "common/ref_count.h"
+#include "common/reffed_ptr.h"
 #include "io/buffer.h"
 
 namespace tsdb2 {
 namespace io {
 
+// A sequence of bytes stored in one or more non-contiguous chunks.
+//
+// The chunks are immutable and reference-counted, and every piece of a cord refers to a range of a
+// chunk. That allows taking substrings (see `Subcord`, `RemovePrefix`, `RemoveSuffix`, and `Split`)
+// without copying any data: the resulting cords simply share the chunks of the original one.
+//
+// Locating a byte takes a binary search over the pieces, i.e. O(log N) where N is the number of
+// pieces. Code that needs to scan the whole content should rather iterate over the chunks with
+// `chunks()`, or use `TryFlat` to get a contiguous span when the cord has a single piece.
+//
+// Removing a prefix doesn't shift the remaining pieces, so consuming a cord from the front (e.g.
+// with repeated calls to `Split`) takes amortized O(log N) per call.
 class Cord {
+ private:
+  class Chunk;
+  struct Piece;
+
  public:
+  // Iterates over the pieces of a cord, returning a span of bytes for each one.
+  class ChunkIterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = absl::Span<uint8_t const>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type const *;
+    using reference = value_type;
+
+    ChunkIterator(ChunkIterator const &) = default;
+    ChunkIterator &operator=(ChunkIterator const &) = default;
+
+    friend bool operator==(ChunkIterator const &lhs, ChunkIterator const &rhs) {
+      return lhs.piece_ == rhs.piece_;
+    }
+
+    friend bool operator!=(ChunkIterator const &lhs, ChunkIterator const &rhs) {
+      return lhs.piece_ != rhs.piece_;
+    }
+
+    value_type operator*() const { return piece_->span(); }
+
+    ChunkIterator &operator++() {
+      ++piece_;
+      return *this;
+    }
+
+    ChunkIterator operator++(int) {
+      ChunkIterator result = *this;
+      ++piece_;
+      return result;
+    }
+
+   private:
+    friend class Cord;
+
+    explicit ChunkIterator(Piece const *const piece) : piece_(piece) {}
+
+    Piece const *piece_;
+  };
+
+  // Range of `ChunkIterator`s returned by `chunks()`.
+  class ChunkRange {
+   public:
+    ChunkIterator begin() const { return begin_; }
+    ChunkIterator end() const { return end_; }
+
+   private:
+    friend class Cord;
+
+    explicit ChunkRange(ChunkIterator const begin, ChunkIterator const end)
+        : begin_(begin), end_(end) {}
+
+    ChunkIterator begin_;
+    ChunkIterator end_;
+  };
+
   template <typename... Args,
             std::enable_if_t<std::conjunction_v<std::is_same<Args, Buffer>...>, bool> = true>
   explicit Cord(Args... pieces) {
@@ -23,68 +101,177 @@ class Cord {
 
   ~Cord() = default;
 
-  Cord(Cord &&) noexcept = default;
-  Cord &operator=(Cord &&) noexcept = default;
+  Cord(Cord &&other) noexcept { swap(other); }
+
+  Cord &operator=(Cord &&other) noexcept {
+    if (this != &other) {
+      Clear();
+      swap(other);
+    }
+    return *this;
+  }
+
+  void swap(Cord &other) noexcept {
+    using std::swap;  // ensure ADL
+    pieces_.swap(other.pieces_);
+    swap(first_, other.first_);
+    swap(base_, other.base_);
+  }
 
-  void swap(Cord &other) noexcept { pieces_.swap(other.pieces_); }
   friend void swap(Cord &lhs, Cord &rhs) noexcept { lhs.swap(rhs); }
 
-  size_t size() const;
+  size_t size() const { return end_offset() - base_; }
   [[nodiscard]] bool empty() const { return pieces_.empty(); }
 
-  uint8_t &at(size_t const index) {
-    auto &[offset, buffer] = GetPieceForIndex(index);
-    return buffer.at<uint8_t>(index - offset);
-  }
+  // Returns the number of pieces the cord is made of.
+  size_t num_chunks() const { return pieces_.size() - first_; }
 
+  // Returns the byte at `index`. The chunks are immutable, so there's no mutable overload.
   uint8_t at(size_t const index) const {
-    auto const &[offset, buffer] = GetPieceForIndex(index);
-    return buffer.at<uint8_t>(index - offset);
+    auto const &piece = GetPieceForIndex(index);
+    return piece.span()[base_ + index - piece.offset];
   }
 
-  uint8_t &operator[](size_t const index) { return at(index); }
   uint8_t operator[](size_t const index) const { return at(index); }
 
+  // Returns an iterable range over the pieces of the cord, each one represented as a span of bytes.
+  // The spans are valid as long as the cord isn't modified.
+  ChunkRange chunks() const {
+    auto const *const data = pieces_.data();
+    return ChunkRange(ChunkIterator(data + first_), ChunkIterator(data + pieces_.size()));
+  }
+
   void Append(Buffer buffer);
 
+  // Appends the pieces of `other` to this cord. The chunks are shared, not copied.
   void Append(Cord other);
 
+  // Returns a new cord with the `length` bytes starting at `offset`. The returned cord shares the
+  // chunks of this one.
+  //
+  // REQUIRES: `offset + length` must not exceed the size of the cord.
+  Cord Subcord(size_t offset, size_t length) const;
+
+  // Removes the first `length` bytes, releasing any chunks that are no longer referenced.
+  //
+  // REQUIRES: `length` must not exceed the size of the cord.
+  void RemovePrefix(size_t length);
+
+  // Removes the last `length` bytes, releasing any chunks that are no longer referenced.
+  //
+  // REQUIRES: `length` must not exceed the size of the cord.
+  void RemoveSuffix(size_t length);
+
+  // Removes the first `length` bytes from this cord and returns them in a separate cord. The
+  // piece straddling the split point, if any, is shared by both cords.
+  //
+  // REQUIRES: `length` must not exceed the size of the cord.
+  Cord Split(size_t length);
+
+  // Returns a span over the whole content if it's stored contiguously (i.e. the cord has at most
+  // one piece), or an empty optional otherwise.
+  std::optional<absl::Span<uint8_t const>> TryFlat() const;
+
+  // Returns a span over the `length` bytes starting at `offset` if they're all stored in the same
+  // piece, or an empty optional if they straddle two or more pieces. Allows reading data that
+  // happens to be contiguous without copying it.
+  //
+  // REQUIRES: `offset + length` must not exceed the size of the cord.
+  std::optional<absl::Span<uint8_t const>> GetContiguousRange(size_t offset, size_t length) const;
+
+  // Appends the `length` bytes starting at `offset` to `buffer`. Check-fails if `buffer` doesn't
+  // have enough spare capacity.
+  //
+  // REQUIRES: `offset + length` must not exceed the size of the cord.
+  void CopyRange(size_t offset, size_t length, Buffer *buffer) const;
+
+  // Returns the content of the cord in a single buffer. The data is copied unless the cord consists
+  // of a single unshared piece spanning a whole chunk, in which case the buffer is moved out.
   Buffer Flatten() &&;
 
  private:
+  // Immutable, reference-counted buffer shared by the pieces of one or more cords.
+  class Chunk final : public tsdb2::common::SimpleRefCounted {
+   public:
+    explicit Chunk(Buffer buffer) : buffer_(std::move(buffer)) {}
+
+    Buffer const &buffer() const { return buffer_; }
+
+    // Moves the buffer out of the chunk.
+    //
+    // REQUIRES: the caller must hold the only reference.
+    Buffer Release() && { return std::move(buffer_); }
+
+   private:
+    Buffer buffer_;
+  };
+
   struct Piece {
-    explicit Piece(size_t const offset, Buffer buffer)
-        : offset(offset), buffer(std::move(buffer)) {}
+    explicit Piece(size_t const offset, tsdb2::common::reffed_ptr<Chunk> chunk, size_t const start,
+                   size_t const length)
+        : offset(offset), chunk(std::move(chunk)), start(start), length(length) {}
 
     ~Piece() = default;
 
-    Piece(Piece const &) = delete;
-    Piece &operator=(Piece const &) = delete;
+    Piece(Piece const &) = default;
+    Piece &operator=(Piece const &) = default;
     Piece(Piece &&) noexcept = default;
     Piece &operator=(Piece &&) noexcept = default;
 
     void swap(Piece &other) noexcept {
       using std::swap;  // ensure ADL
       swap(offset, other.offset);
-      swap(buffer, other.buffer);
+      swap(chunk, other.chunk);
+      swap(start, other.start);
+      swap(length, other.length);
     }
 
     friend void swap(Piece &lhs, Piece &rhs) noexcept { lhs.swap(rhs); }
 
+    absl::Span<uint8_t const> span() const { return chunk->buffer().span(start, length); }
+
+    // Offset of the piece in the cord, plus `Cord::base_`.
     size_t offset;
-    Buffer buffer;
+
+    tsdb2::common::reffed_ptr<Chunk> chunk;
+
+    // Range of the chunk referred to by the piece.
+    size_t start;
+    size_t length;
   };
 
   Cord(Cord const &) = delete;
   Cord &operator=(Cord const &) = delete;
 
-  Piece &GetPieceForIndex(size_t index);
-
-  Piece const &GetPieceForIndex(size_t index) const {
-    return const_cast<Cord *>(this)->GetPieceForIndex(index);
+  // Returns the offset of the end of the last piece, including `base_`.
+  size_t end_offset() const {
+    if (pieces_.empty()) {
+      return base_;
+    } else {
+      auto const &last_piece = pieces_.back();
+      return last_piece.offset + last_piece.length;
+    }
   }
 
+  // Returns the index (in `pieces_`) of the piece containing the byte at `index`.
+  size_t GetPieceIndex(size_t index) const;
+
+  Piece const &GetPieceForIndex(size_t const index) const { return pieces_[GetPieceIndex(index)]; }
+
+  // Removes all pieces.
+  void Clear();
+
+  // The first `first_` elements of `pieces_` are dead pieces left over by `RemovePrefix`. Their
+  // chunks have already been released, and they're erased in bulk once they outnumber the live
+  // ones. That way removing a prefix doesn't need to shift the live pieces every time.
+  //
+  // The offsets of the pieces aren't updated either when removing a prefix. Instead the removed
+  // length is accumulated in `base_`, which is subtracted from the piece offsets.
+  //
+  // `pieces_` is empty iff the cord is empty, in which case `first_` and `base_` are zero.
   absl::InlinedVector<Piece, 1> pieces_;
+  size_t first_ = 0;
+  size_t base_ = 0;
 };
 
 }  // namespace io
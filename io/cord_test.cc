@@ -1,7 +1,12 @@
 #include "io/cord.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <string>
 #include <string_view>
 #include <utility>
+#include <vector>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -10,6 +15,9 @@
 
 namespace {
 
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+using ::testing::Optional;
 using ::tsdb2::io::Buffer;
 using ::tsdb2::io::Cord;
 using ::tsdb2::testing::io::BufferAsString;
@@ -263,6 +271,23 @@ TEST(CordTest, AppendCord) {
   EXPECT_THAT(std::move(cord1).Flatten(), BufferAsString("abcdedefghijklm"));
 }
 
+TEST(CordTest, GetContiguousRange) {
+  Cord cord{Buffer("abcde", 5), Buffer("fgh", 3)};
+  EXPECT_THAT(cord.GetContiguousRange(1, 3), Optional(ElementsAre('b', 'c', 'd')));
+  EXPECT_THAT(cord.GetContiguousRange(5, 3), Optional(ElementsAre('f', 'g', 'h')));
+  EXPECT_THAT(cord.GetContiguousRange(8, 0), Optional(IsEmpty()));
+  EXPECT_EQ(cord.GetContiguousRange(3, 3), std::nullopt);
+}
+
+TEST(CordTest, CopyRange) {
+  Cord cord{Buffer("abcde", 5), Buffer("fg", 2), Buffer("hij", 3)};
+  Buffer buffer{8};
+  cord.CopyRange(3, 6, &buffer);
+  EXPECT_THAT(buffer, BufferAsString("defghi"));
+  cord.CopyRange(0, 2, &buffer);
+  EXPECT_THAT(buffer, BufferAsString("defghiab"));
+}
+
 TEST(CordTest, MoveConstruct) {
   std::string_view constexpr kData = "abcde";
   Buffer buffer{kData.data(), kData.size()};
@@ -375,4 +400,175 @@ TEST(CordTest, AdlSwap) {
   EXPECT_THAT(std::move(cord2).Flatten(), BufferAsString(kData1));
 }
 
+TEST(CordTest, Chunks) {
+  Cord cord{Buffer("abcde", 5), Buffer("fg", 2), Buffer("hij", 3)};
+  EXPECT_EQ(cord.num_chunks(), 3);
+  std::vector<std::string> chunks;
+  for (auto const chunk : cord.chunks()) {
+    chunks.emplace_back(reinterpret_cast<char const*>(chunk.data()), chunk.size());
+  }
+  EXPECT_THAT(chunks, ElementsAre("abcde", "fg", "hij"));
+}
+
+TEST(CordTest, NoChunks) {
+  Cord cord;
+  EXPECT_EQ(cord.num_chunks(), 0);
+  EXPECT_EQ(cord.chunks().begin(), cord.chunks().end());
+}
+
+TEST(CordTest, TryFlat) {
+  EXPECT_THAT(Cord().TryFlat(), Optional(IsEmpty()));
+  EXPECT_THAT(Cord(Buffer("abc", 3)).TryFlat(), Optional(ElementsAre('a', 'b', 'c')));
+  EXPECT_EQ(Cord(Buffer("abc", 3), Buffer("de", 2)).TryFlat(), std::nullopt);
+}
+
+TEST(CordTest, Subcord) {
+  Cord const cord{Buffer("abcde", 5), Buffer("fg", 2), Buffer("hij", 3)};
+  auto subcord = cord.Subcord(3, 6);
+  EXPECT_EQ(subcord.size(), 6);
+  EXPECT_EQ(subcord.num_chunks(), 3);
+  EXPECT_EQ(subcord.at(0), 'd');
+  EXPECT_EQ(subcord.at(2), 'f');
+  EXPECT_EQ(subcord.at(5), 'i');
+  EXPECT_THAT(std::move(subcord).Flatten(), BufferAsString("defghi"));
+  EXPECT_EQ(cord.size(), 10);
+  EXPECT_EQ(cord.at(0), 'a');
+}
+
+TEST(CordTest, SubcordSharesChunks) {
+  Cord const cord{Buffer("abcde", 5), Buffer("fgh", 3)};
+  auto const subcord = cord.Subcord(1, 3);
+  auto const flat = subcord.TryFlat();
+  ASSERT_TRUE(flat.has_value());
+  EXPECT_EQ(flat->data(), cord.GetContiguousRange(1, 3)->data());
+}
+
+TEST(CordTest, EmptySubcord) {
+  Cord const cord{Buffer("abcde", 5)};
+  EXPECT_TRUE(cord.Subcord(2, 0).empty());
+  EXPECT_TRUE(cord.Subcord(5, 0).empty());
+}
+
+TEST(CordTest, RemovePrefix) {
+  Cord cord{Buffer("abcde", 5), Buffer("fg", 2), Buffer("hij", 3)};
+  cord.RemovePrefix(3);
+  EXPECT_EQ(cord.size(), 7);
+  EXPECT_EQ(cord.num_chunks(), 3);
+  EXPECT_EQ(cord.at(0), 'd');
+  cord.RemovePrefix(4);
+  EXPECT_EQ(cord.size(), 3);
+  EXPECT_EQ(cord.num_chunks(), 1);
+  EXPECT_EQ(cord.at(0), 'h');
+  EXPECT_THAT(std::move(cord).Flatten(), BufferAsString("hij"));
+}
+
+TEST(CordTest, RemoveWholePrefix) {
+  Cord cord{Buffer("abcde", 5), Buffer("fg", 2)};
+  cord.RemovePrefix(7);
+  EXPECT_TRUE(cord.empty());
+}
+
+TEST(CordTest, RemoveSuffix) {
+  Cord cord{Buffer("abcde", 5), Buffer("fg", 2), Buffer("hij", 3)};
+  cord.RemoveSuffix(4);
+  EXPECT_EQ(cord.size(), 6);
+  EXPECT_EQ(cord.num_chunks(), 2);
+  EXPECT_THAT(std::move(cord).Flatten(), BufferAsString("abcdef"));
+}
+
+TEST(CordTest, RemoveWholeSuffix) {
+  Cord cord{Buffer("abcde", 5), Buffer("fg", 2)};
+  cord.RemoveSuffix(7);
+  EXPECT_TRUE(cord.empty());
+}
+
+TEST(CordTest, Split) {
+  Cord cord{Buffer("abcde", 5), Buffer("fg", 2), Buffer("hij", 3)};
+  auto prefix = cord.Split(6);
+  EXPECT_EQ(prefix.size(), 6);
+  EXPECT_EQ(cord.size(), 4);
+  EXPECT_THAT(std::move(prefix).Flatten(), BufferAsString("abcdef"));
+  EXPECT_THAT(std::move(cord).Flatten(), BufferAsString("ghij"));
+}
+
+TEST(CordTest, ConsumeFromFront) {
+  Cord cord;
+  std::string expected;
+  for (char c = 'a'; c <= 'z'; ++c) {
+    std::string const piece(3, c);
+    cord.Append(Buffer(piece.data(), piece.size()));
+    expected += piece;
+  }
+  while (!cord.empty()) {
+    auto prefix = cord.Split(std::min<size_t>(4, cord.size()));
+    EXPECT_THAT(std::move(prefix).Flatten(), BufferAsString(expected.substr(0, 4)));
+    expected.erase(0, 4);
+    EXPECT_EQ(cord.size(), expected.size());
+    EXPECT_EQ(cord.num_chunks(), (expected.size() + 2) / 3);
+    if (!cord.empty()) {
+      EXPECT_EQ(cord.at(0), expected.front());
+      EXPECT_EQ(cord.at(cord.size() - 1), expected.back());
+    }
+  }
+  EXPECT_EQ(cord.size(), 0);
+  EXPECT_EQ(cord.num_chunks(), 0);
+}
+
+TEST(CordTest, AppendAfterRemovePrefix) {
+  Cord cord{Buffer("abcde", 5), Buffer("fg", 2), Buffer("hij", 3)};
+  cord.RemovePrefix(6);
+  cord.Append(Buffer("klm", 3));
+  Cord other{Buffer("nop", 3), Buffer("qrs", 3)};
+  other.RemovePrefix(4);
+  cord.Append(std::move(other));
+  EXPECT_EQ(cord.size(), 9);
+  EXPECT_EQ(cord.num_chunks(), 4);
+  EXPECT_EQ(cord.at(4), 'k');
+  EXPECT_EQ(cord.at(7), 'r');
+  EXPECT_THAT(cord.GetContiguousRange(4, 3), Optional(ElementsAre('k', 'l', 'm')));
+  EXPECT_THAT(cord.Subcord(5, 3).Flatten(), BufferAsString("lmr"));
+  cord.RemoveSuffix(3);
+  EXPECT_THAT(std::move(cord).Flatten(), BufferAsString("ghijkl"));
+}
+
+TEST(CordTest, MoveAfterRemovePrefix) {
+  Cord cord1{Buffer("abcde", 5), Buffer("fg", 2), Buffer("hij", 3)};
+  cord1.RemovePrefix(6);
+  Cord cord2{std::move(cord1)};
+  EXPECT_EQ(cord2.size(), 4);
+  EXPECT_EQ(cord2.at(0), 'g');
+  Cord cord3{Buffer("xyz", 3)};
+  cord3 = std::move(cord2);
+  EXPECT_EQ(cord3.size(), 4);
+  EXPECT_EQ(cord3.num_chunks(), 2);
+  EXPECT_THAT(std::move(cord3).Flatten(), BufferAsString("ghij"));
+}
+
+TEST(CordTest, AppendSubcord) {
+  Cord cord1{Buffer("abcde", 5)};
+  Cord cord2{Buffer("fghij", 5)};
+  cord1.Append(cord2.Subcord(1, 3));
+  EXPECT_EQ(cord1.size(), 8);
+  EXPECT_EQ(cord1.at(5), 'g');
+  EXPECT_THAT(std::move(cord1).Flatten(), BufferAsString("abcdeghi"));
+}
+
+TEST(CordTest, FlattenMovesUnsharedBuffer) {
+  Buffer buffer{"abcdefghijklmnopqrstuvwxyz0123456789", 36};
+  auto const* const data = buffer.get();
+  Cord cord{std::move(buffer)};
+  EXPECT_EQ(std::move(cord).Flatten().get(), data);
+}
+
+TEST(CordTest, FlattenCopiesSharedBuffer) {
+  Buffer buffer{"abcdefghijklmnopqrstuvwxyz0123456789", 36};
+  auto const* const data = buffer.get();
+  Cord cord1{std::move(buffer)};
+  auto cord2 = cord1.Subcord(0, 36);
+  auto const flat = std::move(cord2).Flatten();
+  EXPECT_NE(flat.get(), data);
+  EXPECT_THAT(flat, BufferAsString("abcdefghijklmnopqrstuvwxyz0123456789"));
+  EXPECT_EQ(cord1.size(), 36);
+}
+
 }  // namespace
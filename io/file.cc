@@ -0,0 +1,377 @@
+#include "io/file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "common/utilities.h"
+#include "io/buffer.h"
+#include "io/fd.h"
+
+namespace tsdb2 {
+namespace io {
+
+namespace {
+
+size_t AlignUp(size_t const value) {
+  return (value + kDirectIoAlignment - 1) & ~(kDirectIoAlignment - 1);
+}
+
+size_t AlignDown(size_t const value) { return value & ~(kDirectIoAlignment - 1); }
+
+bool IsAligned(void const* const ptr) {
+  return (reinterpret_cast<uintptr_t>(ptr) & (kDirectIoAlignment - 1)) == 0;
+}
+
+}  // namespace
+
+namespace internal {
+
+AlignedBlock AllocateAlignedBlock(size_t const size) {
+  auto* const ptr = static_cast<uint8_t*>(
+      std::aligned_alloc(kDirectIoAlignment, std::max(AlignUp(size), kDirectIoAlignment)));
+  CHECK(ptr != nullptr) << "aligned_alloc failed";
+  return AlignedBlock(ptr);
+}
+
+}  // namespace internal
+
+void MappedView::Unmap() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<uint8_t*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
+
+absl::StatusOr<File> File::Open(std::string_view const path, Mode const mode,
+                                Options const& options) {
+  int flags = O_CLOEXEC;
+  switch (mode) {
+    case Mode::kRead:
+      flags |= O_RDONLY;
+      break;
+    case Mode::kReadWrite:
+      flags |= O_RDWR | O_CREAT;
+      break;
+    case Mode::kTruncate:
+      flags |= O_RDWR | O_CREAT | O_TRUNC;
+      break;
+    default:
+      return absl::InvalidArgumentError("invalid file open mode");
+  }
+  if (options.direct_io) {
+    flags |= O_DIRECT;
+  }
+  std::string path_string{path};
+  int fd;
+  do {
+    fd = ::open(path_string.c_str(), flags, options.permissions);  // NOLINT(*-vararg)
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(\"", absl::CEscape(path_string), "\")"));
+  }
+  return File(std::move(path_string), FD(fd), options.direct_io);
+}
+
+absl::StatusOr<uint64_t> File::GetSize() const {
+  struct stat statbuf;
+  if (::fstat(*fd_, &statbuf) < 0) {
+    return absl::ErrnoToStatus(errno, "fstat");
+  }
+  return statbuf.st_size;
+}
+
+absl::StatusOr<Buffer> File::PRead(uint64_t const offset, size_t const length) const {
+  Buffer buffer{length};
+  DEFINE_CONST_OR_RETURN(bytes_read, PRead(offset, buffer.as_byte_array(), length));
+  buffer.Advance(bytes_read);
+  return buffer;
+}
+
+absl::StatusOr<size_t> File::PRead(uint64_t const offset, void* const dest,
+                                   size_t const length) const {
+  RETURN_IF_ERROR(CheckAlignment(offset, length));
+  if (!direct_io_ || IsAligned(dest)) {
+    return PReadFully(offset, static_cast<uint8_t*>(dest), length);
+  }
+  auto const block = internal::AllocateAlignedBlock(length);
+  DEFINE_CONST_OR_RETURN(bytes_read, PReadFully(offset, block.get(), length));
+  std::memcpy(dest, block.get(), bytes_read);
+  return bytes_read;
+}
+
+absl::Status File::PWrite(uint64_t const offset, absl::Span<uint8_t const> const data) {
+  RETURN_IF_ERROR(CheckAlignment(offset, data.size()));
+  if (!direct_io_ || IsAligned(data.data())) {
+    return PWriteFully(offset, data.data(), data.size());
+  }
+  auto const block = internal::AllocateAlignedBlock(data.size());
+  std::memcpy(block.get(), data.data(), data.size());
+  return PWriteFully(offset, block.get(), data.size());
+}
+
+absl::Status File::Truncate(uint64_t const size) {
+  int result;
+  do {
+    result = ::ftruncate(*fd_, size);
+  } while (result < 0 && errno == EINTR);
+  if (result < 0) {
+    return absl::ErrnoToStatus(errno, "ftruncate");
+  } else {
+    return absl::OkStatus();
+  }
+}
+
+absl::Status File::DataSync() {
+  int result;
+  do {
+    result = ::fdatasync(*fd_);
+  } while (result < 0 && errno == EINTR);
+  if (result < 0) {
+    return absl::ErrnoToStatus(errno, "fdatasync");
+  } else {
+    return absl::OkStatus();
+  }
+}
+
+absl::Status File::AdviseSequential() const {
+  int const result = ::posix_fadvise(*fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if (result != 0) {
+    // NOTE: `posix_fadvise` returns the error number rather than setting `errno`.
+    return absl::ErrnoToStatus(result, "posix_fadvise(POSIX_FADV_SEQUENTIAL)");
+  } else {
+    return absl::OkStatus();
+  }
+}
+
+absl::StatusOr<MappedView> File::Map() const {
+  DEFINE_CONST_OR_RETURN(size, GetSize());
+  if (size == 0) {
+    return MappedView();
+  }
+  void* const data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, *fd_, 0);
+  if (data == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap");
+  }
+  // This is only a hint for the read-ahead, so we ignore errors.
+  ::madvise(data, size, MADV_SEQUENTIAL);
+  return MappedView(static_cast<uint8_t const*>(data), size);
+}
+
+absl::Status File::CheckAlignment(uint64_t const offset, size_t const length) const {
+  if (direct_io_ && (offset % kDirectIoAlignment != 0 || length % kDirectIoAlignment != 0)) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "direct I/O requires offsets and lengths aligned to ", kDirectIoAlignment,
+        " bytes (offset: ", offset, ", length: ", length, ")"));
+  } else {
+    return absl::OkStatus();
+  }
+}
+
+absl::StatusOr<size_t> File::PReadFully(uint64_t const offset, uint8_t* const dest,
+                                        size_t const length) const {
+  size_t total = 0;
+  while (total < length) {
+    ssize_t const result = ::pread(*fd_, dest + total, length - total, offset + total);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return absl::ErrnoToStatus(errno, "pread");
+    } else if (result == 0) {
+      break;
+    }
+    total += result;
+  }
+  return total;
+}
+
+absl::Status File::PWriteFully(uint64_t const offset, uint8_t const* const data,
+                               size_t const length) {
+  size_t total = 0;
+  while (total < length) {
+    ssize_t const result = ::pwrite(*fd_, data + total, length - total, offset + total);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return absl::ErrnoToStatus(errno, "pwrite");
+    } else if (result == 0) {
+      // No progress is possible (e.g. the device is full), and retrying would loop forever.
+      return absl::ErrnoToStatus(ENOSPC, "pwrite");
+    }
+    total += result;
+  }
+  return absl::OkStatus();
+}
+
+FileReader::FileReader(File const* const file, uint64_t const offset, size_t const buffer_size)
+    : file_(file),
+      offset_(offset),
+      buffer_size_(std::max(AlignUp(buffer_size), kDirectIoAlignment)),
+      buffer_(internal::AllocateAlignedBlock(buffer_size_)) {
+  // This is only a hint for the read-ahead, so we ignore errors.
+  file_->AdviseSequential().IgnoreError();
+}
+
+absl::StatusOr<absl::Span<uint8_t const>> FileReader::Next() {
+  if (buffer_start_ == buffer_end_) {
+    if (eof_) {
+      return absl::Span<uint8_t const>();
+    }
+    RETURN_IF_ERROR(Fill());
+  }
+  absl::Span<uint8_t const> const chunk{buffer_.get() + buffer_start_, buffer_end_ - buffer_start_};
+  buffer_start_ = buffer_end_;
+  offset_ += chunk.size();
+  return chunk;
+}
+
+absl::StatusOr<Buffer> FileReader::Read(size_t const length) {
+  Buffer result{length};
+  while (result.size() < length) {
+    if (buffer_start_ == buffer_end_) {
+      if (eof_) {
+        break;
+      }
+      size_t const remaining = length - result.size();
+      if (!file_->direct_io() && remaining >= buffer_size_) {
+        // Large reads go straight into the result, skipping the intermediate copy.
+        DEFINE_CONST_OR_RETURN(
+            bytes_read, file_->PRead(offset_, result.as_byte_array() + result.size(), remaining));
+        result.Advance(bytes_read);
+        offset_ += bytes_read;
+        eof_ = bytes_read < remaining;
+        continue;
+      }
+      RETURN_IF_ERROR(Fill());
+    }
+    size_t const chunk_length = std::min(length - result.size(), buffer_end_ - buffer_start_);
+    result.MemCpy(buffer_.get() + buffer_start_, chunk_length);
+    buffer_start_ += chunk_length;
+    offset_ += chunk_length;
+  }
+  return result;
+}
+
+absl::Status FileReader::Skip(size_t length) {
+  while (length > 0) {
+    if (buffer_start_ == buffer_end_) {
+      if (eof_) {
+        break;
+      }
+      if (!file_->direct_io() && length >= buffer_size_) {
+        DEFINE_CONST_OR_RETURN(size, file_->GetSize());
+        uint64_t const end = std::max<uint64_t>(size, offset_);
+        offset_ = std::min<uint64_t>(offset_ + length, end);
+        eof_ = offset_ == end;
+        break;
+      }
+      RETURN_IF_ERROR(Fill());
+    }
+    size_t const chunk_length = std::min(length, buffer_end_ - buffer_start_);
+    buffer_start_ += chunk_length;
+    offset_ += chunk_length;
+    length -= chunk_length;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status FileReader::Fill() {
+  DEFINE_CONST_OR_RETURN(bytes_read, file_->PRead(offset_, buffer_.get(), buffer_size_));
+  buffer_start_ = 0;
+  buffer_end_ = bytes_read;
+  eof_ = bytes_read < buffer_size_;
+  return absl::OkStatus();
+}
+
+FileWriter::FileWriter(File* const file, uint64_t const offset, size_t const buffer_size)
+    : file_(file),
+      file_offset_(offset),
+      synced_offset_(offset),
+      buffer_size_(std::max(AlignUp(buffer_size), kDirectIoAlignment)),
+      buffer_(internal::AllocateAlignedBlock(buffer_size_)) {}
+
+absl::Status FileWriter::Append(absl::Span<uint8_t const> data) {
+  if (!file_->direct_io() && buffer_length_ == 0 && data.size() >= buffer_size_) {
+    // Large appends go straight to the file, skipping the intermediate copy.
+    RETURN_IF_ERROR(file_->PWrite(file_offset_, data));
+    file_offset_ += data.size();
+    return absl::OkStatus();
+  }
+  while (!data.empty()) {
+    size_t const chunk_length = std::min(data.size(), buffer_size_ - buffer_length_);
+    std::memcpy(buffer_.get() + buffer_length_, data.data(), chunk_length);
+    buffer_length_ += chunk_length;
+    data.remove_prefix(chunk_length);
+    if (buffer_length_ == buffer_size_) {
+      RETURN_IF_ERROR(
+          file_->PWrite(file_offset_, absl::Span<uint8_t const>(buffer_.get(), buffer_size_)));
+      file_offset_ += buffer_size_;
+      buffer_length_ = 0;
+      flushed_length_ = 0;
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status FileWriter::Flush() {
+  if (buffer_length_ == flushed_length_) {
+    return absl::OkStatus();
+  }
+  if (!file_->direct_io()) {
+    RETURN_IF_ERROR(
+        file_->PWrite(file_offset_, absl::Span<uint8_t const>(buffer_.get(), buffer_length_)));
+    file_offset_ += buffer_length_;
+    buffer_length_ = 0;
+    return absl::OkStatus();
+  }
+  // Direct I/O can only write whole blocks, so we pad the last one with zeros, write everything,
+  // and truncate the file back to its logical size. The last block stays in the buffer so that it
+  // can be rewritten when more data is appended.
+  size_t const padded_length = AlignUp(buffer_length_);
+  std::memset(buffer_.get() + buffer_length_, 0, padded_length - buffer_length_);
+  RETURN_IF_ERROR(
+      file_->PWrite(file_offset_, absl::Span<uint8_t const>(buffer_.get(), padded_length)));
+  RETURN_IF_ERROR(file_->Truncate(file_offset_ + buffer_length_));
+  size_t const full_length = AlignDown(buffer_length_);
+  size_t const tail_length = buffer_length_ - full_length;
+  if (full_length > 0) {
+    std::memmove(buffer_.get(), buffer_.get() + full_length, tail_length);
+  }
+  file_offset_ += full_length;
+  buffer_length_ = tail_length;
+  flushed_length_ = tail_length;
+  return absl::OkStatus();
+}
+
+absl::Status FileWriter::Sync() {
+  if (unsynced_bytes() == 0) {
+    return absl::OkStatus();
+  }
+  RETURN_IF_ERROR(Flush());
+  RETURN_IF_ERROR(file_->DataSync());
+  synced_offset_ = offset();
+  return absl::OkStatus();
+}
+
+}  // namespace io
+}  // namespace tsdb2
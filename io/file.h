@@ -0,0 +1,322 @@
+#ifndef __TSDB2_IO_FILE_H__
+#define __TSDB2_IO_FILE_H__
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "io/buffer.h"
+#include "io/fd.h"
+
+namespace tsdb2 {
+namespace io {
+
+// Alignment of the offsets, lengths, and memory addresses used for direct I/O (i.e. files opened
+// with `O_DIRECT`). 4 KiB satisfies the logical block size of all common block devices.
+inline size_t constexpr kDirectIoAlignment = 4096;
+
+namespace internal {
+
+struct AlignedDeleter {
+  void operator()(uint8_t* const ptr) const { std::free(ptr); }  // NOLINT(*-no-malloc)
+};
+
+// Memory block aligned to `kDirectIoAlignment`, suitable for direct I/O.
+using AlignedBlock = std::unique_ptr<uint8_t[], AlignedDeleter>;
+
+// Allocates an `AlignedBlock` of `size` bytes. `size` is rounded up to a multiple of
+// `kDirectIoAlignment`.
+AlignedBlock AllocateAlignedBlock(size_t size);
+
+}  // namespace internal
+
+// Read-only memory-mapped view of a file, returned by `File::Map`. The mapping is released upon
+// destruction.
+//
+// `MappedView` is movable but not copyable.
+class MappedView {
+ public:
+  // Creates an empty view.
+  explicit MappedView() = default;
+
+  ~MappedView() { Unmap(); }
+
+  MappedView(MappedView&& other) noexcept
+      : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+  MappedView& operator=(MappedView&& other) noexcept {
+    if (this != &other) {
+      Unmap();
+      data_ = std::exchange(other.data_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+
+  void swap(MappedView& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+  }
+
+  friend void swap(MappedView& lhs, MappedView& rhs) noexcept { lhs.swap(rhs); }
+
+  size_t size() const { return size_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
+  // Returns the mapped bytes. The span is valid as long as this view is alive.
+  absl::Span<uint8_t const> span() const { return absl::Span<uint8_t const>(data_, size_); }
+
+ private:
+  friend class File;
+
+  explicit MappedView(uint8_t const* const data, size_t const size) : data_(data), size_(size) {}
+
+  MappedView(MappedView const&) = delete;
+  MappedView& operator=(MappedView const&) = delete;
+
+  void Unmap();
+
+  uint8_t const* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+// An open file supporting positional I/O, data synchronization, and memory mapping.
+//
+// Sequential access is best performed through a `FileReader` or `FileWriter`, which buffer the data
+// so as to issue few large system calls.
+//
+// Files can optionally be opened for direct I/O (`O_DIRECT`), bypassing the page cache. In that
+// case the offsets and lengths passed to `PRead` and `PWrite` must be multiples of
+// `kDirectIoAlignment`, otherwise `InvalidArgumentError` is returned. The data is staged in aligned
+// memory blocks internally, so callers don't need to align their buffers.
+//
+// `File` is thread-compatible: the const methods are thread-safe.
+class File {
+ public:
+  enum class Mode {
+    // Opens an existing file for reading.
+    kRead,
+
+    // Opens a file for reading and writing, creating it if it doesn't exist.
+    kReadWrite,
+
+    // Like `kReadWrite`, but truncates the file if it exists.
+    kTruncate,
+  };
+
+  struct Options {
+    // Opens the file with `O_DIRECT`.
+    bool direct_io = false;
+
+    // Permissions of the file if it's created.
+    mode_t permissions = 0644;
+  };
+
+  static absl::StatusOr<File> Open(std::string_view path, Mode mode, Options const& options);
+
+  static absl::StatusOr<File> Open(std::string_view const path, Mode const mode) {
+    return Open(path, mode, Options());
+  }
+
+  ~File() = default;
+
+  File(File&&) noexcept = default;
+  File& operator=(File&&) noexcept = default;
+
+  void swap(File& other) noexcept {
+    using std::swap;  // ensure ADL
+    swap(path_, other.path_);
+    swap(fd_, other.fd_);
+    swap(direct_io_, other.direct_io_);
+  }
+
+  friend void swap(File& lhs, File& rhs) noexcept { lhs.swap(rhs); }
+
+  std::string_view path() const { return path_; }
+  FD const& fd() const { return fd_; }
+  bool direct_io() const { return direct_io_; }
+
+  // Returns the current size of the file.
+  absl::StatusOr<uint64_t> GetSize() const;
+
+  // Reads up to `length` bytes at `offset`. The returned buffer is shorter than `length` only if
+  // the end of the file is reached.
+  absl::StatusOr<Buffer> PRead(uint64_t offset, size_t length) const;
+
+  // Reads up to `length` bytes at `offset` into `dest`, returning the number of bytes read. That is
+  // less than `length` only if the end of the file is reached.
+  absl::StatusOr<size_t> PRead(uint64_t offset, void* dest, size_t length) const;
+
+  // Writes all of `data` at `offset`.
+  absl::Status PWrite(uint64_t offset, absl::Span<uint8_t const> data);
+
+  // Truncates or extends the file to `size` bytes.
+  absl::Status Truncate(uint64_t size);
+
+  // Flushes the data written so far (and the metadata required to retrieve it) to the storage
+  // device using `fdatasync`.
+  absl::Status DataSync();
+
+  // Hints the kernel that the file will be read sequentially, enabling more aggressive read-ahead.
+  absl::Status AdviseSequential() const;
+
+  // Maps the whole file in memory for reading. The view doesn't reflect later changes to the size
+  // of the file. Mapping an empty file returns an empty view.
+  absl::StatusOr<MappedView> Map() const;
+
+ private:
+  explicit File(std::string path, FD fd, bool const direct_io)
+      : path_(std::move(path)), fd_(std::move(fd)), direct_io_(direct_io) {}
+
+  File(File const&) = delete;
+  File& operator=(File const&) = delete;
+
+  // Checks the alignment constraints of direct I/O. Always succeeds if `direct_io_` is false.
+  absl::Status CheckAlignment(uint64_t offset, size_t length) const;
+
+  // Runs `pread` until `length` bytes are read or the end of the file is reached.
+  absl::StatusOr<size_t> PReadFully(uint64_t offset, uint8_t* dest, size_t length) const;
+
+  // Runs `pwrite` until all of `length` bytes are written.
+  absl::Status PWriteFully(uint64_t offset, uint8_t const* data, size_t length);
+
+  std::string path_;
+  FD fd_;
+  bool direct_io_;
+};
+
+// Reads a file sequentially through a memory buffer, so that many small reads result in few large
+// `pread` calls.
+//
+// In direct I/O mode the buffer size and the start offset must be multiples of
+// `kDirectIoAlignment`. The buffer size is rounded up automatically, while a misaligned offset
+// makes every read fail.
+//
+// `FileReader` doesn't take ownership of the file, which must outlive the reader. It's
+// thread-compatible.
+class FileReader {
+ public:
+  static size_t constexpr kDefaultBufferSize = 1 << 20;
+
+  explicit FileReader(File const* file, uint64_t offset = 0,
+                      size_t buffer_size = kDefaultBufferSize);
+
+  ~FileReader() = default;
+
+  FileReader(FileReader&&) noexcept = default;
+  FileReader& operator=(FileReader&&) noexcept = default;
+
+  // Returns the offset of the next byte to read.
+  uint64_t offset() const { return offset_; }
+
+  // Returns a view of the next chunk of buffered data, reading more from the file if needed. The
+  // chunk is consumed and the returned span is valid until the next call to any reading method. An
+  // empty span is returned at the end of the file.
+  absl::StatusOr<absl::Span<uint8_t const>> Next();
+
+  // Reads the next `length` bytes. The returned buffer is shorter only if the end of the file is
+  // reached.
+  absl::StatusOr<Buffer> Read(size_t length);
+
+  // Skips the next `length` bytes, or up to the end of the file if there aren't enough.
+  absl::Status Skip(size_t length);
+
+ private:
+  FileReader(FileReader const&) = delete;
+  FileReader& operator=(FileReader const&) = delete;
+
+  // Refills the buffer with data at `offset_`. Must only be called when the buffer is empty.
+  absl::Status Fill();
+
+  File const* file_;
+
+  // Offset of the next byte returned to the caller.
+  uint64_t offset_;
+
+  size_t buffer_size_;
+  internal::AlignedBlock buffer_;
+
+  // Range of `buffer_` holding data that hasn't been returned to the caller yet.
+  size_t buffer_start_ = 0;
+  size_t buffer_end_ = 0;
+
+  bool eof_ = false;
+};
+
+// Writes a file sequentially through a memory buffer, so that many small appends result in few
+// large `pwrite` calls.
+//
+// `Sync` only issues `fdatasync` if something was written since the previous sync, so callers
+// can batch several appends in a single sync and call `Sync` liberally.
+//
+// In direct I/O mode the buffer size and the start offset must be multiples of
+// `kDirectIoAlignment`. `Flush` then writes the last, incomplete block padded with zeros and
+// truncates the file to its logical size; the block is rewritten by the next flush.
+//
+// The destructor doesn't flush: any data appended after the last `Flush` or `Sync` is discarded.
+//
+// `FileWriter` doesn't take ownership of the file, which must outlive the writer. It's
+// thread-compatible.
+class FileWriter {
+ public:
+  static size_t constexpr kDefaultBufferSize = 1 << 20;
+
+  explicit FileWriter(File* file, uint64_t offset = 0, size_t buffer_size = kDefaultBufferSize);
+
+  ~FileWriter() = default;
+
+  FileWriter(FileWriter&&) noexcept = default;
+  FileWriter& operator=(FileWriter&&) noexcept = default;
+
+  // Returns the logical size of the written data, i.e. the offset at which the next append will
+  // land.
+  uint64_t offset() const { return file_offset_ + buffer_length_; }
+
+  // Number of bytes appended since the last successful `Sync`.
+  uint64_t unsynced_bytes() const { return offset() - synced_offset_; }
+
+  absl::Status Append(absl::Span<uint8_t const> data);
+
+  absl::Status Append(Buffer const& buffer) { return Append(buffer.span()); }
+
+  // Writes the buffered data to the file, without syncing.
+  absl::Status Flush();
+
+  // Flushes the buffered data and syncs it to the storage device, unless nothing was appended since
+  // the last sync.
+  absl::Status Sync();
+
+ private:
+  FileWriter(FileWriter const&) = delete;
+  FileWriter& operator=(FileWriter const&) = delete;
+
+  File* file_;
+
+  // Offset of the first byte of `buffer_` in the file.
+  uint64_t file_offset_;
+
+  // Offset up to which the data is known to be synced.
+  uint64_t synced_offset_;
+
+  size_t buffer_size_;
+  internal::AlignedBlock buffer_;
+  size_t buffer_length_ = 0;
+
+  // Number of bytes at the beginning of `buffer_` that have already been written to the file. Only
+  // direct I/O mode keeps written data in the buffer (the last, incomplete block).
+  size_t flushed_length_ = 0;
+};
+
+}  // namespace io
+}  // namespace tsdb2
+
+#endif  // __TSDB2_IO_FILE_H__
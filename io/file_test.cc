@@ -0,0 +1,263 @@
+#include "io/file.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "common/testing.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "io/buffer.h"
+
+namespace {
+
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::ElementsAreArray;
+using ::testing::IsEmpty;
+using ::testing::TestTempFile;
+using ::tsdb2::io::Buffer;
+using ::tsdb2::io::File;
+using ::tsdb2::io::FileReader;
+using ::tsdb2::io::FileWriter;
+using ::tsdb2::io::kDirectIoAlignment;
+
+std::string_view constexpr kTestFileName = "file_test";
+
+std::vector<uint8_t> MakeData(size_t const length) {
+  std::vector<uint8_t> data;
+  data.reserve(length);
+  for (size_t i = 0; i < length; ++i) {
+    data.push_back(static_cast<uint8_t>(i * 7 + i / 251));
+  }
+  return data;
+}
+
+class FileTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto status_or_temp_file = TestTempFile::Create(kTestFileName);
+    ASSERT_OK(status_or_temp_file);
+    temp_file_.emplace(std::move(status_or_temp_file).value());
+    temp_file_->Close();
+  }
+
+  std::string_view path() const { return temp_file_->path(); }
+
+  absl::StatusOr<File> OpenDirect() const {
+    File::Options options;
+    options.direct_io = true;
+    return File::Open(path(), File::Mode::kReadWrite, options);
+  }
+
+  std::optional<TestTempFile> temp_file_;
+};
+
+TEST_F(FileTest, OpenMissingFile) {
+  EXPECT_THAT(File::Open("/this/file/does/not/exist", File::Mode::kRead),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST_F(FileTest, EmptyFile) {
+  auto status_or_file = File::Open(path(), File::Mode::kRead);
+  ASSERT_OK(status_or_file);
+  auto const& file = status_or_file.value();
+  EXPECT_EQ(file.path(), path());
+  EXPECT_FALSE(file.direct_io());
+  EXPECT_THAT(file.GetSize(), IsOkAndHolds(0));
+  auto const status_or_buffer = file.PRead(0, 10);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_TRUE(status_or_buffer->empty());
+}
+
+TEST_F(FileTest, PositionalIo) {
+  auto status_or_file = File::Open(path(), File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  auto const data = MakeData(100);
+  ASSERT_OK(file.PWrite(50, data));
+  EXPECT_THAT(file.GetSize(), IsOkAndHolds(150));
+  auto const status_or_buffer = file.PRead(60, 20);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(),
+              ElementsAreArray(absl::Span<uint8_t const>(data).subspan(10, 20)));
+}
+
+TEST_F(FileTest, ShortReadAtEnd) {
+  auto status_or_file = File::Open(path(), File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  auto const data = MakeData(100);
+  ASSERT_OK(file.PWrite(0, data));
+  auto const status_or_buffer = file.PRead(90, 20);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(),
+              ElementsAreArray(absl::Span<uint8_t const>(data).subspan(90)));
+}
+
+TEST_F(FileTest, Truncate) {
+  auto status_or_file = File::Open(path(), File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  ASSERT_OK(file.PWrite(0, MakeData(100)));
+  ASSERT_OK(file.Truncate(40));
+  EXPECT_THAT(file.GetSize(), IsOkAndHolds(40));
+  ASSERT_OK(file.DataSync());
+  auto status_or_file2 = File::Open(path(), File::Mode::kTruncate);
+  ASSERT_OK(status_or_file2);
+  EXPECT_THAT(status_or_file2->GetSize(), IsOkAndHolds(0));
+}
+
+TEST_F(FileTest, Map) {
+  auto status_or_file = File::Open(path(), File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  auto const data = MakeData(10000);
+  ASSERT_OK(file.PWrite(0, data));
+  auto status_or_view = file.Map();
+  ASSERT_OK(status_or_view);
+  auto view = std::move(status_or_view).value();
+  EXPECT_EQ(view.size(), data.size());
+  EXPECT_THAT(view.span(), ElementsAreArray(data));
+}
+
+TEST_F(FileTest, MapEmptyFile) {
+  auto status_or_file = File::Open(path(), File::Mode::kRead);
+  ASSERT_OK(status_or_file);
+  auto const status_or_view = status_or_file->Map();
+  ASSERT_OK(status_or_view);
+  EXPECT_TRUE(status_or_view->empty());
+  EXPECT_THAT(status_or_view->span(), IsEmpty());
+}
+
+TEST_F(FileTest, SequentialRead) {
+  auto status_or_file = File::Open(path(), File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  auto const data = MakeData(10000);
+  ASSERT_OK(file.PWrite(0, data));
+  FileReader reader{&file, /*offset=*/0, /*buffer_size=*/4096};
+  std::vector<uint8_t> result;
+  while (true) {
+    auto const status_or_chunk = reader.Next();
+    ASSERT_OK(status_or_chunk);
+    auto const chunk = status_or_chunk.value();
+    if (chunk.empty()) {
+      break;
+    }
+    EXPECT_LE(chunk.size(), 4096);
+    result.insert(result.end(), chunk.begin(), chunk.end());
+  }
+  EXPECT_THAT(result, ElementsAreArray(data));
+  EXPECT_EQ(reader.offset(), data.size());
+}
+
+TEST_F(FileTest, ReadAndSkip) {
+  auto status_or_file = File::Open(path(), File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  auto const data = MakeData(20000);
+  absl::Span<uint8_t const> const span{data};
+  ASSERT_OK(file.PWrite(0, data));
+  FileReader reader{&file, /*offset=*/100, /*buffer_size=*/4096};
+  auto status_or_buffer = reader.Read(10);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(), ElementsAreArray(span.subspan(100, 10)));
+  ASSERT_OK(reader.Skip(20));
+  EXPECT_EQ(reader.offset(), 130);
+  status_or_buffer = reader.Read(9000);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(), ElementsAreArray(span.subspan(130, 9000)));
+  ASSERT_OK(reader.Skip(5000));
+  EXPECT_EQ(reader.offset(), 14130);
+  status_or_buffer = reader.Read(10000);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(), ElementsAreArray(span.subspan(14130)));
+  ASSERT_OK(reader.Skip(100));
+  EXPECT_EQ(reader.offset(), data.size());
+  EXPECT_THAT(reader.Next(), IsOkAndHolds(IsEmpty()));
+}
+
+TEST_F(FileTest, SequentialWrite) {
+  auto status_or_file = File::Open(path(), File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  auto const data = MakeData(20000);
+  absl::Span<uint8_t const> const span{data};
+  FileWriter writer{&file, /*offset=*/0, /*buffer_size=*/4096};
+  ASSERT_OK(writer.Append(span.subspan(0, 1000)));
+  ASSERT_OK(writer.Append(span.subspan(1000, 5000)));
+  ASSERT_OK(writer.Append(Buffer(span.subspan(6000, 10))));
+  EXPECT_EQ(writer.offset(), 6010);
+  ASSERT_OK(writer.Flush());
+  ASSERT_OK(writer.Append(span.subspan(6010)));
+  ASSERT_OK(writer.Flush());
+  EXPECT_THAT(file.GetSize(), IsOkAndHolds(data.size()));
+  auto const status_or_buffer = file.PRead(0, data.size());
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(), ElementsAreArray(data));
+}
+
+TEST_F(FileTest, SyncBatching) {
+  auto status_or_file = File::Open(path(), File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  FileWriter writer{&file};
+  EXPECT_EQ(writer.unsynced_bytes(), 0);
+  ASSERT_OK(writer.Append(MakeData(10)));
+  ASSERT_OK(writer.Append(MakeData(20)));
+  EXPECT_EQ(writer.unsynced_bytes(), 30);
+  ASSERT_OK(writer.Sync());
+  EXPECT_EQ(writer.unsynced_bytes(), 0);
+  EXPECT_THAT(file.GetSize(), IsOkAndHolds(30));
+  ASSERT_OK(writer.Sync());
+  EXPECT_EQ(writer.offset(), 30);
+}
+
+TEST_F(FileTest, DirectIoAlignment) {
+  auto status_or_file = OpenDirect();
+  if (!status_or_file.ok()) {
+    GTEST_SKIP() << "direct I/O not supported: " << status_or_file.status();
+  }
+  auto& file = status_or_file.value();
+  EXPECT_TRUE(file.direct_io());
+  EXPECT_THAT(file.PWrite(100, MakeData(kDirectIoAlignment)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(file.PWrite(0, MakeData(100)), StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(file.PRead(0, 100), StatusIs(absl::StatusCode::kInvalidArgument));
+  auto const data = MakeData(kDirectIoAlignment * 2);
+  ASSERT_OK(file.PWrite(kDirectIoAlignment, data));
+  auto const status_or_buffer = file.PRead(kDirectIoAlignment, data.size());
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(), ElementsAreArray(data));
+}
+
+TEST_F(FileTest, DirectIoStreams) {
+  auto status_or_file = OpenDirect();
+  if (!status_or_file.ok()) {
+    GTEST_SKIP() << "direct I/O not supported: " << status_or_file.status();
+  }
+  auto& file = status_or_file.value();
+  auto const data = MakeData(10000);
+  absl::Span<uint8_t const> const span{data};
+  FileWriter writer{&file, /*offset=*/0, /*buffer_size=*/8192};
+  ASSERT_OK(writer.Append(span.subspan(0, 5000)));
+  ASSERT_OK(writer.Flush());
+  EXPECT_THAT(file.GetSize(), IsOkAndHolds(5000));
+  ASSERT_OK(writer.Append(span.subspan(5000)));
+  ASSERT_OK(writer.Sync());
+  EXPECT_THAT(file.GetSize(), IsOkAndHolds(data.size()));
+  FileReader reader{&file, /*offset=*/0, /*buffer_size=*/4096};
+  auto const status_or_buffer = reader.Read(data.size() + 100);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(), ElementsAreArray(data));
+}
+
+}  // namespace
@@ -0,0 +1,550 @@
+#include "io/write_ahead_log.h"
+
+#include <dirent.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/crc/crc32c.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/escaping.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "common/simple_condition.h"
+#include "common/utilities.h"
+#include "io/advisory_file_lock.h"
+#include "io/buffer.h"
+#include "io/fd.h"
+#include "io/file.h"
+
+namespace tsdb2 {
+namespace io {
+
+namespace {
+
+using ::tsdb2::common::SimpleCondition;
+
+std::string_view constexpr kLockFileName = "LOCK";
+std::string_view constexpr kSegmentFileSuffix = ".wal";
+size_t constexpr kSegmentNumberDigits = 20;
+
+uint32_t constexpr kSegmentMagic = 0x54574C47;  // "TWLG"
+uint32_t constexpr kSegmentVersion = 1;
+
+// All fields are stored in network byte order.
+struct SegmentHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t first_sequence_number;
+};
+
+static_assert(sizeof(SegmentHeader) == 16);
+
+// All fields are stored in network byte order. The checksum is the CRC32C of the `length` field
+// followed by the payload.
+struct RecordHeader {
+  uint32_t length;
+  uint32_t checksum;
+};
+
+static_assert(sizeof(RecordHeader) == 8);
+
+size_t constexpr kSegmentHeaderSize = sizeof(SegmentHeader);
+size_t constexpr kRecordHeaderSize = sizeof(RecordHeader);
+size_t constexpr kMaxRecordSize = std::numeric_limits<uint32_t>::max();
+
+// Buffer size of the `FileWriter` of the active segment. Batches larger than this are written
+// directly.
+size_t constexpr kWriterBufferSize = 64 << 10;
+
+// Limit of the segments that are no longer active, which are read entirely.
+uint64_t constexpr kNoLimit = std::numeric_limits<uint64_t>::max();
+
+std::string MakeSegmentPath(std::string_view const directory,
+                            uint64_t const first_sequence_number) {
+  return absl::StrCat(directory, "/",
+                      absl::Dec(first_sequence_number, absl::kZeroPad20),
+                      kSegmentFileSuffix);
+}
+
+// Parses the first sequence number from the name of a segment file. Returns an empty optional if
+// `name` is not the name of a segment file.
+std::optional<uint64_t> ParseSegmentName(std::string_view const name) {
+  if (name.size() != kSegmentNumberDigits + kSegmentFileSuffix.size() ||
+      name.substr(kSegmentNumberDigits) != kSegmentFileSuffix) {
+    return std::nullopt;
+  }
+  auto const digits = name.substr(0, kSegmentNumberDigits);
+  if (!std::all_of(digits.begin(), digits.end(),
+                   [](char const ch) { return ch >= '0' && ch <= '9'; })) {
+    return std::nullopt;
+  }
+  uint64_t value;
+  if (!absl::SimpleAtoi(digits, &value)) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+// Returns the first sequence numbers of all the segments in `directory`, sorted.
+absl::StatusOr<std::vector<uint64_t>> ListSegments(std::string const& directory) {
+  DIR* const dir = ::opendir(directory.c_str());
+  if (dir == nullptr) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("opendir(\"", absl::CEscape(directory), "\")"));
+  }
+  std::vector<uint64_t> segments;
+  errno = 0;
+  for (struct dirent* entry = ::readdir(dir); entry != nullptr; entry = ::readdir(dir)) {
+    auto const maybe_sequence_number = ParseSegmentName(entry->d_name);
+    if (maybe_sequence_number.has_value()) {
+      segments.push_back(maybe_sequence_number.value());
+    }
+  }
+  int const error = errno;
+  ::closedir(dir);
+  if (error != 0) {
+    return absl::ErrnoToStatus(error, absl::StrCat("readdir(\"", absl::CEscape(directory), "\")"));
+  }
+  std::sort(segments.begin(), segments.end());
+  return segments;
+}
+
+// Syncs the directory entries of `directory`, so that created and deleted files are durable.
+absl::Status SyncDirectory(std::string const& directory) {
+  FD const fd{::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)};  // NOLINT
+  if (!fd) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("open(\"", absl::CEscape(directory), "\")"));
+  }
+  if (::fsync(*fd) < 0) {
+    return absl::ErrnoToStatus(errno, absl::StrCat("fsync(\"", absl::CEscape(directory), "\")"));
+  }
+  return absl::OkStatus();
+}
+
+// Writes and syncs the header of a new segment.
+absl::Status WriteSegmentHeader(File* const file, uint64_t const first_sequence_number) {
+  SegmentHeader const header{
+      .magic = htobe32(kSegmentMagic),
+      .version = htobe32(kSegmentVersion),
+      .first_sequence_number = htobe64(first_sequence_number),
+  };
+  RETURN_IF_ERROR(file->Truncate(0));
+  RETURN_IF_ERROR(file->PWrite(
+      0, absl::Span<uint8_t const>(reinterpret_cast<uint8_t const*>(&header), sizeof(header))));
+  return file->DataSync();
+}
+
+absl::Status CheckSegmentHeader(absl::Span<uint8_t const> const data,
+                                uint64_t const first_sequence_number, std::string_view const path) {
+  if (data.size() < kSegmentHeaderSize) {
+    return absl::DataLossError(
+        absl::StrCat("truncated segment header in \"", absl::CEscape(std::string(path)), "\""));
+  }
+  SegmentHeader header;
+  std::memcpy(&header, data.data(), sizeof(header));
+  if (be32toh(header.magic) != kSegmentMagic || be32toh(header.version) != kSegmentVersion ||
+      be64toh(header.first_sequence_number) != first_sequence_number) {
+    return absl::DataLossError(
+        absl::StrCat("invalid segment header in \"", absl::CEscape(std::string(path)), "\""));
+  }
+  return absl::OkStatus();
+}
+
+uint32_t ComputeChecksum(uint32_t const encoded_length, absl::Span<uint8_t const> const payload) {
+  auto const crc = absl::ComputeCrc32c(std::string_view(
+      reinterpret_cast<char const*>(&encoded_length), sizeof(encoded_length)));
+  return static_cast<uint32_t>(absl::ExtendCrc32c(
+      crc, std::string_view(reinterpret_cast<char const*>(payload.data()), payload.size())));
+}
+
+// Frames `payload` and appends it to `buffer`, which must be growable.
+void AppendRecord(Buffer* const buffer, absl::Span<uint8_t const> const payload) {
+  uint32_t const encoded_length = htobe32(payload.size());
+  RecordHeader const header{
+      .length = encoded_length,
+      .checksum = htobe32(ComputeChecksum(encoded_length, payload)),
+  };
+  buffer->MemCpy(&header, sizeof(header));
+  if (!payload.empty()) {
+    buffer->MemCpy(payload.data(), payload.size());
+  }
+}
+
+// Parses the record at `offset` in `data` and returns its payload. Returns an empty optional if the
+// record is truncated or its checksum doesn't match.
+std::optional<absl::Span<uint8_t const>> ParseRecord(absl::Span<uint8_t const> const data,
+                                                     size_t const offset) {
+  if (data.size() - offset < kRecordHeaderSize) {
+    return std::nullopt;
+  }
+  RecordHeader header;
+  std::memcpy(&header, data.data() + offset, sizeof(header));
+  size_t const length = be32toh(header.length);
+  if (data.size() - offset - kRecordHeaderSize < length) {
+    return std::nullopt;
+  }
+  auto const payload = data.subspan(offset + kRecordHeaderSize, length);
+  if (ComputeChecksum(header.length, payload) != be32toh(header.checksum)) {
+    return std::nullopt;
+  }
+  return payload;
+}
+
+Buffer MakePendingBuffer() {
+  Buffer buffer;
+  buffer.set_growable(true);
+  return buffer;
+}
+
+struct RecoveredSegment {
+  uint64_t size;
+  uint64_t next_sequence_number;
+};
+
+// Scans the active segment after a restart, discarding any records torn by a crash.
+absl::StatusOr<RecoveredSegment> RecoverSegment(File* const file,
+                                                uint64_t const first_sequence_number) {
+  DEFINE_CONST_OR_RETURN(file_size, file->GetSize());
+  if (file_size <= kSegmentHeaderSize) {
+    // The process crashed while creating the segment, or right after.
+    RETURN_IF_ERROR(WriteSegmentHeader(file, first_sequence_number));
+    return RecoveredSegment{
+        .size = kSegmentHeaderSize,
+        .next_sequence_number = first_sequence_number,
+    };
+  }
+  DEFINE_CONST_OR_RETURN(view, file->Map());
+  auto const data = view.span();
+  RETURN_IF_ERROR(CheckSegmentHeader(data, first_sequence_number, file->path()));
+  size_t offset = kSegmentHeaderSize;
+  uint64_t next_sequence_number = first_sequence_number;
+  while (offset < data.size()) {
+    auto const payload = ParseRecord(data, offset);
+    if (!payload.has_value()) {
+      break;
+    }
+    offset += kRecordHeaderSize + payload->size();
+    ++next_sequence_number;
+  }
+  if (offset < data.size()) {
+    RETURN_IF_ERROR(file->Truncate(offset));
+    RETURN_IF_ERROR(file->DataSync());
+  }
+  return RecoveredSegment{
+      .size = offset,
+      .next_sequence_number = next_sequence_number,
+  };
+}
+
+}  // namespace
+
+absl::StatusOr<std::optional<WriteAheadLog::Record>> WriteAheadLog::Reader::Next() {
+  while (true) {
+    if (offset_ >= data_.size()) {
+      DEFINE_CONST_OR_RETURN(has_segment, OpenNextSegment());
+      if (!has_segment) {
+        return std::nullopt;
+      }
+      continue;
+    }
+    auto const payload = ParseRecord(data_, offset_);
+    if (!payload.has_value()) {
+      return absl::DataLossError(absl::StrCat("corrupted record at offset ", offset_, " of \"",
+                                              absl::CEscape(segments_[next_segment_ - 1].path),
+                                              "\""));
+    }
+    offset_ += kRecordHeaderSize + payload->size();
+    uint64_t const sequence_number = next_sequence_number_++;
+    if (sequence_number >= from_sequence_number_) {
+      return Record{
+          .sequence_number = sequence_number,
+          .data = payload.value(),
+      };
+    }
+  }
+}
+
+absl::StatusOr<bool> WriteAheadLog::Reader::OpenNextSegment() {
+  view_ = MappedView();
+  data_ = absl::Span<uint8_t const>();
+  offset_ = 0;
+  // Skip the segments that only contain records preceding `from_sequence_number_`.
+  while (next_segment_ + 1 < segments_.size() &&
+         segments_[next_segment_ + 1].first_sequence_number <= from_sequence_number_) {
+    ++next_segment_;
+  }
+  if (next_segment_ >= segments_.size()) {
+    return false;
+  }
+  auto const& segment = segments_[next_segment_++];
+  DEFINE_CONST_OR_RETURN(file, File::Open(segment.path, File::Mode::kRead));
+  ASSIGN_OR_RETURN(view_, file.Map());
+  data_ = view_.span().subspan(0, segment.limit);
+  RETURN_IF_ERROR(CheckSegmentHeader(data_, segment.first_sequence_number, segment.path));
+  offset_ = kSegmentHeaderSize;
+  next_sequence_number_ = segment.first_sequence_number;
+  return true;
+}
+
+ABSL_CONST_INIT absl::Mutex WriteAheadLog::open_logs_mutex_{absl::kConstInit};
+absl::flat_hash_set<WriteAheadLog::LockId> WriteAheadLog::open_logs_;
+
+absl::StatusOr<std::unique_ptr<WriteAheadLog>> WriteAheadLog::Open(std::string_view const directory,
+                                                                   Options const& options) {
+  std::string directory_path{directory};
+  if (::mkdir(directory_path.c_str(), 0755) < 0 && errno != EEXIST) {
+    return absl::ErrnoToStatus(errno,
+                               absl::StrCat("mkdir(\"", absl::CEscape(directory_path), "\")"));
+  }
+  DEFINE_CONST_OR_RETURN(lock_file, File::Open(absl::StrCat(directory_path, "/", kLockFileName),
+                                               File::Mode::kReadWrite));
+  struct stat statbuf {};
+  if (::fstat(*(lock_file.fd()), &statbuf) < 0) {
+    return absl::ErrnoToStatus(errno, "fstat");
+  }
+  LockId const lock_id{statbuf.st_dev, statbuf.st_ino};
+  {
+    absl::MutexLock lock{&open_logs_mutex_};
+    if (!open_logs_.emplace(lock_id).second) {
+      return absl::FailedPreconditionError(absl::StrCat(
+          "the write-ahead log in \"", absl::CEscape(directory_path), "\" is already open"));
+    }
+  }
+  auto status_or_log = [&]() -> absl::StatusOr<std::unique_ptr<WriteAheadLog>> {
+    DEFINE_VAR_OR_RETURN(lock, ExclusiveFileLock::Acquire(lock_file.fd()));
+    DEFINE_CONST_OR_RETURN(sequence_numbers, ListSegments(directory_path));
+    std::vector<Segment> segments;
+    segments.reserve(std::max<size_t>(sequence_numbers.size(), 1));
+    for (uint64_t const sequence_number : sequence_numbers) {
+      segments.push_back(Segment{
+          .first_sequence_number = sequence_number,
+          .path = MakeSegmentPath(directory_path, sequence_number),
+      });
+    }
+    bool const created = segments.empty();
+    if (created) {
+      segments.push_back(Segment{
+          .first_sequence_number = 0,
+          .path = MakeSegmentPath(directory_path, 0),
+      });
+    }
+    auto const& active_segment = segments.back();
+    DEFINE_VAR_OR_RETURN(active_file, File::Open(active_segment.path, File::Mode::kReadWrite));
+    DEFINE_CONST_OR_RETURN(recovered, RecoverSegment(&active_file,
+                                                     active_segment.first_sequence_number));
+    if (created) {
+      RETURN_IF_ERROR(SyncDirectory(directory_path));
+    }
+    return absl::WrapUnique(new WriteAheadLog(
+        std::move(directory_path), options, lock_id, std::move(lock), std::move(segments),
+        std::move(active_file), recovered.size, recovered.next_sequence_number));
+  }();
+  if (!status_or_log.ok()) {
+    absl::MutexLock lock{&open_logs_mutex_};
+    open_logs_.erase(lock_id);
+  }
+  return status_or_log;
+}
+
+WriteAheadLog::WriteAheadLog(std::string directory, Options const& options, LockId const lock_id,
+                             ExclusiveFileLock lock, std::vector<Segment> segments,
+                             File active_file, uint64_t const active_size,
+                             uint64_t const next_sequence_number)
+    : directory_(std::move(directory)),
+      options_(options),
+      lock_id_(lock_id),
+      lock_(std::move(lock)),
+      segments_(std::move(segments)),
+      pending_(MakePendingBuffer()),
+      next_sequence_number_(next_sequence_number),
+      durable_sequence_number_(next_sequence_number),
+      durable_size_(active_size) {
+  active_file_.emplace(std::move(active_file));
+  active_writer_.emplace(&active_file_.value(), active_size, kWriterBufferSize);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  absl::MutexLock lock{&open_logs_mutex_};
+  open_logs_.erase(lock_id_);
+}
+
+uint64_t WriteAheadLog::next_sequence_number() const {
+  absl::MutexLock lock{&mutex_};
+  return next_sequence_number_;
+}
+
+size_t WriteAheadLog::num_segments() const {
+  absl::MutexLock lock{&mutex_};
+  return segments_.size();
+}
+
+uint64_t WriteAheadLog::num_syncs() const {
+  absl::MutexLock lock{&mutex_};
+  return num_syncs_;
+}
+
+absl::StatusOr<uint64_t> WriteAheadLog::Append(absl::Span<uint8_t const> const data) {
+  if (data.size() > kMaxRecordSize) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("record too large (", data.size(), " bytes, max ", kMaxRecordSize, ")"));
+  }
+  absl::MutexLock lock{&mutex_};
+  RETURN_IF_ERROR(status_);
+  uint64_t const sequence_number = next_sequence_number_++;
+  AppendRecord(&pending_, data);
+  if (AwaitLeadership([this, sequence_number]() ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+        return durable_sequence_number_ > sequence_number || !status_.ok();
+      })) {
+    auto const commit_status = CommitPending(/*rotate=*/false);
+    leader_active_ = false;
+    RETURN_IF_ERROR(commit_status);
+  }
+  if (durable_sequence_number_ > sequence_number) {
+    return sequence_number;
+  } else {
+    return status_;
+  }
+}
+
+absl::Status WriteAheadLog::Rotate() {
+  absl::MutexLock lock{&mutex_};
+  if (!AwaitLeadership([this]() ABSL_SHARED_LOCKS_REQUIRED(mutex_) { return !status_.ok(); })) {
+    return status_;
+  }
+  auto const status = CommitPending(/*rotate=*/true);
+  leader_active_ = false;
+  return status;
+}
+
+absl::Status WriteAheadLog::TruncateBefore(uint64_t const sequence_number) {
+  std::vector<Segment> obsolete_segments;
+  {
+    absl::MutexLock lock{&mutex_};
+    size_t count = 0;
+    while (count + 1 < segments_.size() &&
+           segments_[count + 1].first_sequence_number <= sequence_number) {
+      ++count;
+    }
+    if (count == 0) {
+      return absl::OkStatus();
+    }
+    obsolete_segments.reserve(count);
+    std::move(segments_.begin(), segments_.begin() + count,
+              std::back_inserter(obsolete_segments));
+    segments_.erase(segments_.begin(), segments_.begin() + count);
+  }
+  // If deleting a file fails it will reappear upon the next `Open`, which is harmless because its
+  // records are still valid.
+  for (auto const& segment : obsolete_segments) {
+    if (::unlink(segment.path.c_str()) < 0 && errno != ENOENT) {
+      return absl::ErrnoToStatus(errno,
+                                 absl::StrCat("unlink(\"", absl::CEscape(segment.path), "\")"));
+    }
+  }
+  return SyncDirectory(directory_);
+}
+
+absl::StatusOr<WriteAheadLog::Reader> WriteAheadLog::Replay(
+    uint64_t const from_sequence_number) const {
+  std::vector<Reader::Segment> segments;
+  absl::MutexLock lock{&mutex_};
+  segments.reserve(segments_.size());
+  for (size_t i = 0; i < segments_.size(); ++i) {
+    segments.push_back(Reader::Segment{
+        .path = segments_[i].path,
+        .first_sequence_number = segments_[i].first_sequence_number,
+        .limit = i + 1 < segments_.size() ? kNoLimit : durable_size_,
+    });
+  }
+  return Reader(std::move(segments), from_sequence_number);
+}
+
+template <typename Done>
+bool WriteAheadLog::AwaitLeadership(Done done) {
+  mutex_.Await(SimpleCondition([this, &done]() ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+    return !leader_active_ || done();
+  }));
+  if (done()) {
+    return false;
+  }
+  leader_active_ = true;
+  return true;
+}
+
+absl::Status WriteAheadLog::CommitPending(bool const rotate) {
+  Buffer const batch = std::move(pending_);
+  pending_ = MakePendingBuffer();
+  uint64_t const first_sequence_number = durable_sequence_number_;
+  uint64_t const end_sequence_number = next_sequence_number_;
+  absl::Status status;
+  if (!batch.empty()) {
+    mutex_.Unlock();
+    status = [&]() -> absl::Status {
+      // Start a new segment if the batch doesn't fit, unless the active one is empty.
+      uint64_t const offset = active_writer_->offset();
+      if (offset > kSegmentHeaderSize && offset + batch.size() > options_.max_segment_size) {
+        RETURN_IF_ERROR(StartSegment(first_sequence_number));
+      }
+      RETURN_IF_ERROR(active_writer_->Append(batch));
+      return active_writer_->Sync();
+    }();
+    mutex_.Lock();
+    if (!status.ok()) {
+      status_ = status;
+      return status;
+    }
+    durable_sequence_number_ = end_sequence_number;
+    durable_size_ = active_writer_->offset();
+    ++num_syncs_;
+  }
+  if (rotate && durable_size_ > kSegmentHeaderSize) {
+    mutex_.Unlock();
+    status = StartSegment(end_sequence_number);
+    mutex_.Lock();
+    if (!status.ok()) {
+      status_ = status;
+    }
+  }
+  return status;
+}
+
+absl::Status WriteAheadLog::StartSegment(uint64_t const first_sequence_number) {
+  std::string path = MakeSegmentPath(directory_, first_sequence_number);
+  DEFINE_VAR_OR_RETURN(file, File::Open(path, File::Mode::kTruncate));
+  RETURN_IF_ERROR(WriteSegmentHeader(&file, first_sequence_number));
+  RETURN_IF_ERROR(SyncDirectory(directory_));
+  active_writer_.reset();
+  active_file_.emplace(std::move(file));
+  active_writer_.emplace(&active_file_.value(), kSegmentHeaderSize, kWriterBufferSize);
+  absl::MutexLock lock{&mutex_};
+  segments_.push_back(Segment{
+      .first_sequence_number = first_sequence_number,
+      .path = std::move(path),
+  });
+  durable_size_ = kSegmentHeaderSize;
+  return absl::OkStatus();
+}
+
+}  // namespace io
+}  // namespace tsdb2
@@ -0,0 +1,233 @@
+#ifndef __TSDB2_IO_WRITE_AHEAD_LOG_H__
+#define __TSDB2_IO_WRITE_AHEAD_LOG_H__
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "io/advisory_file_lock.h"
+#include "io/buffer.h"
+#include "io/file.h"
+
+namespace tsdb2 {
+namespace io {
+
+// Append-only, segmented write-ahead log.
+//
+// The log is a directory containing a `LOCK` file and one or more segment files. Each segment is
+// named after the sequence number of its first record (e.g. `00000000000000000042.wal`) and holds a
+// short header followed by a sequence of records. Every record is framed with its length and a
+// CRC32C checksum covering both the length and the payload, so that a torn write at the end of the
+// log is detected and discarded upon recovery.
+//
+// `Append` is durable: it returns only after the record has been synced to the storage device.
+// Concurrent appenders are group-committed, i.e. the first thread that needs a sync becomes the
+// leader and writes and syncs the records of all the threads that queued up in the meantime with a
+// single `fdatasync`. Throughput is therefore bound by the bandwidth of the device rather than by
+// its sync latency.
+//
+// A new segment is started whenever the active one exceeds `Options::max_segment_size`, or upon an
+// explicit `Rotate` call. Old segments are removed with `TruncateBefore`, typically after the state
+// they describe has been checkpointed elsewhere.
+//
+// Only one `WriteAheadLog` can be open on a given directory at a time: other processes are excluded
+// by an `ExclusiveFileLock` on the `LOCK` file, while other instances in the same process fail to
+// open with `FailedPreconditionError`.
+//
+// If writing or syncing fails the log switches to a failed state, and every subsequent `Append`
+// returns the same error. It must then be closed and reopened, which recovers all records that
+// were durably written.
+//
+// This class is thread-safe.
+class WriteAheadLog {
+ public:
+  struct Options {
+    // Size after which the active segment is closed and a new one is started. Segments may be
+    // slightly larger than this because a group commit is never split across segments.
+    uint64_t max_segment_size = 64 << 20;
+  };
+
+  struct Record {
+    uint64_t sequence_number;
+    absl::Span<uint8_t const> data;
+  };
+
+  // Sequential, zero-copy reader returned by `Replay`.
+  //
+  // The segments are memory-mapped and the returned records refer directly to the mapped memory, so
+  // no data is copied.
+  //
+  // Readers are movable but not copyable, and are thread-compatible.
+  class Reader {
+   public:
+    ~Reader() = default;
+
+    Reader(Reader&&) noexcept = default;
+    Reader& operator=(Reader&&) noexcept = default;
+
+    // Returns the next record, or an empty optional at the end of the log. The data of the returned
+    // record is valid until the next call to `Next` or the destruction of the reader.
+    //
+    // Corrupted records and segment headers result in `DataLossError`.
+    absl::StatusOr<std::optional<Record>> Next();
+
+   private:
+    friend class WriteAheadLog;
+
+    struct Segment {
+      std::string path;
+      uint64_t first_sequence_number;
+
+      // Only the first `limit` bytes of the segment are read.
+      uint64_t limit;
+    };
+
+    explicit Reader(std::vector<Segment> segments, uint64_t const from_sequence_number)
+        : segments_(std::move(segments)), from_sequence_number_(from_sequence_number) {}
+
+    Reader(Reader const&) = delete;
+    Reader& operator=(Reader const&) = delete;
+
+    // Maps the next segment. Returns false if there are no more segments.
+    absl::StatusOr<bool> OpenNextSegment();
+
+    std::vector<Segment> segments_;
+    uint64_t from_sequence_number_;
+
+    size_t next_segment_ = 0;
+    MappedView view_;
+    absl::Span<uint8_t const> data_;
+    size_t offset_ = 0;
+    uint64_t next_sequence_number_ = 0;
+  };
+
+  // Opens the log in `directory`, creating the directory and an initial segment if needed. Records
+  // torn by a crash at the end of the last segment are truncated away.
+  //
+  // Blocks if another process holds the log open.
+  static absl::StatusOr<std::unique_ptr<WriteAheadLog>> Open(std::string_view directory,
+                                                             Options const& options);
+
+  static absl::StatusOr<std::unique_ptr<WriteAheadLog>> Open(std::string_view const directory) {
+    return Open(directory, Options());
+  }
+
+  ~WriteAheadLog() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  std::string_view directory() const { return directory_; }
+
+  // Returns the sequence number that will be assigned to the next appended record.
+  uint64_t next_sequence_number() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns the number of segment files.
+  size_t num_segments() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns the number of syncs performed so far. Smaller than the number of appended records when
+  // group commit kicks in.
+  uint64_t num_syncs() const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Appends a record, blocks until it's durable, and returns its sequence number.
+  absl::StatusOr<uint64_t> Append(absl::Span<uint8_t const> data) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Closes the active segment and starts a new one. No-op if the active segment is empty.
+  absl::Status Rotate() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Deletes all the segments containing only records with sequence numbers lower than
+  // `sequence_number`. The active segment is never deleted.
+  absl::Status TruncateBefore(uint64_t sequence_number) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Returns a reader over all the durable records with sequence numbers greater than or equal to
+  // `from_sequence_number`. Records appended after this call are not returned.
+  //
+  // The reader may fail if `TruncateBefore` deletes a segment before the reader gets to it.
+  absl::StatusOr<Reader> Replay(uint64_t from_sequence_number) const ABSL_LOCKS_EXCLUDED(mutex_);
+
+  absl::StatusOr<Reader> Replay() const { return Replay(0); }
+
+ private:
+  struct Segment {
+    uint64_t first_sequence_number;
+    std::string path;
+  };
+
+  // Identifies a `LOCK` file, for the purpose of excluding other instances in the same process.
+  using LockId = std::pair<dev_t, ino_t>;
+
+  explicit WriteAheadLog(std::string directory, Options const& options, LockId lock_id,
+                         ExclusiveFileLock lock, std::vector<Segment> segments, File active_file,
+                         uint64_t active_size, uint64_t next_sequence_number);
+
+  WriteAheadLog(WriteAheadLog const&) = delete;
+  WriteAheadLog& operator=(WriteAheadLog const&) = delete;
+  WriteAheadLog(WriteAheadLog&&) = delete;
+  WriteAheadLog& operator=(WriteAheadLog&&) = delete;
+
+  static absl::Mutex open_logs_mutex_;
+
+  // The `LOCK` files of the logs currently open in this process.
+  static absl::flat_hash_set<LockId> open_logs_ ABSL_GUARDED_BY(open_logs_mutex_);
+
+  // Waits until no other thread is writing to the files, then makes the calling thread the leader.
+  // Returns false without becoming the leader if `done` returns true first.
+  template <typename Done>
+  bool AwaitLeadership(Done done) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Writes and syncs all pending records. If `rotate` is true the active segment is also rotated
+  // afterwards, provided that it's not empty. Must be called by the leader, which remains such upon
+  // return. Temporarily releases `mutex_`.
+  absl::Status CommitPending(bool rotate) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Syncs the directory and starts a new segment whose first record will have the specified
+  // sequence number. Called by the leader without holding `mutex_`.
+  absl::Status StartSegment(uint64_t first_sequence_number) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  std::string const directory_;
+  Options const options_;
+  LockId const lock_id_;
+  ExclusiveFileLock const lock_;
+
+  absl::Mutex mutable mutex_;
+
+  // All segments, sorted by sequence number. The last one is the active one.
+  std::vector<Segment> segments_ ABSL_GUARDED_BY(mutex_);
+
+  // Framed records appended but not yet written, and the sequence number of the next record.
+  Buffer pending_ ABSL_GUARDED_BY(mutex_);
+  uint64_t next_sequence_number_ ABSL_GUARDED_BY(mutex_);
+
+  // All the records with lower sequence numbers are durable.
+  uint64_t durable_sequence_number_ ABSL_GUARDED_BY(mutex_);
+
+  // Durable size of the active segment.
+  uint64_t durable_size_ ABSL_GUARDED_BY(mutex_);
+
+  // Indicates that a thread (the "leader") is writing to the files.
+  bool leader_active_ ABSL_GUARDED_BY(mutex_) = false;
+
+  // Sticky error status, set when writing or syncing fails.
+  absl::Status status_ ABSL_GUARDED_BY(mutex_);
+
+  uint64_t num_syncs_ ABSL_GUARDED_BY(mutex_) = 0;
+
+  // The active segment file and its writer. Only the leader can access these.
+  std::optional<File> active_file_;
+  std::optional<FileWriter> active_writer_;
+};
+
+}  // namespace io
+}  // namespace tsdb2
+
+#endif  // __TSDB2_IO_WRITE_AHEAD_LOG_H__
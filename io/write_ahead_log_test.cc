@@ -0,0 +1,357 @@
+#include "io/write_ahead_log.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/types/span.h"
+#include "common/testing.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "io/file.h"
+
+namespace {
+
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+using ::testing::Eq;
+using ::testing::Field;
+using ::testing::Gt;
+using ::testing::IsEmpty;
+using ::testing::Le;
+using ::testing::Optional;
+using ::testing::UnorderedElementsAreArray;
+using ::tsdb2::io::File;
+using ::tsdb2::io::WriteAheadLog;
+
+std::vector<uint8_t> MakeData(size_t const length, uint8_t const seed = 0) {
+  std::vector<uint8_t> data;
+  data.reserve(length);
+  for (size_t i = 0; i < length; ++i) {
+    data.push_back(static_cast<uint8_t>(seed + i * 11));
+  }
+  return data;
+}
+
+std::vector<uint8_t> ToBytes(std::string_view const text) { return {text.begin(), text.end()}; }
+
+class WriteAheadLogTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    std::string path = absl::StrCat(::testing::GetTestTmpDir(), "/write_ahead_log_test.XXXXXX");
+    ASSERT_NE(::mkdtemp(path.data()), nullptr);
+    directory_ = std::move(path);
+  }
+
+  void TearDown() override { std::filesystem::remove_all(directory_); }
+
+  absl::StatusOr<std::unique_ptr<WriteAheadLog>> Open(uint64_t const max_segment_size = 64 << 20) {
+    return WriteAheadLog::Open(directory_,
+                               WriteAheadLog::Options{.max_segment_size = max_segment_size});
+  }
+
+  // Returns the paths of the segment files, sorted.
+  std::vector<std::string> GetSegmentPaths() const {
+    std::vector<std::string> paths;
+    for (auto const& entry : std::filesystem::directory_iterator(directory_)) {
+      if (entry.path().extension() == ".wal") {
+        paths.push_back(entry.path().string());
+      }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+  }
+
+  // Replays the whole log starting at `from_sequence_number`, returning the sequence numbers and
+  // contents of all records.
+  static absl::StatusOr<std::vector<std::pair<uint64_t, std::vector<uint8_t>>>> ReadAll(
+      WriteAheadLog const& log, uint64_t const from_sequence_number = 0) {
+    auto status_or_reader = log.Replay(from_sequence_number);
+    if (!status_or_reader.ok()) {
+      return status_or_reader.status();
+    }
+    auto& reader = status_or_reader.value();
+    std::vector<std::pair<uint64_t, std::vector<uint8_t>>> records;
+    while (true) {
+      auto const status_or_record = reader.Next();
+      if (!status_or_record.ok()) {
+        return status_or_record.status();
+      }
+      auto const& maybe_record = status_or_record.value();
+      if (!maybe_record.has_value()) {
+        return records;
+      }
+      records.emplace_back(maybe_record->sequence_number,
+                           std::vector<uint8_t>(maybe_record->data.begin(),
+                                                maybe_record->data.end()));
+    }
+  }
+
+  std::string directory_;
+};
+
+TEST_F(WriteAheadLogTest, EmptyLog) {
+  auto const status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  auto const& log = *status_or_log.value();
+  EXPECT_EQ(log.directory(), directory_);
+  EXPECT_EQ(log.next_sequence_number(), 0);
+  EXPECT_EQ(log.num_segments(), 1);
+  EXPECT_EQ(log.num_syncs(), 0);
+  EXPECT_THAT(ReadAll(log), IsOkAndHolds(IsEmpty()));
+  EXPECT_EQ(GetSegmentPaths().size(), 1);
+}
+
+TEST_F(WriteAheadLogTest, AppendAndReplay) {
+  auto const status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  EXPECT_THAT(log.Append(ToBytes("lorem")), IsOkAndHolds(0));
+  EXPECT_THAT(log.Append(ToBytes("ipsum")), IsOkAndHolds(1));
+  EXPECT_THAT(log.Append({}), IsOkAndHolds(2));
+  EXPECT_THAT(log.Append(ToBytes("dolor")), IsOkAndHolds(3));
+  EXPECT_EQ(log.next_sequence_number(), 4);
+  EXPECT_EQ(log.num_syncs(), 4);
+  EXPECT_THAT(ReadAll(log), IsOkAndHolds(ElementsAre(std::make_pair(0, ToBytes("lorem")),
+                                                     std::make_pair(1, ToBytes("ipsum")),
+                                                     std::make_pair(2, ToBytes("")),
+                                                     std::make_pair(3, ToBytes("dolor")))));
+}
+
+TEST_F(WriteAheadLogTest, ReplayFromSequenceNumber) {
+  auto const status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  ASSERT_OK(log.Append(ToBytes("lorem")));
+  ASSERT_OK(log.Append(ToBytes("ipsum")));
+  ASSERT_OK(log.Append(ToBytes("dolor")));
+  EXPECT_THAT(ReadAll(log, 1), IsOkAndHolds(ElementsAre(std::make_pair(1, ToBytes("ipsum")),
+                                                        std::make_pair(2, ToBytes("dolor")))));
+  EXPECT_THAT(ReadAll(log, 3), IsOkAndHolds(IsEmpty()));
+}
+
+TEST_F(WriteAheadLogTest, ReplayIgnoresLaterRecords) {
+  auto const status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  ASSERT_OK(log.Append(ToBytes("lorem")));
+  auto status_or_reader = log.Replay();
+  ASSERT_OK(status_or_reader);
+  ASSERT_OK(log.Append(ToBytes("ipsum")));
+  auto& reader = status_or_reader.value();
+  auto const status_or_record = reader.Next();
+  ASSERT_OK(status_or_record);
+  EXPECT_THAT(status_or_record.value(),
+              Optional(Field(&WriteAheadLog::Record::sequence_number, 0)));
+  EXPECT_THAT(reader.Next(), IsOkAndHolds(Eq(std::nullopt)));
+}
+
+TEST_F(WriteAheadLogTest, Reopen) {
+  {
+    auto const status_or_log = Open();
+    ASSERT_OK(status_or_log);
+    auto& log = *status_or_log.value();
+    ASSERT_OK(log.Append(ToBytes("lorem")));
+    ASSERT_OK(log.Append(ToBytes("ipsum")));
+  }
+  auto const status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  EXPECT_EQ(log.next_sequence_number(), 2);
+  EXPECT_THAT(log.Append(ToBytes("dolor")), IsOkAndHolds(2));
+  EXPECT_THAT(ReadAll(log), IsOkAndHolds(ElementsAre(std::make_pair(0, ToBytes("lorem")),
+                                                     std::make_pair(1, ToBytes("ipsum")),
+                                                     std::make_pair(2, ToBytes("dolor")))));
+}
+
+TEST_F(WriteAheadLogTest, AlreadyOpen) {
+  auto status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  EXPECT_THAT(Open(), StatusIs(absl::StatusCode::kFailedPrecondition));
+  status_or_log->reset();
+  EXPECT_OK(Open());
+}
+
+TEST_F(WriteAheadLogTest, RotateBySize) {
+  auto const status_or_log = Open(/*max_segment_size=*/100);
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  std::vector<std::pair<uint64_t, std::vector<uint8_t>>> expected;
+  for (uint64_t i = 0; i < 10; ++i) {
+    auto const data = MakeData(40, i);
+    EXPECT_THAT(log.Append(data), IsOkAndHolds(i));
+    expected.emplace_back(i, data);
+  }
+  EXPECT_EQ(log.num_segments(), 10);
+  EXPECT_EQ(GetSegmentPaths().size(), 10);
+  EXPECT_THAT(ReadAll(log), IsOkAndHolds(ElementsAreArray(expected)));
+  EXPECT_THAT(ReadAll(log, 7),
+              IsOkAndHolds(ElementsAreArray(expected.begin() + 7, expected.end())));
+}
+
+TEST_F(WriteAheadLogTest, LargeRecord) {
+  auto const status_or_log = Open(/*max_segment_size=*/100);
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  auto const data1 = MakeData(1000, 1);
+  auto const data2 = MakeData(200000, 2);
+  ASSERT_OK(log.Append(data1));
+  ASSERT_OK(log.Append(data2));
+  EXPECT_EQ(log.num_segments(), 2);
+  EXPECT_THAT(ReadAll(log),
+              IsOkAndHolds(ElementsAre(std::make_pair(0, data1), std::make_pair(1, data2))));
+}
+
+TEST_F(WriteAheadLogTest, ExplicitRotation) {
+  auto const status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  ASSERT_OK(log.Rotate());
+  EXPECT_EQ(log.num_segments(), 1);
+  ASSERT_OK(log.Append(ToBytes("lorem")));
+  ASSERT_OK(log.Rotate());
+  EXPECT_EQ(log.num_segments(), 2);
+  ASSERT_OK(log.Rotate());
+  EXPECT_EQ(log.num_segments(), 2);
+  ASSERT_OK(log.Append(ToBytes("ipsum")));
+  EXPECT_THAT(ReadAll(log), IsOkAndHolds(ElementsAre(std::make_pair(0, ToBytes("lorem")),
+                                                     std::make_pair(1, ToBytes("ipsum")))));
+}
+
+TEST_F(WriteAheadLogTest, TruncateBefore) {
+  auto const status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_OK(log.Append(ToBytes("lorem")));
+    ASSERT_OK(log.Append(ToBytes("ipsum")));
+    ASSERT_OK(log.Rotate());
+  }
+  ASSERT_OK(log.Append(ToBytes("dolor")));
+  EXPECT_EQ(log.num_segments(), 4);
+  ASSERT_OK(log.TruncateBefore(3));
+  EXPECT_EQ(log.num_segments(), 3);
+  EXPECT_EQ(GetSegmentPaths().size(), 3);
+  EXPECT_THAT(ReadAll(log), IsOkAndHolds(ElementsAre(std::make_pair(2, ToBytes("lorem")),
+                                                     std::make_pair(3, ToBytes("ipsum")),
+                                                     std::make_pair(4, ToBytes("lorem")),
+                                                     std::make_pair(5, ToBytes("ipsum")),
+                                                     std::make_pair(6, ToBytes("dolor")))));
+  ASSERT_OK(log.TruncateBefore(100));
+  EXPECT_EQ(log.num_segments(), 1);
+  EXPECT_THAT(ReadAll(log), IsOkAndHolds(ElementsAre(std::make_pair(6, ToBytes("dolor")))));
+  EXPECT_THAT(log.Append(ToBytes("amet")), IsOkAndHolds(7));
+}
+
+TEST_F(WriteAheadLogTest, RecoverTornRecord) {
+  {
+    auto const status_or_log = Open();
+    ASSERT_OK(status_or_log);
+    auto& log = *status_or_log.value();
+    ASSERT_OK(log.Append(ToBytes("lorem")));
+    ASSERT_OK(log.Append(ToBytes("ipsum")));
+  }
+  auto const paths = GetSegmentPaths();
+  ASSERT_EQ(paths.size(), 1);
+  auto status_or_file = File::Open(paths[0], File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  auto const status_or_size = file.GetSize();
+  ASSERT_OK(status_or_size);
+  uint64_t const size = status_or_size.value();
+  // Simulate a crash in the middle of writing a 100-byte record.
+  ASSERT_OK(file.PWrite(size, std::vector<uint8_t>{0, 0, 0, 100, 1, 2, 3, 4, 5, 6}));
+  auto const status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  EXPECT_THAT(file.GetSize(), IsOkAndHolds(size));
+  EXPECT_EQ(log.next_sequence_number(), 2);
+  EXPECT_THAT(log.Append(ToBytes("dolor")), IsOkAndHolds(2));
+  EXPECT_THAT(ReadAll(log), IsOkAndHolds(ElementsAre(std::make_pair(0, ToBytes("lorem")),
+                                                     std::make_pair(1, ToBytes("ipsum")),
+                                                     std::make_pair(2, ToBytes("dolor")))));
+}
+
+TEST_F(WriteAheadLogTest, DetectCorruption) {
+  auto const status_or_log = Open();
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  ASSERT_OK(log.Append(ToBytes("lorem")));
+  ASSERT_OK(log.Append(ToBytes("ipsum")));
+  ASSERT_OK(log.Rotate());
+  ASSERT_OK(log.Append(ToBytes("dolor")));
+  auto const paths = GetSegmentPaths();
+  ASSERT_EQ(paths.size(), 2);
+  auto status_or_file = File::Open(paths[0], File::Mode::kReadWrite);
+  ASSERT_OK(status_or_file);
+  auto& file = status_or_file.value();
+  auto const status_or_size = file.GetSize();
+  ASSERT_OK(status_or_size);
+  // Flip the last byte of "ipsum".
+  ASSERT_OK(file.PWrite(status_or_size.value() - 1, ToBytes("X")));
+  auto status_or_reader = log.Replay();
+  ASSERT_OK(status_or_reader);
+  auto& reader = status_or_reader.value();
+  auto const status_or_record = reader.Next();
+  ASSERT_OK(status_or_record);
+  EXPECT_THAT(status_or_record.value(),
+              Optional(Field(&WriteAheadLog::Record::sequence_number, 0)));
+  EXPECT_THAT(reader.Next(), StatusIs(absl::StatusCode::kDataLoss));
+}
+
+TEST_F(WriteAheadLogTest, GroupCommit) {
+  auto const status_or_log = Open(/*max_segment_size=*/4096);
+  ASSERT_OK(status_or_log);
+  auto& log = *status_or_log.value();
+  size_t constexpr kNumThreads = 8;
+  size_t constexpr kNumRecordsPerThread = 50;
+  size_t constexpr kNumRecords = kNumThreads * kNumRecordsPerThread;
+  absl::Mutex mutex;
+  std::vector<std::pair<uint64_t, std::vector<uint8_t>>> appended;
+  std::vector<std::thread> threads;
+  threads.reserve(kNumThreads);
+  for (size_t i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([&, i] {
+      for (size_t j = 0; j < kNumRecordsPerThread; ++j) {
+        auto data = ToBytes(absl::StrCat("thread ", i, " record ", j));
+        auto const status_or_sequence_number = log.Append(data);
+        ASSERT_OK(status_or_sequence_number);
+        absl::MutexLock lock{&mutex};
+        appended.emplace_back(status_or_sequence_number.value(), std::move(data));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(log.next_sequence_number(), kNumRecords);
+  EXPECT_THAT(log.num_syncs(), Le(kNumRecords));
+  EXPECT_THAT(log.num_segments(), Gt(1));
+  auto const status_or_records = ReadAll(log);
+  ASSERT_OK(status_or_records);
+  auto const& records = status_or_records.value();
+  ASSERT_EQ(records.size(), kNumRecords);
+  for (size_t i = 0; i < kNumRecords; ++i) {
+    EXPECT_EQ(records[i].first, i);
+  }
+  EXPECT_THAT(records, UnorderedElementsAreArray(appended));
+}
+
+}  // namespace
@@ -0,0 +1,514 @@
+#include "net/async_file_io.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/flags/flag.h"
+#include "absl/log/log.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "common/reffed_ptr.h"
+#include "common/scheduler.h"
+#include "common/utilities.h"
+#include "io/buffer.h"
+#include "io/fd.h"
+#include "io/file.h"
+#include "net/epoll_server.h"
+
+ABSL_FLAG(bool, async_file_io_use_io_uring, true,
+          "Whether asynchronous file I/O uses io_uring when the kernel supports it. If false, or "
+          "if io_uring is not available, all file I/O runs on a pool of blocking worker threads.");
+
+ABSL_FLAG(uint32_t, async_file_io_queue_depth, 256,
+          "Number of submission queue entries of the io_uring used for asynchronous file I/O.");
+
+ABSL_FLAG(uint16_t, num_file_io_workers, 4, "Number of blocking file I/O worker threads.");
+
+namespace tsdb2 {
+namespace net {
+
+using ::tsdb2::common::reffed_ptr;
+using ::tsdb2::io::Buffer;
+using ::tsdb2::io::File;
+
+struct AsyncFileIo::Operation {
+  enum class Kind { kRead, kWrite, kSync };
+
+  explicit Operation(AsyncFileIo* const parent, Kind const kind, File const* const file,
+                     uint64_t const offset, Buffer buffer, size_t const length)
+      : parent(parent),
+        kind(kind),
+        file(file),
+        offset(offset),
+        buffer(std::move(buffer)),
+        length(length) {}
+
+  // Returns the current position in the file, i.e. `offset` plus the bytes transferred so far.
+  uint64_t position() const { return offset + done; }
+
+  AsyncFileIo* const parent;
+  Kind const kind;
+
+  // Write and sync operations receive a non-const `File` from the caller, so casting away constness
+  // is safe for them.
+  File const* const file;
+
+  uint64_t const offset;
+  Buffer buffer;
+
+  // Total number of bytes to transfer and number of bytes transferred so far.
+  size_t const length;
+  size_t done = 0;
+
+  // Only one of these is set, depending on `kind`.
+  ReadCallback read_callback;
+  WriteCallback write_callback;
+
+  // Used by io_uring read and write operations. The kernel requires it to be stable until the
+  // operation completes.
+  struct iovec iov {};
+};
+
+// An io_uring whose completions are signaled through an eventfd registered in the `EpollServer`.
+//
+// The ring is set up with raw system calls because liburing is not among our dependencies. All
+// memory barriers required by the io_uring protocol are issued with the `__atomic` builtins.
+class AsyncFileIo::Ring final : public EpollTarget {
+ public:
+  // The eventfd only needs input events.
+  static inline bool constexpr kIsListener = true;
+
+  ~Ring() override = default;
+
+  // Submits `operation`, taking ownership of it. The ownership is returned to the caller if the
+  // operation couldn't be submitted, e.g. because the ring is full.
+  std::unique_ptr<Operation> Submit(std::unique_ptr<Operation> operation)
+      ABSL_LOCKS_EXCLUDED(submit_mutex_);
+
+ private:
+  friend class EpollServer;
+
+  // RAII wrapper for a memory mapping of the ring.
+  class Mapping {
+   public:
+    explicit Mapping() = default;
+    explicit Mapping(void* const ptr, size_t const size) : ptr_(ptr), size_(size) {}
+
+    ~Mapping() {
+      if (ptr_ != nullptr) {
+        ::munmap(ptr_, size_);
+      }
+    }
+
+    Mapping(Mapping&& other) noexcept
+        : ptr_(std::exchange(other.ptr_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+    Mapping& operator=(Mapping&& other) noexcept {
+      std::swap(ptr_, other.ptr_);
+      std::swap(size_, other.size_);
+      return *this;
+    }
+
+    explicit operator bool() const { return ptr_ != nullptr; }
+
+    template <typename Type>
+    Type* at(size_t const offset) const {
+      return reinterpret_cast<Type*>(static_cast<uint8_t*>(ptr_) + offset);
+    }
+
+   private:
+    Mapping(Mapping const&) = delete;
+    Mapping& operator=(Mapping const&) = delete;
+
+    void* ptr_ = nullptr;
+    size_t size_ = 0;
+  };
+
+  static absl::StatusOr<Mapping> Map(FD const& ring_fd, size_t size, off_t offset);
+
+  static absl::StatusOr<reffed_ptr<Ring>> CreateInternal(EpollServer* parent, uint32_t entries);
+
+  // `cq_ring` is empty if the kernel maps both queues with a single mapping (see
+  // `IORING_FEAT_SINGLE_MMAP`), in which case the completion queue is found in `sq_ring`.
+  explicit Ring(EpollServer* const parent, FD event_fd, FD ring_fd,
+                struct io_uring_params const& params, Mapping sq_ring, Mapping cq_ring,
+                Mapping sqes)
+      : EpollTarget(parent, std::move(event_fd)),
+        ring_fd_(std::move(ring_fd)),
+        sq_ring_(std::move(sq_ring)),
+        cq_ring_(std::move(cq_ring)),
+        sqes_mapping_(std::move(sqes)),
+        sq_head_(sq_ring_.at<unsigned>(params.sq_off.head)),
+        sq_tail_(sq_ring_.at<unsigned>(params.sq_off.tail)),
+        sq_mask_(*sq_ring_.at<unsigned>(params.sq_off.ring_mask)),
+        sq_entries_(*sq_ring_.at<unsigned>(params.sq_off.ring_entries)),
+        sq_array_(sq_ring_.at<unsigned>(params.sq_off.array)),
+        sqes_(sqes_mapping_.at<struct io_uring_sqe>(0)),
+        cq_head_(cq_base().at<unsigned>(params.cq_off.head)),
+        cq_tail_(cq_base().at<unsigned>(params.cq_off.tail)),
+        cq_mask_(*cq_base().at<unsigned>(params.cq_off.ring_mask)),
+        cq_entries_(*cq_base().at<unsigned>(params.cq_off.ring_entries)),
+        cqes_(cq_base().at<struct io_uring_cqe>(params.cq_off.cqes)) {}
+
+  Mapping const& cq_base() const { return cq_ring_ ? cq_ring_ : sq_ring_; }
+
+  void OnError() override { LOG(ERROR) << "unexpected error event on the io_uring eventfd"; }
+
+  // Reaps the completion queue.
+  void OnInput() override ABSL_LOCKS_EXCLUDED(mutex_, submit_mutex_, reap_mutex_);
+
+  void OnOutput() override {}
+
+  FD const ring_fd_;
+
+  Mapping const sq_ring_;
+  Mapping const cq_ring_;
+  Mapping const sqes_mapping_;
+
+  unsigned* const sq_head_;
+  unsigned* const sq_tail_;
+  unsigned const sq_mask_;
+  unsigned const sq_entries_;
+  unsigned* const sq_array_;
+  struct io_uring_sqe* const sqes_;
+
+  unsigned* const cq_head_;
+  unsigned* const cq_tail_;
+  unsigned const cq_mask_;
+  unsigned const cq_entries_;
+  struct io_uring_cqe* const cqes_;
+
+  absl::Mutex mutable submit_mutex_;
+
+  // Number of submitted operations that haven't been reaped yet. We never let it exceed the size of
+  // the completion queue, so that the kernel never has to buffer overflowing completions.
+  size_t num_in_flight_ ABSL_GUARDED_BY(submit_mutex_) = 0;
+
+  absl::Mutex mutable reap_mutex_;
+};
+
+absl::StatusOr<AsyncFileIo::Ring::Mapping> AsyncFileIo::Ring::Map(FD const& ring_fd,
+                                                                  size_t const size,
+                                                                  off_t const offset) {
+  void* const ptr =
+      ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, *ring_fd, offset);
+  if (ptr == MAP_FAILED) {
+    return absl::ErrnoToStatus(errno, "mmap");
+  }
+  return Mapping(ptr, size);
+}
+
+absl::StatusOr<reffed_ptr<AsyncFileIo::Ring>> AsyncFileIo::Ring::CreateInternal(
+    EpollServer* const parent, uint32_t const entries) {
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  FD ring_fd{static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params))};
+  if (!ring_fd) {
+    return absl::ErrnoToStatus(errno, "io_uring_setup");
+  }
+  size_t sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool const single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single_mmap) {
+    sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+  }
+  DEFINE_VAR_OR_RETURN(sq_ring, Map(ring_fd, sq_ring_size, IORING_OFF_SQ_RING));
+  Mapping cq_ring;
+  if (!single_mmap) {
+    ASSIGN_OR_RETURN(cq_ring, Map(ring_fd, cq_ring_size, IORING_OFF_CQ_RING));
+  }
+  DEFINE_VAR_OR_RETURN(
+      sqes, Map(ring_fd, params.sq_entries * sizeof(struct io_uring_sqe), IORING_OFF_SQES));
+  FD event_fd{::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)};
+  if (!event_fd) {
+    return absl::ErrnoToStatus(errno, "eventfd");
+  }
+  int const event_fd_number = *event_fd;
+  if (::syscall(__NR_io_uring_register, *ring_fd, IORING_REGISTER_EVENTFD, &event_fd_number, 1) <
+      0) {
+    return absl::ErrnoToStatus(errno, "io_uring_register(IORING_REGISTER_EVENTFD)");
+  }
+  return reffed_ptr<Ring>(new Ring(parent, std::move(event_fd), std::move(ring_fd), params,
+                                   std::move(sq_ring), std::move(cq_ring), std::move(sqes)));
+}
+
+std::unique_ptr<AsyncFileIo::Operation> AsyncFileIo::Ring::Submit(
+    std::unique_ptr<Operation> operation) {
+  absl::MutexLock lock{&submit_mutex_};
+  if (num_in_flight_ >= cq_entries_) {
+    return operation;
+  }
+  // We're the only producer, so the tail doesn't need an atomic load.
+  unsigned const tail = *sq_tail_;
+  if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+    return operation;
+  }
+  unsigned const index = tail & sq_mask_;
+  struct io_uring_sqe* const sqe = &sqes_[index];
+  std::memset(sqe, 0, sizeof(*sqe));
+  sqe->fd = *(operation->file->fd());
+  sqe->user_data = reinterpret_cast<uintptr_t>(operation.get());
+  switch (operation->kind) {
+    case Operation::Kind::kRead:
+      operation->iov.iov_base = operation->buffer.as_byte_array() + operation->done;
+      operation->iov.iov_len = operation->length - operation->done;
+      sqe->opcode = IORING_OP_READV;
+      break;
+    case Operation::Kind::kWrite:
+      operation->iov.iov_base = operation->buffer.as_byte_array() + operation->done;
+      operation->iov.iov_len = operation->length - operation->done;
+      sqe->opcode = IORING_OP_WRITEV;
+      break;
+    case Operation::Kind::kSync:
+      sqe->opcode = IORING_OP_FSYNC;
+      sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+      break;
+  }
+  if (operation->kind != Operation::Kind::kSync) {
+    sqe->addr = reinterpret_cast<uintptr_t>(&operation->iov);
+    sqe->len = 1;
+    sqe->off = operation->position();
+  }
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  long result;  // NOLINT(google-runtime-int)
+  do {
+    result = ::syscall(__NR_io_uring_enter, *ring_fd_, 1, 0, 0, nullptr, 0);
+  } while (result < 0 && errno == EINTR);
+  if (result < 1) {
+    // The kernel didn't consume the entry (e.g. because it's short on resources), so we take it
+    // back and let the caller fall back to blocking I/O.
+    __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+    return operation;
+  }
+  ++num_in_flight_;
+  operation.release();
+  return nullptr;
+}
+
+void AsyncFileIo::Ring::OnInput() {
+  {
+    absl::MutexLock lock{&mutex_};
+    if (!fd_) {
+      return;
+    }
+    // Reset the eventfd counter before reaping. Any completion posted after this point will raise
+    // a new edge-triggered event.
+    uint64_t value;
+    while (::read(*fd_, &value, sizeof(value)) < 0 && errno == EINTR) {
+    }
+  }
+  std::vector<std::pair<Operation*, int>> completions;
+  {
+    absl::MutexLock lock{&reap_mutex_};
+    unsigned head = *cq_head_;
+    unsigned const tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    completions.reserve(tail - head);
+    for (; head != tail; ++head) {
+      auto const& cqe = cqes_[head & cq_mask_];
+      completions.emplace_back(reinterpret_cast<Operation*>(cqe.user_data), cqe.res);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+  if (completions.empty()) {
+    return;
+  }
+  {
+    absl::MutexLock lock{&submit_mutex_};
+    num_in_flight_ -= completions.size();
+  }
+  for (auto const& [operation, result] : completions) {
+    operation->parent->HandleCompletion(std::unique_ptr<Operation>(operation), result);
+  }
+}
+
+AsyncFileIo* AsyncFileIo::GetInstance() {
+  static gsl::owner<AsyncFileIo*> const kInstance =
+      Create(EpollServer::GetInstance(),
+             Options{
+                 .backend = absl::GetFlag(FLAGS_async_file_io_use_io_uring) ? Backend::kIoUring
+                                                                             : Backend::kThreadPool,
+                 .queue_depth = absl::GetFlag(FLAGS_async_file_io_queue_depth),
+                 .num_workers = absl::GetFlag(FLAGS_num_file_io_workers),
+             })
+          .release();
+  return kInstance;  // NOLINT(cppcoreguidelines-owning-memory)
+}
+
+std::unique_ptr<AsyncFileIo> AsyncFileIo::Create(EpollServer* const epoll_server,
+                                                 Options const& options) {
+  reffed_ptr<Ring> ring;
+  if (options.backend == Backend::kIoUring) {
+    auto status_or_ring = epoll_server->CreateSocket<Ring>(options.queue_depth);
+    if (status_or_ring.ok()) {
+      ring = std::move(status_or_ring).value();
+    } else {
+      LOG(WARNING) << "io_uring not available, file I/O will use blocking threads: "
+                   << status_or_ring.status();
+    }
+  }
+  return absl::WrapUnique(new AsyncFileIo(options, std::move(ring)));
+}
+
+AsyncFileIo::AsyncFileIo(Options const& options, reffed_ptr<Ring> ring)
+    : ring_(std::move(ring)),
+      workers_(tsdb2::common::Scheduler::Options{
+          .num_workers = options.num_workers,
+          .start_now = true,
+      }) {}
+
+AsyncFileIo::~AsyncFileIo() {
+  absl::MutexLock lock{&mutex_};
+  mutex_.Await(absl::Condition(
+      +[](size_t* const num_pending) { return *num_pending == 0; }, &num_pending_));
+}
+
+void AsyncFileIo::Read(File const& file, uint64_t const offset, size_t const length,
+                       ReadCallback callback) {
+  StartOperation();
+  auto operation = std::make_unique<Operation>(this, Operation::Kind::kRead, &file, offset,
+                                               Buffer(length), length);
+  operation->read_callback = std::move(callback);
+  Submit(std::move(operation));
+}
+
+void AsyncFileIo::Write(File* const file, uint64_t const offset, Buffer data,
+                        WriteCallback callback) {
+  StartOperation();
+  size_t const length = data.size();
+  auto operation = std::make_unique<Operation>(this, Operation::Kind::kWrite, file, offset,
+                                               std::move(data), length);
+  operation->write_callback = std::move(callback);
+  if (length > 0) {
+    Submit(std::move(operation));
+  } else {
+    Complete(std::move(operation), absl::OkStatus());
+  }
+}
+
+void AsyncFileIo::DataSync(File* const file, SyncCallback callback) {
+  StartOperation();
+  auto operation =
+      std::make_unique<Operation>(this, Operation::Kind::kSync, file, 0, Buffer(), 0);
+  operation->write_callback = std::move(callback);
+  Submit(std::move(operation));
+}
+
+void AsyncFileIo::StartOperation() {
+  absl::MutexLock lock{&mutex_};
+  ++num_pending_;
+}
+
+void AsyncFileIo::FinishOperation() {
+  absl::MutexLock lock{&mutex_};
+  --num_pending_;
+}
+
+void AsyncFileIo::Submit(std::unique_ptr<Operation> operation) {
+  // Direct I/O has alignment requirements that `io::File` takes care of, so we route it to the
+  // blocking path.
+  if (ring_ && !operation->file->direct_io()) {
+    operation = ring_->Submit(std::move(operation));
+    if (!operation) {
+      return;
+    }
+  }
+  workers_.ScheduleNow([this, operation = std::move(operation)]() mutable {
+    RunBlocking(std::move(operation));
+  });
+}
+
+void AsyncFileIo::RunBlocking(std::unique_ptr<Operation> operation) {
+  // NOLINTBEGIN(cppcoreguidelines-pro-type-const-cast)
+  auto* const file = const_cast<File*>(operation->file);
+  // NOLINTEND(cppcoreguidelines-pro-type-const-cast)
+  absl::Status status;
+  switch (operation->kind) {
+    case Operation::Kind::kRead: {
+      auto status_or_length =
+          file->PRead(operation->position(), operation->buffer.as_byte_array() + operation->done,
+                      operation->length - operation->done);
+      if (status_or_length.ok()) {
+        operation->buffer.Advance(status_or_length.value());
+      } else {
+        status = std::move(status_or_length).status();
+      }
+    } break;
+    case Operation::Kind::kWrite:
+      status = file->PWrite(operation->position(), operation->buffer.span(operation->done));
+      break;
+    case Operation::Kind::kSync:
+      status = file->DataSync();
+      break;
+  }
+  Complete(std::move(operation), std::move(status));
+}
+
+void AsyncFileIo::HandleCompletion(std::unique_ptr<Operation> operation, int const result) {
+  if (result < 0) {
+    if (result == -EINTR || result == -EAGAIN) {
+      return Submit(std::move(operation));
+    } else {
+      return Complete(std::move(operation), absl::ErrnoToStatus(-result, "io_uring"));
+    }
+  }
+  switch (operation->kind) {
+    case Operation::Kind::kRead:
+      operation->buffer.Advance(result);
+      operation->done += result;
+      if (result > 0 && operation->done < operation->length) {
+        return Submit(std::move(operation));
+      }
+      break;
+    case Operation::Kind::kWrite:
+      if (result == 0 && operation->done < operation->length) {
+        // Resubmitting would loop forever without making any progress.
+        return Complete(std::move(operation), absl::ErrnoToStatus(ENOSPC, "io_uring"));
+      }
+      operation->done += result;
+      if (operation->done < operation->length) {
+        return Submit(std::move(operation));
+      }
+      break;
+    case Operation::Kind::kSync:
+      break;
+  }
+  Complete(std::move(operation), absl::OkStatus());
+}
+
+void AsyncFileIo::Complete(std::unique_ptr<Operation> operation, absl::Status status) {
+  if (operation->kind == Operation::Kind::kRead) {
+    auto callback = std::move(operation->read_callback);
+    if (status.ok()) {
+      callback(std::move(operation->buffer));
+    } else {
+      callback(std::move(status));
+    }
+  } else {
+    auto callback = std::move(operation->write_callback);
+    callback(std::move(status));
+  }
+  operation.reset();
+  // NOTE: this object may be destroyed as soon as `FinishOperation` releases the mutex, so it must
+  // be the last thing we do.
+  FinishOperation();
+}
+
+}  // namespace net
+}  // namespace tsdb2
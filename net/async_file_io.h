@@ -0,0 +1,144 @@
+#ifndef __TSDB2_NET_ASYNC_FILE_IO_H__
+#define __TSDB2_NET_ASYNC_FILE_IO_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/functional/any_invocable.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "common/promise.h"
+#include "common/reffed_ptr.h"
+#include "common/scheduler.h"
+#include "io/buffer.h"
+#include "io/file.h"
+#include "net/epoll_server.h"
+
+namespace tsdb2 {
+namespace net {
+
+// Runs file reads, writes, and syncs asynchronously, so that I/O workers and scheduler threads can
+// overlap disk access with network I/O rather than blocking on it.
+//
+// The preferred backend is io_uring: operations are submitted to a ring and their completions are
+// signaled through an eventfd registered in the `EpollServer`, so the completion callbacks run on
+// the `EpollServer` workers just like socket callbacks. When io_uring is not available (or the ring
+// is at capacity, or the file uses direct I/O) the operations run on a small pool of blocking
+// worker threads instead, whose size is configured with --num_file_io_workers.
+//
+// Completion callbacks may run on any thread and must not block. The `io::File` objects passed to
+// the operations must outlive them.
+//
+// This class is thread-safe.
+class AsyncFileIo final {
+ public:
+  using ReadCallback = absl::AnyInvocable<void(absl::StatusOr<io::Buffer>)>;
+  using WriteCallback = absl::AnyInvocable<void(absl::Status)>;
+  using SyncCallback = absl::AnyInvocable<void(absl::Status)>;
+
+  enum class Backend {
+    // Linux io_uring, with completions delivered through the `EpollServer`.
+    kIoUring,
+
+    // Blocking system calls on a dedicated thread pool.
+    kThreadPool,
+  };
+
+  struct Options {
+    // The preferred backend. `kIoUring` silently falls back to `kThreadPool` if the kernel doesn't
+    // support io_uring; use `backend()` to find out which one is in use.
+    Backend backend = Backend::kIoUring;
+
+    // Number of submission queue entries of the io_uring. At most twice as many operations can be
+    // in flight in the ring, any further ones overflow to the thread pool.
+    uint32_t queue_depth = 256;
+
+    // Number of blocking worker threads.
+    uint16_t num_workers = 4;
+  };
+
+  // Returns the process-wide instance, configured by the --async_file_io_use_io_uring,
+  // --async_file_io_queue_depth, and --num_file_io_workers flags.
+  static AsyncFileIo* GetInstance();
+
+  // Creates a separate instance delivering io_uring completions through `epoll_server`. Useful in
+  // tests.
+  static std::unique_ptr<AsyncFileIo> Create(EpollServer* epoll_server, Options const& options);
+
+  // Waits for all pending operations to complete.
+  ~AsyncFileIo() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  Backend backend() const { return ring_ ? Backend::kIoUring : Backend::kThreadPool; }
+
+  // Reads up to `length` bytes at `offset`. The buffer passed to `callback` is shorter than
+  // `length` only if the end of the file is reached.
+  void Read(io::File const& file, uint64_t offset, size_t length, ReadCallback callback)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  tsdb2::common::Promise<io::Buffer> Read(io::File const& file, uint64_t const offset,
+                                          size_t const length) {
+    return tsdb2::common::Promise<io::Buffer>(
+        [&](auto resolve) { Read(file, offset, length, std::move(resolve)); });
+  }
+
+  // Writes all of `data` at `offset`.
+  void Write(io::File* file, uint64_t offset, io::Buffer data, WriteCallback callback)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  tsdb2::common::Promise<void> Write(io::File* const file, uint64_t const offset,
+                                     io::Buffer data) {
+    return tsdb2::common::Promise<void>([&](auto resolve) {
+      Write(file, offset, std::move(data), std::move(resolve));
+    });
+  }
+
+  // Flushes the data written to `file` to the storage device (see `io::File::DataSync`).
+  void DataSync(io::File* file, SyncCallback callback) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  tsdb2::common::Promise<void> DataSync(io::File* const file) {
+    return tsdb2::common::Promise<void>(
+        [&](auto resolve) { DataSync(file, std::move(resolve)); });
+  }
+
+ private:
+  class Ring;
+  struct Operation;
+
+  explicit AsyncFileIo(Options const& options, tsdb2::common::reffed_ptr<Ring> ring);
+
+  AsyncFileIo(AsyncFileIo const&) = delete;
+  AsyncFileIo& operator=(AsyncFileIo const&) = delete;
+  AsyncFileIo(AsyncFileIo&&) = delete;
+  AsyncFileIo& operator=(AsyncFileIo&&) = delete;
+
+  void StartOperation() ABSL_LOCKS_EXCLUDED(mutex_);
+  void FinishOperation() ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Submits `operation` to the ring if possible, otherwise schedules it on the thread pool.
+  void Submit(std::unique_ptr<Operation> operation);
+
+  // Runs the rest of `operation` synchronously on the calling thread.
+  void RunBlocking(std::unique_ptr<Operation> operation);
+
+  // Processes the result of an io_uring operation, resubmitting it if it was only partially
+  // performed. `result` is the `res` field of the completion queue entry.
+  void HandleCompletion(std::unique_ptr<Operation> operation, int result);
+
+  // Invokes the callback of `operation` and destroys it.
+  void Complete(std::unique_ptr<Operation> operation, absl::Status status);
+
+  tsdb2::common::reffed_ptr<Ring> const ring_;
+  tsdb2::common::Scheduler workers_;
+
+  absl::Mutex mutable mutex_;
+  size_t num_pending_ ABSL_GUARDED_BY(mutex_) = 0;
+};
+
+}  // namespace net
+}  // namespace tsdb2
+
+#endif  // __TSDB2_NET_ASYNC_FILE_IO_H__
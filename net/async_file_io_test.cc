@@ -0,0 +1,238 @@
+#include "net/async_file_io.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/notification.h"
+#include "absl/types/span.h"
+#include "common/promise.h"
+#include "common/testing.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "io/buffer.h"
+#include "io/file.h"
+#include "net/epoll_server.h"
+#include "server/testing.h"
+
+namespace {
+
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::ElementsAreArray;
+using ::testing::TestTempFile;
+using ::testing::Values;
+using ::tsdb2::io::Buffer;
+using ::tsdb2::io::File;
+using ::tsdb2::io::kDirectIoAlignment;
+using ::tsdb2::net::AsyncFileIo;
+using ::tsdb2::net::EpollServer;
+
+std::string_view constexpr kTestFileName = "async_file_io_test";
+
+std::vector<uint8_t> MakeData(size_t const length, uint8_t const seed = 0) {
+  std::vector<uint8_t> data;
+  data.reserve(length);
+  for (size_t i = 0; i < length; ++i) {
+    data.push_back(static_cast<uint8_t>(seed + i * 13 + i / 241));
+  }
+  return data;
+}
+
+class AsyncFileIoTest : public tsdb2::testing::init::Test,
+                        public ::testing::WithParamInterface<AsyncFileIo::Backend> {
+ protected:
+  void SetUp() override {
+    auto status_or_temp_file = TestTempFile::Create(kTestFileName);
+    ASSERT_OK(status_or_temp_file);
+    temp_file_.emplace(std::move(status_or_temp_file).value());
+    temp_file_->Close();
+    auto status_or_file = File::Open(temp_file_->path(), File::Mode::kReadWrite);
+    ASSERT_OK(status_or_file);
+    file_.emplace(std::move(status_or_file).value());
+  }
+
+  static std::unique_ptr<AsyncFileIo> CreateAsyncFileIo(uint32_t const queue_depth = 16) {
+    return AsyncFileIo::Create(EpollServer::GetInstance(), AsyncFileIo::Options{
+                                                               .backend = GetParam(),
+                                                               .queue_depth = queue_depth,
+                                                               .num_workers = 2,
+                                                           });
+  }
+
+  absl::StatusOr<Buffer> Read(uint64_t const offset, size_t const length) {
+    std::optional<absl::StatusOr<Buffer>> result;
+    absl::Notification done;
+    async_io_->Read(*file_, offset, length, [&](absl::StatusOr<Buffer> status_or_buffer) {
+      result = std::move(status_or_buffer);
+      done.Notify();
+    });
+    done.WaitForNotification();
+    return std::move(result).value();
+  }
+
+  absl::Status Write(File* const file, uint64_t const offset,
+                     absl::Span<uint8_t const> const data) {
+    absl::Status result;
+    absl::Notification done;
+    async_io_->Write(file, offset, Buffer(data), [&](absl::Status status) {
+      result = std::move(status);
+      done.Notify();
+    });
+    done.WaitForNotification();
+    return result;
+  }
+
+  absl::Status Write(uint64_t const offset, absl::Span<uint8_t const> const data) {
+    return Write(&file_.value(), offset, data);
+  }
+
+  std::optional<TestTempFile> temp_file_;
+  std::optional<File> file_;
+  std::unique_ptr<AsyncFileIo> async_io_ = CreateAsyncFileIo();
+};
+
+TEST_P(AsyncFileIoTest, Backend) {
+  if (GetParam() == AsyncFileIo::Backend::kThreadPool) {
+    EXPECT_EQ(async_io_->backend(), AsyncFileIo::Backend::kThreadPool);
+  }
+}
+
+TEST_P(AsyncFileIoTest, ReadEmptyFile) {
+  auto const status_or_buffer = Read(0, 100);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_TRUE(status_or_buffer->empty());
+}
+
+TEST_P(AsyncFileIoTest, WriteAndRead) {
+  auto const data = MakeData(1000);
+  ASSERT_OK(Write(0, data));
+  EXPECT_THAT(file_->GetSize(), IsOkAndHolds(1000));
+  auto const status_or_buffer = Read(100, 200);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(),
+              ElementsAreArray(absl::Span<uint8_t const>(data).subspan(100, 200)));
+}
+
+TEST_P(AsyncFileIoTest, ShortReadAtEnd) {
+  auto const data = MakeData(1000);
+  ASSERT_OK(Write(0, data));
+  auto const status_or_buffer = Read(900, 500);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(),
+              ElementsAreArray(absl::Span<uint8_t const>(data).subspan(900)));
+  EXPECT_THAT(Read(2000, 100), IsOkAndHolds(::testing::Property(&Buffer::empty, true)));
+}
+
+TEST_P(AsyncFileIoTest, EmptyWrite) {
+  EXPECT_OK(Write(100, {}));
+  EXPECT_THAT(file_->GetSize(), IsOkAndHolds(0));
+}
+
+TEST_P(AsyncFileIoTest, WriteToReadOnlyFile) {
+  auto status_or_file = File::Open(temp_file_->path(), File::Mode::kRead);
+  ASSERT_OK(status_or_file);
+  EXPECT_THAT(Write(&status_or_file.value(), 0, MakeData(10)),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST_P(AsyncFileIoTest, DataSync) {
+  ASSERT_OK(Write(0, MakeData(100)));
+  absl::Status result;
+  absl::Notification done;
+  async_io_->DataSync(&file_.value(), [&](absl::Status status) {
+    result = std::move(status);
+    done.Notify();
+  });
+  done.WaitForNotification();
+  EXPECT_OK(result);
+}
+
+TEST_P(AsyncFileIoTest, Promises) {
+  auto const data = MakeData(500);
+  absl::Notification done;
+  std::optional<absl::StatusOr<Buffer>> result;
+  auto promise =
+      async_io_->Write(&file_.value(), 0, Buffer(absl::Span<uint8_t const>(data)))
+          .Then([&]() { return async_io_->DataSync(&file_.value()); })
+          .Then([&]() { return async_io_->Read(*file_, 0, data.size()); })
+          .Then([&](absl::StatusOr<Buffer> status_or_buffer) {
+            result = std::move(status_or_buffer);
+            done.Notify();
+          });
+  done.WaitForNotification();
+  ASSERT_OK(result.value());
+  EXPECT_THAT(result->value().span(), ElementsAreArray(data));
+}
+
+TEST_P(AsyncFileIoTest, ManyConcurrentOperations) {
+  // Use a tiny ring so that some operations overflow to the thread pool.
+  async_io_ = CreateAsyncFileIo(/*queue_depth=*/2);
+  size_t constexpr kNumWrites = 200;
+  size_t constexpr kWriteSize = 100;
+  absl::Mutex mutex;
+  size_t num_done = 0;
+  absl::Status first_error;
+  for (size_t i = 0; i < kNumWrites; ++i) {
+    async_io_->Write(&file_.value(), i * kWriteSize,
+                     Buffer(absl::Span<uint8_t const>(MakeData(kWriteSize, i))),
+                     [&](absl::Status status) {
+                       absl::MutexLock lock{&mutex};
+                       first_error.Update(status);
+                       ++num_done;
+                     });
+  }
+  {
+    absl::MutexLock lock{&mutex};
+    mutex.Await(absl::Condition(
+        +[](size_t* const num_done) { return *num_done == kNumWrites; }, &num_done));
+    EXPECT_OK(first_error);
+  }
+  auto const status_or_buffer = Read(0, kNumWrites * kWriteSize);
+  ASSERT_OK(status_or_buffer);
+  auto const& buffer = status_or_buffer.value();
+  ASSERT_EQ(buffer.size(), kNumWrites * kWriteSize);
+  for (size_t i = 0; i < kNumWrites; ++i) {
+    EXPECT_THAT(buffer.span(i * kWriteSize, kWriteSize),
+                ElementsAreArray(MakeData(kWriteSize, i)));
+  }
+}
+
+TEST_P(AsyncFileIoTest, DirectIo) {
+  File::Options options;
+  options.direct_io = true;
+  auto status_or_file = File::Open(temp_file_->path(), File::Mode::kReadWrite, options);
+  if (!status_or_file.ok()) {
+    GTEST_SKIP() << "direct I/O not supported: " << status_or_file.status();
+  }
+  auto& file = status_or_file.value();
+  auto const data = MakeData(kDirectIoAlignment);
+  ASSERT_OK(Write(&file, 0, data));
+  EXPECT_THAT(Write(&file, 0, MakeData(10)), StatusIs(absl::StatusCode::kInvalidArgument));
+  auto const status_or_buffer = file.PRead(0, kDirectIoAlignment);
+  ASSERT_OK(status_or_buffer);
+  EXPECT_THAT(status_or_buffer->span(), ElementsAreArray(data));
+}
+
+TEST_P(AsyncFileIoTest, DestructionWaitsForPendingOperations) {
+  absl::Notification done;
+  async_io_->Read(*file_, 0, 100, [&](absl::StatusOr<Buffer> status_or_buffer) {
+    EXPECT_OK(status_or_buffer);
+    done.Notify();
+  });
+  async_io_.reset();
+  EXPECT_TRUE(done.HasBeenNotified());
+}
+
+INSTANTIATE_TEST_SUITE_P(AsyncFileIoTest, AsyncFileIoTest,
+                         Values(AsyncFileIo::Backend::kIoUring,
+                                AsyncFileIo::Backend::kThreadPool));
+
+}  // namespace
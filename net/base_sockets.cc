@@ -7,6 +7,7 @@
 #include <netinet/tcp.h>
 #include <signal.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include <algorithm>
 #include <cstddef>
@@ -24,6 +25,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "common/default_scheduler.h"
 #include "common/utilities.h"
 #include "net/epoll_server.h"
@@ -60,7 +62,7 @@ absl::StatusOr<FD> CreateInetListener(std::string_view const address, uint16_t c
   if (::listen(*fd, SOMAXCONN) < 0) {
     return absl::ErrnoToStatus(errno, "listen() failed");
   }
-  return std::move(fd);
+  return fd;
 }
 
 absl::Status ConfigureInetSocket(FD const& fd, SocketOptions const& options) {
@@ -177,6 +179,46 @@ absl::Status BaseSocket::SkipInternal(size_t const length, SkipCallback callback
       timeout);
 }
 
+absl::Status BaseSocket::GatherWriteInternal(Buffer header,
+                                             absl::Span<uint8_t const> const payload,
+                                             WriteCallback callback,
+                                             std::optional<absl::Duration> const timeout) {
+  if (!payload.empty()) {
+    Buffer buffer{header.size() + payload.size()};
+    buffer.MemCpy(header.get(), header.size());
+    buffer.MemCpy(payload.data(), payload.size());
+    header = std::move(buffer);
+  }
+  return WriteInternal(std::move(header), std::move(callback), timeout);
+}
+
+absl::Status BaseSocket::SendFileInternal(Buffer header, FileRange const& file,
+                                          WriteCallback callback,
+                                          std::optional<absl::Duration> const timeout) {
+  Buffer buffer{header.size() + file.length};
+  buffer.MemCpy(header.get(), header.size());
+  size_t offset = 0;
+  while (offset < file.length) {
+    ssize_t const result = ::pread(file.fd, buffer.as_byte_array() + buffer.size(),
+                                   file.length - offset, file.offset + offset);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      auto status = absl::ErrnoToStatus(errno, "pread");
+      Close();
+      return status;
+    } else if (result > 0) {
+      buffer.Advance(result);
+      offset += result;
+    } else {
+      Close();
+      return absl::DataLossError("the file was truncated");
+    }
+  }
+  return WriteInternal(std::move(buffer), std::move(callback), timeout);
+}
+
 BaseSocket::ReadCallback BaseSocket::MakeReadSuccessCallback(ReadSuccessCallback callback) {
   return [callback = std::move(callback)](absl::StatusOr<Buffer> status_or_buffer) mutable {
     if (status_or_buffer.ok()) {
@@ -2,6 +2,7 @@
 #define __TSDB2_NET_BASE_SOCKETS_H__
 
 #include <sys/socket.h>
+#include <sys/types.h>
 #include <sys/un.h>
 
 #include <cstddef>
@@ -16,6 +17,7 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "io/buffer.h"  // IWYU pragma: export
 #include "io/fd.h"      // IWYU pragma: export
 #include "net/epoll_server.h"
@@ -65,6 +67,13 @@ struct SocketOptions {
   std::optional<uint8_t> ip_tos;
 };
 
+// A range of bytes of an open file, written by `BaseSocket::SendFileWithTimeout`.
+struct FileRange {
+  int fd;  // not owned
+  off_t offset;
+  size_t length;
+};
+
 // This low-level function is used by both `ListenerSocket` and `SSLListenerSocket` to create a
 // non-UDS listener socket accepting connections at the specified local address and port.
 absl::StatusOr<FD> CreateInetListener(std::string_view address, uint16_t port);
@@ -214,6 +223,36 @@ class BaseSocket : public EpollTarget {
     return WriteInternal(std::move(buffer), std::move(callback), timeout);
   }
 
+  // Like `WriteWithTimeout`, but writes `header` immediately followed by `payload` without copying
+  // the latter, so that small framing headers and large payloads can go out in a single system
+  // call.
+  //
+  // The socket takes ownership of `header` but NOT of `payload`: the caller must keep the memory
+  // referenced by `payload` valid until `callback` is invoked, e.g. by capturing its owner in the
+  // callback.
+  //
+  // REQUIRES: `header.size()` must be greater than zero.
+  absl::Status WriteWithTimeout(Buffer header, absl::Span<uint8_t const> const payload,
+                                WriteCallback callback, absl::Duration const timeout) {
+    return GatherWriteInternal(std::move(header), payload, std::move(callback), timeout);
+  }
+
+  // Like `WriteWithTimeout`, but writes `header` immediately followed by `file.length` bytes of the
+  // file `file.fd` starting at `file.offset`. Plaintext sockets transfer the file content with
+  // `sendfile`, so it's never copied to user space.
+  //
+  // The socket doesn't take ownership of `file.fd`: the caller must keep it open until `callback`
+  // is invoked. The file offset of the descriptor is neither used nor changed.
+  //
+  // If the file turns out to be shorter than `file.length` the write fails and the socket is
+  // closed, because the peer expects the bytes announced by `header`.
+  //
+  // REQUIRES: `header.size()` must be greater than zero.
+  absl::Status SendFileWithTimeout(Buffer header, FileRange const& file, WriteCallback callback,
+                                   absl::Duration const timeout) {
+    return SendFileInternal(std::move(header), file, std::move(callback), timeout);
+  }
+
   // Shuts down the socket gracefully and removes it from the epoll server. All pending callbacks
   // are cancelled with an error status.
   //
@@ -246,6 +285,20 @@ class BaseSocket : public EpollTarget {
   virtual absl::Status WriteInternal(Buffer buffer, WriteCallback callback,
                                      std::optional<absl::Duration> timeout) = 0;
 
+  // The default implementation copies `header` and `payload` into a single buffer and forwards it
+  // to `WriteInternal`. Implementations that can gather the two parts without copying should
+  // override it.
+  virtual absl::Status GatherWriteInternal(Buffer header, absl::Span<uint8_t const> payload,
+                                           WriteCallback callback,
+                                           std::optional<absl::Duration> timeout);
+
+  // The default implementation reads the file range into a buffer after `header` and forwards it to
+  // `WriteInternal`. It's used by sockets that need to process the data in user space anyway, e.g.
+  // to encrypt it.
+  virtual absl::Status SendFileInternal(Buffer header, FileRange const& file,
+                                        WriteCallback callback,
+                                        std::optional<absl::Duration> timeout);
+
   virtual bool CloseInternal(absl::Status status) = 0;
 
  private:
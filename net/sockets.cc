@@ -2,11 +2,14 @@
 
 #include <errno.h>
 #include <netdb.h>
+#include <sys/sendfile.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
 #include <optional>
 #include <string_view>
@@ -19,6 +22,7 @@
 #include "absl/status/statusor.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "common/default_scheduler.h"
 #include "common/scheduler.h"
 #include "net/base_sockets.h"
@@ -33,6 +37,63 @@ using ::tsdb2::common::Scheduler;
 std::string_view constexpr kReadTimeoutMessage = "read timeout";
 std::string_view constexpr kWriteTimeoutMessage = "write timeout";
 
+// Sends as much as possible of `buffer` followed by `payload`, skipping the first `offset` bytes.
+// Returns the result of the underlying system call.
+ssize_t Send(int const fd, Buffer const& buffer, absl::Span<uint8_t const> const payload,
+             size_t const offset) {
+  if (payload.empty()) {
+    return ::send(fd, buffer.as_byte_array() + offset, buffer.size() - offset, MSG_DONTWAIT);
+  }
+  struct iovec iov[2];
+  size_t count = 0;
+  if (offset < buffer.size()) {
+    iov[count].iov_base = const_cast<uint8_t*>(buffer.as_byte_array() + offset);
+    iov[count].iov_len = buffer.size() - offset;
+    ++count;
+    iov[count].iov_base = const_cast<uint8_t*>(payload.data());
+    iov[count].iov_len = payload.size();
+  } else {
+    iov[count].iov_base = const_cast<uint8_t*>(payload.data() + (offset - buffer.size()));
+    iov[count].iov_len = payload.size() - (offset - buffer.size());
+  }
+  ++count;
+  struct msghdr message {};
+  message.msg_iov = iov;
+  message.msg_iovlen = count;
+  return ::sendmsg(fd, &message, MSG_DONTWAIT);
+}
+
+// Sends as much as possible of `buffer` followed by the `file` range, skipping the first `offset`
+// bytes. The file content is transferred with `sendfile` so it doesn't go through user space.
+// Returns the result of the underlying system call.
+ssize_t SendFile(int const fd, Buffer const& buffer, FileRange const& file, size_t const offset) {
+  if (offset < buffer.size()) {
+    // `MSG_MORE` lets the kernel coalesce the header with the beginning of the file content.
+    return ::send(fd, buffer.as_byte_array() + offset, buffer.size() - offset,
+                  MSG_DONTWAIT | (file.length > 0 ? MSG_MORE : 0));
+  }
+  size_t const file_offset = offset - buffer.size();
+  off_t position = file.offset + file_offset;
+  ssize_t const result = ::sendfile(fd, file.fd, &position, file.length - file_offset);
+  if (result == 0) {
+    // `sendfile` returns 0 at the end of the file, which means the file has been truncated. We
+    // report an error rather than letting the caller think that the peer hung up.
+    errno = ENODATA;
+    return -1;
+  }
+  return result;
+}
+
+// Dispatches to `SendFile` or `Send` depending on whether `file` is present.
+ssize_t Send(int const fd, Buffer const& buffer, absl::Span<uint8_t const> const payload,
+             std::optional<FileRange> const& file, size_t const offset) {
+  if (file.has_value()) {
+    return SendFile(fd, buffer, *file, offset);
+  } else {
+    return Send(fd, buffer, payload, offset);
+  }
+}
+
 }  // namespace
 
 Socket::~Socket() {
@@ -194,11 +255,11 @@ void Socket::OnOutput() {
   }
   MaybeCancelTimeout(&write_state_->timeout_handle);
   while (true) {
-    auto& buffer = write_state_->buffer;
     auto& remaining = write_state_->remaining;
-    CHECK_LE(remaining, buffer.size());
-    size_t const offset = buffer.size() - remaining;
-    ssize_t const result = ::send(*fd_, buffer.as_byte_array() + offset, remaining, MSG_DONTWAIT);
+    CHECK_LE(remaining, write_state_->size());
+    size_t const offset = write_state_->size() - remaining;
+    ssize_t const result =
+        Send(*fd_, write_state_->buffer, write_state_->payload, write_state_->file, offset);
     if (result < 0) {
       if (errno != EAGAIN && errno != EWOULDBLOCK) {
         auto status = absl::ErrnoToStatus(errno, "send");
@@ -322,6 +383,24 @@ absl::Status Socket::ReadInternal(size_t const length, ReadCallback callback,
 
 absl::Status Socket::WriteInternal(Buffer buffer, WriteCallback callback,
                                    std::optional<absl::Duration> const timeout) {
+  return GatherWriteInternal(std::move(buffer), /*payload=*/{}, std::move(callback), timeout);
+}
+
+absl::Status Socket::GatherWriteInternal(Buffer buffer, absl::Span<uint8_t const> const payload,
+                                         WriteCallback callback,
+                                         std::optional<absl::Duration> const timeout) {
+  return StartWrite(std::move(buffer), payload, /*file=*/std::nullopt, std::move(callback),
+                    timeout);
+}
+
+absl::Status Socket::SendFileInternal(Buffer header, FileRange const& file, WriteCallback callback,
+                                      std::optional<absl::Duration> const timeout) {
+  return StartWrite(std::move(header), /*payload=*/{}, file, std::move(callback), timeout);
+}
+
+absl::Status Socket::StartWrite(Buffer buffer, absl::Span<uint8_t const> const payload,
+                                std::optional<FileRange> const file, WriteCallback callback,
+                                std::optional<absl::Duration> const timeout) {
   if (buffer.empty()) {
     return absl::InvalidArgumentError("the number of bytes to write must be at least 1");
   }
@@ -338,11 +417,12 @@ absl::Status Socket::WriteInternal(Buffer buffer, WriteCallback callback,
   if (write_state_) {
     return absl::FailedPreconditionError("another write operation is already in progress");
   }
+  size_t const size = buffer.size() + payload.size() + (file.has_value() ? file->length : 0);
   size_t offset = 0;
   while (true) {
-    CHECK_LT(offset, buffer.size());
-    size_t const remaining = buffer.size() - offset;
-    ssize_t const result = ::send(*fd_, buffer.as_byte_array() + offset, remaining, MSG_DONTWAIT);
+    CHECK_LT(offset, size);
+    size_t const remaining = size - offset;
+    ssize_t const result = Send(*fd_, buffer, payload, file, offset);
     if (result < 0) {
       if (errno != EAGAIN && errno != EWOULDBLOCK) {
         auto status = absl::ErrnoToStatus(errno, "send");
@@ -355,13 +435,13 @@ absl::Status Socket::WriteInternal(Buffer buffer, WriteCallback callback,
         if (timeout) {
           timeout_handle = ScheduleTimeout(*timeout, kWriteTimeoutMessage);
         }
-        write_state_.emplace(std::move(buffer), remaining, std::move(callback), timeout,
-                             timeout_handle);
+        write_state_.emplace(std::move(buffer), payload, file, remaining, std::move(callback),
+                             timeout, timeout_handle);
         return absl::OkStatus();
       }
     } else if (result > 0) {
       offset += result;
-      if (!(offset < buffer.size())) {
+      if (!(offset < size)) {
         lock.Release();
         callback(absl::OkStatus());
         return absl::OkStatus();
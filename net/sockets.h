@@ -27,6 +27,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "common/reffed_ptr.h"
 #include "common/scheduler.h"
 #include "common/utilities.h"
@@ -212,10 +213,13 @@ class Socket : public BaseSocket {
   using MaybeReadState = std::optional<ReadState>;
 
   struct WriteState final {
-    explicit WriteState(Buffer buffer, size_t const remaining, WriteCallback callback,
-                        std::optional<absl::Duration> const timeout,
+    explicit WriteState(Buffer buffer, absl::Span<uint8_t const> const payload,
+                        std::optional<FileRange> const file, size_t const remaining,
+                        WriteCallback callback, std::optional<absl::Duration> const timeout,
                         tsdb2::common::Scheduler::Handle const timeout_handle)
         : buffer(std::move(buffer)),
+          payload(payload),
+          file(file),
           remaining(remaining),
           callback(std::move(callback)),
           timeout(timeout),
@@ -229,7 +233,14 @@ class Socket : public BaseSocket {
     WriteState(WriteState&&) noexcept = default;
     WriteState& operator=(WriteState&&) noexcept = default;
 
+    // Total number of bytes to write, including the unowned payload and file range.
+    size_t size() const {
+      return buffer.size() + payload.size() + (file.has_value() ? file->length : 0);
+    }
+
     Buffer buffer;
+    absl::Span<uint8_t const> payload;  // not owned, see `BaseSocket::WriteWithTimeout`
+    std::optional<FileRange> file;      // see `BaseSocket::SendFileWithTimeout`
     size_t remaining;
     WriteCallback callback;
     std::optional<absl::Duration> timeout;
@@ -312,6 +323,21 @@ class Socket : public BaseSocket {
                              std::optional<absl::Duration> timeout) override
       ABSL_LOCKS_EXCLUDED(mutex_);
 
+  absl::Status GatherWriteInternal(Buffer header, absl::Span<uint8_t const> payload,
+                                   WriteCallback callback,
+                                   std::optional<absl::Duration> timeout) override
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  absl::Status SendFileInternal(Buffer header, FileRange const& file, WriteCallback callback,
+                                std::optional<absl::Duration> timeout) override
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Implements `GatherWriteInternal` and `SendFileInternal`. At most one of `payload` and `file` is
+  // non-empty.
+  absl::Status StartWrite(Buffer buffer, absl::Span<uint8_t const> payload,
+                          std::optional<FileRange> file, WriteCallback callback,
+                          std::optional<absl::Duration> timeout) ABSL_LOCKS_EXCLUDED(mutex_);
+
   MaybeConnectState connect_state_ ABSL_GUARDED_BY(mutex_) = std::nullopt;
   MaybeReadState read_state_ ABSL_GUARDED_BY(mutex_) = std::nullopt;
   MaybeWriteState write_state_ ABSL_GUARDED_BY(mutex_) = std::nullopt;
@@ -4,12 +4,15 @@
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include <cstddef>
 #include <cstdint>
+#include <string>
 #include <string_view>
 #include <thread>
 #include <utility>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/flags/flag.h"
@@ -18,9 +21,11 @@
 #include "absl/status/status.h"
 #include "absl/status/status_matchers.h"
 #include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "common/default_scheduler.h"
 #include "common/flag_override.h"
 #include "common/mock_clock.h"
@@ -35,6 +40,7 @@
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "net/base_sockets.h"
+#include "net/ssl.h"
 #include "net/ssl_sockets.h"
 #include "net/testing.h"
 #include "server/testing.h"
@@ -53,6 +59,7 @@ using ::testing::GetTestTmpDir;
 using ::testing::Not;
 using ::testing::Pointee2;
 using ::testing::Property;
+using ::testing::TestTempFile;
 using ::tsdb2::common::MockClock;
 using ::tsdb2::common::reffed_ptr;
 using ::tsdb2::common::Scheduler;
@@ -63,6 +70,7 @@ using ::tsdb2::net::BaseListenerSocket;
 using ::tsdb2::net::BaseSocket;
 using ::tsdb2::net::Buffer;
 using ::tsdb2::net::FD;
+using ::tsdb2::net::FileRange;
 using ::tsdb2::net::KeepAliveParams;
 using ::tsdb2::net::kInetSocketTag;
 using ::tsdb2::net::kLocalHost;
@@ -72,6 +80,7 @@ using ::tsdb2::net::Socket;
 using ::tsdb2::net::SocketOptions;
 using ::tsdb2::net::SSLListenerSocket;
 using ::tsdb2::net::SSLSocket;
+using ::tsdb2::net::internal::SSLSessionCache;
 using ::tsdb2::net::testing::MakeTestSocketPath;
 
 uint16_t GetNewPort() {
@@ -166,6 +175,75 @@ TEST_F(SocketTest, Listen) {
       IsOkAndHolds(AllOf(Not(nullptr), Pointee2(Property(&BaseListenerSocket::is_open, true)))));
 }
 
+class AcceptedSSLSockets {
+ public:
+  static void Callback(void* const arg, absl::StatusOr<reffed_ptr<SSLSocket>> status_or_socket) {
+    CHECK_OK(status_or_socket);
+    auto* const self = static_cast<AcceptedSSLSockets*>(arg);
+    absl::MutexLock lock{&self->mutex_};
+    self->sockets_.emplace_back(std::move(status_or_socket).value());
+  }
+
+  // Waits until at least `count` connections have been accepted and returns the last one.
+  reffed_ptr<SSLSocket> Wait(size_t const count) ABSL_LOCKS_EXCLUDED(mutex_) {
+    absl::MutexLock lock{&mutex_, SimpleCondition([&]() ABSL_SHARED_LOCKS_REQUIRED(mutex_) {
+                           return sockets_.size() >= count;
+                         })};
+    return sockets_.back();
+  }
+
+ private:
+  absl::Mutex mutex_;
+  std::vector<reffed_ptr<SSLSocket>> sockets_ ABSL_GUARDED_BY(mutex_);
+};
+
+reffed_ptr<SSLSocket> ConnectSSL(uint16_t const port) {
+  absl::Notification connected;
+  auto status_or_socket = SSLSocket::Create(
+      kLocalHost, port, SocketOptions(), [&](reffed_ptr<SSLSocket>, absl::Status const status) {
+        CHECK_OK(status);
+        connected.Notify();
+      });
+  CHECK_OK(status_or_socket);
+  connected.WaitForNotification();
+  return std::move(status_or_socket).value();
+}
+
+TEST_F(SocketTest, SSLSessionResumption) {
+  SSLSessionCache::Get().Clear();
+  auto const port = GetNewPort();
+  AcceptedSSLSockets accepted;
+  auto const status_or_listener = SSLListenerSocket<SSLSocket>::Create(
+      kLocalHost, port, SocketOptions(), &AcceptedSSLSockets::Callback, &accepted);
+  ASSERT_OK(status_or_listener);
+  auto const client1 = ConnectSSL(port);
+  // Receiving data also processes the session tickets that the server sent after the handshake.
+  TransferData(accepted.Wait(1), client1, "lorem");
+  EXPECT_FALSE(client1->is_session_reused());
+  auto const client2 = ConnectSSL(port);
+  TransferData(accepted.Wait(2), client2, "ipsum");
+  EXPECT_TRUE(client2->is_session_reused());
+}
+
+TEST_F(SocketTest, NoSSLSessionResumptionAcrossServers) {
+  SSLSessionCache::Get().Clear();
+  auto const port1 = GetNewPort();
+  AcceptedSSLSockets accepted1;
+  auto const status_or_listener1 = SSLListenerSocket<SSLSocket>::Create(
+      kLocalHost, port1, SocketOptions(), &AcceptedSSLSockets::Callback, &accepted1);
+  ASSERT_OK(status_or_listener1);
+  auto const port2 = GetNewPort();
+  AcceptedSSLSockets accepted2;
+  auto const status_or_listener2 = SSLListenerSocket<SSLSocket>::Create(
+      kLocalHost, port2, SocketOptions(), &AcceptedSSLSockets::Callback, &accepted2);
+  ASSERT_OK(status_or_listener2);
+  auto const client1 = ConnectSSL(port1);
+  TransferData(accepted1.Wait(1), client1, "lorem");
+  auto const client2 = ConnectSSL(port2);
+  TransferData(accepted2.Wait(1), client2, "ipsum");
+  EXPECT_FALSE(client2->is_session_reused());
+}
+
 enum class ListenerState {
   kListening = 0,
   kAccepted = 1,
@@ -404,8 +482,8 @@ TYPED_TEST_P(TransferTest, TransferWithKeepAlives) {
                        SocketOptions{.keep_alive = true}};
   auto const& server_socket = connection.server_socket();
   auto const& client_socket = connection.client_socket();
-  this->TransferData(client_socket, server_socket, "lorem ipsum");
-  this->TransferData(server_socket, client_socket, "dolor sit amet");
+  TransferData(client_socket, server_socket, "lorem ipsum");
+  TransferData(server_socket, client_socket, "dolor sit amet");
   EXPECT_TRUE(server_socket->is_open());
   EXPECT_TRUE(client_socket->is_open());
 }
@@ -415,8 +493,8 @@ TYPED_TEST_P(TransferTest, TransferWithoutKeepAlives) {
                        SocketOptions{.keep_alive = false}};
   auto const& server_socket = connection.server_socket();
   auto const& client_socket = connection.client_socket();
-  this->TransferData(client_socket, server_socket, "lorem ipsum");
-  this->TransferData(server_socket, client_socket, "dolor sit amet");
+  TransferData(client_socket, server_socket, "lorem ipsum");
+  TransferData(server_socket, client_socket, "dolor sit amet");
   EXPECT_TRUE(server_socket->is_open());
   EXPECT_TRUE(client_socket->is_open());
 }
@@ -588,6 +666,96 @@ TYPED_TEST_P(TransferTest, ReadMoreThanImmediatelyAvailable) {
   EXPECT_TRUE(client_socket->is_open());
 }
 
+TYPED_TEST_P(TransferTest, WriteWithPayload) {
+  TypeParam connection{absl::GetFlag(FLAGS_socket_test_use_random_ports), SocketOptions()};
+  auto const& server_socket = connection.server_socket();
+  auto const& client_socket = connection.client_socket();
+  std::string_view constexpr kHeader = "header";
+  // Large enough to require several `send` calls.
+  std::string const payload(1 << 20, 'x');
+  absl::Notification read_notification;
+  absl::Notification write_notification;
+  ASSERT_OK(server_socket->Read(
+      kHeader.size() + payload.size(), [&](absl::StatusOr<Buffer> const status_or_buffer) {
+        ASSERT_OK(status_or_buffer);
+        auto const& buffer = status_or_buffer.value();
+        std::string_view const data{buffer.as_char_array(), buffer.size()};
+        EXPECT_EQ(data, absl::StrCat(kHeader, payload));
+        read_notification.Notify();
+      }));
+  ASSERT_OK(client_socket->WriteWithTimeout(
+      Buffer(kHeader.data(), kHeader.size()),
+      absl::Span<uint8_t const>(reinterpret_cast<uint8_t const*>(payload.data()), payload.size()),
+      [&](absl::Status const status) {
+        EXPECT_OK(status);
+        write_notification.Notify();
+      },
+      absl::Seconds(10)));
+  read_notification.WaitForNotification();
+  write_notification.WaitForNotification();
+  EXPECT_TRUE(server_socket->is_open());
+  EXPECT_TRUE(client_socket->is_open());
+}
+
+TYPED_TEST_P(TransferTest, SendFile) {
+  TypeParam connection{absl::GetFlag(FLAGS_socket_test_use_random_ports), SocketOptions()};
+  auto const& server_socket = connection.server_socket();
+  auto const& client_socket = connection.client_socket();
+  auto status_or_file = TestTempFile::Create("sockets_test");
+  ASSERT_OK(status_or_file);
+  auto const& file = status_or_file.value();
+  // Large enough to require several `sendfile` calls.
+  std::string content(1 << 20, 0);
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = static_cast<char>('a' + i % 26);
+  }
+  ASSERT_EQ(::pwrite(*file.fd(), content.data(), content.size(), 0),
+            static_cast<ssize_t>(content.size()));
+  std::string_view constexpr kHeader = "header";
+  size_t constexpr kOffset = 3;
+  size_t const length = content.size() - kOffset - 5;
+  absl::Notification read_notification;
+  absl::Notification write_notification;
+  ASSERT_OK(server_socket->Read(
+      kHeader.size() + length, [&](absl::StatusOr<Buffer> const status_or_buffer) {
+        ASSERT_OK(status_or_buffer);
+        auto const& buffer = status_or_buffer.value();
+        std::string_view const data{buffer.as_char_array(), buffer.size()};
+        EXPECT_EQ(data, absl::StrCat(kHeader, content.substr(kOffset, length)));
+        read_notification.Notify();
+      }));
+  ASSERT_OK(client_socket->SendFileWithTimeout(
+      Buffer(kHeader.data(), kHeader.size()), FileRange{*file.fd(), kOffset, length},
+      [&](absl::Status const status) {
+        EXPECT_OK(status);
+        write_notification.Notify();
+      },
+      absl::Seconds(10)));
+  read_notification.WaitForNotification();
+  write_notification.WaitForNotification();
+  EXPECT_EQ(::lseek(*file.fd(), 0, SEEK_CUR), 0);
+  EXPECT_TRUE(server_socket->is_open());
+  EXPECT_TRUE(client_socket->is_open());
+}
+
+TYPED_TEST_P(TransferTest, SendTruncatedFile) {
+  TypeParam connection{absl::GetFlag(FLAGS_socket_test_use_random_ports), SocketOptions()};
+  auto const& client_socket = connection.client_socket();
+  auto status_or_file = TestTempFile::Create("sockets_test");
+  ASSERT_OK(status_or_file);
+  auto const& file = status_or_file.value();
+  std::string_view constexpr kContent = "lorem ipsum";
+  ASSERT_EQ(::pwrite(*file.fd(), kContent.data(), kContent.size(), 0),
+            static_cast<ssize_t>(kContent.size()));
+  std::string_view constexpr kHeader = "header";
+  EXPECT_THAT(client_socket->SendFileWithTimeout(
+                  Buffer(kHeader.data(), kHeader.size()),
+                  FileRange{*file.fd(), 0, kContent.size() * 2},
+                  [](absl::Status const /*status*/) { ADD_FAILURE(); }, absl::Seconds(10)),
+              Not(IsOk()));
+  EXPECT_FALSE(client_socket->is_open());
+}
+
 TYPED_TEST_P(TransferTest, Skip) {
   TypeParam connection{absl::GetFlag(FLAGS_socket_test_use_random_ports), SocketOptions()};
   auto const& server_socket = connection.server_socket();
@@ -646,7 +814,8 @@ TYPED_TEST_P(TransferTest, SkipEvenChunks) {
 REGISTER_TYPED_TEST_SUITE_P(TransferTest, TransferWithKeepAlives, TransferWithoutKeepAlives,
                             ReadValidation, WriteValidation, ClientHangUp, ClientClose,
                             ServerHangUp, ServerClose, TwoChunks, ReadMoreThanImmediatelyAvailable,
-                            Skip, SkipManyChunks, SkipEvenChunks);
+                            WriteWithPayload, SendFile, SendTruncatedFile, Skip, SkipManyChunks,
+                            SkipEvenChunks);
 
 INSTANTIATE_TYPED_TEST_SUITE_P(TransferTest, TransferTest, TestConnectionTypes);
 
@@ -9,7 +9,9 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <cstring>
+#include <memory>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -49,8 +51,86 @@ int PassphraseCallback(char* const buffer, int const size, int const rwflag,
   return length;
 }
 
+// Identifies the server an SSL object is connected to, so that the new-session callback knows where
+// to store the session. Attached to the SSL object as ex_data.
+struct SessionKey {
+  std::string host;
+  uint16_t port;
+};
+
+void FreeSessionKey(void* /*parent*/, void* const ptr, CRYPTO_EX_DATA* /*ad*/, int /*index*/,
+                    long /*argl*/, void* /*argp*/) {
+  delete static_cast<gsl::owner<SessionKey*>>(ptr);
+}
+
+int GetSessionKeyIndex() {
+  static int const index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, &FreeSessionKey);
+  return index;
+}
+
+int NewSessionCallback(::SSL* const ssl, SSL_SESSION* const session) {
+  auto const* const key =
+      static_cast<SessionKey const*>(SSL_get_ex_data(ssl, GetSessionKeyIndex()));
+  if (key == nullptr || !SSL_SESSION_is_resumable(session)) {
+    return 0;
+  }
+  SSLSessionCache::Get().Insert(key->host, key->port, session);
+  // Returning 1 tells OpenSSL that we took ownership of the session.
+  return 1;
+}
+
 }  // namespace
 
+SSLSessionCache& SSLSessionCache::Get() {
+  static tsdb2::common::NoDestructor<SSLSessionCache> instance;
+  return *instance;
+}
+
+gsl::owner<SSL_SESSION*> SSLSessionCache::Take(std::string_view const host, uint16_t const port) {
+  absl::MutexLock lock{&mutex_};
+  auto const it = sessions_.find(std::make_pair(std::string(host), port));
+  if (it == sessions_.end()) {
+    return nullptr;
+  }
+  auto& list = it->second;
+  SSL_SESSION* const session = list.back().get();
+  if (SSL_SESSION_get_protocol_version(session) < TLS1_3_VERSION) {
+    SSL_SESSION_up_ref(session);
+    return session;
+  }
+  auto const result = list.back().release();
+  list.pop_back();
+  if (list.empty()) {
+    sessions_.erase(it);
+  }
+  return result;
+}
+
+void SSLSessionCache::Insert(std::string_view const host, uint16_t const port,
+                             gsl::owner<SSL_SESSION*> const session) {
+  SessionPtr ptr{session};
+  absl::MutexLock lock{&mutex_};
+  auto key = std::make_pair(std::string(host), port);
+  auto it = sessions_.find(key);
+  if (it == sessions_.end()) {
+    if (sessions_.size() >= kMaxServers) {
+      sessions_.erase(sessions_.begin());
+    }
+    it = sessions_.try_emplace(std::move(key)).first;
+  }
+  auto& list = it->second;
+  if (list.size() >= kMaxSessionsPerServer) {
+    list.erase(list.begin());
+  }
+  list.emplace_back(std::move(ptr));
+}
+
+void SSLSessionCache::Clear() {
+  absl::flat_hash_map<std::pair<std::string, uint16_t>, SessionList> sessions;
+  absl::MutexLock lock{&mutex_};
+  sessions_.swap(sessions);
+}
+
 void LogSSLErrors(std::string_view const file, int const line) {
   static tsdb2::common::NoDestructor<absl::Mutex> mutex;
   if (!mutex->TryLock()) {
@@ -81,9 +161,42 @@ absl::StatusOr<SSL> SSLContext::MakeSSL(tsdb2::io::FD const& fd) const {
   RETURN_IF_ERROR(ssl.SetFD(fd));
   SSL_set_options(ssl.get(), SSL_OP_NO_RENEGOTIATION);
   SSL_set_options(ssl.get(), SSL_OP_NO_TICKET);
+  // A write that fails with SSL_ERROR_WANT_WRITE is retried from the buffer stored in the pending
+  // write state, and small `Buffer`s keep their data inline, so the retry may pass a different
+  // pointer than the first attempt. OpenSSL rejects that unless this mode is set.
+  SSL_set_mode(ssl.get(), SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
   return std::move(ssl);
 }
 
+absl::StatusOr<SSL> SSLContext::MakeClientSSL(tsdb2::io::FD const& fd, std::string_view const host,
+                                              uint16_t const port) const {
+  DEFINE_VAR_OR_RETURN(ssl, MakeSSL(fd));
+  auto key = std::make_unique<SessionKey>(SessionKey{std::string(host), port});
+  if (SSL_set_ex_data(ssl.get(), GetSessionKeyIndex(), key.get()) <= 0) {
+    return absl::UnknownError("SSL_set_ex_data");
+  }
+  key.release();  // now owned by the SSL object, see `FreeSessionKey`
+  gsl::owner<SSL_SESSION*> const session = SSLSessionCache::Get().Take(host, port);
+  if (session != nullptr) {
+    // `SSL_set_session` takes its own reference. If it fails we just do a full handshake.
+    if (SSL_set_session(ssl.get(), session) <= 0) {
+      TSDB2_SSL_LOG_ERRORS();
+    }
+    SSL_SESSION_free(session);
+  }
+  return std::move(ssl);
+}
+
+void SSLContext::ConfigureServerSessionCache(::SSL_CTX* const context) {
+  static std::string_view constexpr kSessionIdContext = "tsdb2";
+  SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+  CHECK_GT(SSL_CTX_set_session_id_context(
+               context, reinterpret_cast<uint8_t const*>(kSessionIdContext.data()),
+               kSessionIdContext.size()),
+           0)
+      << "SSL_CTX_set_session_id_context";
+}
+
 gsl::owner<SSLContext*> SSLContext::CreateServerContext() {
   auto const* const method = TLS_server_method();
   CHECK(method != nullptr) << "TLS_server_method";
@@ -123,7 +236,7 @@ gsl::owner<SSLContext*> SSLContext::CreateServerContext() {
            0)
       << "SSL_CTX_use_PrivateKey_file";
 
-  SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+  ConfigureServerSessionCache(context);
   SSL_CTX_set_options(context, SSL_OP_NO_RENEGOTIATION);
   SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
 
@@ -144,7 +257,11 @@ gsl::owner<SSLContext*> SSLContext::CreateClientContext() {
   CHECK_GT(SSL_CTX_set_max_proto_version(context, TLS1_3_VERSION), 0)
       << "SSL_CTX_set_max_proto_version(TLS1_3_VERSION)";
 
-  SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+  // Sessions are stored in `SSLSessionCache` rather than in the context, because the internal
+  // cache is keyed by session ID and can't be looked up by server.
+  SSL_CTX_set_session_cache_mode(context,
+                                 SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(context, &NewSessionCallback);
   SSL_CTX_set_options(context, SSL_OP_NO_RENEGOTIATION);
   SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
 
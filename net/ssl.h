@@ -5,10 +5,19 @@
 #include <openssl/ssl.h>
 
 #include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
 #include <string_view>
+#include <utility>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
 #include "common/singleton.h"
 #include "common/utilities.h"
 #include "io/fd.h"
@@ -90,6 +99,57 @@ class SSL final {
   gsl::owner<::SSL*> ssl_;
 };
 
+// Client-side cache of resumable TLS sessions, keyed by the host and port of the server. It allows
+// new connections to a server we've already talked to to skip the full handshake.
+//
+// The client `SSLContext` stores here every new session received by an SSL object created with
+// `MakeClientSSL`, and `MakeClientSSL` resumes one of the sessions cached for the same server.
+// TLS 1.3 sessions are single-use (the server drops them once resumed, and sends new ones on the
+// resumed connection), so they're removed from the cache when taken. TLS 1.2 sessions stay until
+// they're replaced.
+//
+// At most `kMaxSessionsPerServer` sessions are kept for each server and at most `kMaxServers`
+// servers are tracked. When either limit is reached the oldest session of the server, or an
+// arbitrary server, is evicted.
+class SSLSessionCache {
+ public:
+  static size_t constexpr kMaxServers = 1024;
+  static size_t constexpr kMaxSessionsPerServer = 4;
+
+  // Returns the process-wide instance used by the client `SSLContext`.
+  static SSLSessionCache& Get();
+
+  explicit SSLSessionCache() = default;
+
+  // Returns a session that can be resumed when connecting to `host`:`port`, or nullptr if there are
+  // none. The caller owns the returned session and must release it with `SSL_SESSION_free`.
+  gsl::owner<SSL_SESSION*> Take(std::string_view host, uint16_t port) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Stores a new session for `host`:`port`, taking ownership of it.
+  void Insert(std::string_view host, uint16_t port, gsl::owner<SSL_SESSION*> session)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Drops all cached sessions.
+  void Clear() ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  struct SessionDeleter {
+    void operator()(gsl::owner<SSL_SESSION*> const session) const { SSL_SESSION_free(session); }
+  };
+
+  using SessionPtr = std::unique_ptr<SSL_SESSION, SessionDeleter>;
+  using SessionList = absl::InlinedVector<SessionPtr, kMaxSessionsPerServer>;
+
+  SSLSessionCache(SSLSessionCache const&) = delete;
+  SSLSessionCache& operator=(SSLSessionCache const&) = delete;
+  SSLSessionCache(SSLSessionCache&&) = delete;
+  SSLSessionCache& operator=(SSLSessionCache&&) = delete;
+
+  absl::Mutex mutex_;
+  absl::flat_hash_map<std::pair<std::string, uint16_t>, SessionList> sessions_
+      ABSL_GUARDED_BY(mutex_);
+};
+
 // This singleton manages a `SSL_CTX` object.
 class SSLContext {
  public:
@@ -126,6 +186,12 @@ class SSLContext {
   // Constructs an `SSL` object from this SSL context.
   absl::StatusOr<SSL> MakeSSL(tsdb2::io::FD const& fd) const;
 
+  // Like `MakeSSL`, but for client connections to `host`:`port`. The returned object resumes a
+  // session from `SSLSessionCache`, if there's one for the same server, and any new sessions it
+  // receives from the server are added to the cache.
+  absl::StatusOr<SSL> MakeClientSSL(tsdb2::io::FD const& fd, std::string_view host,
+                                    uint16_t port) const;
+
  private:
   // Constructs the server-side `SSLContext` instance. Invoked by `GetServerContext` only the first
   // time.
@@ -135,6 +201,13 @@ class SSLContext {
   // time.
   static gsl::owner<SSLContext*> CreateClientContext();
 
+  // Enables the server-side session cache, allowing clients to resume their sessions.
+  //
+  // NOTE: `SSL_OP_NO_TICKET` stays enabled, so TLS 1.2 clients resume by session ID and TLS 1.3
+  // clients get stateful tickets. Either way the session state never leaves the server and there
+  // are no ticket encryption keys to rotate.
+  static void ConfigureServerSessionCache(::SSL_CTX* context);
+
   // Creates a server-side `SSLContext` with an unsafe self-signed certificate and an utterly leaked
   // private key.
   //
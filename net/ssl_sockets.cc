@@ -65,6 +65,11 @@ SSLSocket::~SSLSocket() {
   }
 }
 
+bool SSLSocket::is_session_reused() const {
+  absl::MutexLock lock{&mutex_};
+  return SSL_session_reused(ssl_.get()) != 0;
+}
+
 SSLSocket::SSLSocket(EpollServer* const parent, AcceptTag /*accept_tag*/, FD fd, internal::SSL ssl,
                      absl::Duration const handshake_timeout, InternalConnectCallback callback)
     : BaseSocket(parent, std::move(fd)),
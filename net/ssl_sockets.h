@@ -106,6 +106,10 @@ class SSLSocket : public BaseSocket {
 
   ~SSLSocket() override ABSL_LOCKS_EXCLUDED(mutex_);
 
+  // Indicates whether the TLS handshake resumed a previous session rather than performing a full
+  // key exchange. Only meaningful after the connect callback has run.
+  bool is_session_reused() const ABSL_LOCKS_EXCLUDED(mutex_);
+
  protected:
   using InternalConnectCallback = absl::AnyInvocable<void(SSLSocket*, absl::Status)>;
 
@@ -619,7 +623,8 @@ absl::StatusOr<tsdb2::common::reffed_ptr<SocketClass>> SSLSocket::CreateClass(
   if (connect_result < 0 && errno != EINPROGRESS) {
     return absl::ErrnoToStatus(errno, "connect()");
   }
-  DEFINE_VAR_OR_RETURN(ssl, internal::SSLContext::GetClientContext().MakeSSL(fd));
+  DEFINE_VAR_OR_RETURN(ssl,
+                       internal::SSLContext::GetClientContext().MakeClientSSL(fd, address, port));
   auto socket = tsdb2::common::WrapReffed(new SocketClass(
       parent, kConnectTag, std::move(fd), std::move(ssl),
       absl::GetFlag(FLAGS_ssl_handshake_timeout),
@@ -112,7 +112,7 @@ gsl::owner<SSLContext *> SSLContext::CreateUnsafeServerContextForTesting() {
   BIO_free(certificate_bio);
   BIO_free(private_key_bio);
 
-  SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+  ConfigureServerSessionCache(context);
   SSL_CTX_set_options(context, SSL_OP_NO_RENEGOTIATION);
   SSL_CTX_set_options(context, SSL_OP_NO_TICKET);
 
@@ -40,6 +40,10 @@ ABSL_FLAG(
     "Whether to emit the reflection API for the generated types. The reflection API is very heavy "
     "to compile so it's disabled by default, but you'll need it if you use TextFormat.");
 
+ABSL_FLAG(bool, proto_emit_rpc_services, false,
+          "Whether to emit the server base classes and client stubs of the RPC services (see "
+          "http/rpc.h). Only unary and server-streaming methods are supported.");
+
 ABSL_FLAG(bool, proto_use_raw_google_api_types, false,
           "Whether to use raw ::google::protobuf::* API messages instead of absl::Time and "
           "absl::Duration for timestamp and duration fields.");
@@ -383,6 +387,11 @@ absl::StatusOr<std::string> Generator::GenerateHeaderFileContent() {
       .extensions = file_descriptor_->extension,
   };
   RETURN_IF_ERROR(EmitHeaderForScope(&writer, global_scope));
+  if (ShouldEmitRpcServices()) {
+    for (auto const& service : file_descriptor_->service) {
+      RETURN_IF_ERROR(EmitServiceHeader(&writer, service));
+    }
+  }
   if (!package.empty()) {
     writer.AppendLine("}  // namespace ", package);
     writer.AppendEmptyLine();
@@ -422,6 +431,11 @@ absl::StatusOr<std::string> Generator::GenerateSourceFileContent() {
       .extensions = file_descriptor_->extension,
   };
   RETURN_IF_ERROR(EmitImplementationForScope(&writer, /*prefix=*/{}, global_scope));
+  if (ShouldEmitRpcServices()) {
+    for (auto const& service : file_descriptor_->service) {
+      RETURN_IF_ERROR(EmitServiceImplementation(&writer, service));
+    }
+  }
   if (emit_reflection_api_) {
     RETURN_IF_ERROR(EmitReflectionDescriptors(&writer));
   }
@@ -485,7 +499,8 @@ absl::StatusOr<Generator> Generator::Builder::Build() && {
   ASSIGN_OR_RETURN(message_types_by_path_, GetMessageTypesByPath());
   RETURN_IF_ERROR(CheckMapTypes());
   return Generator(
-      file_descriptor_, absl::GetFlag(FLAGS_proto_emit_reflection_api), use_raw_google_api_types_,
+      file_descriptor_, absl::GetFlag(FLAGS_proto_emit_reflection_api),
+      absl::GetFlag(FLAGS_proto_emit_rpc_services), use_raw_google_api_types_,
       absl::GetFlag(
           FLAGS_proto_internal_generate_definitions_for_google_api_types_i_dont_care_about_odr_violations),
       std::move(enum_types_by_path_), std::move(message_types_by_path_), std::move(dependencies_),
@@ -898,6 +913,9 @@ void Generator::EmitIncludes(TextWriter* const writer) const {
   tsdb2::common::flat_map<std::string, bool> headers;
   headers.reserve(file_descriptor_->dependency.size() + 1);
   headers.try_emplace("proto/runtime.h", false);
+  if (ShouldEmitRpcServices()) {
+    headers.try_emplace("http/rpc.h", false);
+  }
   tsdb2::common::flat_set<size_t> const public_dependency_indexes{
       file_descriptor_->public_dependency.begin(), file_descriptor_->public_dependency.end()};
   for (size_t i = 0; i < file_descriptor_->dependency.size(); ++i) {
@@ -918,20 +936,30 @@ void Generator::EmitIncludes(TextWriter* const writer) const {
   }
 }
 
+absl::StatusOr<std::pair<std::string, bool>> Generator::GetCppTypeName(
+    std::string_view const proto_type_name) const {
+  if (!use_raw_google_api_types_) {
+    DEFINE_CONST_OR_RETURN(path, GetTypePath(proto_type_name));
+    auto const it = kGoogleApiTypes->find(path);
+    if (it != kGoogleApiTypes->end()) {
+      return std::make_pair(absl::StrCat("::", absl::StrJoin(it->second.cc_type, "::")),
+                            /*mapped=*/true);
+    }
+  }
+  return std::make_pair(absl::StrReplaceAll(proto_type_name, {{".", "::"}}), /*mapped=*/false);
+}
+
 absl::StatusOr<std::pair<std::string, bool>> Generator::GetFieldType(
     FieldDescriptorProto const& descriptor) const {
   if (descriptor.type_name.has_value()) {
     auto const& type_name = descriptor.type_name.value();
-    if (!use_raw_google_api_types_) {
-      DEFINE_CONST_OR_RETURN(path, GetTypePath(type_name));
-      auto const it = kGoogleApiTypes->find(path);
-      if (it != kGoogleApiTypes->end()) {
-        return std::make_pair(absl::StrCat("::", absl::StrJoin(it->second.cc_type, "::")),
-                              /*primitive=*/true);
-      }
+    DEFINE_VAR_OR_RETURN(cc_type, GetCppTypeName(type_name));
+    auto& [name, mapped] = cc_type;
+    if (mapped) {
+      return std::make_pair(std::move(name), /*primitive=*/true);
     }
     DEFINE_CONST_OR_RETURN(is_enum, IsEnum(type_name));
-    return std::make_pair(absl::StrReplaceAll(type_name, {{".", "::"}}), /*primitive=*/is_enum);
+    return std::make_pair(std::move(name), /*primitive=*/is_enum);
   }
   REQUIRE_FIELD_OR_RETURN(type, descriptor, type);
   auto const it = kFieldTypeNames.find(type);
@@ -2481,5 +2509,173 @@ absl::Status Generator::EmitReflectionDescriptors(TextWriter* writer) const {
   return absl::OkStatus();
 }
 
+absl::StatusOr<std::string> Generator::GetRpcMethodPath(
+    google::protobuf::ServiceDescriptorProto const& service,
+    google::protobuf::MethodDescriptorProto const& method) const {
+  REQUIRE_FIELD_OR_RETURN(package_name, *file_descriptor_, package);
+  REQUIRE_FIELD_OR_RETURN(service_name, service, name);
+  REQUIRE_FIELD_OR_RETURN(method_name, method, name);
+  if (package_name.empty()) {
+    return absl::StrCat("/", service_name, "/", method_name);
+  } else {
+    return absl::StrCat("/", package_name, ".", service_name, "/", method_name);
+  }
+}
+
+absl::StatusOr<std::pair<std::string, std::string>> Generator::GetRpcMethodTypes(
+    google::protobuf::MethodDescriptorProto const& method) const {
+  REQUIRE_FIELD_OR_RETURN(input_type, method, input_type);
+  REQUIRE_FIELD_OR_RETURN(output_type, method, output_type);
+  std::string cc_types[2];
+  for (size_t i = 0; i < 2; ++i) {
+    auto const& type_name = i > 0 ? output_type : input_type;
+    DEFINE_CONST_OR_RETURN(is_message, IsMessage(type_name));
+    if (!is_message) {
+      return absl::InvalidArgumentError(absl::StrCat("RPC method types must be messages, got \"",
+                                                     absl::CEscape(type_name), "\""));
+    }
+    DEFINE_VAR_OR_RETURN(cc_type, GetCppTypeName(type_name));
+    auto& [name, mapped] = cc_type;
+    if (mapped) {
+      // The mapped C++ types (e.g. `absl::Time`) don't have the `Encode` and `Decode` functions
+      // required by the RPC layer.
+      return absl::InvalidArgumentError(
+          absl::StrCat("RPC method types must be messages, got \"", absl::CEscape(type_name),
+                       "\" which is mapped to `", name, "`"));
+    }
+    cc_types[i] = std::move(name);
+  }
+  return std::make_pair(std::move(cc_types[0]), std::move(cc_types[1]));
+}
+
+absl::Status Generator::EmitServiceHeader(
+    TextWriter* const writer, google::protobuf::ServiceDescriptorProto const& service) const {
+  REQUIRE_FIELD_OR_RETURN(name, service, name);
+  writer->AppendLine("struct ", name, "Service : public ::tsdb2::http::RpcService {");
+  {
+    TextWriter::IndentedScope is{writer};
+    writer->AppendLine("explicit ", name, "Service() = default;");
+    writer->AppendLine("~", name, "Service() override = default;");
+    writer->AppendEmptyLine();
+    for (auto const& method : service.method) {
+      REQUIRE_FIELD_OR_RETURN(method_name, method, name);
+      if (method.client_streaming) {
+        writer->AppendLine("// NOTE: ", method_name,
+                           " is omitted because client-streaming RPCs are not supported.");
+        continue;
+      }
+      DEFINE_CONST_OR_RETURN(types, GetRpcMethodTypes(method));
+      auto const& [request_type, response_type] = types;
+      if (method.server_streaming) {
+        writer->AppendLine("virtual void ", method_name, "(", request_type,
+                           " request, ::tsdb2::common::reffed_ptr<::tsdb2::http::RpcServerWriter<",
+                           response_type, ">> writer) = 0;");
+      } else {
+        writer->AppendLine("virtual void ", method_name, "(", request_type,
+                           " request, ::tsdb2::http::UnaryRpcCallback<", response_type,
+                           "> callback) = 0;");
+      }
+    }
+    writer->AppendEmptyLine();
+    writer->AppendLine("HandlerList MakeHandlers() override;");
+  }
+  writer->AppendLine("};");
+  writer->AppendEmptyLine();
+  writer->AppendLine("struct ", name, "Stub : public ::tsdb2::http::RpcStub {");
+  {
+    TextWriter::IndentedScope is{writer};
+    writer->AppendLine("using ::tsdb2::http::RpcStub::RpcStub;");
+    writer->AppendEmptyLine();
+    for (auto const& method : service.method) {
+      if (method.client_streaming) {
+        continue;
+      }
+      REQUIRE_FIELD_OR_RETURN(method_name, method, name);
+      DEFINE_CONST_OR_RETURN(types, GetRpcMethodTypes(method));
+      auto const& [request_type, response_type] = types;
+      if (method.server_streaming) {
+        writer->AppendLine("::tsdb2::common::Promise<void> ", method_name, "(", request_type,
+                           " const& request, ::absl::AnyInvocable<void(", response_type,
+                           ")> callback) const;");
+      } else {
+        writer->AppendLine("::tsdb2::common::Promise<", response_type, "> ", method_name, "(",
+                           request_type, " const& request) const;");
+      }
+    }
+  }
+  writer->AppendLine("};");
+  writer->AppendEmptyLine();
+  return absl::OkStatus();
+}
+
+absl::Status Generator::EmitServiceImplementation(
+    TextWriter* const writer, google::protobuf::ServiceDescriptorProto const& service) const {
+  REQUIRE_FIELD_OR_RETURN(name, service, name);
+  writer->AppendEmptyLine();
+  writer->AppendLine("::tsdb2::http::RpcService::HandlerList ", name, "Service::MakeHandlers() {");
+  {
+    TextWriter::IndentedScope is{writer};
+    writer->AppendLine("HandlerList handlers;");
+    for (auto const& method : service.method) {
+      if (method.client_streaming) {
+        continue;
+      }
+      REQUIRE_FIELD_OR_RETURN(method_name, method, name);
+      DEFINE_CONST_OR_RETURN(path, GetRpcMethodPath(service, method));
+      DEFINE_CONST_OR_RETURN(types, GetRpcMethodTypes(method));
+      auto const& [request_type, response_type] = types;
+      writer->AppendLine("handlers.emplace_back(");
+      TextWriter::IndentedScope is1{writer};
+      TextWriter::IndentedScope is2{writer};
+      writer->AppendLine("\"", path, "\",");
+      if (method.server_streaming) {
+        writer->AppendLine("std::make_unique<::tsdb2::http::ServerStreamingRpcHandler<",
+                           request_type, ", ", response_type, ">>(");
+        writer->AppendLine(
+            "    [this](", request_type,
+            " request, ::tsdb2::common::reffed_ptr<::tsdb2::http::RpcServerWriter<", response_type,
+            ">> writer) {");
+        writer->AppendLine("      ", method_name, "(std::move(request), std::move(writer));");
+      } else {
+        writer->AppendLine("std::make_unique<::tsdb2::http::UnaryRpcHandler<", request_type, ", ",
+                           response_type, ">>(");
+        writer->AppendLine("    [this](", request_type,
+                           " request, ::tsdb2::http::UnaryRpcCallback<", response_type,
+                           "> callback) {");
+        writer->AppendLine("      ", method_name, "(std::move(request), std::move(callback));");
+      }
+      writer->AppendLine("    }));");
+    }
+    writer->AppendLine("return handlers;");
+  }
+  writer->AppendLine("}");
+  for (auto const& method : service.method) {
+    if (method.client_streaming) {
+      continue;
+    }
+    REQUIRE_FIELD_OR_RETURN(method_name, method, name);
+    DEFINE_CONST_OR_RETURN(path, GetRpcMethodPath(service, method));
+    DEFINE_CONST_OR_RETURN(types, GetRpcMethodTypes(method));
+    auto const& [request_type, response_type] = types;
+    writer->AppendEmptyLine();
+    if (method.server_streaming) {
+      writer->AppendLine("::tsdb2::common::Promise<void> ", name, "Stub::", method_name, "(",
+                         request_type, " const& request, ::absl::AnyInvocable<void(",
+                         response_type, ")> callback) const {");
+      TextWriter::IndentedScope is{writer};
+      writer->AppendLine("return CallServerStreaming<", response_type, ">(\"", path, "\", ",
+                         request_type, "::Encode(request), std::move(callback));");
+    } else {
+      writer->AppendLine("::tsdb2::common::Promise<", response_type, "> ", name, "Stub::",
+                         method_name, "(", request_type, " const& request) const {");
+      TextWriter::IndentedScope is{writer};
+      writer->AppendLine("return CallUnary<", response_type, ">(\"", path, "\", ", request_type,
+                         "::Encode(request));");
+    }
+    writer->AppendLine("}");
+  }
+  return absl::OkStatus();
+}
+
 }  // namespace proto
 }  // namespace tsdb2
@@ -157,13 +157,15 @@ class Generator {
   };
 
   explicit Generator(google::protobuf::FileDescriptorProto const* const file_descriptor,
-                     bool const emit_reflection_api, bool const use_raw_google_api_types,
+                     bool const emit_reflection_api, bool const emit_rpc_services,
+                     bool const use_raw_google_api_types,
                      bool const generate_definitions_for_google_api_types,
                      EnumsByPath enum_types_by_path, MessagesByPath message_types_by_path,
                      internal::DependencyManager dependencies,
                      internal::DependencyManager flat_dependencies, Path base_path)
       : file_descriptor_(file_descriptor),
         emit_reflection_api_(emit_reflection_api),
+        emit_rpc_services_(emit_rpc_services),
         use_raw_google_api_types_(use_raw_google_api_types),
         generate_definitions_for_google_api_types_(generate_definitions_for_google_api_types),
         enum_types_by_path_(std::move(enum_types_by_path)),
@@ -204,6 +206,12 @@ class Generator {
 
   void EmitIncludes(internal::TextWriter* writer) const;
 
+  // Returns the C++ name of a message or enum type. Unless `use_raw_google_api_types_` is set, the
+  // Google API types are mapped to their C++ counterparts (e.g. `google.protobuf.Timestamp` to
+  // `absl::Time`), in which case the returned boolean is true.
+  absl::StatusOr<std::pair<std::string, bool>> GetCppTypeName(
+      std::string_view proto_type_name) const;
+
   absl::StatusOr<std::pair<std::string, bool>> GetFieldType(
       google::protobuf::FieldDescriptorProto const& descriptor) const;
 
@@ -354,8 +362,29 @@ class Generator {
 
   absl::Status EmitReflectionDescriptors(internal::TextWriter* writer) const;
 
+  // Indicates whether the server base classes and client stubs of the RPC services must be emitted.
+  bool ShouldEmitRpcServices() const {
+    return emit_rpc_services_ && !file_descriptor_->service.empty();
+  }
+
+  // Returns the path of the handler of an RPC method, e.g. "/foo.bar.Service/Method".
+  absl::StatusOr<std::string> GetRpcMethodPath(
+      google::protobuf::ServiceDescriptorProto const& service,
+      google::protobuf::MethodDescriptorProto const& method) const;
+
+  // Returns the C++ types of the request and response messages of an RPC method.
+  absl::StatusOr<std::pair<std::string, std::string>> GetRpcMethodTypes(
+      google::protobuf::MethodDescriptorProto const& method) const;
+
+  absl::Status EmitServiceHeader(internal::TextWriter* writer,
+                                 google::protobuf::ServiceDescriptorProto const& service) const;
+
+  absl::Status EmitServiceImplementation(
+      internal::TextWriter* writer, google::protobuf::ServiceDescriptorProto const& service) const;
+
   google::protobuf::FileDescriptorProto const* file_descriptor_;
   bool emit_reflection_api_;
+  bool emit_rpc_services_;
   bool use_raw_google_api_types_;
   bool generate_definitions_for_google_api_types_;
   EnumsByPath enum_types_by_path_;
@@ -20,9 +20,12 @@ def _cc_proto_library_impl(ctx):
         dep[CcInfo]
         for dep in ctx.attr.deps
     ]
+    runtime_deps = ctx.attr._runtime_deps
+    if ctx.attr.enable_rpc_services:
+        runtime_deps = runtime_deps + ctx.attr._rpc_runtime_deps
     cc_infos = cc_proto_infos + [
         dep[CcInfo]
-        for dep in ctx.attr._runtime_deps
+        for dep in runtime_deps
     ]
     generated_header_files = []
     generated_source_files = []
@@ -46,6 +49,7 @@ def _cc_proto_library_impl(ctx):
             "--proto_root_path=" + _join_path(ctx.genfiles_dir.path, proto_info.proto_source_root),
             "--proto_file_descriptor_sets=" + proto_info.direct_descriptor_set.path,
             "--proto_emit_reflection_api" if ctx.attr.enable_reflection else "--noproto_emit_reflection_api",
+            "--proto_emit_rpc_services" if ctx.attr.enable_rpc_services else "--noproto_emit_rpc_services",
             "--proto_use_raw_google_api_types" if ctx.attr.use_raw_google_api_types else "--noproto_use_raw_google_api_types",
             "--proto_internal_generate_definitions_for_google_api_types_i_dont_care_about_odr_violations" if ctx.attr.internal_generate_definitions_for_google_api_types_i_dont_care_about_odr_violations else "--noproto_internal_generate_definitions_for_google_api_types_i_dont_care_about_odr_violations",
         ],
@@ -89,11 +93,13 @@ tsdb2_cc_proto_library = rule(
     attrs = {
         "proto": attr.label(mandatory = True, providers = [ProtoInfo]),
         "enable_reflection": attr.bool(),
+        "enable_rpc_services": attr.bool(),
         "use_raw_google_api_types": attr.bool(),
         "internal_generate_definitions_for_google_api_types_i_dont_care_about_odr_violations": attr.bool(),
         "deps": attr.label_list(providers = [ProtoInfo, CcInfo]),
         "_generator": attr.label(default = "//proto:generate", executable = True, cfg = "exec"),
         "_runtime_deps": attr.label_list(default = ["//proto:runtime"], providers = [CcInfo]),
+        "_rpc_runtime_deps": attr.label_list(default = ["//http:rpc"], providers = [CcInfo]),
 
         # TODO: remove this attribute when https://github.com/bazelbuild/bazel/issues/7260 is
         # resolved. See instructions at
@@ -0,0 +1,188 @@
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/synchronization/notification.h"
+#include "common/no_destructor.h"
+#include "common/promise.h"
+#include "common/reffed_ptr.h"
+#include "common/stats_counter.h"
+#include "common/testing.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "http/client.h"
+#include "http/rpc.h"
+#include "http/server.h"
+#include "net/base_sockets.h"
+#include "proto/tests/service_test.pb.h"
+#include "server/testing.h"
+
+namespace {
+
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::ElementsAre;
+using ::testing::Field;
+using ::testing::Optional;
+using ::tsdb2::common::Promise;
+using ::tsdb2::common::reffed_ptr;
+using ::tsdb2::http::Client;
+using ::tsdb2::http::RpcServerWriter;
+using ::tsdb2::http::Server;
+using ::tsdb2::http::UnaryRpcCallback;
+using ::tsdb2::net::kLocalHost;
+using ::tsdb2::net::SocketOptions;
+using ::tsdb2::proto::test::EchoRequest;
+using ::tsdb2::proto::test::EchoResponse;
+using ::tsdb2::proto::test::EchoService;
+using ::tsdb2::proto::test::EchoStub;
+
+uint16_t GetNewPort() {
+  static tsdb2::common::NoDestructor<tsdb2::common::StatsCounter> next_port{22048};
+  return next_port->Increment();
+}
+
+class TestEchoService : public EchoService {
+ public:
+  void Say(EchoRequest request, UnaryRpcCallback<EchoResponse> callback) override {
+    if (request.text.value_or("").empty()) {
+      return callback(absl::InvalidArgumentError("nothing to say"));
+    }
+    callback(EchoResponse{.text = std::move(request.text)});
+  }
+
+  void SayRepeatedly(EchoRequest request,
+                     reffed_ptr<RpcServerWriter<EchoResponse>> writer) override {
+    Write(std::move(writer), request.text.value_or(""), request.repeat.value_or(0));
+  }
+
+ private:
+  // Writes the remaining messages one at a time, waiting for each write to complete.
+  static void Write(reffed_ptr<RpcServerWriter<EchoResponse>> writer, std::string text,
+                    int32_t const count) {
+    if (count <= 0) {
+      return writer->Finish(absl::OkStatus());
+    }
+    auto* const ptr = writer.get();
+    ptr->Write(EchoResponse{.text = text},
+               [writer = std::move(writer), text, count](absl::Status status) mutable {
+                 if (status.ok()) {
+                   Write(std::move(writer), std::move(text), count - 1);
+                 } else {
+                   writer->Finish(status);
+                 }
+               });
+  }
+};
+
+class RpcTest : public tsdb2::testing::init::Test {
+ protected:
+  void SetUp() override {
+    Server::HandlerSet handlers;
+    ASSERT_OK(service_.AddHandlers(&handlers));
+    auto status_or_server =
+        Server::Create("", port_, /*use_ssl=*/false, SocketOptions(), std::move(handlers));
+    ASSERT_OK(status_or_server);
+    server_ = std::move(status_or_server).value();
+  }
+
+  uint16_t const port_ = GetNewPort();
+  TestEchoService service_;
+  std::unique_ptr<Server> server_;
+};
+
+TEST_F(RpcTest, Unary) {
+  // NOTE: the promise must outlive the client, whose destructor waits for all callbacks to
+  // complete.
+  Promise<void> promise;
+  Client client{Client::Options{.use_ssl = false}};
+  EchoStub stub{&client, kLocalHost, port_};
+  absl::Notification done;
+  absl::StatusOr<EchoResponse> result;
+  promise = stub.Say(EchoRequest{.text = "lorem"})
+                .Then([&](absl::StatusOr<EchoResponse> status_or_response) {
+                  result = std::move(status_or_response);
+                  done.Notify();
+                });
+  done.WaitForNotification();
+  EXPECT_THAT(result, IsOkAndHolds(Field(&EchoResponse::text, Optional(std::string("lorem")))));
+}
+
+TEST_F(RpcTest, UnaryError) {
+  Promise<void> promise;
+  Client client{Client::Options{.use_ssl = false}};
+  EchoStub stub{&client, kLocalHost, port_};
+  absl::Notification done;
+  absl::StatusOr<EchoResponse> result;
+  promise = stub.Say(EchoRequest())
+                .Then([&](absl::StatusOr<EchoResponse> status_or_response) {
+                  result = std::move(status_or_response);
+                  done.Notify();
+                });
+  done.WaitForNotification();
+  EXPECT_THAT(result, StatusIs(absl::StatusCode::kInvalidArgument, "nothing to say"));
+}
+
+TEST_F(RpcTest, ServerStreaming) {
+  Promise<void> promise;
+  Client client{Client::Options{.use_ssl = false}};
+  EchoStub stub{&client, kLocalHost, port_};
+  absl::Notification done;
+  std::vector<EchoResponse> responses;
+  absl::Status result;
+  promise = stub.SayRepeatedly(EchoRequest{.text = "lorem", .repeat = 3},
+                               [&](EchoResponse response) {
+                                 ASSERT_FALSE(done.HasBeenNotified());
+                                 responses.emplace_back(std::move(response));
+                               })
+                .Then([&](absl::Status status) {
+                  result = std::move(status);
+                  done.Notify();
+                });
+  done.WaitForNotification();
+  EXPECT_OK(result);
+  auto const lorem = Field(&EchoResponse::text, Optional(std::string("lorem")));
+  EXPECT_THAT(responses, ElementsAre(lorem, lorem, lorem));
+}
+
+TEST_F(RpcTest, ServerStreamingEmpty) {
+  Promise<void> promise;
+  Client client{Client::Options{.use_ssl = false}};
+  EchoStub stub{&client, kLocalHost, port_};
+  absl::Notification done;
+  size_t num_responses = 0;
+  absl::Status result;
+  promise = stub.SayRepeatedly(EchoRequest{.text = "lorem", .repeat = 0},
+                               [&](EchoResponse) { ++num_responses; })
+                .Then([&](absl::Status status) {
+                  result = std::move(status);
+                  done.Notify();
+                });
+  done.WaitForNotification();
+  EXPECT_OK(result);
+  EXPECT_EQ(num_responses, 0);
+}
+
+TEST_F(RpcTest, UnknownMethod) {
+  Promise<void> promise;
+  Client client{Client::Options{.use_ssl = false}};
+  tsdb2::http::RpcStub stub{&client, kLocalHost, port_};
+  absl::Notification done;
+  absl::StatusOr<EchoResponse> result;
+  promise = stub.CallUnary<EchoResponse>("/tsdb2.proto.test.Echo/Collect",
+                                         EchoRequest::Encode(EchoRequest{.text = "lorem"}))
+                .Then([&](absl::StatusOr<EchoResponse> status_or_response) {
+                  result = std::move(status_or_response);
+                  done.Notify();
+                });
+  done.WaitForNotification();
+  EXPECT_THAT(result, StatusIs(absl::StatusCode::kUnimplemented));
+}
+
+}  // namespace
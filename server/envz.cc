@@ -9,9 +9,11 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "common/env.h"
+#include "common/no_destructor.h"
 #include "common/utilities.h"
 #include "http/default_server.h"
 #include "http/handlers.h"
+#include "http/hpack.h"
 #include "http/http.h"
 #include "io/buffer.h"
 #include "server/module.h"
@@ -51,11 +53,16 @@ void EnvzHandler::operator()(tsdb2::http::StreamInterface *const stream,
   }
   std::string const content = absl::StrJoin(rows, "");
 
-  stream->SendResponseOrLog(
-      {
+  static tsdb2::common::NoDestructor<tsdb2::http::hpack::PrecompiledHeaders> const
+      kResponseFields{tsdb2::http::hpack::Encoder::Precompile({
           {":status", absl::StrCat(tsdb2::util::to_underlying(tsdb2::http::Status::k200))},
           {"content-type", "text/plain"},
           {"content-disposition", "inline"},
+      })};
+
+  stream->SendResponseOrLog(
+      *kResponseFields,
+      {
           {"content-length", absl::StrCat(content.size())},
       },
       tsdb2::io::Buffer(content.data(), content.size()));
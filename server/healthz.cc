@@ -8,9 +8,11 @@
 #include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
 #include "common/singleton.h"
+#include "common/no_destructor.h"
 #include "common/utilities.h"
 #include "http/default_server.h"
 #include "http/handlers.h"
+#include "http/hpack.h"
 #include "http/http.h"
 #include "io/buffer.h"
 #include "server/module.h"
@@ -48,11 +50,16 @@ class HealthzHandler final : public tsdb2::http::Handler {
     absl::Status const status = Healthz::instance->RunChecks();
     std::string reply = absl::StrCat(status.ToString(), "\n");
 
-    stream->SendResponseOrLog(
-        {
+    static tsdb2::common::NoDestructor<tsdb2::http::hpack::PrecompiledHeaders> const
+        kResponseFields{tsdb2::http::hpack::Encoder::Precompile({
             {":status", absl::StrCat(tsdb2::util::to_underlying(tsdb2::http::Status::k200))},
             {"content-type", "text/plain"},
             {"content-disposition", "inline"},
+        })};
+
+    stream->SendResponseOrLog(
+        *kResponseFields,
+        {
             {"content-length", absl::StrCat(reply.size())},
         },
         tsdb2::io::Buffer(reply.data(), reply.size()));
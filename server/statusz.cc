@@ -3,9 +3,11 @@
 
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
+#include "common/no_destructor.h"
 #include "common/utilities.h"
 #include "http/default_server.h"
 #include "http/handlers.h"
+#include "http/hpack.h"
 #include "http/http.h"
 #include "io/buffer.h"
 #include "server/module.h"
@@ -42,10 +44,15 @@ void StatuszHandler::operator()(tsdb2::http::StreamInterface *const stream,
 </html>
   )html";
 
-  stream->SendResponseOrLog(
-      {
+  static tsdb2::common::NoDestructor<tsdb2::http::hpack::PrecompiledHeaders> const
+      kResponseFields{tsdb2::http::hpack::Encoder::Precompile({
           {":status", absl::StrCat(tsdb2::util::to_underlying(tsdb2::http::Status::k200))},
           {"content-type", "text/html; charset=utf-8"},
+      })};
+
+  stream->SendResponseOrLog(
+      *kResponseFields,
+      {
           {"content-length", absl::StrCat(content.size())},
       },
       tsdb2::io::Buffer(content.data(), content.size()));
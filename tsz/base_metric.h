@@ -36,7 +36,7 @@ class BaseMetric {
         name_(name),
         options_(std::move(options)),
         metric_fields_(metric_field_names...),
-        proxy_(absl::bind_front(&BaseMetric::DefineMetric, this)) {}
+        definition_(absl::bind_front(&BaseMetric::DefineMetric, this)) {}
 
   template <typename... EntityLabelArgs, typename MetricFieldsAlias = MetricFields,
             std::enable_if_t<MetricFieldsAlias::kHasTypeNames, bool> = true>
@@ -45,7 +45,7 @@ class BaseMetric {
       : entity_(&entity),
         name_(name),
         options_(std::move(options)),
-        proxy_(absl::bind_front(&BaseMetric::DefineMetric, this)) {}
+        definition_(absl::bind_front(&BaseMetric::DefineMetric, this)) {}
 
   template <typename MetricFieldsAlias = MetricFields,
             std::enable_if_t<!MetricFieldsAlias::kHasTypeNames, bool> = true>
@@ -70,8 +70,12 @@ class BaseMetric {
   auto const &metric_field_names() const { return metric_fields_.names(); }
 
  protected:
-  internal::ScopedMetricProxy &proxy() { return *proxy_; }
-  internal::ScopedMetricProxy const &proxy() const { return *proxy_; }
+  internal::ScopedMetricProxy &proxy() { return definition_->proxy; }
+  internal::ScopedMetricProxy const &proxy() const { return definition_->proxy; }
+
+  // Returns the shard where the metric is defined, or nullptr if the definition failed.
+  internal::Shard *shard() { return definition_->shard; }
+  internal::Shard const *shard() const { return definition_->shard; }
 
  private:
   BaseMetric(BaseMetric const &) = delete;
@@ -79,7 +83,12 @@ class BaseMetric {
   BaseMetric(BaseMetric &&) = delete;
   BaseMetric &operator=(BaseMetric &&) = delete;
 
-  internal::ScopedMetricProxy DefineMetric() const;
+  struct Definition {
+    internal::Shard *shard = nullptr;
+    internal::ScopedMetricProxy proxy;
+  };
+
+  Definition DefineMetric() const;
 
   tsdb2::common::reffed_ptr<EntityInterface const> const entity_;
   std::string const name_;
@@ -87,7 +96,7 @@ class BaseMetric {
 
   MetricFields const metric_fields_;
 
-  tsdb2::common::Lazy<internal::ScopedMetricProxy> proxy_;
+  tsdb2::common::Lazy<Definition> definition_;
 };
 
 template <typename Value, typename... EntityLabelArgs, typename... MetricFieldArgs>
@@ -155,21 +164,22 @@ class BaseMetric<Value, EntityLabels<EntityLabelArgs...>, MetricFields<MetricFie
 };
 
 template <typename Value, typename... MetricFieldArgs>
-internal::ScopedMetricProxy BaseMetric<Value, MetricFieldArgs...>::DefineMetric() const {
+typename BaseMetric<Value, MetricFieldArgs...>::Definition
+BaseMetric<Value, MetricFieldArgs...>::DefineMetric() const {
   auto const status_or_shard = internal::exporter->DefineMetricRedundant(name_, options_);
   if (!status_or_shard.ok()) {
     LOG(ERROR) << "Failed to define metric \"" << absl::CEscape(name_)
                << "\" in the tsz exporter: " << status_or_shard.status();
-    return internal::ScopedMetricProxy();
+    return Definition();
   }
   auto const shard = status_or_shard.value();
   auto status_or_proxy = shard->GetPinnedMetric(entity_labels(), name_);
   if (!status_or_proxy.ok()) {
     LOG(ERROR) << "Failed to define metric \"" << absl::CEscape(name_)
                << "\" in the tsz exporter: " << status_or_proxy.status();
-    return internal::ScopedMetricProxy();
+    return Definition();
   }
-  return std::move(status_or_proxy).value();
+  return Definition{shard, std::move(status_or_proxy).value()};
 }
 
 template <typename Value, typename... EntityLabelArgs, typename... MetricFieldArgs>
@@ -5,6 +5,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <limits>
+#include <tuple>
 
 #include "absl/hash/hash.h"
 #include "common/lock_free_hash_set.h"
@@ -34,6 +35,55 @@ Bucketer const& Bucketer::Custom(double const width, double const growth_factor,
 }
 
 double Bucketer::lower_bound(int const i) const {
+  if (i >= 0 && static_cast<size_t>(i) < lower_bounds_.size()) {
+    return lower_bounds_[i];
+  } else {
+    return ComputeLowerBound(i);
+  }
+}
+
+int Bucketer::GetBucketFor(double const sample) const {
+  // NOTE: this condition is also true for NaNs.
+  if (!(sample >= lower_bounds_.front())) {
+    return -1;
+  }
+  if (sample >= lower_bounds_.back()) {
+    return num_finite_buckets_;
+  }
+  return GetFiniteBucketFor(sample);
+}
+
+Bucketer::Bucketer(double const width, double const growth_factor, double const scale_factor,
+                   size_t const num_finite_buckets)
+    : width_(width),
+      growth_factor_(growth_factor),
+      scale_factor_(scale_factor),
+      num_finite_buckets_(num_finite_buckets),
+      kind_(GetKind(width, growth_factor, scale_factor)),
+      log2_growth_factor_(kind_ == Kind::kPowersOfTwo ? std::ilogb(growth_factor) : 0),
+      inverse_log_growth_factor_(kind_ == Kind::kPowers ? 1.0 / std::log(growth_factor) : 0) {
+  lower_bounds_.reserve(num_finite_buckets_ + 1);
+  for (int i = 0; i <= static_cast<int>(num_finite_buckets_); ++i) {
+    lower_bounds_.push_back(ComputeLowerBound(i));
+  }
+}
+
+Bucketer::Kind Bucketer::GetKind(double const width, double const growth_factor,
+                                 double const scale_factor) {
+  if (growth_factor == 0) {
+    return width > 0 ? Kind::kFixedWidth : Kind::kOther;
+  }
+  if (width != 0 || !(growth_factor > 1) || !(scale_factor > 0) || std::isinf(growth_factor)) {
+    return Kind::kOther;
+  }
+  if (growth_factor == std::ldexp(1.0, std::ilogb(growth_factor))) {
+    return Kind::kPowersOfTwo;
+  } else {
+    return Kind::kPowers;
+  }
+}
+
+double Bucketer::ComputeLowerBound(int const i) const {
   double result = width_ * i;
   if (growth_factor_ != 0) {
     result += scale_factor_ * std::pow(growth_factor_, i - 1);
@@ -41,21 +91,44 @@ double Bucketer::lower_bound(int const i) const {
   return result;
 }
 
-int Bucketer::GetBucketFor(double const sample) const {
-  int i = 0;
-  int j = num_finite_buckets_ + 1;
-  while (j > i) {
-    int k = i + ((j - i) >> 1);
-    double const l = lower_bound(k);
-    if (sample < l) {
-      j = k;
-    } else if (sample > l) {
-      i = k + 1;
-    } else {
-      return k;
+int Bucketer::GetFiniteBucketFor(double const sample) const {
+  int i;
+  switch (kind_) {
+    case Kind::kFixedWidth:
+      i = static_cast<int>(std::min<double>(sample / width_, num_finite_buckets_ - 1));
+      break;
+    case Kind::kPowersOfTwo:
+      // `ilogb` extracts the binary exponent, which is `floor(log2(sample / scale_factor))`.
+      i = (std::ilogb(sample / scale_factor_) + log2_growth_factor_) / log2_growth_factor_;
+      break;
+    case Kind::kPowers: {
+      double const exponent = std::log(sample / scale_factor_) * inverse_log_growth_factor_;
+      i = static_cast<int>(std::floor(exponent)) + 1;
+      break;
     }
+    default: {
+      // Branchless binary search for the last lower bound that is less than or equal to the
+      // sample. The compiler turns the ternary operator into a conditional move.
+      double const* base = lower_bounds_.data();
+      size_t length = num_finite_buckets_;
+      while (length > 1) {
+        size_t const half = length / 2;
+        base = base[half] <= sample ? base + half : base;
+        length -= half;
+      }
+      return base - lower_bounds_.data();
+    }
+  }
+  // The above calculations may be off by one because of rounding errors, so we clamp the result and
+  // correct it based on the precomputed boundaries.
+  i = std::clamp<int>(i, 0, num_finite_buckets_ - 1);
+  while (sample < lower_bounds_[i]) {
+    --i;
+  }
+  while (sample >= lower_bounds_[i + 1]) {
+    ++i;
   }
-  return i - 1;
+  return i;
 }
 
 namespace {
@@ -67,8 +140,25 @@ class BucketerImpl final : public Bucketer {
       : Bucketer(width, growth_factor, scale_factor, num_finite_buckets) {}
 };
 
+// The parameters of a bucketer, in the same order as `Bucketer::tie`.
+using BucketerKey = std::tuple<double, double, double, size_t>;
+
+// We look up bucketers by `BucketerKey` before emplacing them, because emplacing constructs a new
+// bucketer (and computes its boundaries) even if an equal one already exists.
+struct HashBucketer {
+  using is_transparent = void;
+  size_t operator()(Bucketer const& bucketer) const {
+    return absl::HashOf(BucketerKey(bucketer.tie()));
+  }
+
+  size_t operator()(BucketerKey const& key) const { return absl::HashOf(key); }
+};
+
 struct CompareBucketers {
+  using is_transparent = void;
   bool operator()(Bucketer const& lhs, Bucketer const& rhs) const { return lhs.tie() == rhs.tie(); }
+  bool operator()(Bucketer const& lhs, BucketerKey const& rhs) const { return lhs.tie() == rhs; }
+  bool operator()(BucketerKey const& lhs, Bucketer const& rhs) const { return lhs == rhs.tie(); }
 };
 
 }  // namespace
@@ -77,11 +167,17 @@ Bucketer const& Bucketer::GetCanonicalBucketer(double const width, double const
                                                double const scale_factor,
                                                size_t const num_finite_buckets) {
   static tsdb2::common::NoDestructor<
-      tsdb2::common::lock_free_hash_set<BucketerImpl, absl::Hash<Bucketer>, CompareBucketers>>
+      tsdb2::common::lock_free_hash_set<BucketerImpl, HashBucketer, CompareBucketers>>
       bucketers;
-  auto const [it, _] = bucketers->emplace(width, growth_factor, scale_factor,
-                                          std::min(num_finite_buckets, kMaxNumFiniteBuckets));
-  return *it;
+  BucketerKey const key{width, growth_factor, scale_factor,
+                        std::min(num_finite_buckets, kMaxNumFiniteBuckets)};
+  auto const it = bucketers->find<BucketerKey>(key);
+  if (it != bucketers->end()) {
+    return *it;
+  }
+  auto const [new_it, _] =
+      bucketers->emplace(width, growth_factor, scale_factor, std::get<3>(key));
+  return *new_it;
 }
 
 }  // namespace tsz
@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <tuple>
 #include <utility>
+#include <vector>
 
 #include "absl/strings/str_format.h"
 
@@ -20,6 +21,9 @@ namespace tsz {
 //   width * i + scale_factor * pow(growth_factor, i - 1)
 //
 // for any `growth_factor` != 0. If `growth_factor` is zero the upper bound is just `width * i`.
+//
+// Bucketers are canonical: they are created only once for each combination of parameters and are
+// never destroyed, so they precompute all bucket boundaries at construction time.
 class Bucketer {
  public:
   // Maximum allowed number of buckets defined by a Bucketer. Higher values are clamped.
@@ -60,9 +64,12 @@ class Bucketer {
   // caller has to do that.
   double upper_bound(int const i) const { return lower_bound(i + 1); }
 
-  // Performs a binary search over the buckets and retrieves the one where `sample` falls. If the
-  // returned index is negative the sample falls in the underflow bucket, while if it's greater than
-  // or equal to `num_finite_buckets` it falls in the overflow bucket.
+  // Retrieves the bucket where `sample` falls. If the returned index is negative the sample falls
+  // in the underflow bucket, while if it's greater than or equal to `num_finite_buckets` it falls
+  // in the overflow bucket. NaNs fall in the underflow bucket.
+  //
+  // The index is calculated in constant time for fixed-width and power-of-base bucketers. For all
+  // other bucketers we perform a branchless binary search over the precomputed boundaries.
   int GetBucketFor(double sample) const;
 
   template <typename Sink>
@@ -82,12 +89,8 @@ class Bucketer {
   friend bool operator!=(Bucketer const &lhs, Bucketer const &rhs) { return &lhs != &rhs; }
 
  protected:
-  explicit Bucketer(double const width, double const growth_factor, double const scale_factor,
-                    size_t const num_finite_buckets)
-      : width_(width),
-        growth_factor_(growth_factor),
-        scale_factor_(scale_factor),
-        num_finite_buckets_(num_finite_buckets) {}
+  explicit Bucketer(double width, double growth_factor, double scale_factor,
+                    size_t num_finite_buckets);
 
   ~Bucketer() = default;
 
@@ -98,13 +101,50 @@ class Bucketer {
   Bucketer(Bucketer &&) = delete;
   Bucketer &operator=(Bucketer &&) = delete;
 
+  // Determines how `GetBucketFor` finds the bucket of a sample.
+  enum class Kind {
+    // `lower_bound(i)` is `width * i`, so we can divide by the width.
+    kFixedWidth,
+
+    // `lower_bound(i)` is `scale_factor * pow(growth_factor, i - 1)` and the growth factor is a
+    // power of two, so we can extract the binary exponent of the sample.
+    kPowersOfTwo,
+
+    // `lower_bound(i)` is `scale_factor * pow(growth_factor, i - 1)`, so we can use a logarithm.
+    kPowers,
+
+    // Any other combination of parameters: we search over `lower_bounds_`.
+    kOther,
+  };
+
   static Bucketer const &GetCanonicalBucketer(double width, double growth_factor,
                                               double scale_factor, size_t num_finite_buckets);
 
+  static Kind GetKind(double width, double growth_factor, double scale_factor);
+
+  double ComputeLowerBound(int i) const;
+
+  // Finds the bucket of a sample using `kind_`.
+  //
+  // REQUIRES: `lower_bounds_[0] <= sample < lower_bounds_[num_finite_buckets_]`.
+  int GetFiniteBucketFor(double sample) const;
+
   double width_;
   double growth_factor_;
   double scale_factor_;
   size_t num_finite_buckets_;
+
+  Kind kind_;
+
+  // Binary logarithm of the growth factor for `Kind::kPowersOfTwo`.
+  int log2_growth_factor_;
+
+  // `1 / log(growth_factor)` for `Kind::kPowers`.
+  double inverse_log_growth_factor_;
+
+  // The lower bounds of all finite buckets, plus the upper bound of the last one. Contains
+  // `num_finite_buckets_ + 1` elements.
+  std::vector<double> lower_bounds_;
 };
 
 }  // namespace tsz
@@ -1,8 +1,12 @@
 #include "tsz/bucketer.h"
 
+#include <cmath>
 #include <functional>
+#include <limits>
+#include <vector>
 
 #include "absl/functional/bind_front.h"
+#include "absl/strings/str_cat.h"
 #include "gtest/gtest.h"
 
 namespace {
@@ -89,4 +93,77 @@ TEST_F(GetBucketTest, Overflow) {
   EXPECT_EQ(bucketer_.GetBucketFor(7), 5);
 }
 
+TEST(BucketerTest, NaN) {
+  EXPECT_EQ(Bucketer::Default().GetBucketFor(std::numeric_limits<double>::quiet_NaN()), -1);
+  EXPECT_EQ(Bucketer::FixedWidth(1, 10).GetBucketFor(std::numeric_limits<double>::quiet_NaN()),
+            -1);
+  EXPECT_EQ(Bucketer::Custom(1, 2, 0.5, 20).GetBucketFor(std::numeric_limits<double>::quiet_NaN()),
+            -1);
+}
+
+TEST(BucketerTest, Infinity) {
+  EXPECT_EQ(Bucketer::Default().GetBucketFor(-std::numeric_limits<double>::infinity()), -1);
+  EXPECT_EQ(Bucketer::Default().GetBucketFor(std::numeric_limits<double>::infinity()),
+            Bucketer::Default().num_finite_buckets());
+}
+
+class GetBucketForTest : public ::testing::TestWithParam<std::function<Bucketer const&()>> {
+ protected:
+  // Reference implementation: binary search over the lower bounds.
+  static int GetBucketFor(Bucketer const& bucketer, double const sample) {
+    int i = 0;
+    int j = bucketer.num_finite_buckets() + 1;
+    while (j > i) {
+      int const k = i + ((j - i) >> 1);
+      if (sample < bucketer.lower_bound(k)) {
+        j = k;
+      } else {
+        i = k + 1;
+      }
+    }
+    return i - 1;
+  }
+
+  // Returns a list of samples including all boundaries, their neighbors, and the midpoints of all
+  // buckets.
+  static std::vector<double> GetSamples(Bucketer const& bucketer) {
+    std::vector<double> samples{-1, 0, 1e-300, 1e300};
+    for (int i = 0; i <= bucketer.num_finite_buckets(); ++i) {
+      double const bound = bucketer.lower_bound(i);
+      samples.push_back(bound);
+      samples.push_back(std::nextafter(bound, -std::numeric_limits<double>::infinity()));
+      samples.push_back(std::nextafter(bound, std::numeric_limits<double>::infinity()));
+      if (i < bucketer.num_finite_buckets()) {
+        samples.push_back((bound + bucketer.upper_bound(i)) / 2);
+      }
+    }
+    return samples;
+  }
+
+  Bucketer const& bucketer_ = GetParam()();
+};
+
+TEST_P(GetBucketForTest, MatchesBinarySearch) {
+  for (double const sample : GetSamples(bucketer_)) {
+    EXPECT_EQ(bucketer_.GetBucketFor(sample), GetBucketFor(bucketer_, sample))
+        << "bucketer: " << absl::StrCat(bucketer_) << ", sample: " << sample;
+  }
+}
+
+INSTANTIATE_TEST_SUITE_P(GetBucketForTest, GetBucketForTest,
+                         ::testing::Values(absl::bind_front(&Bucketer::FixedWidth, 1, 10),
+                                           absl::bind_front(&Bucketer::FixedWidth, 0.1, 100),
+                                           absl::bind_front(&Bucketer::FixedWidth, 3, 5000),
+                                           absl::bind_front(&Bucketer::PowersOf, 2.0),
+                                           absl::bind_front(&Bucketer::PowersOf, 3.0),
+                                           absl::bind_front(&Bucketer::PowersOf, 1.1),
+                                           absl::bind_front(&Bucketer::ScaledPowersOf, 2, 3, 1e6),
+                                           absl::bind_front(&Bucketer::ScaledPowersOf, 10, 1, 1e9),
+                                           absl::bind_front(&Bucketer::Custom, 0, 8, 0.5, 20),
+                                           absl::bind_front(&Bucketer::Custom, 1, 2, 0.5, 20),
+                                           absl::bind_front(&Bucketer::Custom, 1, 0, 1, 5),
+                                           absl::bind_front(&Bucketer::Custom, 2, 1.5, 1, 1),
+                                           absl::bind_front(&Bucketer::Default),
+                                           absl::bind_front(&Bucketer::None)));
+
 }  // namespace
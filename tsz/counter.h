@@ -119,12 +119,32 @@ class Counter : private BaseMetric<int64_t, MetricFieldArgs...> {
   using Base::name;
   using Base::options;
 
+  // Pre-hashed reference to the metric fields of a cell, see `MakeFieldsRef`.
+  using FieldsRef = FieldMapRef<sizeof...(MetricFieldArgs)>;
+
+  // Returns a pre-hashed reference to the cell with the specified metric fields. Callers that
+  // increment the same cells over and over can cache the refs and pass them to `Increment` and
+  // `IncrementBy` in place of the field values, so that the fields aren't hashed every time.
+  //
+  // NOTE: the provided string values MUST outlive the returned ref.
+  FieldsRef MakeFieldsRef(ParameterFieldTypeT<MetricFieldArgs> const... args) const {
+    return metric_fields().MakeFieldMapRef(args...);
+  }
+
   void IncrementBy(int64_t const delta, ParameterFieldTypeT<MetricFieldArgs> const... args) {
-    Base::proxy().AddToInt(metric_fields().MakeFieldMap(args...), delta);
+    Base::proxy().AddToInt(metric_fields().MakeFieldMapRef(args...), delta);
+  }
+
+  void IncrementBy(int64_t const delta, FieldsRef const &metric_field_ref) {
+    Base::proxy().AddToInt(metric_field_ref, delta);
   }
 
   void Increment(ParameterFieldTypeT<MetricFieldArgs> const... args) {
-    Base::proxy().AddToInt(metric_fields().MakeFieldMap(args...), 1);
+    Base::proxy().AddToInt(metric_fields().MakeFieldMapRef(args...), 1);
+  }
+
+  void Increment(FieldsRef const &metric_field_ref) {
+    Base::proxy().AddToInt(metric_field_ref, 1);
   }
 
   void Delete(ParameterFieldTypeT<MetricFieldArgs> const... args) {
@@ -161,8 +181,8 @@ class Counter<EntityLabels<EntityLabelArgs...>, MetricFields<MetricFieldArgs...>
                    ParameterFieldTypeT<MetricFieldArgs> const... metric_field_values) {
     auto const shard = Base::shard();
     if (shard) {
-      shard->AddToInt(entity_labels().MakeFieldMap(entity_label_values...), name(),
-                      metric_fields().MakeFieldMap(metric_field_values...), delta);
+      shard->AddToInt(entity_labels().MakeFieldMapRef(entity_label_values...), name(),
+                      metric_fields().MakeFieldMapRef(metric_field_values...), delta);
     }
   }
 
@@ -170,8 +190,8 @@ class Counter<EntityLabels<EntityLabelArgs...>, MetricFields<MetricFieldArgs...>
                  ParameterFieldTypeT<MetricFieldArgs> const... metric_field_values) {
     auto const shard = Base::shard();
     if (shard) {
-      shard->AddToInt(entity_labels().MakeFieldMap(entity_label_values...), name(),
-                      metric_fields().MakeFieldMap(metric_field_values...), 1);
+      shard->AddToInt(entity_labels().MakeFieldMapRef(entity_label_values...), name(),
+                      metric_fields().MakeFieldMapRef(metric_field_values...), 1);
     }
   }
 
@@ -268,6 +268,15 @@ TEST_F(CounterTest, IncrementByOne7) {
   EXPECT_THAT(reader2_.Read(456, true), IsOkAndHolds(2));
 }
 
+TEST_F(CounterTest, IncrementWithFieldsRef) {
+  auto const fields_ref = counter7->MakeFieldsRef(123, false);
+  counter7->Increment(fields_ref);
+  counter7->IncrementBy(12, fields_ref);
+  EXPECT_THAT(reader2_.Read(123, false), IsOkAndHolds(13));
+  counter7->Increment(123, false);
+  EXPECT_THAT(reader2_.Read(123, false), IsOkAndHolds(14));
+}
+
 TEST_F(CounterTest, Delete1) {
   counter1->IncrementBy(12, "12", "34", 123, false);
   counter1->IncrementBy(34, "56", "78", 456, true);
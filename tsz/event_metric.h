@@ -92,14 +92,22 @@
 //       };
 //
 // WARNING: in the last two forms the `entity` object MUST outlive all metrics associated to it.
+//
+// Metrics that are recorded at very high rates can enable the `buffer_samples` option, so that each
+// thread accumulates its samples in a local buffer for every cell and merges them into the metric
+// in bulk. See `Options::buffer_samples` for more information.
 #ifndef __TSDB2_TSZ_EVENT_METRIC_H__
 #define __TSDB2_TSZ_EVENT_METRIC_H__
 
 #include <cstddef>
+#include <cstdint>
 #include <utility>
 
 #include "tsz/base.h"
 #include "tsz/base_metric.h"
+#include "tsz/internal/sample_buffer.h"
+#include "tsz/internal/scoped_metric_proxy.h"
+#include "tsz/types.h"
 
 namespace tsz {
 
@@ -120,13 +128,46 @@ class EventMetric : private BaseMetric<Distribution, MetricFieldArgs...> {
   using Base::name;
   using Base::options;
 
+  // Pre-hashed reference to the metric fields of a cell, see `MakeFieldsRef`.
+  using FieldsRef = FieldMapRef<sizeof...(MetricFieldArgs)>;
+
+  // Returns a pre-hashed reference to the cell with the specified metric fields. Callers that
+  // record in the same cells over and over can cache the refs and pass them to `Record` and
+  // `RecordMany` in place of the field values, so that the fields aren't hashed every time.
+  //
+  // NOTE: the provided string values MUST outlive the returned ref.
+  FieldsRef MakeFieldsRef(ParameterFieldTypeT<MetricFieldArgs> const... args) const {
+    return metric_fields().MakeFieldMapRef(args...);
+  }
+
   void Record(double const sample, ParameterFieldTypeT<MetricFieldArgs> const... args) {
-    RecordMany(sample, /*times=*/1, args...);
+    RecordMany(sample, /*times=*/1, MakeFieldsRef(args...));
+  }
+
+  void Record(double const sample, FieldsRef const &metric_field_ref) {
+    RecordMany(sample, /*times=*/1, metric_field_ref);
   }
 
   void RecordMany(double const sample, size_t const times,
                   ParameterFieldTypeT<MetricFieldArgs> const... args) {
-    Base::proxy().AddToDistribution(metric_fields().MakeFieldMap(args...), sample, times);
+    RecordMany(sample, times, MakeFieldsRef(args...));
+  }
+
+  void RecordMany(double const sample, size_t const times, FieldsRef const &metric_field_ref) {
+    auto const shard = Base::shard();
+    if (shard && options().buffer_samples) {
+      auto *const table = internal::SampleBufferTable::Get();
+      if (table) {
+        auto *const buffer = table->GetOrCreate(
+            metric_id_, FieldMapRef<0>(FieldMapRef<0>::Entries{}), metric_field_ref, bucketer(),
+            shard->clock(), [this] { return Base::proxy().Duplicate(); });
+        if (buffer) {
+          buffer->Record(sample, times);
+          return;
+        }
+      }
+    }
+    Base::proxy().AddToDistribution(metric_field_ref, sample, times);
   }
 
   void Delete(ParameterFieldTypeT<MetricFieldArgs> const... args) {
@@ -134,6 +175,13 @@ class EventMetric : private BaseMetric<Distribution, MetricFieldArgs...> {
   }
 
   void Clear() { Base::proxy().Clear(); }
+
+ private:
+  Bucketer const &bucketer() const {
+    return options().bucketer != nullptr ? *options().bucketer : Bucketer::Default();
+  }
+
+  uintptr_t const metric_id_ = internal::SampleBufferTable::NewMetricId();
 };
 
 template <typename... EntityLabelArgs, typename... MetricFieldArgs>
@@ -168,10 +216,31 @@ class EventMetric<EntityLabels<EntityLabelArgs...>, MetricFields<MetricFieldArgs
                   ParameterFieldTypeT<EntityLabelArgs> const... entity_label_values,
                   ParameterFieldTypeT<MetricFieldArgs> const... metric_field_values) {
     auto const shard = Base::shard();
-    if (shard) {
-      shard->AddToDistribution(entity_labels().MakeFieldMap(entity_label_values...), name(),
-                               metric_fields().MakeFieldMap(metric_field_values...), sample, times);
+    if (!shard) {
+      return;
     }
+    auto const entity_label_ref = entity_labels().MakeFieldMapRef(entity_label_values...);
+    auto const metric_field_ref = metric_fields().MakeFieldMapRef(metric_field_values...);
+    if (options().buffer_samples) {
+      auto *const table = internal::SampleBufferTable::Get();
+      if (table) {
+        auto *const buffer = table->GetOrCreate(
+            metric_id_, entity_label_ref, metric_field_ref, bucketer(), shard->clock(),
+            [&]() -> internal::ScopedMetricProxy {
+              auto status_or_proxy = shard->GetPinnedMetric(entity_label_ref, name());
+              if (status_or_proxy.ok()) {
+                return std::move(status_or_proxy).value();
+              } else {
+                return internal::ScopedMetricProxy();
+              }
+            });
+        if (buffer) {
+          buffer->Record(sample, times);
+          return;
+        }
+      }
+    }
+    shard->AddToDistribution(entity_label_ref, name(), metric_field_ref, sample, times);
   }
 
   bool Delete(ParameterFieldTypeT<EntityLabelArgs> const... entity_label_values,
@@ -198,6 +267,13 @@ class EventMetric<EntityLabels<EntityLabelArgs...>, MetricFields<MetricFieldArgs
       shard->DeleteMetric(name());
     }
   }
+
+ private:
+  Bucketer const &bucketer() const {
+    return options().bucketer != nullptr ? *options().bucketer : Bucketer::Default();
+  }
+
+  uintptr_t const metric_id_ = internal::SampleBufferTable::NewMetricId();
 };
 
 }  // namespace tsz
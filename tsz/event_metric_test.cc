@@ -2,8 +2,11 @@
 
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 #include "absl/status/status_matchers.h"
+#include "absl/synchronization/notification.h"
 #include "common/testing.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -29,6 +32,7 @@ using ::tsz::testing::DistributionBucketerIs;
 using ::tsz::testing::DistributionSumAndCountAre;
 
 std::string_view constexpr kMetricName = "/lorem/ipsum";
+std::string_view constexpr kBufferedMetricName = "/lorem/ipsum/buffered";
 std::string_view constexpr kMetricDescription = "Lorem ipsum dolor sit amet.";
 
 char constexpr kLoremLabel[] = "lorem";
@@ -94,6 +98,18 @@ NoDestructor<tsz::EventMetric<int, bool>> event_metric7{
         .description = std::string(kMetricDescription),
     }};
 
+NoDestructor<tsz::EventMetric<
+    tsz::EntityLabels<tsz::Field<std::string, kLoremLabel>, tsz::Field<std::string, kIpsumLabel>>,
+    tsz::MetricFields<tsz::Field<int, kFooField>, tsz::Field<bool, kBarField>>>>
+    buffered_event_metric1{kBufferedMetricName, tsz::Options{
+                                                    .buffer_samples = true,
+                                                }};
+
+NoDestructor<tsz::EventMetric<tsz::Field<int, kFooField>, tsz::Field<bool, kBarField>>>
+    buffered_event_metric2{kBufferedMetricName, tsz::Options{
+                                                    .buffer_samples = true,
+                                                }};
+
 class EventMetricTest : public ::testing::Test {
  protected:
   CellReader<
@@ -329,6 +345,20 @@ TEST_F(EventMetricTest, RecordMany7) {
                                  DistributionSumAndCountAre(112, 2))));
 }
 
+TEST_F(EventMetricTest, RecordWithFieldsRef) {
+  auto const fields_ref1 = event_metric7->MakeFieldsRef(123, false);
+  auto const fields_ref2 = event_metric7->MakeFieldsRef(456, true);
+  event_metric7->Record(12, fields_ref1);
+  event_metric7->RecordMany(34, 2, fields_ref1);
+  event_metric7->Record(56, fields_ref2);
+  EXPECT_THAT(reader2_.Read(123, false),
+              IsOkAndHolds(AllOf(DistributionBucketerIs(Bucketer::Default()),
+                                 DistributionSumAndCountAre(80, 3))));
+  EXPECT_THAT(reader2_.Read(456, true),
+              IsOkAndHolds(AllOf(DistributionBucketerIs(Bucketer::Default()),
+                                 DistributionSumAndCountAre(56, 1))));
+}
+
 TEST_F(EventMetricTest, Delete1) {
   event_metric1->Record(12, "12", "34", 123, false);
   event_metric1->Record(34, "56", "78", 456, true);
@@ -588,4 +618,119 @@ TEST_F(EventMetricTest, DeleteEntity3) {
                                  DistributionSumAndCountAre(56, 1))));
 }
 
+class BufferedEventMetricTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    buffered_event_metric1->Clear();
+    buffered_event_metric2->Clear();
+  }
+
+  CellReader<
+      Distribution,
+      tsz::EntityLabels<tsz::Field<std::string, kLoremLabel>, tsz::Field<std::string, kIpsumLabel>>,
+      tsz::MetricFields<tsz::Field<int, kFooField>, tsz::Field<bool, kBarField>>>
+      reader1_{kBufferedMetricName};
+
+  CellReader<Distribution, tsz::EntityLabels<>,
+             tsz::MetricFields<tsz::Field<int, kFooField>, tsz::Field<bool, kBarField>>>
+      reader2_{kBufferedMetricName};
+};
+
+TEST_F(BufferedEventMetricTest, Record1) {
+  buffered_event_metric1->Record(12, "12", "34", 123, false);
+  buffered_event_metric1->Record(34, "12", "34", 123, false);
+  buffered_event_metric1->Record(56, "56", "78", 456, true);
+  EXPECT_THAT(reader1_.Read("12", "34", 123, false),
+              IsOkAndHolds(AllOf(DistributionBucketerIs(Bucketer::Default()),
+                                 DistributionSumAndCountAre(46, 2))));
+  EXPECT_THAT(reader1_.Read("56", "78", 456, true),
+              IsOkAndHolds(AllOf(DistributionBucketerIs(Bucketer::Default()),
+                                 DistributionSumAndCountAre(56, 1))));
+  buffered_event_metric1->RecordMany(78, 2, "12", "34", 123, false);
+  EXPECT_THAT(reader1_.Read("12", "34", 123, false),
+              IsOkAndHolds(DistributionSumAndCountAre(202, 4)));
+}
+
+TEST_F(BufferedEventMetricTest, Record2) {
+  buffered_event_metric2->Record(12, 123, false);
+  buffered_event_metric2->Record(34, 123, false);
+  buffered_event_metric2->Record(56, 456, true);
+  EXPECT_THAT(reader2_.Read(123, false),
+              IsOkAndHolds(AllOf(DistributionBucketerIs(Bucketer::Default()),
+                                 DistributionSumAndCountAre(46, 2))));
+  EXPECT_THAT(reader2_.Read(456, true),
+              IsOkAndHolds(AllOf(DistributionBucketerIs(Bucketer::Default()),
+                                 DistributionSumAndCountAre(56, 1))));
+  buffered_event_metric2->RecordMany(78, 2, 123, false);
+  EXPECT_THAT(reader2_.Read(123, false), IsOkAndHolds(DistributionSumAndCountAre(202, 4)));
+}
+
+TEST_F(BufferedEventMetricTest, RecordWithFieldsRef) {
+  auto const fields_ref = buffered_event_metric2->MakeFieldsRef(123, false);
+  buffered_event_metric2->Record(12, fields_ref);
+  buffered_event_metric2->Record(34, 123, false);
+  buffered_event_metric2->RecordMany(56, 2, fields_ref);
+  EXPECT_THAT(reader2_.Read(123, false), IsOkAndHolds(DistributionSumAndCountAre(158, 4)));
+}
+
+TEST_F(BufferedEventMetricTest, ReadWhileRecordingThreadIsAlive) {
+  absl::Notification recorded;
+  absl::Notification done;
+  std::thread thread{[&] {
+    buffered_event_metric1->Record(12, "12", "34", 123, false);
+    buffered_event_metric2->Record(34, 123, false);
+    recorded.Notify();
+    done.WaitForNotification();
+  }};
+  recorded.WaitForNotification();
+  buffered_event_metric1->Record(56, "12", "34", 123, false);
+  EXPECT_THAT(reader1_.Read("12", "34", 123, false),
+              IsOkAndHolds(DistributionSumAndCountAre(68, 2)));
+  EXPECT_THAT(reader2_.Read(123, false), IsOkAndHolds(DistributionSumAndCountAre(34, 1)));
+  done.Notify();
+  thread.join();
+}
+
+TEST_F(BufferedEventMetricTest, RecordInManyThreads) {
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([] {
+      for (int j = 0; j < 1000; ++j) {
+        buffered_event_metric1->Record(2, "12", "34", 123, false);
+        buffered_event_metric2->Record(3, 123, false);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_THAT(reader1_.Read("12", "34", 123, false),
+              IsOkAndHolds(DistributionSumAndCountAre(8000, 4000)));
+  EXPECT_THAT(reader2_.Read(123, false), IsOkAndHolds(DistributionSumAndCountAre(12000, 4000)));
+}
+
+TEST_F(BufferedEventMetricTest, Delete) {
+  buffered_event_metric1->Record(12, "12", "34", 123, false);
+  buffered_event_metric1->Record(34, "56", "78", 456, true);
+  buffered_event_metric2->Record(56, 123, false);
+  buffered_event_metric1->Delete("12", "34", 123, false);
+  buffered_event_metric2->Delete(123, false);
+  EXPECT_THAT(reader1_.Read("12", "34", 123, false), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(reader1_.Read("56", "78", 456, true),
+              IsOkAndHolds(DistributionSumAndCountAre(34, 1)));
+  EXPECT_THAT(reader2_.Read(123, false), StatusIs(absl::StatusCode::kNotFound));
+  buffered_event_metric1->Record(78, "12", "34", 123, false);
+  EXPECT_THAT(reader1_.Read("12", "34", 123, false),
+              IsOkAndHolds(DistributionSumAndCountAre(78, 1)));
+}
+
+TEST_F(BufferedEventMetricTest, Clear) {
+  buffered_event_metric1->Record(12, "12", "34", 123, false);
+  buffered_event_metric2->Record(34, 123, false);
+  buffered_event_metric1->Clear();
+  buffered_event_metric2->Clear();
+  EXPECT_THAT(reader1_.Read("12", "34", 123, false), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_THAT(reader2_.Read(123, false), StatusIs(absl::StatusCode::kNotFound));
+}
+
 }  // namespace
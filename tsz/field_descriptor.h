@@ -3,12 +3,14 @@
 
 #include <algorithm>
 #include <array>
+#include <cstddef>
 #include <numeric>
 #include <string>
 #include <string_view>
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <variant>
 
 #include "common/fixed.h"
 #include "common/flat_map.h"
@@ -191,6 +193,17 @@ struct ParameterFieldType<internal::FieldImpl<Args...>> {
 template <typename Field>
 using ParameterFieldTypeT = typename ParameterFieldType<Field>::Type;
 
+// Infers the type of the `FieldValueRef` alternative holding the values of a field. It's the same
+// as the canonical type except that strings are referenced by `std::string_view`.
+template <typename Field>
+struct FieldValueRefType {
+  using Type = std::conditional_t<std::is_same_v<CanonicalFieldTypeT<Field>, std::string>,
+                                  std::string_view, CanonicalFieldTypeT<Field>>;
+};
+
+template <typename Field>
+using FieldValueRefTypeT = typename FieldValueRefType<Field>::Type;
+
 // Represents an entity label set or metric field set in a tsz metric definition. The fields must
 // not have duplicate names.
 //
@@ -289,6 +302,14 @@ class FieldDescriptor {
   // Returns a `FieldMap` object mapping these fields' names to the provided values.
   FieldMap MakeFieldMap(ParameterFieldTypeT<Fields> const... values) const;
 
+  // Like `MakeFieldMap` but returns a `FieldMapRef` referring to the names of this descriptor and
+  // to the provided values, without copying them. This is used in the recording paths of the
+  // metrics so that updating an existing cell doesn't allocate any memory.
+  //
+  // NOTE: the returned ref MUST NOT outlive this descriptor or any of the provided string values.
+  FieldMapRef<sizeof...(Fields)> MakeFieldMapRef(
+      ParameterFieldTypeT<Fields> const... values) const;
+
  private:
   // Called by the constructors to initialize `indices_`.
   //
@@ -316,6 +337,19 @@ FieldMap FieldDescriptor<Fields...>::MakeFieldMap(
   return FieldMap(tsdb2::common::kSortedDeduplicatedContainer, std::move(rep));
 }
 
+template <typename... Fields>
+FieldMapRef<sizeof...(Fields)> FieldDescriptor<Fields...>::MakeFieldMapRef(
+    ParameterFieldTypeT<Fields> const... values) const {
+  std::array<FieldValueRef, sizeof...(Fields)> value_array{
+      FieldValueRef(std::in_place_type<FieldValueRefTypeT<Fields>>, values)...};
+  typename FieldMapRef<sizeof...(Fields)>::Entries entries;
+  for (size_t i = 0; i < sizeof...(Fields); ++i) {
+    auto const index = indices_[i];
+    entries[i] = std::make_pair(std::string_view(names_[index]), value_array[index]);
+  }
+  return FieldMapRef<sizeof...(Fields)>(entries);
+}
+
 template <typename... Fields>
 void FieldDescriptor<Fields...>::InitIndices() {
   std::iota(indices_.begin(), indices_.end(), 0);
@@ -338,6 +372,7 @@ class EntityLabels : public FieldDescriptor<Fields...> {
 
   using FieldDescriptor<Fields...>::names;
   using FieldDescriptor<Fields...>::MakeFieldMap;
+  using FieldDescriptor<Fields...>::MakeFieldMapRef;
 };
 
 // Used to specify metric fields in tsz metrics. See `FieldDescriptor` for more info.
@@ -355,6 +390,7 @@ class MetricFields : public FieldDescriptor<Fields...> {
 
   using FieldDescriptor<Fields...>::names;
   using FieldDescriptor<Fields...>::MakeFieldMap;
+  using FieldDescriptor<Fields...>::MakeFieldMapRef;
 };
 
 }  // namespace tsz
@@ -16,7 +16,9 @@ using ::testing::Pair;
 using ::testing::VariantWith;
 using ::tsz::EntityLabels;
 using ::tsz::Field;
+using ::tsz::HashFieldMap;
 using ::tsz::MetricFields;
+using ::tsz::ToFieldMap;
 using ::tsz::internal::HasDuplicateNamesV;
 
 char constexpr kFooName[] = "foo";
@@ -99,6 +101,14 @@ TEST(EmptyFieldDescriptorTest, FieldMap) {
   EXPECT_THAT(mf.MakeFieldMap(), ElementsAre());
 }
 
+TEST(EmptyFieldDescriptorTest, FieldMapRef) {
+  EntityLabels<> el;
+  auto const ref = el.MakeFieldMapRef();
+  EXPECT_THAT(ref.entries(), ElementsAre());
+  EXPECT_EQ(ref.hash(), HashFieldMap(el.MakeFieldMap()));
+  EXPECT_EQ(ref, el.MakeFieldMap());
+}
+
 TEST(EmptyEntityLabelsTest, Copyable) {
   EntityLabels<> fd1;
   EntityLabels<> fd2{fd1};
@@ -190,6 +200,20 @@ TEST(SingleFieldDescriptorTest, FieldMap) {
   EXPECT_THAT(mf2.MakeFieldMap(44), ElementsAre(Pair(kBazName, VariantWith<int64_t>(44))));
 }
 
+TEST(SingleFieldDescriptorTest, FieldMapRef) {
+  EntityLabels<Field<int, kFooName>> el;
+  auto const ref1 = el.MakeFieldMapRef(42);
+  EXPECT_THAT(ref1.entries(), ElementsAre(Pair(kFooName, VariantWith<int64_t>(42))));
+  EXPECT_EQ(ref1.hash(), HashFieldMap(el.MakeFieldMap(42)));
+  EXPECT_EQ(ref1, el.MakeFieldMap(42));
+  EXPECT_NE(ref1, el.MakeFieldMap(43));
+  MetricFields<int> mf{kBazName};
+  auto const ref2 = mf.MakeFieldMapRef(44);
+  EXPECT_THAT(ref2.entries(), ElementsAre(Pair(kBazName, VariantWith<int64_t>(44))));
+  EXPECT_EQ(ref2.hash(), HashFieldMap(mf.MakeFieldMap(44)));
+  EXPECT_EQ(ref2, mf.MakeFieldMap(44));
+}
+
 TEST(SingleEntityLabelTest, Copyable) {
   EntityLabels<Field<int, kFooName>> fd1;
   EntityLabels<Field<int, kFooName>> fd2{fd1};
@@ -319,4 +343,22 @@ TEST(TwoFieldDescriptorTest, FieldMap) {
                           Pair(kFooName, VariantWith<bool>(true))));
 }
 
+TEST(TwoFieldDescriptorTest, FieldMapRef) {
+  EntityLabels<Field<bool, kFooName>, Field<std::string, kBarName>> el;
+  auto const ref1 = el.MakeFieldMapRef(true, "lorem");
+  EXPECT_THAT(ref1.entries(), ElementsAre(Pair(kBarName, VariantWith<std::string_view>("lorem")),
+                                          Pair(kFooName, VariantWith<bool>(true))));
+  EXPECT_EQ(ref1.hash(), HashFieldMap(el.MakeFieldMap(true, "lorem")));
+  EXPECT_EQ(ref1, el.MakeFieldMap(true, "lorem"));
+  EXPECT_NE(ref1, el.MakeFieldMap(true, "ipsum"));
+  EXPECT_EQ(ToFieldMap(ref1), el.MakeFieldMap(true, "lorem"));
+  MetricFields<bool, std::string> mf{kFooName, kBazName};
+  auto const ref2 = mf.MakeFieldMapRef(false, "ipsum");
+  EXPECT_THAT(ref2.entries(), ElementsAre(Pair(kBazName, VariantWith<std::string_view>("ipsum")),
+                                          Pair(kFooName, VariantWith<bool>(false))));
+  EXPECT_EQ(ref2.hash(), HashFieldMap(mf.MakeFieldMap(false, "ipsum")));
+  EXPECT_EQ(ref2, mf.MakeFieldMap(false, "ipsum"));
+  EXPECT_EQ(ToFieldMap(ref2), mf.MakeFieldMap(false, "ipsum"));
+}
+
 }  // namespace
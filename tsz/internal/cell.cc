@@ -1,11 +1,14 @@
 #include "tsz/internal/cell.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <string>
+#include <utility>
 #include <variant>
 
 #include "absl/functional/overload.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "common/flat_map.h"
 #include "tsz/types.h"
@@ -13,6 +16,44 @@
 namespace tsz {
 namespace internal {
 
+Cell::Cell(Cell const &other)
+    : metric_fields_(other.metric_fields_),
+      hash_(other.hash_),
+      value_(other.value_),
+      start_time_(other.start_time_),
+      last_update_time_(other.last_update_time_.load(std::memory_order_relaxed)) {}
+
+Cell &Cell::operator=(Cell const &other) {
+  if (this != &other) {
+    metric_fields_ = other.metric_fields_;
+    hash_ = other.hash_;
+    value_ = other.value_;
+    start_time_ = other.start_time_;
+    last_update_time_.store(other.last_update_time_.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+  }
+  return *this;
+}
+
+Cell::Cell(Cell &&other) noexcept
+    : metric_fields_(std::move(other.metric_fields_)),
+      hash_(other.hash_),
+      value_(std::move(other.value_)),
+      start_time_(other.start_time_),
+      last_update_time_(other.last_update_time_.load(std::memory_order_relaxed)) {}
+
+Cell &Cell::operator=(Cell &&other) noexcept {
+  if (this != &other) {
+    metric_fields_ = std::move(other.metric_fields_);
+    hash_ = other.hash_;
+    value_ = std::move(other.value_);
+    start_time_ = other.start_time_;
+    last_update_time_.store(other.last_update_time_.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+  }
+  return *this;
+}
+
 void Cell::swap(Cell &other) {
   if (this == &other) {
     return;
@@ -22,7 +63,21 @@ void Cell::swap(Cell &other) {
   swap(hash_, other.hash_);
   swap(value_, other.value_);
   swap(start_time_, other.start_time_);
-  swap(last_update_time_, other.last_update_time_);
+  last_update_time_.store(
+      other.last_update_time_.exchange(last_update_time_.load(std::memory_order_relaxed),
+                                       std::memory_order_relaxed),
+      std::memory_order_relaxed);
+}
+
+Value Cell::value() const {
+  if (auto const value = std::get_if<int64_t>(&value_)) {
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+  } else if (std::holds_alternative<Distribution>(value_)) {
+    absl::MutexLock lock{&distribution_mutex_};
+    return value_;
+  } else {
+    return value_;
+  }
 }
 
 void Cell::Reset(absl::Time const new_start_time) {
@@ -35,7 +90,16 @@ void Cell::Reset(absl::Time const new_start_time) {
              },
              value_);
   start_time_ = new_start_time;
-  last_update_time_ = new_start_time;
+  last_update_time_.store(absl::ToUnixNanos(new_start_time), std::memory_order_relaxed);
+}
+
+void Cell::AdvanceLastUpdateTime(absl::Time const now) {
+  int64_t const timestamp = absl::ToUnixNanos(now);
+  int64_t current = last_update_time_.load(std::memory_order_relaxed);
+  while (current < timestamp && !last_update_time_.compare_exchange_weak(
+                                    current, timestamp, std::memory_order_relaxed)) {
+    // loop
+  }
 }
 
 }  // namespace internal
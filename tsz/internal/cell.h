@@ -1,11 +1,17 @@
 #ifndef __TSDB2_TSZ_INTERNAL_CELL_H__
 #define __TSDB2_TSZ_INTERNAL_CELL_H__
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <utility>
+#include <variant>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "common/utilities.h"
 #include "tsz/types.h"
 
 namespace tsz {
@@ -13,7 +19,10 @@ namespace internal {
 
 // A single tsz value cell.
 //
-// NOTE: this class is not thread-safe, only thread-friendly.
+// NOTE: this class is only partially thread-safe. `AddToInt`, `AddToDistribution`, `value`, and
+// `last_update_time` can be called concurrently with each other, so that `Metric` can update
+// existing cells while holding only a shared lock on its cell set. All other methods (including
+// copies and moves) require exclusive access to the cell.
 //
 // Each cell contains:
 //
@@ -32,6 +41,11 @@ class Cell {
   static size_t ToHash(Cell const &cell) { return cell.hash(); }
   static size_t ToHash(FieldMapView const &field_view) { return field_view.hash(); }
 
+  template <size_t N>
+  static size_t ToHash(FieldMapRef<N> const &field_ref) {
+    return field_ref.hash();
+  }
+
  public:
   // Custom hash functor to store `Cell`s in an `absl::flat_hash_set`. It's fast because the metric
   // fields are pre-hashed.
@@ -52,6 +66,11 @@ class Cell {
     static FieldMap const &ToFields(Cell const &cell) { return cell.metric_fields(); }
     static FieldMap const &ToFields(FieldMapView const &field_view) { return field_view.value(); }
 
+    template <size_t N>
+    static FieldMapRef<N> const &ToFields(FieldMapRef<N> const &field_ref) {
+      return field_ref;
+    }
+
     // NOTE: we can't use perfect forwarding here because we can't move our params, we need to use
     // them twice.
     template <typename LHS, typename RHS>
@@ -67,33 +86,33 @@ class Cell {
   struct DistributionCell {};
   static inline DistributionCell constexpr kDistributionCell;
 
-  // REQUIRES: `hash` MUST be the hash of `metric_fields` obtained from `absl::HashOf`. We cannot
+  // REQUIRES: `hash` MUST be the hash of `metric_fields` obtained from `HashFieldMap`. We cannot
   // calculate it ourselves because this constructor is executed in a latency-sensitive context.
   template <typename MetricFields>
   explicit Cell(MetricFields &&metric_fields, size_t const hash, Value value, absl::Time const now)
-      : metric_fields_(std::forward<MetricFields>(metric_fields)),
+      : metric_fields_(ToFieldMap(std::forward<MetricFields>(metric_fields))),
         hash_(hash),
         value_(std::move(value)),
         start_time_(now),
-        last_update_time_(now) {}
+        last_update_time_(absl::ToUnixNanos(now)) {}
 
-  // REQUIRES: `hash` MUST be the hash of `metric_fields` obtained from `absl::HashOf`. We cannot
+  // REQUIRES: `hash` MUST be the hash of `metric_fields` obtained from `HashFieldMap`. We cannot
   // calculate it ourselves because this constructor is executed in a latency-sensitive context.
   template <typename MetricFields>
   explicit Cell(DistributionCell /*distribution_cell*/, MetricFields &&metric_fields,
                 size_t const hash, Bucketer const *const bucketer, absl::Time const now)
-      : metric_fields_(std::forward<MetricFields>(metric_fields)),
+      : metric_fields_(ToFieldMap(std::forward<MetricFields>(metric_fields))),
         hash_(hash),
         value_(Distribution(bucketer ? *bucketer : Bucketer::Default())),
         start_time_(now),
-        last_update_time_(now) {}
+        last_update_time_(absl::ToUnixNanos(now)) {}
 
   ~Cell() = default;
 
-  Cell(Cell const &) = default;
-  Cell &operator=(Cell const &) = default;
-  Cell(Cell &&) noexcept = default;
-  Cell &operator=(Cell &&) noexcept = default;
+  Cell(Cell const &other);
+  Cell &operator=(Cell const &other);
+  Cell(Cell &&other) noexcept;
+  Cell &operator=(Cell &&other) noexcept;
 
   void swap(Cell &other);
   friend void swap(Cell &lhs, Cell &rhs) { lhs.swap(rhs); }
@@ -101,25 +120,46 @@ class Cell {
   FieldMap const &metric_fields() const { return metric_fields_; }
   size_t hash() const { return hash_; }
 
-  Value &value() { return value_; }
-  Value const &value() const { return value_; }
+  // Returns a snapshot of the value.
+  Value value() const;
 
   absl::Time start_time() const { return start_time_; }
-  absl::Time last_update_time() const { return last_update_time_; }
 
+  absl::Time last_update_time() const {
+    return absl::FromUnixNanos(last_update_time_.load(std::memory_order_relaxed));
+  }
+
+  // REQUIRES: exclusive access, because `value` may hold a different type than the current one.
   void SetValue(Value &&value, absl::Time const now) {
     value_ = std::move(value);
-    last_update_time_ = now;
+    last_update_time_.store(absl::ToUnixNanos(now), std::memory_order_relaxed);
   }
 
   void AddToInt(int64_t const delta, absl::Time const now) {
-    std::get<int64_t>(value_) += delta;
-    last_update_time_ = now;
+    // NOTE: we use the `__atomic` builtins rather than `std::atomic` because the integer lives in
+    // the `Value` variant along with the other value types.
+    __atomic_fetch_add(&std::get<int64_t>(value_), delta, __ATOMIC_RELAXED);
+    AdvanceLastUpdateTime(now);
+  }
+
+  void AddToDistribution(double const sample, size_t const times, absl::Time const now)
+      ABSL_LOCKS_EXCLUDED(distribution_mutex_) {
+    {
+      absl::MutexLock lock{&distribution_mutex_};
+      std::get<Distribution>(value_).RecordMany(sample, times);
+    }
+    AdvanceLastUpdateTime(now);
   }
 
-  void AddToDistribution(double const sample, size_t const times, absl::Time const now) {
-    std::get<Distribution>(value_).RecordMany(sample, times);
-    last_update_time_ = now;
+  // Merges `samples` into the distribution. Fails if `samples` doesn't have the same bucketer.
+  absl::Status AddToDistribution(Distribution const &samples, absl::Time const now)
+      ABSL_LOCKS_EXCLUDED(distribution_mutex_) {
+    {
+      absl::MutexLock lock{&distribution_mutex_};
+      RETURN_IF_ERROR(std::get<Distribution>(value_).Add(samples));
+    }
+    AdvanceLastUpdateTime(now);
+    return absl::OkStatus();
   }
 
   // Resets the cell to a "zero value", setting its timestamps to the provided `new_start_time`.
@@ -128,11 +168,23 @@ class Cell {
   void Reset(absl::Time new_start_time);
 
  private:
+  // Sets `last_update_time_` to `now` unless it's already more recent. Concurrent updates may be
+  // timestamped out of order, and we don't want the last update time to go back.
+  void AdvanceLastUpdateTime(absl::Time now);
+
   FieldMap metric_fields_;
   size_t hash_;
+
+  // Serializes concurrent `AddToDistribution` calls, as well as reads of distribution values.
+  // Integer values are updated atomically and all other value types can only change with exclusive
+  // access to the cell, so they don't need it.
+  absl::Mutex mutable distribution_mutex_;
+
   Value value_;
   absl::Time start_time_;
-  absl::Time last_update_time_;
+
+  // Nanoseconds since the Unix epoch.
+  std::atomic<int64_t> last_update_time_;
 };
 
 }  // namespace internal
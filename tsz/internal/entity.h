@@ -45,7 +45,7 @@ class EntityContext;
 class Entity : public MetricManager {
  public:
   explicit Entity(EntityManager *const manager, FieldMap labels)
-      : manager_(manager), labels_(std::move(labels)), hash_(absl::HashOf(labels_)) {}
+      : manager_(manager), labels_(std::move(labels)), hash_(HashFieldMap(labels_)) {}
 
   ~Entity() override = default;
 
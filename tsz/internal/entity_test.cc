@@ -6,7 +6,6 @@
 #include <string_view>
 #include <utility>
 
-#include "absl/hash/hash.h"
 #include "absl/status/status.h"
 #include "absl/status/status_matchers.h"
 #include "absl/time/clock.h"
@@ -29,6 +28,7 @@ using ::tsz::BoolValue;
 using ::tsz::Bucketer;
 using ::tsz::Distribution;
 using ::tsz::FieldMap;
+using ::tsz::HashFieldMap;
 using ::tsz::IntValue;
 using ::tsz::StringValue;
 using ::tsz::internal::Entity;
@@ -75,7 +75,7 @@ class EntityTest : public ::testing::Test {
 TEST_F(EntityTest, Labels) {
   auto const entity = std::make_shared<Entity>(&manager_, entity_labels_);
   EXPECT_EQ(entity->labels(), entity_labels_);
-  EXPECT_EQ(entity->hash(), absl::HashOf(entity_labels_));
+  EXPECT_EQ(entity->hash(), HashFieldMap(entity_labels_));
 }
 
 TEST_F(EntityTest, OtherLabels) {
@@ -87,7 +87,7 @@ TEST_F(EntityTest, OtherLabels) {
   EXPECT_CALL(manager_, DeleteEntityInternal(entity_labels)).Times(0);
   auto const entity = std::make_shared<Entity>(&manager_, entity_labels);
   EXPECT_EQ(entity->labels(), entity_labels);
-  EXPECT_EQ(entity->hash(), absl::HashOf(entity_labels));
+  EXPECT_EQ(entity->hash(), HashFieldMap(entity_labels));
 }
 
 TEST_F(EntityTest, EntityContext) {
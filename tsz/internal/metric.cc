@@ -15,8 +15,24 @@ bool Metric::Unpin() {
   return UnpinLocked();
 }
 
+void Metric::AddSampleBuffer(SampleBufferInterface *const buffer) {
+  absl::MutexLock lock{&buffers_mutex_};
+  sample_buffers_.emplace(buffer);
+}
+
+void Metric::RemoveSampleBuffer(SampleBufferInterface *const buffer) {
+  absl::MutexLock lock{&buffers_mutex_};
+  sample_buffers_.erase(buffer);
+}
+
+void Metric::FlushSampleBuffers() const {
+  absl::MutexLock lock{&buffers_mutex_};
+  FlushSampleBuffersLocked();
+}
+
 absl::StatusOr<Value> Metric::GetValue(FieldMap const &metric_fields) const {
   FieldMapView const metric_field_view{metric_fields};
+  FlushSampleBuffers();
   absl::ReaderMutexLock lock{&mutex_};
   auto const it = cells_.find(metric_field_view);
   if (it != cells_.end()) {
@@ -30,6 +46,7 @@ bool Metric::ResetIfCumulative(absl::Time const start_time) {
   if (!config_.cumulative) {
     return false;
   }
+  FlushSampleBuffers();
   absl::WriterMutexLock lock{&mutex_};
   for (auto const &cell : cells_) {
     const_cast<Cell &>(cell).Reset(start_time);
@@ -37,6 +54,30 @@ bool Metric::ResetIfCumulative(absl::Time const start_time) {
   return true;
 }
 
+void Metric::FlushSampleBuffersLocked() const {
+  for (auto *const buffer : sample_buffers_) {
+    buffer->Flush();
+  }
+}
+
+void Metric::DetachSampleBuffersLocked(FieldMap const &metric_fields) {
+  for (auto it = sample_buffers_.begin(); it != sample_buffers_.end();) {
+    if ((*it)->metric_fields() == metric_fields) {
+      (*it)->Detach();
+      sample_buffers_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void Metric::DetachSampleBuffersLocked() {
+  for (auto *const buffer : sample_buffers_) {
+    buffer->Detach();
+  }
+  sample_buffers_.clear();
+}
+
 bool Metric::UnpinLocked() {
   auto const result = pin_count_.Unref();
   if (result && cells_.empty()) {
@@ -36,6 +36,31 @@ class MetricManager {
   MetricManager &operator=(MetricManager &&) = delete;
 };
 
+// A buffer where samples are accumulated before being merged into the distribution cells of a
+// `Metric` in bulk (see `SampleBuffer`).
+class SampleBufferInterface {
+ public:
+  explicit SampleBufferInterface() = default;
+  virtual ~SampleBufferInterface() = default;
+
+  // Returns the fields of the cell the buffer merges its samples into.
+  virtual FieldMap const &metric_fields() const = 0;
+
+  // Merges the buffered samples into the metric and empties the buffer.
+  virtual void Flush() = 0;
+
+  // Invoked by the metric when the cell of the buffer is deleted, after removing the buffer from
+  // the metric. The buffer must drop any samples it holds and stop pinning the metric as soon as
+  // possible.
+  virtual void Detach() = 0;
+
+ private:
+  SampleBufferInterface(SampleBufferInterface const &) = delete;
+  SampleBufferInterface &operator=(SampleBufferInterface const &) = delete;
+  SampleBufferInterface(SampleBufferInterface &&) = delete;
+  SampleBufferInterface &operator=(SampleBufferInterface &&) = delete;
+};
+
 class Metric {
  public:
   explicit Metric(MetricManager *const manager, std::string_view const name,
@@ -52,6 +77,18 @@ class Metric {
   void Pin() { pin_count_.Ref(); }
   bool Unpin() ABSL_LOCKS_EXCLUDED(mutex_);
 
+  // Registers a buffer whose samples must be merged into this metric before its cells are read or
+  // cleared. The buffer must be removed before it's destroyed, unless the metric detached it first
+  // (see `SampleBufferInterface::Detach`).
+  void AddSampleBuffer(SampleBufferInterface *buffer) ABSL_LOCKS_EXCLUDED(buffers_mutex_);
+
+  void RemoveSampleBuffer(SampleBufferInterface *buffer) ABSL_LOCKS_EXCLUDED(buffers_mutex_);
+
+  // Merges the samples of all registered buffers into the cells. This is done automatically before
+  // reading or clearing values, but any code that accesses the cells in other ways (e.g. the
+  // exporter, when sampling) must call it first.
+  void FlushSampleBuffers() const ABSL_LOCKS_EXCLUDED(buffers_mutex_, mutex_);
+
   absl::StatusOr<Value> GetValue(FieldMap const &metric_fields) const ABSL_LOCKS_EXCLUDED(mutex_);
 
   template <typename MetricContext>
@@ -70,6 +107,16 @@ class Metric {
   void AddToDistribution(MetricContext *context, MetricFields &&metric_fields, double sample,
                          size_t times) ABSL_LOCKS_EXCLUDED(mutex_);
 
+  // Merges `samples` into a distribution cell, creating it if necessary. Fails if `samples` doesn't
+  // use the bucketer of the metric.
+  //
+  // The samples may have been buffered for a while, so the time of the update is specified by the
+  // caller rather than taken from the context.
+  template <typename MetricContext, typename MetricFields>
+  absl::Status AddToDistribution(MetricContext *context, MetricFields &&metric_fields,
+                                 Distribution const &samples, absl::Time now)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
   template <typename MetricContext>
   bool DeleteValue(MetricContext *context, FieldMap const &metric_fields)
       ABSL_LOCKS_EXCLUDED(mutex_);
@@ -91,24 +138,41 @@ class Metric {
 
   bool UnpinLocked() ABSL_SHARED_LOCKS_REQUIRED(mutex_);
 
+  void FlushSampleBuffersLocked() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(buffers_mutex_)
+      ABSL_LOCKS_EXCLUDED(mutex_);
+
+  // Detaches and removes the buffers of the cell identified by `metric_fields`.
+  void DetachSampleBuffersLocked(FieldMap const &metric_fields)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(buffers_mutex_);
+
+  // Detaches and removes all buffers.
+  void DetachSampleBuffersLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(buffers_mutex_);
+
   MetricManager *const manager_;  // not owned
 
   std::string const name_;
   size_t const hash_;
   MetricConfig const &config_;
 
+  // Protects `sample_buffers_`. It's acquired before `mutex_` when flushing the buffers.
+  absl::Mutex mutable buffers_mutex_;
+  absl::flat_hash_set<SampleBufferInterface *> sample_buffers_ ABSL_GUARDED_BY(buffers_mutex_);
+
   absl::Mutex mutable mutex_;
 
   tsdb2::common::RefCount pin_count_;
 
+  // NOTE: updates to existing integer and distribution cells only acquire a shared lock on `mutex_`
+  // because the `Cell` class synchronizes them internally. An exclusive lock is required to insert
+  // or remove cells and to replace values.
   CellSet cells_ ABSL_GUARDED_BY(mutex_);
-  absl::Time last_update_time_ ABSL_GUARDED_BY(mutex_) = absl::InfinitePast();
 };
 
 template <typename MetricContext>
 absl::StatusOr<Value> Metric::GetValue(MetricContext *const context,
                                        FieldMap const &metric_fields) const {
   FieldMapView const metric_field_view{metric_fields};
+  FlushSampleBuffers();
   {
     absl::ReaderMutexLock lock{&mutex_};
     typename MetricContext::Closure context_closure{context};
@@ -122,7 +186,7 @@ absl::StatusOr<Value> Metric::GetValue(MetricContext *const context,
 
 template <typename MetricContext, typename MetricFields>
 void Metric::SetValue(MetricContext *const context, MetricFields &&metric_fields, Value value) {
-  FieldMapView const metric_field_view{metric_fields};
+  auto const metric_field_view = MakeFieldView(metric_fields);
   absl::WriterMutexLock lock{&mutex_};
   typename MetricContext::Closure context_closure{context};
   auto const it = cells_.find(metric_field_view);
@@ -132,13 +196,23 @@ void Metric::SetValue(MetricContext *const context, MetricFields &&metric_fields
     cells_.emplace(std::forward<MetricFields>(metric_fields), metric_field_view.hash(),
                    std::move(value), context->time());
   }
-  last_update_time_ = context->time();
 }
 
 template <typename MetricContext, typename MetricFields>
 void Metric::AddToInt(MetricContext *const context, MetricFields &&metric_fields,
                       int64_t const delta) {
-  FieldMapView const metric_field_view{metric_fields};
+  auto const metric_field_view = MakeFieldView(metric_fields);
+  {
+    // Fast path: the cell usually exists already and can be incremented atomically, so a shared
+    // lock is enough.
+    absl::ReaderMutexLock lock{&mutex_};
+    auto const it = cells_.find(metric_field_view);
+    if (it != cells_.end()) {
+      typename MetricContext::Closure context_closure{context};
+      const_cast<Cell &>(*it).AddToInt(delta, context->time());
+      return;
+    }
+  }
   absl::WriterMutexLock lock{&mutex_};
   typename MetricContext::Closure context_closure{context};
   auto const it = cells_.find(metric_field_view);
@@ -148,13 +222,23 @@ void Metric::AddToInt(MetricContext *const context, MetricFields &&metric_fields
     cells_.emplace(std::forward<MetricFields>(metric_fields), metric_field_view.hash(), delta,
                    context->time());
   }
-  last_update_time_ = context->time();
 }
 
 template <typename MetricContext, typename MetricFields>
 void Metric::AddToDistribution(MetricContext *const context, MetricFields &&metric_fields,
                                double const sample, size_t const times) {
-  FieldMapView const metric_field_view{metric_fields};
+  auto const metric_field_view = MakeFieldView(metric_fields);
+  {
+    // Fast path: the cell usually exists already and has its own lock, so a shared lock on the cell
+    // set is enough.
+    absl::ReaderMutexLock lock{&mutex_};
+    auto const it = cells_.find(metric_field_view);
+    if (it != cells_.end()) {
+      typename MetricContext::Closure context_closure{context};
+      const_cast<Cell &>(*it).AddToDistribution(sample, times, context->time());
+      return;
+    }
+  }
   absl::WriterMutexLock lock{&mutex_};
   typename MetricContext::Closure context_closure{context};
   auto it = cells_.find(metric_field_view);
@@ -165,29 +249,58 @@ void Metric::AddToDistribution(MetricContext *const context, MetricFields &&metr
                        metric_field_view.hash(), config_.bucketer, context->time());
   }
   const_cast<Cell &>(*it).AddToDistribution(sample, times, context->time());
-  last_update_time_ = context->time();
+}
+
+template <typename MetricContext, typename MetricFields>
+absl::Status Metric::AddToDistribution(MetricContext *const context, MetricFields &&metric_fields,
+                                       Distribution const &samples, absl::Time const now) {
+  auto const metric_field_view = MakeFieldView(metric_fields);
+  {
+    absl::ReaderMutexLock lock{&mutex_};
+    auto const it = cells_.find(metric_field_view);
+    if (it != cells_.end()) {
+      typename MetricContext::Closure context_closure{context};
+      return const_cast<Cell &>(*it).AddToDistribution(samples, now);
+    }
+  }
+  absl::WriterMutexLock lock{&mutex_};
+  typename MetricContext::Closure context_closure{context};
+  auto it = cells_.find(metric_field_view);
+  if (it == cells_.end()) {
+    bool unused;
+    std::tie(it, unused) =
+        cells_.emplace(Cell::kDistributionCell, std::forward<MetricFields>(metric_fields),
+                       metric_field_view.hash(), config_.bucketer, now);
+  }
+  return const_cast<Cell &>(*it).AddToDistribution(samples, now);
 }
 
 template <typename MetricContext>
 bool Metric::DeleteValue(MetricContext *const context, FieldMap const &metric_fields) {
   typename CellSet::node_type node;
+  absl::MutexLock buffers_lock{&buffers_mutex_};
+  FlushSampleBuffersLocked();
   {
     FieldMapView const metric_field_view{metric_fields};
     absl::WriterMutexLock lock{&mutex_};
     typename MetricContext::Closure context_closure{context};
     node = cells_.extract(metric_field_view);
   }
+  DetachSampleBuffersLocked(metric_fields);
   return !node.empty();
 }
 
 template <typename MetricContext>
 bool Metric::Clear(MetricContext *const context) {
   CellSet cells;
+  absl::MutexLock buffers_lock{&buffers_mutex_};
+  FlushSampleBuffersLocked();
   {
     absl::WriterMutexLock lock{&mutex_};
     typename MetricContext::Closure context_closure{context};
     cells_.swap(cells);
   }
+  DetachSampleBuffersLocked();
   return !cells.empty();
 }
 
@@ -44,6 +44,16 @@ class MetricProxy {
   [[nodiscard]] bool empty() const { return metric_ == nullptr; }
   explicit operator bool() const { return metric_ != nullptr; }
 
+  // Returns a new proxy for the same metric, with the same context time. Returns an empty proxy if
+  // this one is empty.
+  MetricProxy Duplicate() const {
+    if (metric_) {
+      return MetricProxy(manager_, metric_, context_.time());
+    } else {
+      return MetricProxy();
+    }
+  }
+
   absl::StatusOr<Value> GetValue(FieldMap const& metric_fields) const {
     if (metric_) {
       return metric_->GetValue(&context_, metric_fields);
@@ -74,6 +84,29 @@ class MetricProxy {
     }
   }
 
+  template <typename MetricFields>
+  absl::Status AddToDistribution(MetricFields&& metric_fields, Distribution const& samples,
+                                 absl::Time const now) {
+    if (metric_) {
+      return metric_->AddToDistribution(&context_, std::forward<MetricFields>(metric_fields),
+                                        samples, now);
+    } else {
+      return absl::FailedPreconditionError("the proxy is empty");
+    }
+  }
+
+  void AddSampleBuffer(SampleBufferInterface* const buffer) {
+    if (metric_) {
+      metric_->AddSampleBuffer(buffer);
+    }
+  }
+
+  void RemoveSampleBuffer(SampleBufferInterface* const buffer) {
+    if (metric_) {
+      metric_->RemoveSampleBuffer(buffer);
+    }
+  }
+
   bool DeleteValue(FieldMap const& metric_fields) {
     if (metric_) {
       return metric_->DeleteValue(&context_, metric_fields);
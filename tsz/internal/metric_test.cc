@@ -4,6 +4,8 @@
 #include <memory>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 #include "absl/hash/hash.h"
 #include "absl/status/status_matchers.h"
@@ -595,6 +597,49 @@ TYPED_TEST_P(MetricTest, DontResetDistributionIfNotCumulative) {
                   AllOf(DistributionBucketerIs(bucketer), DistributionSumAndCountAre(34, 1)))));
 }
 
+TYPED_TEST_P(MetricTest, ConcurrentAddToInt) {
+  auto const metric = std::make_shared<Metric>(&this->manager_, kMetricName, this->metric_config_);
+  FieldMap const metric_fields{
+      {"lorem", BoolValue(true)},
+      {"ipsum", IntValue(42)},
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < 1000; ++j) {
+        TypeParam context{metric, absl::Now()};
+        metric->AddToInt(&context, metric_fields, 1);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_THAT(metric->GetValue(metric_fields), IsOkAndHolds(VariantWith<int64_t>(4000)));
+}
+
+TYPED_TEST_P(MetricTest, ConcurrentAddToDistribution) {
+  auto const metric = std::make_shared<Metric>(&this->manager_, kMetricName, this->metric_config_);
+  FieldMap const metric_fields{
+      {"lorem", BoolValue(true)},
+      {"ipsum", IntValue(42)},
+  };
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&] {
+      for (int j = 0; j < 1000; ++j) {
+        TypeParam context{metric, absl::Now()};
+        metric->AddToDistribution(&context, metric_fields, 2, 1);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_THAT(metric->GetValue(metric_fields),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(8000, 4000))));
+}
+
 REGISTER_TYPED_TEST_SUITE_P(MetricTest, Name, AnotherName, GetMissingValue, SetValue, GetValue,
                             SetAnotherValue, DeleteValue, DeleteMissingValue, GetDeletedValue,
                             RemainingValueKeepsMetricAlive, GetRemainingValue, DoubleDeletion,
@@ -602,7 +647,8 @@ REGISTER_TYPED_TEST_SUITE_P(MetricTest, Name, AnotherName, GetMissingValue, SetV
                             AddToAnotherInt, AddToDistribution, AddToDistributionWithCustomBucketer,
                             AddToDistributionTwice, AddToAnotherDistribution, ResetIntIfCumulative,
                             DontResetIntIfNotCumulative, ResetDistributionIfCumulative,
-                            DontResetDistributionIfNotCumulative);
+                            DontResetDistributionIfNotCumulative, ConcurrentAddToInt,
+                            ConcurrentAddToDistribution);
 
 using MetricContextTypes = ::testing::Types<ScopedMetricContext, ThrowAwayMetricContext>;
 INSTANTIATE_TYPED_TEST_SUITE_P(MetricTest, MetricTest, MetricContextTypes);
@@ -0,0 +1,99 @@
+#include "tsz/internal/sample_buffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "absl/base/attributes.h"
+#include "absl/log/log.h"
+#include "absl/synchronization/mutex.h"
+#include "common/clock.h"
+#include "common/sequence_number.h"
+#include "tsz/internal/scoped_metric_proxy.h"
+#include "tsz/types.h"
+
+namespace tsz {
+namespace internal {
+
+SampleBuffer::SampleBuffer(ScopedMetricProxy proxy, FieldMap metric_fields,
+                           Bucketer const &bucketer, tsdb2::common::Clock const &clock,
+                           std::atomic<bool> *const detach_signal)
+    : proxy_(std::move(proxy)),
+      metric_fields_(std::move(metric_fields)),
+      clock_(clock),
+      detach_signal_(detach_signal),
+      samples_(bucketer) {
+  proxy_.AddSampleBuffer(this);
+}
+
+SampleBuffer::~SampleBuffer() {
+  proxy_.RemoveSampleBuffer(this);
+  Flush();
+}
+
+void SampleBuffer::Record(double const sample, size_t const times) {
+  absl::MutexLock lock{&mutex_};
+  samples_.RecordMany(sample, times);
+  if (samples_.count() >= kMaxSamples) {
+    FlushLocked();
+  }
+}
+
+void SampleBuffer::Flush() {
+  absl::MutexLock lock{&mutex_};
+  FlushLocked();
+}
+
+void SampleBuffer::Detach() {
+  {
+    absl::MutexLock lock{&mutex_};
+    samples_.Clear();
+  }
+  detached_.store(true, std::memory_order_release);
+  if (detach_signal_ != nullptr) {
+    detach_signal_->store(true, std::memory_order_release);
+  }
+}
+
+void SampleBuffer::FlushLocked() {
+  if (samples_.empty()) {
+    return;
+  }
+  auto const status = proxy_.AddToDistribution(metric_fields_, samples_, clock_.TimeNow());
+  if (!status.ok()) {
+    LOG(ERROR) << "Failed to merge buffered samples: " << status;
+  }
+  samples_.Clear();
+}
+
+ABSL_CONST_INIT thread_local SampleBufferTable::State SampleBufferTable::state_ =
+    SampleBufferTable::State::kAlive;
+
+SampleBufferTable *SampleBufferTable::Get() {
+  if (state_ == State::kDestroyed) {
+    return nullptr;
+  }
+  thread_local SampleBufferTable instance;
+  return &instance;
+}
+
+uintptr_t SampleBufferTable::NewMetricId() {
+  static tsdb2::common::SequenceNumber sequence_number;
+  return sequence_number.GetNext();
+}
+
+SampleBufferTable::~SampleBufferTable() { state_ = State::kDestroyed; }
+
+void SampleBufferTable::EvictDetachedBuffers() {
+  for (auto it = buffers_.begin(); it != buffers_.end();) {
+    if (it->second->detached()) {
+      buffers_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace internal
+}  // namespace tsz
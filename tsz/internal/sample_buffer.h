@@ -0,0 +1,206 @@
+#ifndef __TSDB2_TSZ_INTERNAL_SAMPLE_BUFFER_H__
+#define __TSDB2_TSZ_INTERNAL_SAMPLE_BUFFER_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <utility>
+
+#include "absl/base/attributes.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/hash/hash.h"
+#include "absl/synchronization/mutex.h"
+#include "common/clock.h"
+#include "tsz/internal/metric.h"
+#include "tsz/internal/scoped_metric_proxy.h"
+#include "tsz/types.h"
+
+namespace tsz {
+namespace internal {
+
+// Accumulates the samples that one thread records in a distribution cell, so that recording
+// doesn't need to look up the entity and the cell and doesn't contend on their locks.
+//
+// The buffered samples are merged into the cell with `Distribution::Add` when the buffer is full,
+// when the metric is read or cleared (see `Metric::FlushSampleBuffers`), and when the buffer is
+// destroyed. The cell is updated with the time of the flush, read from `clock`. The buffer has its
+// own mutex because flushes may come from other threads, but the mutex is nearly always
+// uncontended.
+//
+// The buffer keeps the metric (and, through the proxy, its entity) pinned until it's destroyed.
+// When the cell is deleted, either individually or because the metric or the entity is, the metric
+// detaches the buffer: the buffered samples are dropped and `detached()` starts returning true.
+// The owner of the buffer is expected to destroy detached buffers, thus releasing the pin. If
+// `detach_signal` is not null it's set to true when the buffer is detached, so that the owner
+// doesn't need to poll all of its buffers.
+class SampleBuffer final : public SampleBufferInterface {
+ public:
+  // The buffer is flushed automatically when it reaches this number of samples.
+  static inline size_t constexpr kMaxSamples = 1024;
+
+  // REQUIRES: `bucketer` must be the bucketer of the metric.
+  explicit SampleBuffer(ScopedMetricProxy proxy, FieldMap metric_fields, Bucketer const &bucketer,
+                        tsdb2::common::Clock const &clock,
+                        std::atomic<bool> *detach_signal = nullptr);
+
+  ~SampleBuffer() override;
+
+  FieldMap const &metric_fields() const override { return metric_fields_; }
+
+  bool detached() const { return detached_.load(std::memory_order_acquire); }
+
+  void Record(double sample, size_t times) ABSL_LOCKS_EXCLUDED(mutex_);
+
+  void Flush() override ABSL_LOCKS_EXCLUDED(mutex_);
+
+  void Detach() override ABSL_LOCKS_EXCLUDED(mutex_);
+
+ private:
+  SampleBuffer(SampleBuffer const &) = delete;
+  SampleBuffer &operator=(SampleBuffer const &) = delete;
+  SampleBuffer(SampleBuffer &&) = delete;
+  SampleBuffer &operator=(SampleBuffer &&) = delete;
+
+  void FlushLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  ScopedMetricProxy proxy_;
+  FieldMap const metric_fields_;
+  tsdb2::common::Clock const &clock_;
+  std::atomic<bool> *const detach_signal_;
+
+  std::atomic<bool> detached_{false};
+
+  absl::Mutex mutex_;
+  Distribution samples_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Per-thread table of `SampleBuffer`s, indexed by metric ID, entity labels, and metric fields.
+//
+// Metric IDs are allocated with `NewMetricId` by the frontend metric objects (e.g. `EventMetric`)
+// and are never reused, so a buffer can never be mistaken for one of a different metric object
+// that happens to have the same address.
+//
+// The buffers live until the thread exits, except for the detached ones (see `SampleBuffer`), which
+// are evicted by the next `GetOrCreate` call of the thread. So a thread that has stopped recording
+// keeps its buffers, and the pins on the corresponding metrics and entities, until it records
+// again or exits.
+class SampleBufferTable {
+ public:
+  // Returns the table of the calling thread, or nullptr if the thread is exiting and its table has
+  // already been destroyed. In the latter case samples must be recorded directly in the cells.
+  static SampleBufferTable *Get();
+
+  static uintptr_t NewMetricId();
+
+  // Returns the buffer of the specified cell, creating it if necessary. If the buffer doesn't exist
+  // `make_proxy` is invoked to obtain a pinned proxy for the metric. Returns nullptr if the proxy
+  // is empty. `clock` is used by the buffer to timestamp its flushes.
+  //
+  // `entity_labels` and `metric_fields` can be `FieldMap`s or `FieldMapRef`s.
+  template <typename EntityLabels, typename MetricFields, typename MakeProxy>
+  SampleBuffer *GetOrCreate(uintptr_t const metric_id, EntityLabels const &entity_labels,
+                            MetricFields const &metric_fields, Bucketer const &bucketer,
+                            tsdb2::common::Clock const &clock, MakeProxy &&make_proxy) {
+    if (has_detached_buffers_.exchange(false, std::memory_order_acquire)) {
+      EvictDetachedBuffers();
+    }
+    KeyRef<EntityLabels, MetricFields> const key_ref{metric_id, entity_labels, metric_fields};
+    auto it = buffers_.find(key_ref);
+    if (it == buffers_.end()) {
+      ScopedMetricProxy proxy = std::forward<MakeProxy>(make_proxy)();
+      if (!proxy) {
+        return nullptr;
+      }
+      bool unused;
+      std::tie(it, unused) = buffers_.try_emplace(
+          Key{metric_id, ToFieldMap(entity_labels), ToFieldMap(metric_fields), key_ref.hash},
+          std::make_unique<SampleBuffer>(std::move(proxy), ToFieldMap(metric_fields), bucketer,
+                                         clock, &has_detached_buffers_));
+    }
+    return it->second.get();
+  }
+
+  // Returns the number of buffers in the table, including the detached ones that haven't been
+  // evicted yet. Used in tests.
+  size_t size() const { return buffers_.size(); }
+
+ private:
+  enum class State { kAlive, kDestroyed };
+
+  static size_t HashOf(FieldMap const &fields) { return HashFieldMap(fields); }
+
+  template <size_t N>
+  static size_t HashOf(FieldMapRef<N> const &fields) {
+    return fields.hash();
+  }
+
+  struct Key {
+    uintptr_t metric_id;
+    FieldMap entity_labels;
+    FieldMap metric_fields;
+    size_t hash;
+  };
+
+  template <typename EntityLabels, typename MetricFields>
+  struct KeyRef {
+    explicit KeyRef(uintptr_t const metric_id, EntityLabels const &entity_labels,
+                    MetricFields const &metric_fields)
+        : metric_id(metric_id),
+          entity_labels(entity_labels),
+          metric_fields(metric_fields),
+          hash(absl::HashOf(metric_id, HashOf(entity_labels), HashOf(metric_fields))) {}
+
+    uintptr_t const metric_id;
+    EntityLabels const &entity_labels;
+    MetricFields const &metric_fields;
+    size_t const hash;
+  };
+
+  // Custom hash functor to look up buffers transparently by `KeyRef` using the pre-calculated hash.
+  struct Hash {
+    using is_transparent = void;
+    template <typename Arg>
+    size_t operator()(Arg const &arg) const {
+      return arg.hash;
+    }
+  };
+
+  // Custom equality functor to look up buffers transparently by `KeyRef`. It short-circuits if the
+  // pre-calculated hashes are different.
+  struct Eq {
+    using is_transparent = void;
+    template <typename LHS, typename RHS>
+    bool operator()(LHS const &lhs, RHS const &rhs) const {
+      return lhs.hash == rhs.hash && lhs.metric_id == rhs.metric_id &&
+             lhs.entity_labels == rhs.entity_labels && lhs.metric_fields == rhs.metric_fields;
+    }
+  };
+
+  static ABSL_CONST_INIT thread_local State state_;
+
+  explicit SampleBufferTable() = default;
+  ~SampleBufferTable();
+
+  SampleBufferTable(SampleBufferTable const &) = delete;
+  SampleBufferTable &operator=(SampleBufferTable const &) = delete;
+  SampleBufferTable(SampleBufferTable &&) = delete;
+  SampleBufferTable &operator=(SampleBufferTable &&) = delete;
+
+  void EvictDetachedBuffers();
+
+  // Set by the buffers when they are detached, possibly by other threads.
+  //
+  // NOTE: this must be declared before `buffers_` so that it outlives them. Buffers can only be
+  // detached while they are registered with their metric, and they unregister when destroyed.
+  std::atomic<bool> has_detached_buffers_{false};
+
+  absl::flat_hash_map<Key, std::unique_ptr<SampleBuffer>, Hash, Eq> buffers_;
+};
+
+}  // namespace internal
+}  // namespace tsz
+
+#endif  // __TSDB2_TSZ_INTERNAL_SAMPLE_BUFFER_H__
@@ -0,0 +1,302 @@
+#include "tsz/internal/sample_buffer.h"
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/time/clock.h"
+#include "common/mock_clock.h"
+#include "common/testing.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "tsz/distribution_testing.h"
+#include "tsz/internal/metric.h"
+#include "tsz/internal/metric_config.h"
+#include "tsz/internal/mock_metric_manager.h"
+#include "tsz/internal/scoped_metric_proxy.h"
+#include "tsz/types.h"
+
+namespace {
+
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::AllOf;
+using ::testing::Ne;
+using ::testing::VariantWith;
+using ::tsz::BoolValue;
+using ::tsz::Bucketer;
+using ::tsz::Distribution;
+using ::tsz::FieldMap;
+using ::tsz::FieldMapRef;
+using ::tsz::FieldValueRef;
+using ::tsz::IntValue;
+using ::tsz::internal::Metric;
+using ::tsz::internal::MetricConfig;
+using ::tsz::internal::SampleBuffer;
+using ::tsz::internal::SampleBufferTable;
+using ::tsz::internal::ScopedMetricProxy;
+using ::tsz::internal::testing::MockMetricManager;
+using ::tsz::testing::DistributionBucketerIs;
+using ::tsz::testing::DistributionSumAndCountAre;
+
+std::string_view constexpr kMetricName = "/foo/bar";
+
+class SampleBufferTest : public ::testing::Test {
+ protected:
+  explicit SampleBufferTest() {
+    EXPECT_CALL(*manager_, DeleteMetricInternal(kMetricName)).Times(0);
+  }
+
+  ScopedMetricProxy MakeProxy() { return ScopedMetricProxy(manager_, metric_, absl::Now()); }
+
+  tsdb2::common::MockClock clock_;
+  std::shared_ptr<MockMetricManager> manager_ = std::make_shared<MockMetricManager>();
+  MetricConfig const metric_config_{};
+  std::shared_ptr<Metric> const metric_ =
+      std::make_shared<Metric>(manager_.get(), kMetricName, metric_config_);
+  FieldMap const metric_fields_{
+      {"lorem", BoolValue(true)},
+      {"ipsum", IntValue(42)},
+  };
+};
+
+TEST_F(SampleBufferTest, PinsMetric) {
+  {
+    SampleBuffer buffer{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+    EXPECT_TRUE(metric_->is_pinned());
+    EXPECT_CALL(*manager_, DeleteMetricInternal(kMetricName)).Times(1);
+  }
+  EXPECT_FALSE(metric_->is_pinned());
+}
+
+TEST_F(SampleBufferTest, FlushOnRead) {
+  SampleBuffer buffer{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+  buffer.Record(2, 1);
+  buffer.Record(3, 2);
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(AllOf(
+                  DistributionBucketerIs(Bucketer::Default()), DistributionSumAndCountAre(8, 3)))));
+  buffer.Record(4, 1);
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(12, 4))));
+}
+
+TEST_F(SampleBufferTest, FlushOnDestruction) {
+  {
+    SampleBuffer buffer{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+    metric_->RemoveSampleBuffer(&buffer);
+    buffer.Record(2, 3);
+    EXPECT_THAT(metric_->GetValue(metric_fields_), StatusIs(absl::StatusCode::kNotFound));
+  }
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(6, 3))));
+}
+
+TEST_F(SampleBufferTest, FlushWhenFull) {
+  SampleBuffer buffer{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+  metric_->RemoveSampleBuffer(&buffer);
+  buffer.Record(1, SampleBuffer::kMaxSamples - 1);
+  EXPECT_THAT(metric_->GetValue(metric_fields_), StatusIs(absl::StatusCode::kNotFound));
+  buffer.Record(1, 1);
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(
+                  SampleBuffer::kMaxSamples, SampleBuffer::kMaxSamples))));
+}
+
+TEST_F(SampleBufferTest, ExplicitFlush) {
+  SampleBuffer buffer{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+  metric_->RemoveSampleBuffer(&buffer);
+  buffer.Record(5, 1);
+  buffer.Flush();
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(5, 1))));
+}
+
+TEST_F(SampleBufferTest, FlushSampleBuffers) {
+  SampleBuffer buffer1{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+  SampleBuffer buffer2{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+  buffer1.Record(2, 1);
+  buffer2.Record(3, 1);
+  metric_->FlushSampleBuffers();
+  metric_->RemoveSampleBuffer(&buffer1);
+  metric_->RemoveSampleBuffer(&buffer2);
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(5, 2))));
+}
+
+TEST_F(SampleBufferTest, DeleteValue) {
+  SampleBuffer buffer{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+  buffer.Record(2, 1);
+  auto proxy = MakeProxy();
+  EXPECT_TRUE(proxy.DeleteValue(metric_fields_));
+  EXPECT_TRUE(buffer.detached());
+  EXPECT_THAT(metric_->GetValue(metric_fields_), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_CALL(*manager_, DeleteMetricInternal(kMetricName)).Times(1);
+}
+
+TEST_F(SampleBufferTest, DeleteOtherValue) {
+  SampleBuffer buffer{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+  buffer.Record(2, 1);
+  auto proxy = MakeProxy();
+  EXPECT_FALSE(proxy.DeleteValue(FieldMap{{"lorem", BoolValue(false)}}));
+  EXPECT_FALSE(buffer.detached());
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(2, 1))));
+}
+
+TEST_F(SampleBufferTest, Clear) {
+  SampleBuffer buffer{MakeProxy(), metric_fields_, Bucketer::Default(), clock_};
+  buffer.Record(2, 1);
+  auto proxy = MakeProxy();
+  EXPECT_TRUE(proxy.Clear());
+  EXPECT_TRUE(buffer.detached());
+  EXPECT_THAT(metric_->GetValue(metric_fields_), StatusIs(absl::StatusCode::kNotFound));
+  EXPECT_CALL(*manager_, DeleteMetricInternal(kMetricName)).Times(1);
+}
+
+TEST_F(SampleBufferTest, IncompatibleBucketer) {
+  auto const &bucketer = Bucketer::FixedWidth(1, 10);
+  SampleBuffer buffer{MakeProxy(), metric_fields_, bucketer, clock_};
+  buffer.Record(2, 1);
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(0, 0))));
+}
+
+TEST_F(SampleBufferTest, ConcurrentRecording) {
+  auto const metric_id = SampleBufferTable::NewMetricId();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&] {
+      auto *const buffer = SampleBufferTable::Get()->GetOrCreate(
+          metric_id, FieldMap(), metric_fields_, Bucketer::Default(), clock_,
+          [&] { return MakeProxy(); });
+      for (int j = 0; j < 1000; ++j) {
+        buffer->Record(2, 1);
+        if (j % 100 == 0) {
+          EXPECT_OK(metric_->GetValue(metric_fields_));
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(8000, 4000))));
+}
+
+// NOTE: the table tests run in a separate thread so that the buffers are destroyed, and the metric
+// unpinned, when the thread exits.
+class SampleBufferTableTest : public SampleBufferTest {
+ protected:
+  template <typename Function>
+  void RunInThread(Function &&function) {
+    std::thread thread{std::forward<Function>(function)};
+    thread.join();
+  }
+};
+
+TEST_F(SampleBufferTableTest, GetOrCreate) {
+  EXPECT_CALL(*manager_, DeleteMetricInternal(kMetricName)).Times(1);
+  RunInThread([this] {
+    auto *const table = SampleBufferTable::Get();
+    ASSERT_NE(table, nullptr);
+    auto const metric_id = SampleBufferTable::NewMetricId();
+    int num_proxies = 0;
+    auto const make_proxy = [&] {
+      ++num_proxies;
+      return MakeProxy();
+    };
+    auto *const buffer = table->GetOrCreate(metric_id, FieldMap(), metric_fields_,
+                                            Bucketer::Default(), clock_, make_proxy);
+    EXPECT_NE(buffer, nullptr);
+    EXPECT_EQ(num_proxies, 1);
+    EXPECT_EQ(table->GetOrCreate(metric_id, FieldMap(), metric_fields_, Bucketer::Default(),
+                                 clock_, make_proxy),
+              buffer);
+    EXPECT_EQ(num_proxies, 1);
+    FieldMap const other_metric_fields{
+        {"lorem", BoolValue(false)},
+        {"ipsum", IntValue(42)},
+    };
+    EXPECT_THAT(table->GetOrCreate(metric_id, FieldMap(), other_metric_fields,
+                                   Bucketer::Default(), clock_, make_proxy),
+                AllOf(Ne(nullptr), Ne(buffer)));
+    EXPECT_EQ(num_proxies, 2);
+    FieldMap const entity_labels{
+        {"dolor", IntValue(43)},
+    };
+    EXPECT_THAT(table->GetOrCreate(metric_id, entity_labels, metric_fields_, Bucketer::Default(),
+                                   clock_, make_proxy),
+                AllOf(Ne(nullptr), Ne(buffer)));
+    EXPECT_EQ(num_proxies, 3);
+    EXPECT_THAT(table->GetOrCreate(SampleBufferTable::NewMetricId(), FieldMap(), metric_fields_,
+                                   Bucketer::Default(), clock_, make_proxy),
+                AllOf(Ne(nullptr), Ne(buffer)));
+    EXPECT_EQ(num_proxies, 4);
+  });
+  EXPECT_FALSE(metric_->is_pinned());
+}
+
+TEST_F(SampleBufferTableTest, FieldMapRefLookup) {
+  RunInThread([this] {
+    auto *const table = SampleBufferTable::Get();
+    ASSERT_NE(table, nullptr);
+    auto const metric_id = SampleBufferTable::NewMetricId();
+    auto *const buffer = table->GetOrCreate(metric_id, FieldMap(), metric_fields_,
+                                            Bucketer::Default(), clock_,
+                                            [this] { return MakeProxy(); });
+    FieldMapRef<0> const entity_label_ref{FieldMapRef<0>::Entries{}};
+    FieldMapRef<2> const metric_field_ref{FieldMapRef<2>::Entries{{
+        {"ipsum", FieldValueRef(std::in_place_type<int64_t>, 42)},
+        {"lorem", FieldValueRef(std::in_place_type<bool>, true)},
+    }}};
+    EXPECT_EQ(table->GetOrCreate(metric_id, entity_label_ref, metric_field_ref, Bucketer::Default(),
+                                 clock_, [] { return ScopedMetricProxy(); }),
+              buffer);
+    buffer->Record(2, 1);
+  });
+  EXPECT_THAT(metric_->GetValue(metric_fields_),
+              IsOkAndHolds(VariantWith<Distribution>(DistributionSumAndCountAre(2, 1))));
+}
+
+TEST_F(SampleBufferTableTest, EvictDetachedBuffers) {
+  RunInThread([this] {
+    auto *const table = SampleBufferTable::Get();
+    ASSERT_NE(table, nullptr);
+    auto *const buffer =
+        table->GetOrCreate(SampleBufferTable::NewMetricId(), FieldMap(), metric_fields_,
+                           Bucketer::Default(), clock_, [this] { return MakeProxy(); });
+    ASSERT_NE(buffer, nullptr);
+    buffer->Record(2, 1);
+    EXPECT_TRUE(MakeProxy().Clear());
+    EXPECT_TRUE(buffer->detached());
+    EXPECT_EQ(table->size(), 1);
+    EXPECT_TRUE(metric_->is_pinned());
+    EXPECT_CALL(*manager_, DeleteMetricInternal(kMetricName)).Times(1);
+    EXPECT_EQ(table->GetOrCreate(SampleBufferTable::NewMetricId(), FieldMap(), metric_fields_,
+                                 Bucketer::Default(), clock_, [] { return ScopedMetricProxy(); }),
+              nullptr);
+    EXPECT_EQ(table->size(), 0);
+    EXPECT_FALSE(metric_->is_pinned());
+  });
+  EXPECT_THAT(metric_->GetValue(metric_fields_), StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST_F(SampleBufferTableTest, EmptyProxy) {
+  RunInThread([this] {
+    auto *const table = SampleBufferTable::Get();
+    ASSERT_NE(table, nullptr);
+    EXPECT_EQ(table->GetOrCreate(SampleBufferTable::NewMetricId(), FieldMap(), metric_fields_,
+                                 Bucketer::Default(), clock_, [] { return ScopedMetricProxy(); }),
+              nullptr);
+  });
+}
+
+}  // namespace
@@ -81,15 +81,17 @@ bool Shard::DeleteMetric(FieldMap const &entity_labels, std::string_view const m
 }
 
 void Shard::DeleteMetric(std::string_view const metric_name) {
-  bool done;
-  do {
-    done = true;
-    for (auto &proxy : GetAllProxies()) {
-      if (proxy.DeleteMetric(metric_name)) {
-        done = false;
+  for (auto const &stripe : stripes_) {
+    bool done;
+    do {
+      done = true;
+      for (auto &proxy : GetStripeProxies(stripe)) {
+        if (proxy.DeleteMetric(metric_name)) {
+          done = false;
+        }
       }
-    }
-  } while (!done);
+    } while (!done);
+  }
 }
 
 absl::StatusOr<MetricConfig const *> Shard::GetConfigForMetric(
@@ -105,10 +107,11 @@ absl::StatusOr<MetricConfig const *> Shard::GetConfigForMetric(
 bool Shard::DeleteEntityInternal(FieldMap const &labels) {
   typename EntitySet::node_type node;
   FieldMapView const label_view{labels};
-  absl::WriterMutexLock lock{&mutex_};
-  auto const it = entities_.find(label_view);
-  if (it != entities_.end() && !(*it)->is_pinned()) {
-    node = entities_.extract(it);
+  auto &stripe = GetStripe(label_view.hash());
+  absl::WriterMutexLock lock{&stripe.mutex};
+  auto const it = stripe.entities.find(label_view);
+  if (it != stripe.entities.end() && !(*it)->is_pinned()) {
+    node = stripe.entities.extract(it);
   }
   return !node.empty();
 }
@@ -116,10 +119,11 @@ bool Shard::DeleteEntityInternal(FieldMap const &labels) {
 EntityProxy Shard::GetEntity(FieldMap const &entity_labels) const {
   absl::Time const now = clock_.TimeNow();
   FieldMapView const entity_label_view{entity_labels};
+  auto const &stripe = GetStripe(entity_label_view.hash());
   {
-    absl::WriterMutexLock lock{&mutex_};
-    auto it = entities_.find(entity_label_view);
-    if (it != entities_.end()) {
+    absl::ReaderMutexLock lock{&stripe.mutex};
+    auto it = stripe.entities.find(entity_label_view);
+    if (it != stripe.entities.end()) {
       return it->MakeProxy(now);
     }
   }
@@ -128,21 +132,22 @@ EntityProxy Shard::GetEntity(FieldMap const &entity_labels) const {
 
 std::shared_ptr<Entity> Shard::GetEphemeralEntity(FieldMap const &entity_labels) const {
   FieldMapView const entity_label_view{entity_labels};
-  absl::WriterMutexLock lock{&mutex_};
-  auto it = entities_.find(entity_label_view);
-  if (it != entities_.end()) {
+  auto const &stripe = GetStripe(entity_label_view.hash());
+  absl::ReaderMutexLock lock{&stripe.mutex};
+  auto it = stripe.entities.find(entity_label_view);
+  if (it != stripe.entities.end()) {
     return it->ptr();
   } else {
     return nullptr;
   }
 }
 
-std::vector<EntityProxy> Shard::GetAllProxies() const {
+std::vector<EntityProxy> Shard::GetStripeProxies(Stripe const &stripe) const {
   std::vector<EntityProxy> proxies;
   auto const now = clock_.TimeNow();
-  absl::ReaderMutexLock lock{&mutex_};
-  proxies.reserve(entities_.size());
-  for (auto const &entity : entities_) {
+  absl::ReaderMutexLock lock{&stripe.mutex};
+  proxies.reserve(stripe.entities.size());
+  for (auto const &entity : stripe.entities) {
     proxies.emplace_back(entity.MakeProxy(now));
   }
   return proxies;
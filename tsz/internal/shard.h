@@ -2,8 +2,10 @@
 #define __TSDB2_TSZ_INTERNAL_SHARD_H__
 
 #include <algorithm>
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <limits>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -36,6 +38,8 @@ class Shard : private EntityManager {
 
   ~Shard() override = default;
 
+  tsdb2::common::Clock const &clock() const { return clock_; }
+
   absl::Status DefineMetric(std::string_view metric_name, MetricConfig metric_config);
 
   absl::Status DefineMetricRedundant(std::string_view metric_name, MetricConfig metric_config);
@@ -73,9 +77,9 @@ class Shard : private EntityManager {
 
   // Deletes a metric across all entities.
   //
-  // WARNING: this method is VERY SLOW, as it needs to acquire the shard mutex and scan all entities
-  // multiple times. It's meant mostly for test code, where there are few entities and it's
-  // important to reset all global state after each test.
+  // WARNING: this method is VERY SLOW, as it needs to scan all entities multiple times. It only
+  // locks one stripe of the shard at a time, but it's still meant mostly for test code, where there
+  // are few entities and it's important to reset all global state after each test.
   void DeleteMetric(std::string_view metric_name);
 
   template <typename EntityLabels>
@@ -116,6 +120,11 @@ class Shard : private EntityManager {
     static size_t HashOf(EntityCell const &entity_cell) { return entity_cell.hash(); }
     static size_t HashOf(FieldMapView const &entity_label_view) { return entity_label_view.hash(); }
 
+    template <size_t N>
+    static size_t HashOf(FieldMapRef<N> const &entity_label_ref) {
+      return entity_label_ref.hash();
+    }
+
    public:
     // Custom hash functor to index entity cells by their labels transparently while taking
     // advantage of the pre-calculated hash, therefore reducing the time spent in the critical
@@ -142,6 +151,11 @@ class Shard : private EntityManager {
         return entity_label_view.value();
       }
 
+      template <size_t N>
+      static FieldMapRef<N> const &ToLabels(FieldMapRef<N> const &entity_label_ref) {
+        return entity_label_ref;
+      }
+
       // NOTE: we can't use perfect forwarding here because we can't move our params, we need to use
       // them twice.
       template <typename LHS, typename RHS>
@@ -182,6 +196,30 @@ class Shard : private EntityManager {
 
   using EntitySet = absl::flat_hash_set<EntityCell, EntityCell::Hash, EntityCell::Eq>;
 
+  // The entities of a shard are partitioned in `kNumStripes` stripes, each with its own mutex, so
+  // that recording in different entities doesn't contend and scanning all entities only blocks one
+  // stripe at a time.
+  static inline size_t constexpr kNumStripeBits = 4;
+  static inline size_t constexpr kNumStripes = 1 << kNumStripeBits;
+
+  struct Stripe {
+    absl::Mutex mutable mutex;
+    EntitySet entities ABSL_GUARDED_BY(mutex);
+  };
+
+  // Returns the stripe of the entity whose labels have the specified hash.
+  //
+  // NOTE: we select the stripe using the most significant bits of the hash because the entity sets
+  // use the least significant ones for probing, so using those would cluster the entities of a
+  // stripe.
+  Stripe &GetStripe(size_t const hash) {
+    return stripes_[hash >> (std::numeric_limits<size_t>::digits - kNumStripeBits)];
+  }
+
+  Stripe const &GetStripe(size_t const hash) const {
+    return stripes_[hash >> (std::numeric_limits<size_t>::digits - kNumStripeBits)];
+  }
+
   Shard(Shard const &) = delete;
   Shard &operator=(Shard const &) = delete;
   Shard(Shard &&) = delete;
@@ -190,36 +228,47 @@ class Shard : private EntityManager {
   absl::StatusOr<MetricConfig const *> GetConfigForMetric(
       std::string_view metric_name) const override;
 
-  bool DeleteEntityInternal(FieldMap const &labels) override ABSL_LOCKS_EXCLUDED(mutex_);
+  bool DeleteEntityInternal(FieldMap const &labels) override;
 
-  EntityProxy GetEntity(FieldMap const &entity_labels) const ABSL_LOCKS_EXCLUDED(mutex_);
+  EntityProxy GetEntity(FieldMap const &entity_labels) const;
 
   template <typename EntityLabels>
-  EntityProxy GetOrCreateEntity(EntityLabels &&entity_labels) ABSL_LOCKS_EXCLUDED(mutex_);
+  EntityProxy GetOrCreateEntity(EntityLabels &&entity_labels);
 
-  std::shared_ptr<Entity> GetEphemeralEntity(FieldMap const &entity_labels) const
-      ABSL_LOCKS_EXCLUDED(mutex_);
+  std::shared_ptr<Entity> GetEphemeralEntity(FieldMap const &entity_labels) const;
 
-  std::vector<EntityProxy> GetAllProxies() const ABSL_LOCKS_EXCLUDED(mutex_);
+  // Returns proxies for all the entities of a stripe, pinning them.
+  std::vector<EntityProxy> GetStripeProxies(Stripe const &stripe) const;
 
   tsdb2::common::Clock const &clock_;
 
   tsdb2::common::lock_free_hash_map<std::string, MetricConfigHolder> metric_configs_;
 
-  absl::Mutex mutable mutex_;
-  EntitySet entities_ ABSL_GUARDED_BY(mutex_);
+  std::array<Stripe, kNumStripes> stripes_;
 };
 
 template <typename EntityLabels>
 EntityProxy Shard::GetOrCreateEntity(EntityLabels &&entity_labels) {
   absl::Time const now = clock_.TimeNow();
-  FieldMapView const entity_label_view{entity_labels};
-  absl::WriterMutexLock lock{&mutex_};
-  auto it = entities_.find(entity_label_view);
-  if (it == entities_.end()) {
+  auto const entity_label_view = MakeFieldView(entity_labels);
+  auto &stripe = GetStripe(entity_label_view.hash());
+  {
+    // Fast path: the entity nearly always exists already, so we look it up under a shared lock.
+    // Pinning it here is safe because entities are only deleted under an exclusive lock and only if
+    // they are not pinned.
+    absl::ReaderMutexLock lock{&stripe.mutex};
+    auto const it = stripe.entities.find(entity_label_view);
+    if (it != stripe.entities.end()) {
+      return it->MakeProxy(now);
+    }
+  }
+  absl::WriterMutexLock lock{&stripe.mutex};
+  auto it = stripe.entities.find(entity_label_view);
+  if (it == stripe.entities.end()) {
     bool unused;
-    std::tie(it, unused) = entities_.emplace(static_cast<EntityManager *>(this),
-                                             std::forward<EntityLabels>(entity_labels));
+    std::tie(it, unused) =
+        stripe.entities.emplace(static_cast<EntityManager *>(this),
+                                ToFieldMap(std::forward<EntityLabels>(entity_labels)));
   }
   return it->MakeProxy(now);
 }
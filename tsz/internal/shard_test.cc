@@ -2,6 +2,8 @@
 
 #include <cstdint>
 #include <string_view>
+#include <thread>
+#include <vector>
 
 #include "absl/log/log.h"
 #include "absl/status/status.h"
@@ -144,6 +146,34 @@ TEST_F(ShardTest, AddToAnotherInt) {
               IsOkAndHolds(VariantWith<int64_t>(134)));
 }
 
+TEST_F(ShardTest, ConcurrentAddToInt) {
+  int constexpr kNumThreads = 4;
+  int constexpr kNumIterations = 1000;
+  std::vector<std::thread> threads;
+  threads.reserve(kNumThreads + 1);
+  for (int i = 0; i < kNumThreads; ++i) {
+    threads.emplace_back([this] {
+      for (int j = 0; j < kNumIterations; ++j) {
+        shard_.AddToInt(entity_labels1_, kIntMetricName, metric_fields1_, 1);
+      }
+    });
+  }
+  // Keep creating and deleting another entity in the meantime.
+  threads.emplace_back([this] {
+    for (int j = 0; j < kNumIterations; ++j) {
+      shard_.AddToInt(entity_labels2_, kIntMetricName, metric_fields2_, 1);
+      shard_.DeleteValue(entity_labels2_, kIntMetricName, metric_fields2_);
+    }
+  });
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_THAT(shard_.GetValue(entity_labels1_, kIntMetricName, metric_fields1_),
+              IsOkAndHolds(VariantWith<int64_t>(kNumThreads * kNumIterations)));
+  EXPECT_THAT(shard_.GetValue(entity_labels2_, kIntMetricName, metric_fields2_),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
 TEST_F(ShardTest, AddToDistribution) {
   shard_.AddToDistribution(entity_labels1_, kDistributionMetricName, metric_fields1_, 12, 1);
   shard_.AddToDistribution(entity_labels1_, kDistributionMetricName, metric_fields1_, 34, 1);
@@ -208,6 +238,28 @@ TEST_F(ShardTest, DeleteMetric) {
               IsOkAndHolds(VariantWith<double>(DoubleNear(2.78, 0.001))));
 }
 
+TEST_F(ShardTest, DeleteMetricAcrossManyEntities) {
+  int constexpr kNumEntities = 100;
+  for (int i = 0; i < kNumEntities; ++i) {
+    FieldMap const entity_labels{{"lorem", IntValue(i)}};
+    shard_.SetValue(entity_labels, kIntMetricName, metric_fields1_, IntValue(i));
+    shard_.SetValue(entity_labels, kDoubleMetricName, metric_fields1_, DoubleValue(i));
+  }
+  for (int i = 0; i < kNumEntities; ++i) {
+    FieldMap const entity_labels{{"lorem", IntValue(i)}};
+    EXPECT_THAT(shard_.GetValue(entity_labels, kIntMetricName, metric_fields1_),
+                IsOkAndHolds(VariantWith<int64_t>(i)));
+  }
+  shard_.DeleteMetric(kIntMetricName);
+  for (int i = 0; i < kNumEntities; ++i) {
+    FieldMap const entity_labels{{"lorem", IntValue(i)}};
+    EXPECT_THAT(shard_.GetValue(entity_labels, kIntMetricName, metric_fields1_),
+                StatusIs(absl::StatusCode::kNotFound));
+    EXPECT_THAT(shard_.GetValue(entity_labels, kDoubleMetricName, metric_fields1_),
+                IsOkAndHolds(VariantWith<double>(DoubleNear(i, 0.001))));
+  }
+}
+
 TEST_F(ShardTest, GetPinnedMetric) {
   EXPECT_OK(shard_.GetPinnedMetric(entity_labels1_, kIntMetricName));
   EXPECT_OK(shard_.GetPinnedMetric(entity_labels2_, kIntMetricName));
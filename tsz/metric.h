@@ -140,9 +140,24 @@ class Metric : private BaseMetric<Value, MetricFieldArgs...> {
   using Base::name;
   using Base::options;
 
+  // Pre-hashed reference to the metric fields of a cell, see `MakeFieldsRef`.
+  using FieldsRef = FieldMapRef<sizeof...(MetricFieldArgs)>;
+
+  // Returns a pre-hashed reference to the cell with the specified metric fields. Callers that set
+  // the same cells over and over can cache the refs and pass them to `Set` in place of the field
+  // values, so that the fields aren't hashed every time.
+  //
+  // NOTE: the provided string values MUST outlive the returned ref.
+  FieldsRef MakeFieldsRef(ParameterFieldTypeT<MetricFieldArgs> const... args) const {
+    return metric_fields().MakeFieldMapRef(args...);
+  }
+
   void Set(ParameterTypeT<Value> value, ParameterFieldTypeT<MetricFieldArgs> const... args) {
-    Base::proxy().SetValue(metric_fields().MakeFieldMap(args...),
-                           CanonicalTypeT<Value>(std::move(value)));
+    Set(std::move(value), MakeFieldsRef(args...));
+  }
+
+  void Set(ParameterTypeT<Value> value, FieldsRef const &metric_field_ref) {
+    Base::proxy().SetValue(metric_field_ref, CanonicalTypeT<Value>(std::move(value)));
   }
 
   absl::StatusOr<Value> Get(ParameterFieldTypeT<MetricFieldArgs> const... args) const {
@@ -188,8 +203,8 @@ class Metric<Value, EntityLabels<EntityLabelArgs...>, MetricFields<MetricFieldAr
            ParameterFieldTypeT<MetricFieldArgs> const... metric_field_values) {
     auto const shard = Base::shard();
     if (shard) {
-      shard->SetValue(entity_labels().MakeFieldMap(entity_label_values...), name(),
-                      metric_fields().MakeFieldMap(metric_field_values...),
+      shard->SetValue(entity_labels().MakeFieldMapRef(entity_label_values...), name(),
+                      metric_fields().MakeFieldMapRef(metric_field_values...),
                       CanonicalTypeT<Value>(std::move(value)));
     }
   }
@@ -212,6 +212,16 @@ TEST_F(MetricTest, Set7) {
   EXPECT_THAT(reader2_.Read(456, true), IsOkAndHolds(56));
 }
 
+TEST_F(MetricTest, SetWithFieldsRef) {
+  auto const fields_ref = metric7->MakeFieldsRef(123, false);
+  metric7->Set(12, fields_ref);
+  EXPECT_THAT(reader2_.Read(123, false), IsOkAndHolds(12));
+  metric7->Set(34, fields_ref);
+  EXPECT_THAT(reader2_.Read(123, false), IsOkAndHolds(34));
+  metric7->Set(56, 123, false);
+  EXPECT_THAT(reader2_.Read(123, false), IsOkAndHolds(56));
+}
+
 TEST_F(MetricTest, Get1) {
   metric1->Set(12, "12", "34", 123, false);
   metric1->Set(34, "12", "34", 123, false);
@@ -1,6 +1,7 @@
 #ifndef __TSDB2_TSZ_TYPES_H__
 #define __TSDB2_TSZ_TYPES_H__
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
 #include <optional>
@@ -53,6 +54,66 @@ inline std::string StringValue(std::string_view const value) { return std::strin
 inline Distribution DistributionValue(Distribution const &value) { return value; }
 inline Distribution DistributionValue(Distribution &&value) { return std::move(value); }
 
+// Same as `FieldValue`, but string values are referenced rather than owned. The alternatives MUST
+// be the same as those of `FieldValue`, in the same order.
+using FieldValueRef = std::variant<bool, int64_t, std::string_view>;
+
+namespace internal {
+
+inline bool HashableFieldValue(bool const value) { return value; }
+inline int64_t HashableFieldValue(int64_t const value) { return value; }
+inline std::string_view HashableFieldValue(std::string_view const value) { return value; }
+
+// Combines a single entity label or metric field into the hash state `h`. `value` can be either a
+// `FieldValue` or a `FieldValueRef`, which hash the same because they have the same alternatives
+// and string values are always hashed as `std::string_view`s.
+template <typename H, typename Value>
+H HashField(H h, std::string_view const name, Value const &value) {
+  return std::visit(
+      [&h, name, index = value.index()](auto const &alternative) {
+        return H::combine(std::move(h), name, index, HashableFieldValue(alternative));
+      },
+      value);
+}
+
+// Makes a sorted range of (name, value) pairs hashable. This is how both `FieldMap` and
+// `FieldMapRef` objects get hashed, see `HashFieldMap`.
+template <typename Fields>
+struct HashableFields {
+  template <typename H>
+  friend H AbslHashValue(H h, HashableFields const &hashable) {
+    for (auto const &[name, value] : hashable.fields) {
+      h = HashField(std::move(h), name, value);
+    }
+    return H::combine(std::move(h), hashable.fields.size());
+  }
+
+  Fields const &fields;
+};
+
+inline bool FieldValueEquals(FieldValue const &lhs, FieldValueRef const &rhs) {
+  if (auto const value = std::get_if<std::string>(&lhs)) {
+    auto const other = std::get_if<std::string_view>(&rhs);
+    return other && *value == *other;
+  } else if (auto const value = std::get_if<int64_t>(&lhs)) {
+    auto const other = std::get_if<int64_t>(&rhs);
+    return other && *value == *other;
+  } else {
+    auto const other = std::get_if<bool>(&rhs);
+    return other && std::get<bool>(lhs) == *other;
+  }
+}
+
+}  // namespace internal
+
+// Returns the hash of a `FieldMap` as used by the tsz internals (e.g. by `FieldMapView`).
+//
+// NOTE: this is NOT the same as `absl::HashOf(fields)`. We define our own hash so that
+// `FieldMapRef` objects can reproduce it without building a `FieldMap`.
+inline size_t HashFieldMap(FieldMap const &fields) {
+  return absl::HashOf(internal::HashableFields<FieldMap>{fields});
+}
+
 // Immutable pre-hashed view of a `FieldMap` object, similar to what `std::string_view` is to
 // `std::string`.
 //
@@ -63,7 +124,7 @@ class FieldMapView {
   explicit FieldMapView() : value_(nullptr), hash_(0) {}
 
   // Constructs a view referring to the specified `FieldMap` object.
-  explicit FieldMapView(FieldMap const &value) : value_(&value), hash_(absl::HashOf(*value_)) {}
+  explicit FieldMapView(FieldMap const &value) : value_(&value), hash_(HashFieldMap(*value_)) {}
 
   ~FieldMapView() = default;
 
@@ -95,6 +156,93 @@ class FieldMapView {
   size_t hash_;
 };
 
+// Pre-hashed reference to `N` entity labels or metric fields. It hashes and compares equal to a
+// `FieldMap` with the same entries, so it can be used to look up entities and metric cells without
+// allocating anything. A `FieldMap` is materialized (with `ToFieldMap`) only when a new entity or
+// cell must be created. `FieldMapRef`s are usually obtained from
+// `FieldDescriptor::MakeFieldMapRef`.
+//
+// NOTE: the referenced names and string values MUST outlive the `FieldMapRef`.
+template <size_t N>
+class FieldMapRef {
+ public:
+  using Entries = std::array<std::pair<std::string_view, FieldValueRef>, N>;
+
+  // REQUIRES: `entries` must be sorted by name and the names must be unique.
+  explicit FieldMapRef(Entries const &entries)
+      : entries_(entries), hash_(absl::HashOf(internal::HashableFields<Entries>{entries_})) {}
+
+  ~FieldMapRef() = default;
+
+  FieldMapRef(FieldMapRef const &) = default;
+  FieldMapRef &operator=(FieldMapRef const &) = default;
+  FieldMapRef(FieldMapRef &&) noexcept = default;
+  FieldMapRef &operator=(FieldMapRef &&) noexcept = default;
+
+  friend bool operator==(FieldMapRef const &lhs, FieldMap const &rhs) {
+    if (rhs.size() != N) {
+      return false;
+    }
+    auto it = rhs.begin();
+    for (auto const &[name, value] : lhs.entries_) {
+      if (it->first != name || !internal::FieldValueEquals(it->second, value)) {
+        return false;
+      }
+      ++it;
+    }
+    return true;
+  }
+
+  friend bool operator==(FieldMap const &lhs, FieldMapRef const &rhs) { return rhs == lhs; }
+  friend bool operator!=(FieldMapRef const &lhs, FieldMap const &rhs) { return !(lhs == rhs); }
+  friend bool operator!=(FieldMap const &lhs, FieldMapRef const &rhs) { return !(rhs == lhs); }
+
+  Entries const &entries() const { return entries_; }
+  size_t hash() const { return hash_; }
+
+  // Builds a `FieldMap` with a copy of the referenced names and values.
+  FieldMap ToFieldMap() const {
+    typename FieldMap::representation_type rep;
+    rep.reserve(N);
+    for (auto const &[name, value] : entries_) {
+      rep.emplace_back(std::string(name),
+                       std::visit([](auto const alternative) { return ToFieldValue(alternative); },
+                                  value));
+    }
+    return FieldMap(tsdb2::common::kSortedDeduplicatedContainer, std::move(rep));
+  }
+
+ private:
+  static FieldValue ToFieldValue(bool const value) { return value; }
+  static FieldValue ToFieldValue(int64_t const value) { return value; }
+  static FieldValue ToFieldValue(std::string_view const value) { return std::string(value); }
+
+  Entries entries_;
+  size_t hash_;
+};
+
+// `MakeFieldView` returns a pre-hashed key for the provided fields, suitable for heterogeneous
+// lookups of entities and metric cells: a `FieldMapView` for `FieldMap`s and a copy of the ref
+// itself for `FieldMapRef`s.
+
+inline FieldMapView MakeFieldView(FieldMap const &fields) { return FieldMapView(fields); }
+
+template <size_t N>
+FieldMapRef<N> MakeFieldView(FieldMapRef<N> const &fields) {
+  return fields;
+}
+
+// `ToFieldMap` converts the provided fields to a `FieldMap`. `FieldMap`s are passed through as they
+// are, so that the caller can copy or move them as appropriate.
+
+inline FieldMap const &ToFieldMap(FieldMap const &fields) { return fields; }
+inline FieldMap &&ToFieldMap(FieldMap &&fields) { return std::move(fields); }
+
+template <size_t N>
+FieldMap ToFieldMap(FieldMapRef<N> const &fields) {
+  return fields.ToFieldMap();
+}
+
 // Metric options.
 struct Options {
   // This key is used to index certain settings per-(prefix,backend). The prefix component is the
@@ -213,6 +361,15 @@ struct Options {
   // `Bucketer::Default()`). Ignored for non-distribution metrics.
   Bucketer const *bucketer = nullptr;
 
+  // When enabled, the samples of a distribution metric are accumulated in per-thread buffers and
+  // merged into the metric in bulk, which makes recording much cheaper for metrics that are updated
+  // at very high rates. The buffers are merged whenever a value of the metric is read or cleared,
+  // so this flag doesn't change what readers observe. Ignored for non-distribution metrics.
+  //
+  // NOTE: every thread keeps a buffer for each cell it records into until the thread exits, so this
+  // is meant for long-lived metrics with a bounded number of cells.
+  bool buffer_samples = false;
+
   std::optional<absl::Duration> max_entity_staleness = std::nullopt;
   std::optional<absl::Duration> max_value_staleness = std::nullopt;
 
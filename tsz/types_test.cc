@@ -1,15 +1,21 @@
 #include "tsz/types.h"
 
-#include "absl/hash/hash.h"
+#include <cstdint>
+#include <string_view>
+
 #include "gtest/gtest.h"
 
 namespace {
 
 using ::tsz::BoolValue;
 using ::tsz::FieldMap;
+using ::tsz::FieldMapRef;
 using ::tsz::FieldMapView;
+using ::tsz::FieldValueRef;
+using ::tsz::HashFieldMap;
 using ::tsz::IntValue;
 using ::tsz::StringValue;
+using ::tsz::ToFieldMap;
 
 TEST(TszTypesTest, EmptyView) {
   FieldMapView const view;
@@ -24,7 +30,7 @@ TEST(TszTypesTest, NonEmptyView) {
   };
   FieldMapView const view{fields};
   EXPECT_FALSE(view.empty());
-  EXPECT_EQ(view.hash(), absl::HashOf(fields));
+  EXPECT_EQ(view.hash(), HashFieldMap(fields));
   EXPECT_EQ(view.value(), fields);
 }
 
@@ -59,4 +65,91 @@ TEST(TszTypesTest, DifferentViews) {
   EXPECT_TRUE(view1 != view2);
 }
 
+TEST(TszTypesTest, EmptyRef) {
+  FieldMapRef<0> const ref{{}};
+  FieldMap const fields;
+  EXPECT_EQ(ref.hash(), HashFieldMap(fields));
+  EXPECT_TRUE(ref == fields);
+  EXPECT_TRUE(fields == ref);
+  EXPECT_FALSE(ref != fields);
+  EXPECT_FALSE(fields != ref);
+  EXPECT_EQ(ToFieldMap(ref), fields);
+}
+
+TEST(TszTypesTest, RefMatchesFieldMap) {
+  std::string_view const value = "hello";
+  FieldMapRef<3> const ref{{{
+      {"dolor", FieldValueRef(value)},
+      {"ipsum", FieldValueRef(true)},
+      {"lorem", FieldValueRef(int64_t{123})},
+  }}};
+  FieldMap const fields{
+      {"lorem", IntValue(123)},
+      {"ipsum", BoolValue(true)},
+      {"dolor", StringValue("hello")},
+  };
+  EXPECT_EQ(ref.hash(), HashFieldMap(fields));
+  EXPECT_EQ(ref.hash(), FieldMapView(fields).hash());
+  EXPECT_TRUE(ref == fields);
+  EXPECT_TRUE(fields == ref);
+  EXPECT_FALSE(ref != fields);
+  EXPECT_FALSE(fields != ref);
+  EXPECT_EQ(ToFieldMap(ref), fields);
+}
+
+TEST(TszTypesTest, RefWithDifferentValue) {
+  FieldMapRef<2> const ref{{{
+      {"ipsum", FieldValueRef(true)},
+      {"lorem", FieldValueRef(int64_t{456})},
+  }}};
+  FieldMap const fields{
+      {"lorem", IntValue(123)},
+      {"ipsum", BoolValue(true)},
+  };
+  EXPECT_NE(ref.hash(), HashFieldMap(fields));
+  EXPECT_FALSE(ref == fields);
+  EXPECT_FALSE(fields == ref);
+  EXPECT_TRUE(ref != fields);
+  EXPECT_TRUE(fields != ref);
+}
+
+TEST(TszTypesTest, RefWithDifferentType) {
+  FieldMapRef<1> const ref{{{
+      {"lorem", FieldValueRef(std::string_view("123"))},
+  }}};
+  FieldMap const fields{
+      {"lorem", IntValue(123)},
+  };
+  EXPECT_NE(ref.hash(), HashFieldMap(fields));
+  EXPECT_FALSE(ref == fields);
+  EXPECT_TRUE(ref != fields);
+}
+
+TEST(TszTypesTest, RefWithDifferentNames) {
+  FieldMapRef<2> const ref{{{
+      {"ipsum", FieldValueRef(true)},
+      {"lorem", FieldValueRef(int64_t{123})},
+  }}};
+  FieldMap const fields{
+      {"lorem", IntValue(123)},
+      {"dolor", BoolValue(true)},
+  };
+  EXPECT_NE(ref.hash(), HashFieldMap(fields));
+  EXPECT_FALSE(ref == fields);
+  EXPECT_TRUE(ref != fields);
+}
+
+TEST(TszTypesTest, RefWithDifferentSize) {
+  FieldMapRef<1> const ref{{{
+      {"lorem", FieldValueRef(int64_t{123})},
+  }}};
+  FieldMap const fields{
+      {"lorem", IntValue(123)},
+      {"ipsum", BoolValue(true)},
+  };
+  EXPECT_NE(ref.hash(), HashFieldMap(fields));
+  EXPECT_FALSE(ref == fields);
+  EXPECT_TRUE(ref != fields);
+}
+
 }  // namespace